@@ -13,11 +13,48 @@
 
 #include <pon_adapter.h>
 #include <pon_img_register.h>
+#include <pon_uboot.h>
 
 /** \defgroup PON_IMG_LIB PON Image Library
  *  @{
  */
 
+/** Number of image banks, A and B */
+#define PON_IMG_BANKS			2
+
+/** The bank state holds the active bank */
+#define PON_IMG_STATE_ACTIVE		0x01
+/** The bank state holds the committed bank */
+#define PON_IMG_STATE_COMMITTED		0x02
+/** The bank state holds the validity */
+#define PON_IMG_STATE_VALID		0x04
+/** The bank state holds the version */
+#define PON_IMG_STATE_VERSION		0x08
+/** The bank state holds the pending activation */
+#define PON_IMG_STATE_ACTIVATE		0x10
+
+/** State of an image bank */
+struct pon_img_bank_state {
+	/** The bank is active */
+	bool active;
+	/** The bank is committed */
+	bool committed;
+	/** The image in the bank is valid */
+	bool valid;
+	/** The bank is activated for the next boot */
+	bool activate_pending;
+	/** Version of the image, "0.0" if not set */
+	char version[UBOOT_VAL_LEN_MAX + 1];
+	/** U-Boot variables which are set, PON_IMG_STATE_* bits */
+	uint8_t present;
+};
+
+/** State of both image banks */
+struct pon_img_state {
+	/** Bank A at index 0, bank B at index 1 */
+	struct pon_img_bank_state bank[PON_IMG_BANKS];
+};
+
 /**	Function to execute the image upgrade.
  *
  *	\param[in] id		Partition identifier ('A' or 'B').
@@ -39,6 +76,100 @@
 enum pon_adapter_errno pon_img_upgrade(struct pon_img_context *ctx,
 				       const char id, const char *filename);
 
+/**	Same as \ref pon_img_upgrade, the digests of the image are passed to
+ *	the upgrade daemon, which then does not need to read the image again
+ *	to check its hash.
+ *
+ *	\param[in] id		Partition identifier ('A' or 'B').
+ *	\param[in] filename	Path to the image file.
+ *	\param[in] sha256	SHA-256 of the image in hex, NULL if unknown
+ *	\param[in] sha384	SHA-384 of the image in hex, NULL if unknown
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- Other: An error code in case of error.
+ */
+enum pon_adapter_errno pon_img_upgrade_digest(struct pon_img_context *ctx,
+					      const char id,
+					      const char *filename,
+					      const char *sha256,
+					      const char *sha384);
+
+/**	Same as \ref pon_img_upgrade, but the image is written into the
+ *	volumes of the bank by the library instead of the upgrade daemon.
+ *	Only the changed blocks are written. The bank must not be the active
+ *	one, it is invalid while it is written and gets the version and the
+ *	valid flag afterwards.
+ *
+ *	\param[in] id		Partition identifier ('A' or 'B').
+ *	\param[in] filename	Path to the image file.
+ *	\param[in] dir		Directory with file-backed volumes, NULL to
+ *				write into the UBI volumes or MTD partitions
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- PON_ADAPTER_ERR_NOT_SUPPORTED: The bank is active
+ *	- Other: An error code in case of error.
+ */
+enum pon_adapter_errno pon_img_upgrade_native(struct pon_img_context *ctx,
+					      const char id,
+					      const char *filename,
+					      const char *dir);
+
+/**	Record the identity of the image in a bank. It is cleared before
+ *	the bank is written, the bank is not written if this fails. It is set
+ *	after the image was written completely.
+ *
+ *	\param[in] id		Partition identifier ('A' or 'B').
+ *	\param[in] ident	Identity, an empty string clears it
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- Other: An error code in case of error.
+ */
+enum pon_adapter_errno pon_img_ident_set(struct pon_img_context *ctx,
+					 const char id, const char *ident);
+
+/**	Read the identity of the image in a bank. Through ubus it is empty
+ *	if the get_uboot_env method does not return the variable.
+ *
+ *	\param[in] id		Partition identifier ('A' or 'B').
+ *	\param[out] ident	Identity, an empty string if none is recorded
+ *	\param[in] size		Size of the identity buffer
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- Other: An error code in case of error.
+ */
+enum pon_adapter_errno pon_img_ident_get(struct pon_img_context *ctx,
+					 const char id, char *ident,
+					 size_t size);
+
+/**	Read the telemetry of the current or last SW download.
+ *
+ *	\param[out] stats	Telemetry
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- PON_ADAPTER_ERR_RESOURCE_NOT_FOUND: No download was started yet or
+ *	  the telemetry is disabled
+ */
+enum pon_adapter_errno pon_img_dl_stats_get(struct pon_img_context *ctx,
+					    struct pon_img_dl_stats *stats);
+
+/**	Read the state of both banks from one consistent state of the U-Boot
+ *	variables. This replaces the getters below when several values are
+ *	needed, the variables are read only once.
+ *
+ *	\param[out] state	State of the banks
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- Other: An error code in case of error.
+ */
+enum pon_adapter_errno pon_img_state_get(struct pon_img_context *ctx,
+					 struct pon_img_state *state);
+
 /**	Function to set activate (temporary activation) status for image stored
  *	in flash at specified partition.
  *
@@ -155,6 +286,99 @@ enum pon_adapter_errno pon_img_valid_set(struct pon_img_context *ctx,
 enum pon_adapter_errno pon_img_valid_get(struct pon_img_context *ctx,
 					 const char id, bool *valid);
 
+/**	Completion callback of an asynchronous call, it is called by the
+ *	worker thread of the context.
+ *
+ *	\param[in] priv	Argument given with the call
+ *	\param[in] id		Request handle returned by the call
+ *	\param[in] result	Result of the call
+ */
+typedef void (*pon_img_async_cb)(void *priv, uint32_t id,
+				 enum pon_adapter_errno result);
+
+/**	Asynchronous \ref pon_img_upgrade_digest. All asynchronous calls
+ *	return at once, they are run in order by the worker thread of the
+ *	context. Without a callback, the result is read with
+ *	\ref pon_img_async_result.
+ *
+ *	\param[in] id		Partition identifier ('A' or 'B').
+ *	\param[in] filename	Path to the image file.
+ *	\param[in] sha256	SHA-256 of the image in hex, NULL if unknown
+ *	\param[in] sha384	SHA-384 of the image in hex, NULL if unknown
+ *	\param[in] cb		Completion callback, can be NULL
+ *	\param[in] priv	Argument of the completion callback
+ *	\param[out] req	Request handle, can be NULL
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If the call was queued
+ *	- PON_ADAPTER_ERR_OUT_OF_BOUNDS: Too many queued calls or results
+ *	- Other: An error code in case of error.
+ */
+enum pon_adapter_errno pon_img_upgrade_async(struct pon_img_context *ctx,
+					     const char id,
+					     const char *filename,
+					     const char *sha256,
+					     const char *sha384,
+					     pon_img_async_cb cb, void *priv,
+					     uint32_t *req);
+
+/**	Asynchronous \ref pon_img_active_set. */
+enum pon_adapter_errno pon_img_active_set_async(struct pon_img_context *ctx,
+						const char id,
+						pon_img_async_cb cb,
+						void *priv, uint32_t *req);
+
+/**	Asynchronous \ref pon_img_commit_set. */
+enum pon_adapter_errno pon_img_commit_set_async(struct pon_img_context *ctx,
+						const char id,
+						pon_img_async_cb cb,
+						void *priv, uint32_t *req);
+
+/**	Asynchronous \ref pon_img_version_set. */
+enum pon_adapter_errno pon_img_version_set_async(struct pon_img_context *ctx,
+						 const char id,
+						 const char *buff,
+						 pon_img_async_cb cb,
+						 void *priv, uint32_t *req);
+
+/**	Asynchronous \ref pon_img_valid_set. */
+enum pon_adapter_errno pon_img_valid_set_async(struct pon_img_context *ctx,
+					       const char id,
+					       const bool valid,
+					       pon_img_async_cb cb,
+					       void *priv, uint32_t *req);
+
+/**	Asynchronous \ref pon_img_state_get.
+ *
+ *	\param[out] state	State of the banks, it must stay valid until the
+ *				call is completed
+ */
+enum pon_adapter_errno pon_img_state_get_async(struct pon_img_context *ctx,
+					       struct pon_img_state *state,
+					       pon_img_async_cb cb,
+					       void *priv, uint32_t *req);
+
+/**	File descriptor for poll(), it is readable while results of
+ *	asynchronous calls without a callback are not yet read.
+ *
+ *	\return File descriptor, -1 if the worker thread can not be
+ *	created.
+ */
+int pon_img_async_fd(struct pon_img_context *ctx);
+
+/**	Read the next result of an asynchronous call without a callback.
+ *
+ *	\param[out] id		Request handle
+ *	\param[out] result	Result of the call
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If a result was read
+ *	- PON_ADAPTER_ERR_NO_DATA: No call was completed
+ */
+enum pon_adapter_errno pon_img_async_result(struct pon_img_context *ctx,
+					    uint32_t *id,
+					    enum pon_adapter_errno *result);
+
 /** @} */
 
 #endif /* _PON_IMG_H_ */
@@ -15,6 +15,7 @@
 #ifndef _PON_IMG_REGISTER_H_
 #define _PON_IMG_REGISTER_H_
 
+#include <stdbool.h>
 #include <pon_adapter.h>
 #include <pon_adapter_errno.h>
 
@@ -22,10 +23,98 @@
  *  @{
  */
 
+struct pon_img_wb;
+struct pon_img_uimage;
+struct pon_img_bank;
+struct pon_img_ckpt;
+struct pon_img_reasm;
+struct pon_uboot_cache;
+struct pon_img_store;
+struct pon_img_unpack;
+struct pon_img_digest;
+struct pon_img_stats;
+struct pon_img_async;
+
+/** Maximum length of the image version, as in the U-Boot image header */
+#define PON_IMG_VERSION_LEN	32
+
+/** Length of the identity of an image, see \ref pon_img_ident_set */
+#define PON_IMG_IDENT_LEN	56
+
+/** Maximum length of the staging file path */
+#define PON_IMG_PATH_LEN	128
+
+/** Buffer size of an image digest in hex, SHA-384 with terminating zero */
+#define PON_IMG_DIGEST_LEN	97
+
+/** SW download progress event, the data is a struct pon_img_dl_stats */
+#define PON_IMG_EVENT_DL_PROGRESS	1
+/** Completion of an asynchronous store, the data is a
+ *  struct pon_img_store_done
+ */
+#define PON_IMG_EVENT_STORE_DONE	2
+
+/** Receiver of the library events.
+ *
+ *  \param[in] priv	Argument set with the receiver
+ *  \param[in] event	Event, like \ref PON_IMG_EVENT_DL_PROGRESS
+ *  \param[in] data	Event data, only valid during the call
+ */
+typedef void (*pon_img_event_cb)(void *priv, unsigned int event,
+				 const void *data);
+
+/** Data of \ref PON_IMG_EVENT_STORE_DONE */
+struct pon_img_store_done {
+	/** SW image id */
+	uint8_t id;
+	/** Result of the store */
+	enum pon_adapter_errno result;
+};
+
+/** Number of buckets of the window latency histogram */
+#define PON_IMG_DL_LAT_BUCKETS	12
+
+/** SW download telemetry */
+struct pon_img_dl_stats {
+	/** A download is in progress */
+	bool active;
+	/** Image size */
+	uint32_t size;
+	/** Contiguous image bytes received */
+	uint32_t offset;
+	/** Received bytes, including repeated windows */
+	uint64_t bytes;
+	/** Received windows, including repeated windows */
+	uint32_t windows;
+	/** Time since the start of the download in ms */
+	uint32_t elapsed_ms;
+	/** Receive rate in bytes per second over the last sample interval */
+	uint32_t rate;
+	/** Receive rate in bytes per second since the start */
+	uint32_t rate_avg;
+	/** Estimated time until the image is complete in seconds,
+	 *  0 if not known
+	 */
+	uint32_t eta_s;
+	/** Time spent writing the image in us */
+	uint64_t stall_us;
+	/** Processing latency of the windows. Bucket 0 counts the windows
+	 *  below 16 us, bucket n the windows below 16 << n us, the last
+	 *  bucket all slower windows.
+	 */
+	uint32_t latency[PON_IMG_DL_LAT_BUCKETS];
+	/** Highest processing latency of a window in us */
+	uint32_t latency_max_us;
+};
+
 /** Status information for currently active SW download. */
 struct pon_image_info {
 	/** File descriptor for image download file before flash storage */
 	int fd;
+	/** Path of the image download file */
+	char path[PON_IMG_PATH_LEN];
+	/** Path of the download checkpoint */
+	char ckpt_path[PON_IMG_PATH_LEN + 8];
 	/** Image size */
 	uint32_t size;
 	/** Image offset */
@@ -34,19 +123,245 @@ struct pon_image_info {
 	uint32_t crc;
 	/** next window number which shall be handled */
 	uint32_t next_window;
+	/** Staging buffer, collects windows to write them in aligned chunks */
+	uint8_t *buf;
+	/** Size of the staging buffer, this is the write chunk size */
+	uint32_t buf_size;
+	/** Number of bytes currently held in the staging buffer */
+	uint32_t buf_len;
+	/** The space of the complete image is allocated in the file */
+	bool reserved;
+	/** Mapping of the image file, used instead of the staging buffer
+	 *  if enabled
+	 */
+	uint8_t *map;
+	/** Write position in the mapping */
+	uint32_t map_pos;
+	/** A delta image is received, it is rebuilt by download_end() */
+	bool delta;
+	/** Decoder of a compressed image, NULL if not compressed */
+	struct pon_img_unpack *unpack;
+	/** CRC register of the decompressed image */
+	uint32_t unpack_crc;
+	/** Write-behind handle, used instead of the staging buffer
+	 *  if write-behind is enabled
+	 */
+	struct pon_img_wb *wb;
+	/** Parser of the U-Boot image headers, checks the image while it is
+	 *  received
+	 */
+	struct pon_img_uimage *uimage;
+	/** Bank written directly during the download, NULL if the image is
+	 *  staged in a file
+	 */
+	struct pon_img_bank *bank;
+	/** Bank which was completely written by the last direct download,
+	 *  0 if none. store() only has to mark this bank.
+	 */
+	char direct_ready;
+	/** Version of the last completed image, from its U-Boot header */
+	char version[PON_IMG_VERSION_LEN + 1];
+	/** Identity of the last completed image: size, CRC, data CRC of the
+	 *  U-Boot header and the start of the SHA-256 in hex. It is recorded
+	 *  for the bank the image is written into, a store of the same image
+	 *  into this bank again only marks the bank if its volumes still hold
+	 *  the sub-images.
+	 */
+	char ident[PON_IMG_IDENT_LEN + 1];
+	/** Progress persisted for a later resume, NULL if disabled */
+	struct pon_img_ckpt *ckpt;
+	/** Image offset of the last checkpoint */
+	uint32_t ckpt_offset;
+	/** Received windows below this offset are already stored by an
+	 *  interrupted download of the same image
+	 */
+	uint32_t resume_offset;
+	/** Bookkeeping of the received windows, for retransmitted windows
+	 *  and windows received out of order
+	 */
+	struct pon_img_reasm *reasm;
+	/** Store of completed images, NULL if not used */
+	struct pon_img_store *store;
+	/** Stored image of the last download, referenced until the next
+	 *  download starts, empty if none
+	 */
+	char stored[PON_IMG_PATH_LEN];
+	/** Digests of the image under download, NULL if disabled */
+	struct pon_img_digest *digest;
+	/** SHA-256 of the last completed image in hex, empty if none */
+	char sha256[PON_IMG_DIGEST_LEN];
+	/** SHA-384 of the last completed image in hex, empty if none */
+	char sha384[PON_IMG_DIGEST_LEN];
+	/** Telemetry of the current download, the one of the context or
+	 *  NULL if it is disabled
+	 */
+	struct pon_img_stats *stats;
 };
 
-/** Private information for pon_img_lib */
+/** Private information for pon_img_lib.
+ *
+ *  The options, the members named dl_*, upgrade_path and
+ *  uboot_env_config, are set by the init_data of the init() call. This is
+ *  a NULL terminated list of "name=value" strings, like
+ *  "dl_store_dir=/data/images" or "dl_write_behind=1". A bool option
+ *  given by its name alone is set. An unknown name is ignored with a
+ *  warning, an invalid value fails the init() call.
+ */
 struct pon_img_context {
 	/** SW image handle to support Software Download */
 	struct pon_image_info image;
 
+	/** Staging file of the SW download, NULL selects the default path.
+	 *  The default of the first registration of the process is the file
+	 *  of the upgrade daemon, the others add their number to it.
+	 */
+	const char *dl_image_path;
+
+	/** Image file which is handed over to the upgrade daemon, NULL
+	 *  selects the default path. The daemon only gets the file name and
+	 *  must read the image from the same directory.
+	 */
+	const char *upgrade_path;
+
+	/** Write chunk size used for the next SW download.
+	 *  It is evaluated by download_start(), 0 selects the default.
+	 */
+	uint32_t dl_chunk_size;
+
+	/** Write the SW download image from a separate thread.
+	 *  It is evaluated by download_start().
+	 */
+	bool dl_write_behind;
+
+	/** Size of the write-behind ring, 0 selects the default */
+	uint32_t dl_ring_size;
+
+	/** Map the image file and copy the windows into the mapping, this
+	 *  needs a file system which can allocate the image space up front.
+	 *  It is evaluated by download_start() and takes precedence over
+	 *  write-behind.
+	 */
+	bool dl_mmap;
+
+	/** Skip the U-Boot image header checks during the SW download.
+	 *  Without this, the headers are checked if the image starts with
+	 *  a U-Boot header, other images are accepted unchecked.
+	 */
+	bool dl_no_header_check;
+
+	/** Keep a compressed image as received, otherwise it is
+	 *  decompressed while it is received
+	 */
+	bool dl_no_unpack;
+
+	/** Memory limit of the decompression, 0 selects the default */
+	uint32_t dl_unpack_mem;
+
+	/** Maximum size of a decompressed image, 0 selects the default */
+	uint32_t dl_unpack_max;
+
+	/** Do not persist the SW download progress, a new download of the
+	 *  same image then starts from the beginning.
+	 */
+	bool dl_no_checkpoint;
+
+	/** Image bytes between two persisted checkpoints,
+	 *  0 selects the default
+	 */
+	uint32_t dl_checkpoint_interval;
+
+	/** Directory on persistent storage for the staging file and its
+	 *  checkpoint, used if dl_image_path is not set. The default staging
+	 *  file is in tmpfs, its checkpoint only survives a restart of the
+	 *  OMCI daemon but not a reboot.
+	 */
+	const char *dl_resume_dir;
+
+	/** Write the SW download directly into the volumes of the inactive
+	 *  bank instead of staging it in a file.
+	 *  This needs the U-Boot image header checks.
+	 */
+	bool dl_direct;
+
+	/** Directory with file-backed volumes for the direct write and the
+	 *  base of delta images, NULL to use the UBI volumes
+	 */
+	const char *dl_bank_dir;
+
+	/** Write a stored image into the bank with the library instead of
+	 *  the upgrade daemon, only the changed blocks are written.
+	 *  dl_bank_dir selects the volumes.
+	 */
+	bool dl_native_write;
+
+	/** Directory of the image store, each registration needs its own.
+	 *  NULL keeps each completed download in the staging file.
+	 */
+	const char *dl_store_dir;
+
+	/** Byte budget of the image store, 0 selects the default */
+	uint64_t dl_store_budget;
+
+	/** Do not calculate the image digest during the SW download, the
+	 *  upgrade daemon then reads the image again to check its hash
+	 */
+	bool dl_no_digest;
+
+	/** Calculate SHA-384 in addition to SHA-256 */
+	bool dl_sha384;
+
+	/** Do not collect the SW download telemetry, this also disables
+	 *  the progress events. It is evaluated by each download_start().
+	 */
+	bool dl_no_stats;
+
+	/** Interval of the SW download progress events in ms,
+	 *  0 selects the default
+	 */
+	uint32_t dl_progress_interval;
+
+	/** Acknowledge the store action at once and write the image into
+	 *  the bank from the worker thread, the result is reported with
+	 *  \ref PON_IMG_EVENT_STORE_DONE. Until then download_start() and
+	 *  store() fail with PON_ADAPTER_ERR_RESOURCE_EXISTS.
+	 */
+	bool dl_async_store;
+
+	/** Receiver of the library events, NULL to drop them. It is set
+	 *  by the higher layer before pon_img_start() and called from the
+	 *  OMCI thread and the worker thread.
+	 */
+	pon_img_event_cb event_cb;
+
+	/** Argument of event_cb */
+	void *event_priv;
+
 	/** Callbacks to access uci and ubus */
 	const struct pa_config *pa_config;
 
 	/** OMCI context */
 	void *hl_handle;
 
+	/** Number of the registration in the process, the first one is 0 */
+	unsigned int instance;
+
+	/** fw_env.config compatible file to read and write the U-Boot
+	 *  variables directly, NULL to use the ubus methods. The image
+	 *  write, the bank activation and the reboot always use ubus.
+	 */
+	const char *uboot_env_config;
+
+	/** Worker thread of the asynchronous calls */
+	struct pon_img_async *async;
+
+	/** Cached U-Boot variables */
+	struct pon_uboot_cache *uboot_cache;
+
+	/** Telemetry of the SW downloads, it lives as long as the context
+	 *  so it can be read from any thread
+	 */
+	struct pon_img_stats *stats;
+
 	/** Time of last update of U-Boot vars.
 	 * Can be set to 0 to drop cached data.
 	 */
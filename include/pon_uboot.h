@@ -20,6 +20,11 @@
 
 /** Maximum supported length of U-Boot variable value */
 #define UBOOT_VAL_LEN_MAX 64
+/** Maximum supported length of U-Boot variable name */
+#define UBOOT_NAME_LEN_MAX 32
+
+/** Maximum number of variables of \ref pon_uboot_get_multi */
+#define UBOOT_GET_MULTI_MAX 16
 
 /** Predefined name for U-Boot image active status */
 #define UBOOT_VAR_IMG_ACTIVE "active_bank"
@@ -31,11 +36,36 @@
 #define UBOOT_VAR_IMG_VERSION "img_version"
 /** Predefined name for U-Boot image validity storage */
 #define UBOOT_VAR_IMG_VALID "img_valid"
+/** Predefined name for the identity of the image written into a bank.
+ *  Through ubus it is only read if the get_uboot_env method of procd
+ *  returns img_identA and img_identB, otherwise every store writes the
+ *  bank.
+ */
+#define UBOOT_VAR_IMG_IDENT "img_ident"
 /** Status value representing validity of image */
 #define UBOOT_VAL_IMG_VALID true
 /** Status value representing invalidity of image */
 #define UBOOT_VAL_IMG_INVALID false
 
+/** Counters of the U-Boot variable cache */
+struct pon_uboot_cache_stats {
+	/** Reads served from the cache */
+	uint32_t hits;
+	/** Reads which had to refresh the cache */
+	uint32_t misses;
+	/** Successful get_uboot_env ubus calls */
+	uint32_t refreshes;
+	/** Received ubus notifications */
+	uint32_t notifications;
+	/** Skipped writes of a value which was already set */
+	uint32_t elided;
+	/** A notification was received, the cache is kept up to date by
+	 *  them. Until then and without a subscription, it is refreshed
+	 *  after 2 s.
+	 */
+	bool subscribed;
+};
+
 /**	Function to write a U-Boot variable with specified string value.
  *
  *	\param[in] name		U-Boot variable name
@@ -60,6 +90,36 @@ enum pon_adapter_errno pon_uboot_set_str(struct pon_img_context *ctx,
 enum pon_adapter_errno pon_uboot_set_bool(struct pon_img_context *ctx,
 					  const char *name, bool value);
 
+/**	Start a transaction of U-Boot variable writes. The variables set
+ *	until \ref pon_uboot_txn_commit are written with one ubus call, which
+ *	is one update of the environment in the flash. Transactions can be
+ *	nested, the outermost one is written. A transaction belongs to the
+ *	calling thread, the one of another thread waits until it is ended.
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ */
+enum pon_adapter_errno pon_uboot_txn_begin(struct pon_img_context *ctx);
+
+/**	Write the variables of the transaction. On success, the cached
+ *	values are updated with the written ones.
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- PON_ADAPTER_ERR_INVALID_VAL: No transaction was started
+ *	- PON_ADAPTER_ERROR: A nested transaction was aborted, nothing is
+ *	  written
+ *	- Other: An error code in case of error, the cached values are
+ *	  dropped.
+ */
+enum pon_adapter_errno pon_uboot_txn_commit(struct pon_img_context *ctx);
+
+/**	Drop the variables of the transaction, nothing is written. In a
+ *	nested transaction the outer one is only marked as failed, its
+ *	outermost commit then writes nothing and returns an error.
+ */
+void pon_uboot_txn_abort(struct pon_img_context *ctx);
+
 /**	Function to read a U-Boot variable to specified value buffer.
  *
  *	\param[in] name		U-Boot variable name
@@ -74,6 +134,84 @@ enum pon_adapter_errno pon_uboot_get(struct pon_img_context *ctx,
 				     const char *name, char *value,
 				     const unsigned int value_size);
 
+/**	Read several U-Boot variables from one consistent state of the cache,
+ *	a concurrent refresh or notification does not mix old and new values.
+ *
+ *	\param[in] ctx		Library context
+ *	\param[in] names	Variable names
+ *	\param[out] values	Values, an empty string if a variable is not set
+ *	\param[in] count	Number of variables, up to
+ *				\ref UBOOT_GET_MULTI_MAX
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- Other: An error code in case of error.
+ */
+enum pon_adapter_errno
+pon_uboot_get_multi(struct pon_img_context *ctx, const char * const *names,
+		    char (*values)[UBOOT_VAL_LEN_MAX + 1], unsigned int count);
+
+/**	Allocate the U-Boot variable cache of a context.
+ *	libponimg_ll_register_ops() does this, a context set up by the caller,
+ *	like in pon_sw_upgrade, needs it before any U-Boot variable is used.
+ *	Without a cache the variable calls return PON_ADAPTER_ERR_INVALID_VAL.
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- PON_ADAPTER_ERR_NO_MEMORY: Out of memory
+ */
+enum pon_adapter_errno pon_uboot_cache_create(struct pon_img_context *ctx);
+
+/**	Free the U-Boot variable cache of a context. */
+void pon_uboot_cache_destroy(struct pon_img_context *ctx);
+
+/**	Access the U-Boot environment directly instead of through ubus,
+ *	e.g. on a system without the procd U-Boot methods.
+ *
+ *	\param[in] ctx		Library context
+ *	\param[in] config	Path of the fw_env.config compatible file
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- Other: An error code if the environment can not be opened.
+ */
+enum pon_adapter_errno pon_uboot_env_open(struct pon_img_context *ctx,
+					 const char *config);
+
+/**	Fill the U-Boot variable cache and subscribe to the notifications of
+ *	the detected ubus object. Without a subscription the cache falls back
+ *	to the time based refresh.
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- Other: An error code if the variables can not be read.
+ */
+enum pon_adapter_errno pon_uboot_cache_start(struct pon_img_context *ctx);
+
+/**	Mark a cached U-Boot variable as possibly changed, e.g. by a ubus
+ *	method which writes it as a side effect. The next read of this
+ *	variable refreshes the whole cache, until then the other variables
+ *	are still read from the cache.
+ *
+ *	\param[in] ctx		Library context
+ *	\param[in] name		U-Boot variable name
+ */
+void pon_uboot_cache_invalidate(struct pon_img_context *ctx,
+				const char *name);
+
+/**	Read the counters of the U-Boot variable cache.
+ *
+ *	\param[in] ctx		Library context
+ *	\param[out] stats	Counters
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- PON_ADAPTER_ERR_INVALID_VAL: No cache
+ */
+enum pon_adapter_errno
+pon_uboot_cache_stats_get(struct pon_img_context *ctx,
+			  struct pon_uboot_cache_stats *stats);
+
 /** @} */
 
 #endif /* _PON_UBOOT_H_ */
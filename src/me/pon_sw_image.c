@@ -8,6 +8,8 @@
  *
  *****************************************************************************/
 
+#include <arpa/inet.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <string.h>
 #include <errno.h>
@@ -18,16 +20,29 @@
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wredundant-decls"
 #include <safe_lib.h>
+#include <safe_mem_lib.h>
 #include <safe_str_lib.h>
 #pragma GCC diagnostic pop
 
 #include <pon_adapter.h>
-#include <pon_adapter_crc.h>
 #include <omci/me/pon_adapter_sw_image.h>
 
+#include "../pon_img_async.h"
+#include "../pon_img_bank.h"
+#include "../pon_img_ckpt.h"
 #include "../pon_img_common.h"
+#include "../pon_img_crc.h"
 #include "../pon_img_debug.h"
+#include "../pon_img_delta.h"
+#include "../pon_img_reasm.h"
+#include "../pon_img_sha.h"
+#include "../pon_img_stats.h"
+#include "../pon_img_store.h"
+#include "../pon_img_uimage.h"
+#include "../pon_img_unpack.h"
+#include "../pon_img_wb.h"
 #include "pon_img.h"
+#include "pon_uboot.h"
 
 /** \addtogroup PON_IMG_LIB
  *  @{
@@ -39,39 +54,1010 @@
 /** SW Image Version length as defined by G.988 */
 #define SWIMAGE_VERSION_LEN		14
 
+/** Default write chunk size, windows are collected up to this size */
+#define SWIMAGE_CHUNK_SIZE		(64 * 1024)
+/** Alignment of the write chunk size and the staging buffer */
+#define SWIMAGE_CHUNK_ALIGN		4096
+
+/** Suffix of the staging file path for the download progress, used to
+ *  resume an interrupted download
+ */
+#define SWIMAGE_CKPT_SUFFIX		".ckpt"
+/** Default number of image bytes between two checkpoints */
+#define SWIMAGE_CKPT_INTERVAL		(1024 * 1024)
+/** Read size of the stored part of a resumed download */
+#define SWIMAGE_DIGEST_BUF_SIZE		(64 * 1024)
+
 /* Create a directory with the full path, like "mkdir -p" from a shell */
 static void mkdir_parents(char *path)
 {
 	char *sep = strrchr(path, '/');
 
-	if (sep && sep != path) {
-		*sep = 0;
-		mkdir_parents(path);
-		*sep = '/';
+	if (sep && sep != path) {
+		*sep = 0;
+		mkdir_parents(path);
+		*sep = '/';
+	}
+	if (mkdir(path, 0777) && errno != EEXIST)
+		dbg_err("error while trying to create '%s': %s\n",
+			path, strerror(errno));
+}
+
+static int open_mkdir(const char *path, int flags, mode_t mode)
+{
+	char *sep = strrchr(path, '/');
+
+	dbg_in_args("%s, %x, %0o", path, flags, mode);
+
+	if (sep) {
+		char *path0 = strdup(path);
+
+		if (!path0) {
+			dbg_err("strdup failed\n");
+			return -1;
+		}
+		path0[sep - path] = 0;
+		mkdir_parents(path0);
+		free(path0);
+	}
+	return open(path, flags, mode);
+}
+
+/* Write all data collected in the staging buffer to the image file */
+static enum pon_adapter_errno image_flush(struct pon_image_info *image)
+{
+	uint32_t done = 0;
+	ssize_t ret;
+
+	while (done < image->buf_len) {
+		ret = write(image->fd, image->buf + done, image->buf_len - done);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			dbg_err("image write failed: %s\n", strerror(errno));
+			return PON_ADAPTER_ERROR;
+		}
+		done += ret;
+	}
+	image->buf_len = 0;
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* The chunk size is rounded up to the alignment but it is not larger than
+ * needed for the complete image.
+ */
+static uint32_t image_chunk_size(const struct pon_image_info *image,
+				 uint32_t chunk_size)
+{
+	if (!chunk_size)
+		chunk_size = SWIMAGE_CHUNK_SIZE;
+	if (chunk_size > image->size)
+		chunk_size = image->size;
+	chunk_size = (chunk_size + SWIMAGE_CHUNK_ALIGN - 1) &
+		     ~(SWIMAGE_CHUNK_ALIGN - 1);
+	if (!chunk_size)
+		chunk_size = SWIMAGE_CHUNK_ALIGN;
+
+	return chunk_size;
+}
+
+static enum pon_adapter_errno image_buf_alloc(struct pon_image_info *image,
+					      uint32_t chunk_size)
+{
+	void *buf;
+
+	if (posix_memalign(&buf, SWIMAGE_CHUNK_ALIGN, chunk_size)) {
+		dbg_err("can not allocate %u bytes staging buffer\n",
+			chunk_size);
+		return PON_ADAPTER_ERR_NO_MEMORY;
+	}
+
+	image->buf = buf;
+	image->buf_size = chunk_size;
+	image->buf_len = 0;
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+static void image_buf_free(struct pon_image_info *image)
+{
+	free(image->buf);
+	image->buf = NULL;
+	image->buf_size = 0;
+	image->buf_len = 0;
+}
+
+/* Collect data in the staging buffer, write only completely filled chunks */
+static enum pon_adapter_errno image_buf_write(struct pon_image_info *image,
+					      const uint8_t *data,
+					      uint32_t len)
+{
+	enum pon_adapter_errno error;
+	uint32_t done, count;
+
+	for (done = 0; done < len; done += count) {
+		count = image->buf_size - image->buf_len;
+		if (count > len - done)
+			count = len - done;
+		if (memcpy_s(image->buf + image->buf_len,
+			     image->buf_size - image->buf_len,
+			     data + done, count)) {
+			dbg_err_fn(memcpy_s);
+			return PON_ADAPTER_ERR_MEM_ACCESS;
+		}
+		image->buf_len += count;
+
+		if (image->buf_len == image->buf_size) {
+			error = image_flush(image);
+			if (error != PON_ADAPTER_SUCCESS)
+				return error;
+		}
+	}
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* Map the reserved image file, the windows are copied into the page cache
+ * without a system call. An access to the mapping can not fail for lack of
+ * space, as all blocks of the file are allocated.
+ */
+static enum pon_adapter_errno image_map(struct pon_image_info *image)
+{
+	off_t pos;
+	void *map;
+
+	pos = lseek(image->fd, 0, SEEK_CUR);
+	if (pos < 0)
+		return PON_ADAPTER_ERROR;
+
+	map = mmap(NULL, image->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   image->fd, 0);
+	if (map == MAP_FAILED) {
+		dbg_wrn("image file can not be mapped: %s\n",
+			strerror(errno));
+		return PON_ADAPTER_ERROR;
+	}
+
+	image->map = map;
+	image->map_pos = pos;
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* Prepare the path from the received windows to the image file, this is
+ * the mapping of the file, the staging buffer or the write-behind ring.
+ */
+static enum pon_adapter_errno image_sink_open(struct pon_img_context *ctx,
+					      struct pon_image_info *image)
+{
+	uint32_t chunk_size = image_chunk_size(image, ctx->dl_chunk_size);
+
+	if (ctx->dl_mmap) {
+		if (image->reserved && image->size &&
+		    image_map(image) == PON_ADAPTER_SUCCESS)
+			return PON_ADAPTER_SUCCESS;
+		dbg_wrn("image file is not mapped\n");
+	}
+
+	if (ctx->dl_write_behind)
+		return pon_img_wb_create(&image->wb, image->fd,
+					 ctx->dl_ring_size, chunk_size);
+
+	return image_buf_alloc(image, chunk_size);
+}
+
+static bool image_sink_ready(const struct pon_image_info *image)
+{
+	return image->buf || image->map || image->wb || image->bank;
+}
+
+static enum pon_adapter_errno image_sink_write(struct pon_image_info *image,
+					       const uint8_t *data,
+					       uint32_t len)
+{
+	uint64_t start = image->stats ? pon_img_stats_now() : 0;
+	enum pon_adapter_errno error;
+
+	if (image->map) {
+		error = PON_ADAPTER_SUCCESS;
+		if (memcpy_s(image->map + image->map_pos,
+			     image->size - image->map_pos, data, len)) {
+			dbg_err_fn(memcpy_s);
+			error = PON_ADAPTER_ERR_MEM_ACCESS;
+		} else {
+			image->map_pos += len;
+		}
+	} else if (image->wb) {
+		error = pon_img_wb_push(image->wb, data, len);
+	} else {
+		error = image_buf_write(image, data, len);
+	}
+
+	if (image->stats)
+		pon_img_stats_stall(image->stats, start);
+
+	return error;
+}
+
+/* Write all pending data, errors of the write-behind thread are reported
+ * here. Data in the mapping is already in the page cache.
+ */
+static enum pon_adapter_errno image_sink_flush(struct pon_image_info *image)
+{
+	uint64_t start = image->stats ? pon_img_stats_now() : 0;
+	enum pon_adapter_errno error;
+
+	if (image->map)
+		return PON_ADAPTER_SUCCESS;
+
+	if (image->wb)
+		error = pon_img_wb_drain(image->wb);
+	else
+		error = image_flush(image);
+
+	if (image->stats)
+		pon_img_stats_stall(image->stats, start);
+
+	return error;
+}
+
+static void image_sink_close(struct pon_image_info *image)
+{
+	if (image->map) {
+		munmap(image->map, image->size);
+		image->map = NULL;
+	}
+	if (image->wb) {
+		pon_img_wb_destroy(image->wb);
+		image->wb = NULL;
+	}
+	image_buf_free(image);
+}
+
+/* Forget the progress, the stored data is invalid or no longer needed */
+static void image_ckpt_drop(struct pon_image_info *image)
+{
+	if (!image->ckpt)
+		return;
+
+	free(image->ckpt);
+	image->ckpt = NULL;
+	image->resume_offset = 0;
+	pon_img_ckpt_remove(image->ckpt_path);
+}
+
+/* Persist the progress. The image data is synced first, so the checkpoint
+ * never covers more than what is durably stored.
+ */
+static enum pon_adapter_errno image_checkpoint(struct pon_image_info *image)
+{
+	struct pon_img_ckpt *ckpt = image->ckpt;
+	enum pon_adapter_errno error;
+	uint64_t start;
+
+	error = image_sink_flush(image);
+	if (error != PON_ADAPTER_SUCCESS)
+		return error;
+
+	/* the mapping is written back only here */
+	start = image->stats ? pon_img_stats_now() : 0;
+	if ((image->map && msync(image->map, image->offset, MS_SYNC)) ||
+	    fdatasync(image->fd)) {
+		dbg_err("image sync failed: %s\n", strerror(errno));
+		return PON_ADAPTER_ERROR;
+	}
+	if (image->stats)
+		pon_img_stats_stall(image->stats, start);
+
+	ckpt->offset = image->offset;
+	ckpt->crc = image->crc;
+	ckpt->next_window = image->next_window;
+	image->ckpt_offset = image->offset;
+
+	/* a failed checkpoint is retried with the next one */
+	(void)pon_img_ckpt_save(image->ckpt_path, ckpt);
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* Create a new staging file. The old one is unlinked first, it can be a
+ * hard link of a stored image, see image_handoff(), which must keep its
+ * content.
+ */
+static int image_create(const char *path)
+{
+	if (unlink(path) && errno != ENOENT)
+		dbg_wrn("%s can not be removed: %s\n", path, strerror(errno));
+
+	return open_mkdir(path, O_CREAT | O_RDWR | O_TRUNC, 0600);
+}
+
+/* The stored part of an interrupted download must still hold the data
+ * described by the checkpoint. The file size says nothing, the space of
+ * the complete image is allocated up front.
+ */
+static bool image_stored_check(int fd, const struct pon_img_ckpt *ckpt)
+{
+	uint32_t offset, len, crc = PON_IMG_CRC32_INIT;
+	uint8_t *buf;
+
+	buf = malloc(SWIMAGE_DIGEST_BUF_SIZE);
+	for (offset = 0; buf && offset < ckpt->offset; offset += len) {
+		len = ckpt->offset - offset;
+		if (len > SWIMAGE_DIGEST_BUF_SIZE)
+			len = SWIMAGE_DIGEST_BUF_SIZE;
+		if (pread(fd, buf, len, offset) != len)
+			break;
+		crc = pon_img_crc32(crc, buf, len);
+	}
+	free(buf);
+
+	if (offset < ckpt->offset || crc != ckpt->crc) {
+		dbg_wrn("stored part of the interrupted download is not valid\n");
+		return false;
+	}
+
+	return true;
+}
+
+/* Open the staging file, windows received ahead are read back from it.
+ * If a checkpoint of an interrupted download with the same id and size
+ * exists, the stored part of the image is kept if it still matches the
+ * checkpoint CRC, unless the file has another link.
+ */
+static int image_open(struct pon_img_context *ctx,
+		      struct pon_image_info *image,
+		      const uint8_t id, const char *path)
+{
+	struct pon_img_ckpt *ckpt;
+	struct stat st;
+	int fd;
+
+	if (ctx->dl_no_checkpoint)
+		return image_create(path);
+
+	ckpt = malloc(sizeof(*ckpt));
+	if (ckpt && pon_img_ckpt_load(image->ckpt_path, ckpt) ==
+		    PON_ADAPTER_SUCCESS &&
+	    ckpt->id == id && ckpt->size == image->size &&
+	    ckpt->offset && ckpt->offset <= image->size &&
+	    stat(path, &st) == 0 && st.st_size >= ckpt->offset &&
+	    st.st_nlink == 1) {
+		fd = open(path, O_RDWR);
+		if (fd >= 0 && image_stored_check(fd, ckpt) &&
+		    ftruncate(fd, ckpt->offset) == 0 &&
+		    lseek(fd, ckpt->offset, SEEK_SET) == ckpt->offset) {
+			dbg_msg("resuming the download of image %u at offset %u\n",
+				id, ckpt->offset);
+			image->ckpt = ckpt;
+			image->ckpt_offset = ckpt->offset;
+			image->resume_offset = ckpt->offset;
+			return fd;
+		}
+		if (fd >= 0)
+			close(fd);
+	}
+
+	pon_img_ckpt_remove(image->ckpt_path);
+	if (ckpt) {
+		memset(ckpt, 0, sizeof(*ckpt));
+		ckpt->id = id;
+		ckpt->size = image->size;
+	}
+	image->ckpt = ckpt;
+
+	return image_create(path);
+}
+
+/* Allocate the space of the complete image. A shortage is detected before
+ * the download starts and the file is not fragmented.
+ */
+static enum pon_adapter_errno image_reserve(struct pon_image_info *image)
+{
+	int err;
+
+	if (!image->size)
+		return PON_ADAPTER_SUCCESS;
+
+	err = posix_fallocate(image->fd, 0, image->size);
+	if (!err) {
+		image->reserved = true;
+		return PON_ADAPTER_SUCCESS;
+	}
+	if (err == EOPNOTSUPP || err == EINVAL) {
+		dbg_wrn("image space can not be allocated: %s\n",
+			strerror(err));
+		return PON_ADAPTER_SUCCESS;
+	}
+
+	dbg_err("no space for the image of %u bytes: %s\n", image->size,
+		strerror(err));
+	/* release a partial allocation, a resumable part is kept */
+	(void)ftruncate(image->fd, image->resume_offset);
+
+	return err == ENOSPC || err == EFBIG ? PON_ADAPTER_ERR_NO_MEMORY :
+					       PON_ADAPTER_ERROR;
+}
+
+/* Drop the stored data from the offset on, the space stays allocated */
+static int image_truncate(struct pon_image_info *image, uint32_t offset)
+{
+	if (ftruncate(image->fd, offset))
+		return -1;
+	if (image->reserved && posix_fallocate(image->fd, 0, image->size))
+		return -1;
+	if (image->map) {
+		image->map_pos = offset;
+		return 0;
+	}
+
+	return lseek(image->fd, offset, SEEK_SET) == offset ? 0 : -1;
+}
+
+/* Windows below the checkpoint were already stored by the interrupted
+ * download, they are not written again. The image identity is checked on
+ * the first bytes, the CRC register at the checkpoint must match.
+ */
+static enum pon_adapter_errno image_resume(struct pon_image_info *image,
+					   const uint8_t *window,
+					   uint32_t length,
+					   uint32_t win_crc,
+					   uint32_t *skip)
+{
+	struct pon_img_ckpt *ckpt = image->ckpt;
+	uint32_t len = image->resume_offset - image->offset;
+	uint32_t head, crc;
+
+	if (image->offset < ckpt->head_len) {
+		head = ckpt->head_len - image->offset;
+		if (head > length)
+			head = length;
+		if (memcmp(window, ckpt->head + image->offset, head)) {
+			/* another image, continue as a new download */
+			dbg_wrn("image differs from the interrupted download\n");
+			if (image_truncate(image, image->offset))
+				return PON_ADAPTER_ERROR;
+			pon_img_ckpt_remove(image->ckpt_path);
+			ckpt->head_len = image->offset;
+			image->ckpt_offset = image->offset;
+			image->resume_offset = 0;
+			*skip = 0;
+			return PON_ADAPTER_SUCCESS;
+		}
+	}
+
+	if (len > length)
+		len = length;
+	*skip = len;
+
+	if (image->offset + len < image->resume_offset)
+		return PON_ADAPTER_SUCCESS;
+
+	/* the checkpoint is normally at the end of a window */
+	if (len == length)
+		crc = pon_img_reasm_crc_append(image->reasm, image->crc,
+					       win_crc, length);
+	else
+		crc = pon_img_crc32(image->crc, window, len);
+
+	if (crc != ckpt->crc) {
+		dbg_err("stored image part does not match the download\n");
+		image_ckpt_drop(image);
+		return PON_ADAPTER_ERR_CRC;
+	}
+	dbg_msg("download resumed at offset %u\n", image->resume_offset);
+	image->resume_offset = 0;
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* The windows before the checkpoint are not received again. The stored
+ * part of the image is read once, it is checked like the received windows
+ * and hashed.
+ */
+static enum pon_adapter_errno image_stored_replay(struct pon_image_info *image)
+{
+	enum pon_adapter_errno error = PON_ADAPTER_SUCCESS;
+	uint32_t offset, len;
+	const uint8_t *data;
+	uint8_t *buf = NULL;
+
+	if (!image->map) {
+		buf = malloc(SWIMAGE_DIGEST_BUF_SIZE);
+		if (!buf)
+			return PON_ADAPTER_ERR_NO_MEMORY;
+	}
+
+	for (offset = 0; offset < image->offset; offset += len) {
+		len = image->offset - offset;
+		if (image->map) {
+			data = image->map + offset;
+		} else {
+			if (len > SWIMAGE_DIGEST_BUF_SIZE)
+				len = SWIMAGE_DIGEST_BUF_SIZE;
+			if (pread(image->fd, buf, len, offset) != len) {
+				dbg_err("stored image part can not be read\n");
+				error = PON_ADAPTER_ERROR;
+				break;
+			}
+			data = buf;
+		}
+
+		if (image->uimage) {
+			error = pon_img_uimage_feed(image->uimage, data, len);
+			if (error != PON_ADAPTER_SUCCESS) {
+				dbg_err("stored image part rejected\n");
+				break;
+			}
+		}
+		if (image->digest)
+			pon_img_digest_update(image->digest, data, len);
+	}
+	free(buf);
+
+	return error;
+}
+
+/* The OMCI stack continues with the window after the checkpoint */
+static enum pon_adapter_errno image_resume_jump(struct pon_image_info *image)
+{
+	enum pon_adapter_errno error;
+
+	dbg_msg("download continues at window %u, offset %u\n",
+		image->ckpt->next_window, image->resume_offset);
+
+	image->offset = image->resume_offset;
+	image->crc = image->ckpt->crc;
+	image->next_window = image->ckpt->next_window;
+	image->resume_offset = 0;
+	image->delta = pon_img_delta_detect(image->ckpt->head,
+					    image->ckpt->head_len);
+
+	/* a delta image is checked and hashed while it is rebuilt */
+	if (image->delta) {
+		free(image->uimage);
+		image->uimage = NULL;
+		return PON_ADAPTER_SUCCESS;
+	}
+
+	error = image_stored_replay(image);
+	if (error != PON_ADAPTER_SUCCESS)
+		image_ckpt_drop(image);
+
+	return error;
+}
+
+static char part_get(const uint8_t id)
+{
+	switch (id) {
+	case 0:
+		return 'A';
+	case 1:
+		return 'B';
+	default:
+		dbg_err("OMCI specified wrong partition number! Using default.\n");
+		return 'A';
+	}
+}
+
+/* Stream the image into the volumes of the target bank. The bank must not
+ * be the active one and it is marked invalid before it is overwritten,
+ * store() marks it valid again.
+ */
+static enum pon_adapter_errno image_direct_open(struct pon_img_context *ctx,
+						struct pon_image_info *image,
+						const char part)
+{
+	enum pon_adapter_errno error;
+	bool active = true;
+
+	error = pon_img_active_get(ctx, part, &active);
+	if (error != PON_ADAPTER_SUCCESS || active) {
+		dbg_wrn("bank %c is active, using the staging file\n", part);
+		return PON_ADAPTER_ERROR;
+	}
+
+	/* the bank does not hold the recorded image anymore */
+	error = pon_uboot_txn_begin(ctx);
+	if (error != PON_ADAPTER_SUCCESS)
+		return error;
+	error = pon_img_valid_set(ctx, part, false);
+	if (error == PON_ADAPTER_SUCCESS)
+		error = pon_img_ident_set(ctx, part, "");
+	if (error != PON_ADAPTER_SUCCESS)
+		pon_uboot_txn_abort(ctx);
+	else
+		error = pon_uboot_txn_commit(ctx);
+	if (error != PON_ADAPTER_SUCCESS) {
+		dbg_wrn("bank %c can not be invalidated, using the staging file\n",
+			part);
+		return error;
+	}
+
+	error = pon_img_bank_open(&image->bank, part, ctx->dl_bank_dir);
+	if (error != PON_ADAPTER_SUCCESS)
+		return error;
+
+	pon_img_uimage_sink_set(image->uimage, &pon_img_bank_sink,
+				image->bank);
+	/* the volumes are only known from the headers */
+	image->uimage->optional = false;
+	dbg_msg("writing the image directly into bank %c\n", part);
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* Release everything of a running download, the staged data is written */
+static void image_release(struct pon_image_info *image)
+{
+	/* keep the file content in line with the received offset */
+	if (image->fd >= 0)
+		(void)image_sink_flush(image);
+	image_sink_close(image);
+
+	if (image->fd >= 0) {
+		close(image->fd);
+		image->fd = -1;
+	}
+	image->reserved = false;
+	pon_img_bank_close(image->bank);
+	image->bank = NULL;
+	free(image->uimage);
+	image->uimage = NULL;
+	free(image->ckpt);
+	image->ckpt = NULL;
+	image->ckpt_offset = 0;
+	image->resume_offset = 0;
+	pon_img_reasm_destroy(image->reasm);
+	image->reasm = NULL;
+	pon_img_unpack_destroy(image->unpack);
+	image->unpack = NULL;
+	free(image->digest);
+	image->digest = NULL;
+}
+
+/* Stage the image in a file */
+static enum pon_adapter_errno image_stage_open(struct pon_img_context *ctx,
+					       struct pon_image_info *image,
+					       const uint8_t id)
+{
+	enum pon_adapter_errno error;
+
+	image->fd = image_open(ctx, image, id, image->path);
+	if (image->fd < 0) {
+		dbg_err("%s can not be opened\n", image->path);
+		return PON_ADAPTER_ERROR;
+	}
+
+	error = image_reserve(image);
+	if (error != PON_ADAPTER_SUCCESS)
+		return error;
+
+	return image_sink_open(ctx, image);
+}
+
+/* Drop the reference to the image of the last download */
+static void image_stored_put(struct pon_image_info *image)
+{
+	if (!image->stored[0])
+		return;
+
+	pon_img_store_put(image->store, image->stored);
+	image->stored[0] = '\0';
+}
+
+static enum pon_adapter_errno image_store_open(struct pon_img_context *ctx,
+					       struct pon_image_info *image)
+{
+	if (image->store)
+		return PON_ADAPTER_SUCCESS;
+	if (!ctx->dl_store_dir)
+		return PON_ADAPTER_ERR_NOT_SUPPORTED;
+
+	return pon_img_store_open(&image->store, ctx->dl_store_dir,
+				  ctx->dl_store_budget);
+}
+
+/* Move the completed image into the store, an identical image which is
+ * already stored is used instead. The path of the image is returned.
+ */
+static const char *image_store_add(struct pon_img_context *ctx,
+				   struct pon_image_info *image,
+				   const uint32_t size, const uint32_t crc)
+{
+	if (image_store_open(ctx, image) != PON_ADAPTER_SUCCESS)
+		return image->path;
+
+	if (pon_img_store_add(image->store, image->path, size, crc,
+			      image->stored, sizeof(image->stored)) !=
+	    PON_ADAPTER_SUCCESS) {
+		image->stored[0] = '\0';
+		return image->path;
+	}
+
+	return image->stored;
+}
+
+/* Decompressed data, it takes the way of the received data of an
+ * uncompressed image
+ */
+static enum pon_adapter_errno image_unpacked(void *priv, const uint8_t *data,
+					     uint32_t len)
+{
+	struct pon_image_info *image = priv;
+	enum pon_adapter_errno error;
+
+	if (!image->bank) {
+		error = image_sink_write(image, data, len);
+		if (error != PON_ADAPTER_SUCCESS)
+			return error;
+	}
+
+	image->unpack_crc = pon_img_crc32(image->unpack_crc, data, len);
+	if (image->digest)
+		pon_img_digest_update(image->digest, data, len);
+
+	if (image->uimage)
+		return pon_img_uimage_feed(image->uimage, data, len);
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* A compressed image is decompressed while it is received. The size of the
+ * decompressed image is not known, so the staging file is written without
+ * a mapping and the download can not be resumed.
+ */
+static enum pon_adapter_errno image_unpack_begin(struct pon_img_context *ctx,
+						 struct pon_image_info *image,
+						 enum pon_img_unpack_type type)
+{
+	const struct pon_img_uimage_sink *sink;
+	enum pon_adapter_errno error;
+	bool optional;
+	void *sink_priv;
+
+	dbg_msg("%s compressed image received\n", pon_img_unpack_name(type));
+
+	error = pon_img_unpack_create(&image->unpack, type, ctx->dl_unpack_mem,
+				      ctx->dl_unpack_max, image_unpacked,
+				      image);
+	if (error != PON_ADAPTER_SUCCESS)
+		return error;
+	image->unpack_crc = PON_IMG_CRC32_INIT;
+
+	if (image->resume_offset && image_truncate(image, 0))
+		return PON_ADAPTER_ERROR;
+	image_ckpt_drop(image);
+
+	/* the size is taken from the first header, the bank stays the
+	 * receiver in the direct mode
+	 */
+	if (image->uimage) {
+		sink = image->uimage->sink;
+		sink_priv = image->uimage->sink_priv;
+		optional = image->uimage->optional;
+		pon_img_uimage_init(image->uimage, UINT32_MAX,
+				    pon_img_uimage_arch_native());
+		pon_img_uimage_sink_set(image->uimage, sink, sink_priv);
+		image->uimage->optional = optional;
+	}
+
+	if (image->map) {
+		image_sink_close(image);
+		error = image_buf_alloc(image,
+					image_chunk_size(image,
+							 ctx->dl_chunk_size));
+	}
+
+	return error;
+}
+
+/* A delta image is staged and rebuilt at the end of the download, it is
+ * not checked while it is received.
+ */
+static enum pon_adapter_errno image_delta_begin(struct pon_img_context *ctx,
+						struct pon_image_info *image,
+						const uint8_t id)
+{
+	dbg_msg("delta image received\n");
+
+	image->delta = true;
+	free(image->uimage);
+	image->uimage = NULL;
+
+	if (!image->bank)
+		return PON_ADAPTER_SUCCESS;
+
+	/* the bank stays invalid until store() */
+	pon_img_bank_close(image->bank);
+	image->bank = NULL;
+
+	return image_stage_open(ctx, image, id);
+}
+
+/* The base image is read from the volumes of the active bank. It must be
+ * the running image and the volumes must hold exactly the base image.
+ */
+static enum pon_adapter_errno
+image_delta_base_open(struct pon_img_context *ctx,
+		      const struct pon_img_delta_hdr *hdr, int *base_fd)
+{
+	struct pon_img_bank *bank = NULL;
+	struct pon_img_bank_state *state_bank;
+	struct pon_img_state state;
+	enum pon_adapter_errno error;
+	char vol[PON_IMG_DELTA_VOLLEN + 1];
+	int i;
+
+	error = pon_img_state_get(ctx, &state);
+	if (error != PON_ADAPTER_SUCCESS ||
+	    !(state.bank[0].present & PON_IMG_STATE_ACTIVE)) {
+		dbg_err("active bank of the delta base is not known\n");
+		return PON_ADAPTER_ERR_RESOURCE_NOT_FOUND;
+	}
+	i = state.bank[0].active ? 0 : 1;
+	state_bank = &state.bank[i];
+
+	if ((state_bank->present & PON_IMG_STATE_VERSION) &&
+	    strncmp(state_bank->version, (const char *)hdr->base_name,
+		    PON_IMG_DELTA_NMLEN)) {
+		dbg_err("delta base %.*s is not the active image %.*s\n",
+			PON_IMG_DELTA_NMLEN, hdr->base_name,
+			PON_IMG_DELTA_NMLEN, state_bank->version);
+		return PON_ADAPTER_ERR_INVALID_VAL;
+	}
+
+	error = pon_img_bank_open(&bank, part_get((uint8_t)i),
+				  ctx->dl_bank_dir);
+	if (error != PON_ADAPTER_SUCCESS)
+		return error;
+
+	for (i = 0; i < PON_IMG_DELTA_VOLS; i++) {
+		if (!hdr->base_vol[i].size)
+			continue;
+		snprintf(vol, sizeof(vol), "%.*s", PON_IMG_DELTA_VOLLEN,
+			 hdr->base_vol[i].name);
+		base_fd[i] = pon_img_bank_vol_open(bank, vol);
+		if (base_fd[i] < 0) {
+			error = PON_ADAPTER_ERR_RESOURCE_NOT_FOUND;
+			goto exit;
+		}
+	}
+
+	error = pon_img_delta_base_check(hdr, base_fd);
+	if (error != PON_ADAPTER_SUCCESS)
+		dbg_err("active bank does not hold the delta base %.*s (%u bytes, CRC 0x%08x)\n",
+			PON_IMG_DELTA_NMLEN, hdr->base_name, hdr->base_size,
+			hdr->base_crc);
+
+exit:
+	pon_img_bank_close(bank);
+	return error;
+}
+
+/* Build the complete image from the received delta image and the base
+ * image in the active bank. The complete image replaces the staging file.
+ */
+static enum pon_adapter_errno image_delta_rebuild(struct pon_img_context *ctx,
+						  struct pon_image_info *image,
+						  uint32_t *size,
+						  uint32_t *crc)
+{
+	int base_fd[PON_IMG_DELTA_VOLS] = {-1, -1, -1};
+	char out[PON_IMG_PATH_LEN + 8];
+	struct pon_img_uimage *uimage = NULL;
+	struct pon_img_delta_hdr hdr;
+	enum pon_adapter_errno error;
+	int fd, out_fd = -1, err, i;
+
+	fd = open(image->path, O_RDONLY);
+	if (fd < 0) {
+		dbg_err("%s can not be opened\n", image->path);
+		return PON_ADAPTER_ERROR;
+	}
+
+	error = pon_img_delta_hdr_read(fd, &hdr);
+	if (error != PON_ADAPTER_SUCCESS)
+		goto exit;
+
+	error = image_delta_base_open(ctx, &hdr, base_fd);
+	if (error != PON_ADAPTER_SUCCESS)
+		goto exit;
+
+	snprintf(out, sizeof(out), "%s.full", image->path);
+	out_fd = open(out, O_CREAT | O_WRONLY | O_TRUNC, 0600);
+	if (out_fd < 0) {
+		dbg_err("delta image can not be applied: %s\n",
+			strerror(errno));
+		error = PON_ADAPTER_ERROR;
+		goto exit;
+	}
+
+	err = hdr.size ? posix_fallocate(out_fd, 0, hdr.size) : 0;
+	if (err && err != EOPNOTSUPP && err != EINVAL) {
+		dbg_err("no space for the image of %u bytes: %s\n",
+			hdr.size, strerror(err));
+		error = PON_ADAPTER_ERR_NO_MEMORY;
+		goto exit;
+	}
+
+	if (!ctx->dl_no_header_check) {
+		uimage = malloc(sizeof(*uimage));
+		if (!uimage) {
+			error = PON_ADAPTER_ERR_NO_MEMORY;
+			goto exit;
+		}
+		pon_img_uimage_init(uimage, hdr.size,
+				    pon_img_uimage_arch_native());
+		uimage->optional = true;
+	}
+
+	if (image->digest)
+		pon_img_digest_init(image->digest, image->digest->use_sha384);
+	error = pon_img_delta_apply(fd, &hdr, base_fd, out_fd, uimage,
+				    image->digest);
+	if (error == PON_ADAPTER_SUCCESS && uimage)
+		error = pon_img_uimage_finish(uimage);
+	if (error != PON_ADAPTER_SUCCESS)
+		goto exit;
+
+	if (rename(out, image->path)) {
+		dbg_err("%s can not be replaced: %s\n", image->path,
+			strerror(errno));
+		error = PON_ADAPTER_ERROR;
+		goto exit;
 	}
-	if (mkdir(path, 0777) && errno != EEXIST)
-		dbg_err("error while trying to create '%s': %s\n",
-			path, strerror(errno));
+	dbg_msg("image of %u bytes rebuilt from the delta image\n", hdr.size);
+
+	*size = hdr.size;
+	*crc = hdr.crc;
+
+exit:
+	free(uimage);
+	if (out_fd >= 0) {
+		close(out_fd);
+		if (error != PON_ADAPTER_SUCCESS)
+			(void)unlink(out);
+	}
+	for (i = 0; i < PON_IMG_DELTA_VOLS; i++)
+		if (base_fd[i] >= 0)
+			close(base_fd[i]);
+	close(fd);
+	return error;
 }
 
-static int open_mkdir(const char *path, int flags, mode_t mode)
+/* Push the download telemetry to the higher layer */
+static void image_progress_event(struct pon_img_context *ctx)
 {
-	char *sep = strrchr(path, '/');
+	struct pon_img_dl_stats stats;
 
-	dbg_in_args("%s, %x, %0o", path, flags, mode);
+	if (!ctx->event_cb)
+		return;
 
-	if (sep) {
-		char *path0 = strdup(path);
+	(void)pon_img_stats_get(ctx->image.stats, &stats);
+	ctx->event_cb(ctx->event_priv, PON_IMG_EVENT_DL_PROGRESS, &stats);
+}
 
-		if (!path0) {
-			dbg_err("strdup failed\n");
-			return -1;
-		}
-		path0[sep - path] = 0;
-		mkdir_parents(path0);
-		free(path0);
-	}
-	return open(path, flags, mode);
+/* The default staging file, each registration of the process has its own.
+ * The first one stages the image directly in the file of the upgrade
+ * daemon.
+ */
+static void image_default_path(const struct pon_img_context *ctx,
+			       char *path, size_t path_size)
+{
+	size_t len;
+
+	if (ctx->dl_resume_dir && !ctx->dl_no_checkpoint)
+		snprintf(path, path_size, "%s/%s", ctx->dl_resume_dir,
+			 SWIMAGE_NAME);
+	else
+		snprintf(path, path_size, "%s",
+			 ctx->upgrade_path ? ctx->upgrade_path : SWIMAGE_PATH);
+
+	len = strlen(path);
+	if (ctx->instance)
+		snprintf(path + len, path_size - len, ".%u", ctx->instance);
 }
 
 /** Preparation of image download
@@ -87,7 +1073,6 @@ static enum pon_adapter_errno download_start(void *ll_handle,
 	enum pon_adapter_errno error;
 	struct pon_img_context *ctx = ll_handle;
 	struct pon_image_info *image;
-	const char *path = SWIMAGE_PATH;
 
 	dbg_in_args("%p, %d, %d", ll_handle, id, size);
 
@@ -98,20 +1083,81 @@ static enum pon_adapter_errno download_start(void *ll_handle,
 
 	image = &ctx->image;
 
-	/* prepare internal image data */
-
-	image->fd = open_mkdir(path, O_CREAT | O_WRONLY | O_TRUNC, 0600);
-	if (image->fd < 0) {
-		dbg_err("%s can not be opened\n", path);
-		error = PON_ADAPTER_ERROR;
+	/* an asynchronous store still uses the last image */
+	if (pon_img_async_busy(ctx)) {
+		dbg_err("image %u is still being stored\n", id);
+		error = PON_ADAPTER_ERR_RESOURCE_EXISTS;
 		goto exit;
 	}
 
+	/* prepare internal image data */
+	image_release(image);
+	image_stored_put(image);
+	if (ctx->dl_image_path)
+		snprintf(image->path, sizeof(image->path), "%s",
+			 ctx->dl_image_path);
+	else
+		image_default_path(ctx, image->path, sizeof(image->path));
+	snprintf(image->ckpt_path, sizeof(image->ckpt_path), "%s%s",
+		 image->path, SWIMAGE_CKPT_SUFFIX);
 	image->size = size;
 	image->offset = 0;
 	image->next_window = 0;
-	image->crc = 0xffffffff;
+	image->crc = PON_IMG_CRC32_INIT;
+	image->direct_ready = 0;
+	image->delta = false;
+	image->sha256[0] = '\0';
+	image->sha384[0] = '\0';
+	image->version[0] = '\0';
+	image->ident[0] = '\0';
+
+	image->stats = ctx->dl_no_stats ? NULL : ctx->stats;
+	if (image->stats)
+		pon_img_stats_start(image->stats, size,
+				    ctx->dl_progress_interval);
+
+	if (!ctx->dl_no_digest) {
+		image->digest = malloc(sizeof(*image->digest));
+		if (!image->digest) {
+			error = PON_ADAPTER_ERR_NO_MEMORY;
+			goto exit;
+		}
+		pon_img_digest_init(image->digest, ctx->dl_sha384);
+	}
+
+	if (!ctx->dl_no_header_check) {
+		image->uimage = malloc(sizeof(*image->uimage));
+		if (!image->uimage) {
+			error = PON_ADAPTER_ERR_NO_MEMORY;
+			goto exit;
+		}
+		pon_img_uimage_init(image->uimage, size,
+				    pon_img_uimage_arch_native());
+		/* other images are accepted unchecked */
+		image->uimage->optional = true;
+	}
+
+	error = pon_img_reasm_create(&image->reasm);
+	if (error != PON_ADAPTER_SUCCESS) {
+		image_release(image);
+		goto exit;
+	}
 
+	if (ctx->dl_direct) {
+		if (!image->uimage)
+			dbg_wrn("direct write needs the image header check\n");
+		else if (image_direct_open(ctx, image, part_get(id)) ==
+			 PON_ADAPTER_SUCCESS)
+			goto exit_ok;
+	}
+
+	error = image_stage_open(ctx, image, id);
+	if (error != PON_ADAPTER_SUCCESS) {
+		image_release(image);
+		goto exit;
+	}
+
+exit_ok:
 	error = PON_ADAPTER_SUCCESS;
 
 exit:
@@ -140,12 +1186,18 @@ static enum pon_adapter_errno download_stop(void *ll_handle,
 
 	image = &ctx->image;
 
-	if (image->fd >= 0) {
-		close(image->fd);
-		image->fd = -1;
-	}
+	/* keep the progress for a later download of the same image */
+	if (image->ckpt && image->fd >= 0 && !image->resume_offset &&
+	    image->offset > image->ckpt_offset)
+		(void)image_checkpoint(image);
+
+	/* a directly written bank stays invalid */
+	image_release(image);
 	image->size = 0;
 
+	if (image->stats && pon_img_stats_stop(image->stats))
+		image_progress_event(ctx);
+
 	error = PON_ADAPTER_SUCCESS;
 
 exit:
@@ -153,6 +1205,31 @@ exit:
 	return error;
 }
 
+void pon_sw_image_release(struct pon_img_context *ctx)
+{
+	(void)download_stop(ctx, 0);
+	image_stored_put(&ctx->image);
+	pon_img_store_close(ctx->image.store);
+	ctx->image.store = NULL;
+	ctx->image.stats = NULL;
+}
+
+/* Record version and identity of the completed image */
+static void image_ident_make(struct pon_image_info *image, uint32_t size,
+			     uint32_t crc)
+{
+	const struct image_header *hdr = NULL;
+
+	if (image->uimage && image->uimage->parts) {
+		hdr = &image->uimage->part[0].hdr;
+		snprintf(image->version, sizeof(image->version), "%.*s",
+			 IH_NMLEN, hdr->ih_name);
+	}
+
+	snprintf(image->ident, sizeof(image->ident), "%08x%08x%08x%.32s",
+		 size, crc, hdr ? ntohl(hdr->ih_dcrc) : 0, image->sha256);
+}
+
 /** Check CRC and size of the image. If the image is ready to be stored,
  *  the file name of the temp image file is returned.
  *
@@ -173,8 +1250,10 @@ static enum pon_adapter_errno download_end(void *ll_handle,
 	enum pon_adapter_errno error;
 	struct pon_img_context *ctx = ll_handle;
 	struct pon_image_info *image;
+	uint32_t store_size = size, store_crc = crc;
 	uint8_t path_length;
-	const char *path = SWIMAGE_PATH;
+	const char *path;
+	bool direct;
 
 	dbg_in_args("%p, %d, 0x%08X, %d, %d, %p",
 		    ll_handle, id, crc, size, filepath_size, filepath);
@@ -185,7 +1264,7 @@ static enum pon_adapter_errno download_end(void *ll_handle,
 	}
 
 	image = &ctx->image;
-	path_length = strnlen_s(path, filepath_size);
+	path = image->path;
 
 	/* check defined image size */
 	if (image->size != size) {
@@ -211,22 +1290,75 @@ static enum pon_adapter_errno download_end(void *ll_handle,
 
 	dbg_msg("received image size checked successfully\n");
 
+	if (image->unpack) {
+		error = pon_img_unpack_finish(image->unpack);
+		if (error != PON_ADAPTER_SUCCESS)
+			goto exit;
+		store_size = (uint32_t)pon_img_unpack_size(image->unpack);
+		store_crc = image->unpack_crc ^ 0xffffffff;
+		dbg_msg("image decompressed from %u to %u bytes\n",
+			size, store_size);
+	}
+
+	/* write the remaining part of the image */
+	if (!image->bank) {
+		error = image_sink_flush(image);
+		if (error != PON_ADAPTER_SUCCESS)
+			goto exit;
+		/* drop the space reserved for the compressed image */
+		if (image->unpack && ftruncate(image->fd, store_size)) {
+			error = PON_ADAPTER_ERROR;
+			goto exit;
+		}
+	}
+
 	/* check CRC */
 	if ((image->crc ^ 0xffffffff) != crc) {
 		dbg_err("Incorrect CRC:\n");
 		dbg_err("Received = 0x%08x, Calculated = 0x%08X\n",
 			crc, image->crc ^ 0xffffffff);
 
+		image_ckpt_drop(image);
 		error = PON_ADAPTER_ERR_CRC;
 		goto exit;
 	}
 
 	dbg_msg("CRC checked successfully\n");
 
+	if (image->uimage) {
+		error = pon_img_uimage_finish(image->uimage);
+		if (error != PON_ADAPTER_SUCCESS) {
+			image_ckpt_drop(image);
+			goto exit;
+		}
+		if (image->uimage->parts)
+			dbg_msg("image headers checked successfully\n");
+	}
+	image_ckpt_drop(image);
+
+	if (image->delta) {
+		error = image_delta_rebuild(ctx, image, &store_size,
+					    &store_crc);
+		if (error != PON_ADAPTER_SUCCESS)
+			goto exit;
+	}
+
 	/* download is finalized - ready to store */
+	if (!image->bank && image->digest) {
+		pon_img_digest_final(image->digest, image->sha256,
+				     image->sha384);
+		dbg_msg("image SHA-256 %s\n", image->sha256);
+	}
+	image_ident_make(image, store_size, store_crc);
+	direct = image->bank != NULL;
 	download_stop(ll_handle, id);
+	if (direct)
+		image->direct_ready = part_get(id);
+	else
+		path = image_store_add(ctx, image, store_size, store_crc);
 
 	if (filepath) {
+		path_length = strnlen_s(path, filepath_size);
 		strncpy_s(filepath, filepath_size - 1, path, path_length);
 		filepath[filepath_size - 1] = '\0';
 	}
@@ -238,6 +1370,261 @@ exit:
 	return error;
 }
 
+/* Windows are accepted ahead only if they can be stored at their final
+ * place in the staging file.
+ */
+static bool image_ahead_possible(const struct pon_image_info *image)
+{
+	return image->fd >= 0 && !image->bank && !image->unpack &&
+	       !image->resume_offset && image->reasm->win_size;
+}
+
+/* The size of the windows is learned from the first full window, the
+ * offsets of windows ahead are counted from there
+ */
+static enum pon_adapter_errno image_win_size_check(struct pon_image_info *image,
+						   uint32_t length)
+{
+	struct pon_img_reasm *reasm = image->reasm;
+
+	/* the last window may be shorter */
+	if (length == reasm->win_size || image->offset + length == image->size)
+		return PON_ADAPTER_SUCCESS;
+
+	if (reasm->win_size) {
+		dbg_wrn("window size changed from %u to %u bytes\n",
+			reasm->win_size, length);
+		pon_img_reasm_pending_drop(reasm);
+	}
+
+	return pon_img_reasm_win_size_set(reasm, length, image->next_window,
+					  image->offset);
+}
+
+/* Skip data which was already written at its place */
+static enum pon_adapter_errno image_sink_skip(struct pon_image_info *image,
+					      uint32_t len)
+{
+	enum pon_adapter_errno error;
+
+	if (image->map) {
+		image->map_pos += len;
+		return PON_ADAPTER_SUCCESS;
+	}
+
+	error = image_sink_flush(image);
+	if (error != PON_ADAPTER_SUCCESS)
+		return error;
+
+	if (lseek(image->fd, len, SEEK_CUR) < 0) {
+		dbg_err("image seek failed: %s\n", strerror(errno));
+		return PON_ADAPTER_ERROR;
+	}
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* Append the next window to the image. A window which was received ahead
+ * is already stored, its data is only needed for the header check.
+ */
+static enum pon_adapter_errno image_window_append(struct pon_image_info *image,
+						  const uint8_t *window,
+						  uint32_t length,
+						  uint32_t win_crc,
+						  bool stored)
+{
+	enum pon_adapter_errno error;
+	struct pon_img_ckpt *ckpt;
+	uint32_t skip = 0, head;
+
+	error = image_win_size_check(image, length);
+	if (error != PON_ADAPTER_SUCCESS)
+		return error;
+
+	if (image->offset < image->resume_offset) {
+		error = image_resume(image, window, length, win_crc, &skip);
+		if (error != PON_ADAPTER_SUCCESS)
+			return error;
+	}
+
+	/* in the direct mode the parser writes into the bank */
+	if (image->unpack)
+		error = PON_ADAPTER_SUCCESS;
+	else if (stored)
+		error = image_sink_skip(image, length);
+	else if (!image->bank)
+		error = image_sink_write(image, window + skip, length - skip);
+	if (error != PON_ADAPTER_SUCCESS)
+		return error;
+
+	/* Reject an invalid image as early as possible. The parser stays in
+	 * the error state, all further windows are refused.
+	 */
+	if (image->unpack) {
+		error = pon_img_unpack_feed(image->unpack, window, length);
+		if (error != PON_ADAPTER_SUCCESS) {
+			dbg_err("compressed image rejected at offset %u\n",
+				image->offset);
+			return error;
+		}
+	} else if (image->uimage) {
+		error = pon_img_uimage_feed(image->uimage, window, length);
+		if (error != PON_ADAPTER_SUCCESS) {
+			dbg_err("image rejected at offset %u\n",
+				image->offset);
+			image_ckpt_drop(image);
+			return error;
+		}
+	}
+
+	/* a delta image is hashed while it is rebuilt */
+	if (image->digest && !image->unpack && !image->delta)
+		pon_img_digest_update(image->digest, window, length);
+
+	/* the first bytes identify the image for a later resume */
+	ckpt = image->ckpt;
+	if (ckpt && image->offset == ckpt->head_len &&
+	    ckpt->head_len < sizeof(ckpt->head)) {
+		head = sizeof(ckpt->head) - ckpt->head_len;
+		if (head > length)
+			head = length;
+		if (memcpy_s(ckpt->head + ckpt->head_len, head,
+			     window, head)) {
+			dbg_err_fn(memcpy_s);
+			return PON_ADAPTER_ERR_MEM_ACCESS;
+		}
+		ckpt->head_len += head;
+	}
+
+	pon_img_reasm_set(image->reasm, image->next_window, length, win_crc,
+			  PON_IMG_REASM_DONE);
+	image->offset += length;
+	image->next_window++;
+	image->crc = pon_img_reasm_crc_append(image->reasm, image->crc,
+					      win_crc, length);
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* Continue with the windows which were received ahead, their data is read
+ * back only if it is needed for the checks.
+ */
+static enum pon_adapter_errno image_pending_complete(struct pon_image_info *image)
+{
+	struct pon_img_reasm *reasm = image->reasm;
+	struct pon_img_reasm_slot *slot;
+	enum pon_adapter_errno error;
+	const uint8_t *data;
+	uint32_t len, crc;
+	ssize_t ret;
+
+	while (reasm->pending) {
+		slot = pon_img_reasm_find(reasm, image->next_window,
+					  PON_IMG_REASM_PENDING);
+		if (!slot)
+			break;
+		len = slot->len;
+		crc = slot->crc;
+
+		data = NULL;
+		if (image->map) {
+			data = image->map + image->offset;
+		} else if (image->uimage || image->digest ||
+			   (image->ckpt &&
+			    image->ckpt->head_len < image->offset + len &&
+			    image->ckpt->head_len <
+				    sizeof(image->ckpt->head))) {
+			ret = pread(image->fd, reasm->buf, len, image->offset);
+			if (ret != len) {
+				dbg_err("read back of window %u failed\n",
+					image->next_window);
+				return PON_ADAPTER_ERROR;
+			}
+			data = reasm->buf;
+		}
+
+		error = image_window_append(image, data, len, crc, true);
+		if (error != PON_ADAPTER_SUCCESS)
+			return error;
+	}
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* A window which is not the next expected one. A retransmission must be
+ * identical to the first reception, a window ahead is written at its
+ * place and completed later.
+ */
+static enum pon_adapter_errno image_window_other(struct pon_image_info *image,
+						 const uint32_t window_nr,
+						 const uint8_t *window,
+						 const uint16_t length)
+{
+	struct pon_img_reasm *reasm = image->reasm;
+	struct pon_img_reasm_slot *slot;
+	uint32_t win_crc, done;
+	uint64_t offset;
+	ssize_t ret;
+
+	win_crc = pon_img_crc32(PON_IMG_CRC32_INIT, window, length);
+
+	slot = pon_img_reasm_find(reasm, window_nr,
+				  window_nr < image->next_window ?
+				  PON_IMG_REASM_DONE : PON_IMG_REASM_PENDING);
+	if (slot) {
+		if (slot->len != length || slot->crc != win_crc) {
+			dbg_err("window %u differs from the first reception\n",
+				window_nr);
+			return PON_ADAPTER_ERROR;
+		}
+		dbg_msg("repeated window %u ignored\n", window_nr);
+		return PON_ADAPTER_SUCCESS;
+	}
+
+	if (window_nr < image->next_window ||
+	    window_nr - image->next_window >= PON_IMG_REASM_AHEAD ||
+	    !image_ahead_possible(image)) {
+		dbg_err("wrong window number: %d (expected: %d)\n",
+			window_nr, image->next_window);
+		return PON_ADAPTER_ERROR;
+	}
+
+	if (!pon_img_reasm_offset(reasm, window_nr, &offset) ||
+	    offset + length > image->size ||
+	    (length != reasm->win_size && offset + length != image->size)) {
+		dbg_err("window %u with %u bytes does not fit into the image\n",
+			window_nr, length);
+		return PON_ADAPTER_ERROR;
+	}
+
+	done = 0;
+	if (image->map) {
+		if (memcpy_s(image->map + offset, image->size - offset,
+			     window, length)) {
+			dbg_err_fn(memcpy_s);
+			return PON_ADAPTER_ERR_MEM_ACCESS;
+		}
+		done = length;
+	}
+	for (; done < length; done += ret) {
+		ret = pwrite(image->fd, window + done, length - done,
+			     offset + done);
+		if (ret < 0 && errno == EINTR) {
+			ret = 0;
+		} else if (ret < 0) {
+			dbg_err("image write failed: %s\n", strerror(errno));
+			return PON_ADAPTER_ERROR;
+		}
+	}
+
+	pon_img_reasm_set(reasm, window_nr, length, win_crc,
+			  PON_IMG_REASM_PENDING);
+	dbg_msg("window %u stored ahead (expected: %u)\n",
+		window_nr, image->next_window);
+
+	return PON_ADAPTER_SUCCESS;
+}
+
 /** Concatenate a Window to the image under download.
  *
  *  \param[in] ll_handle        Lower layer context pointer
@@ -255,6 +1642,9 @@ static enum pon_adapter_errno handle_window(void *ll_handle,
 	enum pon_adapter_errno error;
 	struct pon_img_context *ctx = ll_handle;
 	struct pon_image_info *image;
+	enum pon_img_unpack_type type;
+	uint64_t start = 0;
+	uint32_t offset;
 
 	dbg_in_args("%p, %d, %d, %p, %d",
 		    ll_handle, id, window_nr, window, length);
@@ -265,6 +1655,28 @@ static enum pon_adapter_errno handle_window(void *ll_handle,
 	}
 
 	image = &ctx->image;
+	if (image->stats)
+		start = pon_img_stats_now();
+
+	if (!image_sink_ready(image)) {
+		dbg_err("no download in progress\n");
+		error = PON_ADAPTER_ERROR;
+		goto exit;
+	}
+
+	/* the OMCI stack may continue directly after the checkpoint */
+	if (image->resume_offset && !image->offset && window_nr &&
+	    window_nr == image->ckpt->next_window) {
+		error = image_resume_jump(image);
+		if (error != PON_ADAPTER_SUCCESS)
+			goto exit;
+	}
+
+	/* retransmitted or early windows */
+	if (window_nr != image->next_window) {
+		error = image_window_other(image, window_nr, window, length);
+		goto exit;
+	}
 
 	if (image->offset >= image->size) {
 		dbg_err("image size overflow: %d of %d bytes\n",
@@ -280,44 +1692,269 @@ static enum pon_adapter_errno handle_window(void *ll_handle,
 		goto exit;
 	}
 
-	if (window_nr != image->next_window) {
-		dbg_err("wrong window number: %d (expected: %d)\n",
-			window_nr, image->next_window);
-		error = PON_ADAPTER_ERROR;
-		goto exit;
+	offset = image->offset;
+
+	if (!offset && !image->delta && !image->unpack) {
+		type = ctx->dl_no_unpack ? PON_IMG_UNPACK_NONE :
+			pon_img_unpack_detect(window, length);
+		error = PON_ADAPTER_SUCCESS;
+		if (type != PON_IMG_UNPACK_NONE)
+			error = image_unpack_begin(ctx, image, type);
+		else if (pon_img_delta_detect(window, length))
+			error = image_delta_begin(ctx, image, id);
+		if (error != PON_ADAPTER_SUCCESS) {
+			image_release(image);
+			goto exit;
+		}
 	}
 
-	if (write(image->fd, window, length) < length) {
-		error = PON_ADAPTER_ERROR;
+	error = image_window_append(image, window, length,
+				    pon_img_crc32(PON_IMG_CRC32_INIT,
+						  window, length),
+				    false);
+	if (error != PON_ADAPTER_SUCCESS)
 		goto exit;
-	}
 
-	image->offset += length;
-	image->next_window++;
-	image->crc = pa_omci_crc32(image->crc, window, length);
+	error = image_pending_complete(image);
+	if (error != PON_ADAPTER_SUCCESS)
+		goto exit;
+
+	if (image->ckpt && !image->resume_offset &&
+	    image->offset - image->ckpt_offset >=
+	    (ctx->dl_checkpoint_interval ? ctx->dl_checkpoint_interval :
+					   SWIMAGE_CKPT_INTERVAL)) {
+		error = image_checkpoint(image);
+		if (error != PON_ADAPTER_SUCCESS)
+			goto exit;
+	}
 
-	if ((image->offset >> 20) > ((image->offset - length) >> 20))
+	if ((image->offset >> 20) > (offset >> 20))
 		dbg_msg("Image download from OLT: %d/%d MB received\n",
 			image->offset >> 20, image->size >> 20);
 
 	error = PON_ADAPTER_SUCCESS;
 
 exit:
+	if (error == PON_ADAPTER_SUCCESS && ctx->image.stats &&
+	    pon_img_stats_window(ctx->image.stats, length, ctx->image.offset,
+				 start))
+		image_progress_event(ctx);
+
 	dbg_out_ret("%d", error);
 	return error;
 }
 
-static char part_get(const uint8_t id)
+/* The bank already holds the last completed image, it is only marked */
+static enum pon_adapter_errno image_bank_mark(struct pon_img_context *ctx,
+					      const char part)
 {
-	switch (id) {
-	case 0:
-		return 'A';
-	case 1:
-		return 'B';
-	default:
-		dbg_err("OMCI specified wrong partition number! Using default.\n");
-		return 'A';
+	struct pon_image_info *image = &ctx->image;
+	enum pon_adapter_errno ret;
+
+	/* all variables are written with one environment update */
+	ret = pon_uboot_txn_begin(ctx);
+	if (ret != PON_ADAPTER_SUCCESS)
+		return ret;
+
+	ret = image->version[0] ?
+		pon_img_version_set(ctx, part, image->version) :
+		PON_ADAPTER_SUCCESS;
+	if (ret == PON_ADAPTER_SUCCESS)
+		ret = pon_img_valid_set(ctx, part, true);
+	if (ret == PON_ADAPTER_SUCCESS)
+		ret = pon_img_ident_set(ctx, part, image->ident);
+	if (ret != PON_ADAPTER_SUCCESS) {
+		pon_uboot_txn_abort(ctx);
+		return ret;
+	}
+
+	ret = pon_uboot_txn_commit(ctx);
+	if (ret != PON_ADAPTER_SUCCESS)
+		return ret;
+
+	dbg_msg("bank %c stored, version %s\n", part, image->version);
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* The volumes are already written, only the bank is marked */
+static enum pon_adapter_errno image_direct_store(struct pon_img_context *ctx,
+						 const char part)
+{
+	enum pon_adapter_errno ret;
+
+	ret = image_bank_mark(ctx, part);
+	if (ret == PON_ADAPTER_SUCCESS)
+		ctx->image.direct_ready = 0;
+
+	return ret;
+}
+
+/* Identity of the image file, NULL if it is not the last completed
+ * download
+ */
+static const char *image_ident(struct pon_img_context *ctx,
+			       const char *filepath)
+{
+	struct pon_image_info *image = &ctx->image;
+	const char *path = image->stored[0] ? image->stored : image->path;
+
+	if (!filepath || !image->ident[0] || strcmp(filepath, path) != 0)
+		return NULL;
+
+	return image->ident;
+}
+
+/* Check if the identity recorded for the bank is the one of the image */
+static bool image_in_bank(struct pon_img_context *ctx, const char part,
+			  const char *ident)
+{
+	char current[UBOOT_VAL_LEN_MAX + 1];
+
+	if (pon_img_ident_get(ctx, part, current, sizeof(current)) !=
+	    PON_ADAPTER_SUCCESS)
+		return false;
+
+	return strcmp(current, ident) == 0;
+}
+
+/* Check if the volumes of the bank already hold all sub-images of the
+ * image file, the bank variables may have been lost or not yet written
+ */
+static bool image_parts_in_bank(struct pon_img_context *ctx, const char part,
+				const char *filepath)
+{
+	struct pon_img_bank *bank;
+	bool present = false;
+
+	if (pon_img_bank_open(&bank, part, ctx->dl_bank_dir) !=
+	    PON_ADAPTER_SUCCESS)
+		return false;
+
+	if (pon_img_bank_check_file(bank, filepath, &present) !=
+	    PON_ADAPTER_SUCCESS)
+		present = false;
+	pon_img_bank_close(bank);
+
+	return present;
+}
+
+/* The digest is passed on if the file is the last completed download */
+static enum pon_adapter_errno image_upgrade(struct pon_img_context *ctx,
+					    const char id,
+					    const char *filepath)
+{
+	struct pon_image_info *image = &ctx->image;
+	const char *path = image->stored[0] ? image->stored : image->path;
+
+	if (ctx->dl_native_write && filepath)
+		return pon_img_upgrade_native(ctx, id, filepath,
+					      ctx->dl_bank_dir);
+
+	if (!filepath || !image->sha256[0] || strcmp(filepath, path) != 0)
+		return pon_img_upgrade(ctx, id, filepath);
+
+	return pon_img_upgrade_digest(ctx, id, filepath, image->sha256,
+				      image->sha384[0] ? image->sha384 : NULL);
+}
+
+/* Write the image into the bank, the blocking part of store() */
+static enum pon_adapter_errno image_store(struct pon_img_context *ctx,
+					  const uint8_t id,
+					  const char *filepath)
+{
+	const char part = part_get(id);
+	enum pon_adapter_errno ret;
+	const char *ident;
+	bool recorded;
+
+	if (ctx->image.direct_ready && ctx->image.direct_ready == part)
+		return image_direct_store(ctx, part);
+
+	/* a repeated store of the same image does not write it again. The
+	 * recorded identity is only a hint, the volumes may have been
+	 * written by another tool since, they are read to confirm it.
+	 */
+	ident = image_ident(ctx, filepath);
+	recorded = ident && image_in_bank(ctx, part, ident);
+
+	/* the bank may also hold the image while its variables were lost.
+	 * Without a recorded identity only the native writer checks this,
+	 * it reads the volumes anyway to write only the changed sub-images.
+	 * The upgrade daemon writes the whole image, the read back would
+	 * mostly delay it.
+	 */
+	if ((recorded || (ident && ctx->dl_native_write)) &&
+	    image_parts_in_bank(ctx, part, filepath)) {
+		dbg_msg("bank %c already holds the image\n", part);
+		return image_bank_mark(ctx, part);
+	}
+	if (recorded)
+		dbg_wrn("bank %c does not hold the recorded image\n", part);
+
+	/* the stored image must not be removed during the upgrade */
+	if (ctx->image.store && filepath &&
+	    pon_img_store_get(ctx->image.store, filepath) ==
+		    PON_ADAPTER_SUCCESS) {
+		ret = image_upgrade(ctx, part, filepath);
+		pon_img_store_put(ctx->image.store, filepath);
+	} else {
+		ret = image_upgrade(ctx, part, filepath);
+	}
+
+	if (ret == PON_ADAPTER_SUCCESS && ident &&
+	    pon_img_ident_set(ctx, part, ident) != PON_ADAPTER_SUCCESS)
+		dbg_wrn("identity of bank %c not recorded\n", part);
+
+	return ret;
+}
+
+/* Asynchronous store, run by the worker thread of the context */
+static enum pon_adapter_errno image_store_run(struct pon_img_context *ctx,
+					      struct pon_img_async_req *req)
+{
+	struct pon_img_store_done done = {
+		.id = req->bank == 'B' ? 1 : 0,
+	};
+
+	done.result = image_store(ctx, done.id,
+				  req->path[0] ? req->path : NULL);
+	dbg_msg("image %u stored: %d\n", done.id, done.result);
+
+	if (ctx->event_cb)
+		ctx->event_cb(ctx->event_priv, PON_IMG_EVENT_STORE_DONE, &done);
+
+	return done.result;
+}
+
+/* Queue the store, the action is acknowledged before the image is
+ * written
+ */
+static enum pon_adapter_errno image_store_async(struct pon_img_context *ctx,
+						const uint8_t id,
+						const uint8_t filepath_size,
+						const char *filepath)
+{
+	struct pon_img_async_req *req;
+	size_t len;
+
+	req = pon_img_async_req_alloc(image_store_run, NULL, NULL);
+	if (!req)
+		return PON_ADAPTER_ERR_NO_MEMORY;
+
+	req->bank = part_get(id);
+	req->reported = true;
+	if (filepath) {
+		len = strnlen_s(filepath, filepath_size);
+		if (len >= sizeof(req->path) ||
+		    (len && strncpy_s(req->path, sizeof(req->path), filepath,
+				      len))) {
+			free(req);
+			return PON_ADAPTER_ERR_SIZE;
+		}
 	}
+
+	return pon_img_async_submit(ctx, req, NULL);
 }
 
 static enum pon_adapter_errno store(void *ll_handle,
@@ -330,8 +1967,24 @@ static enum pon_adapter_errno store(void *ll_handle,
 
 	dbg_in_args("%p, %u, %u, %p", ll_handle, id, filepath_size, filepath);
 
-	ret = pon_img_upgrade(ctx, part_get(id), filepath);
+	if (!ctx) {
+		ret = PON_ADAPTER_ERR_PTR_INVALID;
+		goto exit;
+	}
+
+	/* a previous asynchronous store must be finished */
+	if (pon_img_async_busy(ctx)) {
+		dbg_err("image is still being stored\n");
+		ret = PON_ADAPTER_ERR_RESOURCE_EXISTS;
+		goto exit;
+	}
+
+	if (ctx->dl_async_store)
+		ret = image_store_async(ctx, id, filepath_size, filepath);
+	else
+		ret = image_store(ctx, id, filepath);
 
+exit:
 	dbg_out_ret("%d", ret);
 	return ret;
 }
@@ -8,10 +8,16 @@
  *
  *****************************************************************************/
 
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
 #include <libubox/blobmsg.h>
 #include <pon_adapter_config.h>
 
@@ -29,6 +35,9 @@
 #include "pon_img_common.h"
 #include "pon_uboot.h"
 #include "pon_img_debug.h"
+#include "pon_img_stats.h"
+#include "pon_img_async.h"
+#include "pon_img_bank.h"
 
 #define DEFAULT_VERSION "0.0"
 
@@ -67,28 +76,118 @@ static const char *get_id_str(char id)
 	return get_id_bool(id) ? "B" : "A";
 }
 
+/* Copy inside the kernel as a reflink, this shares the data blocks */
+static int copy_reflink(int out_fd, int in_fd)
+{
+#ifdef FICLONE
+	return ioctl(out_fd, FICLONE, in_fd);
+#else
+	(void)out_fd;
+	(void)in_fd;
+	errno = EOPNOTSUPP;
+	return -1;
+#endif
+}
+
+static ssize_t copy_range(int out_fd, int in_fd, size_t len)
+{
+#ifdef SYS_copy_file_range
+	return syscall(SYS_copy_file_range, in_fd, NULL, out_fd, NULL, len, 0);
+#else
+	(void)out_fd;
+	(void)in_fd;
+	(void)len;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/* Copy inside the kernel, without passing the data through user space.
+ * Only an error on the first call allows to fall back to another method,
+ * this is returned as 1.
+ */
+static int copy_kernel(int out_fd, int in_fd, off_t size, bool splice)
+{
+	off_t done = 0;
+	ssize_t ret;
+
+	while (done < size) {
+		if (splice)
+			ret = sendfile(out_fd, in_fd, NULL, size - done);
+		else
+			ret = copy_range(out_fd, in_fd, size - done);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0)
+			return done ? -1 : 1;
+		/* file shrunk while copying */
+		if (ret == 0)
+			return -1;
+		done += ret;
+	}
+
+	return 0;
+}
+
+static int copy_buffered(int out_fd, int in_fd)
+{
+	char buf[65536];
+	ssize_t ret, len, done;
+
+	while (1) {
+		len = read(in_fd, &buf[0], sizeof(buf));
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len <= 0)
+			return len;
+		for (done = 0; done < len; done += ret) {
+			ret = write(out_fd, &buf[done], len - done);
+			if (ret < 0 && errno == EINTR)
+				ret = 0;
+			else if (ret < 0)
+				return -1;
+		}
+	}
+}
+
 static int copy_file(const char *dest_file, const char *src_file)
 {
 	int in_fd = -1, out_fd = -1;
-	char buf[8192];
+	struct stat st;
 	int ret = -1;
 
 	in_fd = open(src_file, O_RDONLY);
 	if (in_fd < 0)
 		goto exit;
+	if (fstat(in_fd, &st))
+		goto exit;
 	out_fd = open(dest_file, O_CREAT | O_WRONLY | O_TRUNC, 0600);
 	if (out_fd < 0)
 		goto exit;
 
-	while (1) {
-		ret = read(in_fd, &buf[0], sizeof(buf));
-		if (ret <= 0)
-			break;
-		ret = write(out_fd, &buf[0], ret);
-		if (ret < 0)
-			break;
+	ret = copy_reflink(out_fd, in_fd);
+	if (ret == 0) {
+		dbg_msg("image %s cloned\n", src_file);
+		goto exit;
 	}
 
+	ret = copy_kernel(out_fd, in_fd, st.st_size, false);
+	if (ret <= 0) {
+		if (ret == 0)
+			dbg_msg("image %s copied with copy_file_range\n",
+				src_file);
+		goto exit;
+	}
+
+	ret = copy_kernel(out_fd, in_fd, st.st_size, true);
+	if (ret <= 0) {
+		if (ret == 0)
+			dbg_msg("image %s copied with sendfile\n", src_file);
+		goto exit;
+	}
+
+	ret = copy_buffered(out_fd, in_fd);
+
 exit:
 	if (in_fd >= 0)
 		close(in_fd);
@@ -97,6 +196,34 @@ exit:
 	return ret;
 }
 
+/* Hand the image over to the fixed path which is used by the upgrade
+ * daemon. A hard link on the same file system avoids any copy, otherwise
+ * the data is copied inside the kernel if possible.
+ */
+static int image_handoff(const char *dest_file, const char *src_file)
+{
+	struct stat src_st, dest_st;
+
+	if (stat(src_file, &src_st))
+		return -1;
+
+	if (stat(dest_file, &dest_st) == 0) {
+		if (src_st.st_dev == dest_st.st_dev &&
+		    src_st.st_ino == dest_st.st_ino)
+			return 0;
+		if (unlink(dest_file))
+			return -1;
+	}
+
+	if (link(src_file, dest_file) == 0) {
+		dbg_msg("image %s linked\n", src_file);
+		return 0;
+	}
+
+	/* the source stays in place, it may be a stored image */
+	return copy_file(dest_file, src_file);
+}
+
 static const struct blobmsg_policy retval_get_policy[] = {
 	{ .name = "retval", .type = BLOBMSG_TYPE_INT32 },
 	{ .name = "write_retval", .type = BLOBMSG_TYPE_INT32 },
@@ -127,23 +254,78 @@ void retval_get(struct ubus_request *req, int type, struct blob_attr *msg)
 	}
 }
 
+/* Mark the variable of a bank, like img_validA, as changed */
+static void uboot_bank_invalidate(struct pon_img_context *ctx,
+				  const char *prefix, const char id)
+{
+	char var[UBOOT_VAL_LEN_MAX];
+
+	snprintf(var, UBOOT_VAL_LEN_MAX, "%s%s", prefix, get_id_str(id));
+	pon_uboot_cache_invalidate(ctx, var);
+}
+
+/* The bank does not hold the recorded image anymore, it is marked as
+ * invalid and its identity is cleared with one environment update. The
+ * bank is not written if this fails, a later store of the same image
+ * would find the old identity and skip the write.
+ */
+static enum pon_adapter_errno img_upgrade_prepare(struct pon_img_context *ctx,
+						  const char id)
+{
+	enum pon_adapter_errno ret;
+
+	ret = pon_uboot_txn_begin(ctx);
+	if (ret != PON_ADAPTER_SUCCESS)
+		goto exit;
+
+	ret = pon_img_valid_set(ctx, id, false);
+	if (ret == PON_ADAPTER_SUCCESS)
+		ret = pon_img_ident_set(ctx, id, "");
+	if (ret == PON_ADAPTER_SUCCESS)
+		ret = pon_uboot_txn_commit(ctx);
+	else
+		pon_uboot_txn_abort(ctx);
+
+exit:
+	if (ret != PON_ADAPTER_SUCCESS)
+		dbg_err("identity of bank %c not cleared: %d\n", id, ret);
+	return ret;
+}
+
 enum pon_adapter_errno pon_img_upgrade(struct pon_img_context *ctx,
 				       const char id, const char *filename)
+{
+	return pon_img_upgrade_digest(ctx, id, filename, NULL, NULL);
+}
+
+enum pon_adapter_errno pon_img_upgrade_digest(struct pon_img_context *ctx,
+					      const char id,
+					      const char *filename,
+					      const char *sha256,
+					      const char *sha384)
 {
 	int err;
 	struct blob_buf req = {0, };
 	uint32_t retval = 0;
+	const char *path, *name;
 
-	dbg_in_args("%c, %p", id, filename);
+	dbg_in_args("%c, %p, %p, %p", id, filename, sha256, sha384);
 
 	if (ctx->ubus_reboot_only)
 		return PON_ADAPTER_ERROR;
 
+	if (img_upgrade_prepare(ctx, id) != PON_ADAPTER_SUCCESS)
+		return PON_ADAPTER_ERROR;
+
+	path = ctx->upgrade_path ? ctx->upgrade_path : SWIMAGE_PATH;
+	name = strrchr(path, '/');
+	name = name ? name + 1 : path;
+
 	/* is the file in the expected location? */
-	if (strcmp(SWIMAGE_PATH, filename) != 0) {
-		err = copy_file(SWIMAGE_PATH, filename);
+	if (strcmp(path, filename) != 0) {
+		err = image_handoff(path, filename);
 		if (err < 0) {
-			dbg_err_fn_ret(copy_file, err);
+			dbg_err_fn_ret(image_handoff, err);
 			return PON_ADAPTER_ERROR;
 		}
 	}
@@ -151,7 +333,12 @@ enum pon_adapter_errno pon_img_upgrade(struct pon_img_context *ctx,
 	blob_buf_init(&req, 0);
 	blobmsg_add_u8(&req, "noreboot", 1);
 	blobmsg_add_string(&req, "bank", get_id_str(id));
-	blobmsg_add_string(&req, "image_name", SWIMAGE_NAME);
+	blobmsg_add_string(&req, "image_name", name);
+	/* the hash is checked without reading the image again */
+	if (sha256)
+		blobmsg_add_string(&req, "sha256", sha256);
+	if (sha384)
+		blobmsg_add_string(&req, "sha384", sha384);
 
 	err = ctx->pa_config->ubus_call(ctx->hl_handle,
 					ctx->ubus_path, UBUS_METHOD_UPGRADE,
@@ -167,15 +354,80 @@ enum pon_adapter_errno pon_img_upgrade(struct pon_img_context *ctx,
 			ctx->ubus_path, UBUS_METHOD_UPGRADE, retval);
 		return PON_ADAPTER_ERROR;
 	}
-	/* The "upgrade" call will also change U-Boot variables,
-	 * so drop current values from cache.
+	/* The "upgrade" call also changes the U-Boot variables of the
+	 * bank. The next read of one of them reads all variables again.
 	 */
-	ctx->last_ubus_ubootvars = 0;
+	uboot_bank_invalidate(ctx, UBOOT_VAR_IMG_VALID, id);
+	uboot_bank_invalidate(ctx, UBOOT_VAR_IMG_VERSION, id);
 
 	dbg_out_ret("%d", PON_ADAPTER_SUCCESS);
 	return PON_ADAPTER_SUCCESS;
 }
 
+enum pon_adapter_errno pon_img_upgrade_native(struct pon_img_context *ctx,
+					      const char id,
+					      const char *filename,
+					      const char *dir)
+{
+	char version[UBOOT_VAL_LEN_MAX + 1] = "";
+	struct pon_img_bank *bank = NULL;
+	enum pon_adapter_errno ret;
+	bool active = true;
+
+	dbg_in_args("%c, %s, %s", id, filename, dir ? dir : "flash");
+
+	ret = pon_img_active_get(ctx, id, &active);
+	if (ret != PON_ADAPTER_SUCCESS)
+		goto exit;
+	if (active) {
+		dbg_err("bank %c is active and can not be written\n", id);
+		ret = PON_ADAPTER_ERR_NOT_SUPPORTED;
+		goto exit;
+	}
+
+	ret = img_upgrade_prepare(ctx, id);
+	if (ret != PON_ADAPTER_SUCCESS)
+		goto exit;
+
+	ret = pon_img_bank_open(&bank, id, dir);
+	if (ret != PON_ADAPTER_SUCCESS)
+		goto exit;
+
+	ret = pon_img_bank_write_file(bank, filename, version,
+				      sizeof(version));
+	if (ret != PON_ADAPTER_SUCCESS)
+		goto exit;
+
+	/* both variables are written with one environment update */
+	ret = pon_uboot_txn_begin(ctx);
+	if (ret != PON_ADAPTER_SUCCESS)
+		goto exit;
+	ret = pon_img_version_set(ctx, id, version);
+	if (ret == PON_ADAPTER_SUCCESS)
+		ret = pon_img_valid_set(ctx, id, true);
+	if (ret != PON_ADAPTER_SUCCESS) {
+		pon_uboot_txn_abort(ctx);
+		goto exit;
+	}
+	ret = pon_uboot_txn_commit(ctx);
+
+exit:
+	pon_img_bank_close(bank);
+	dbg_out_ret("%d", ret);
+	return ret;
+}
+
+enum pon_adapter_errno pon_img_dl_stats_get(struct pon_img_context *ctx,
+					    struct pon_img_dl_stats *stats)
+{
+	if (!ctx || !stats)
+		return PON_ADAPTER_ERR_PTR_INVALID;
+	if (!pon_img_stats_get(ctx->stats, stats))
+		return PON_ADAPTER_ERR_RESOURCE_NOT_FOUND;
+
+	return PON_ADAPTER_SUCCESS;
+}
+
 enum pon_adapter_errno pon_img_active_set(struct pon_img_context *ctx,
 					  const char id)
 {
@@ -208,20 +460,130 @@ enum pon_adapter_errno pon_img_active_set(struct pon_img_context *ctx,
 		return PON_ADAPTER_ERROR;
 	}
 
-	/* This call will change an U-Boot variable,
-	 * so drop current values from cache.
+	/* This call changes the activation variables. The next read of one
+	 * of them reads all variables again.
 	 */
-	ctx->last_ubus_ubootvars = 0;
+	pon_uboot_cache_invalidate(ctx, UBOOT_VAR_IMG_ACTIVATE);
+	pon_uboot_cache_invalidate(ctx, UBOOT_VAR_IMG_ACTIVE);
 
 exit:
 	dbg_out_ret("%d", ret);
 	return ret;
 }
 
+/* Variables of pon_img_state_get, the per bank ones for A and B */
+enum img_state_var {
+	IMG_STATE_ACTIVE,
+	IMG_STATE_COMMIT,
+	IMG_STATE_ACTIVATE,
+	IMG_STATE_VALID,
+	IMG_STATE_VERSION = IMG_STATE_VALID + PON_IMG_BANKS,
+	IMG_STATE_VARS = IMG_STATE_VERSION + PON_IMG_BANKS
+};
+
+static const char * const img_state_names[IMG_STATE_VARS] = {
+	[IMG_STATE_ACTIVE] = UBOOT_VAR_IMG_ACTIVE,
+	[IMG_STATE_COMMIT] = UBOOT_VAR_IMG_COMMIT,
+	[IMG_STATE_ACTIVATE] = UBOOT_VAR_IMG_ACTIVATE,
+	[IMG_STATE_VALID] = UBOOT_VAR_IMG_VALID "A",
+	[IMG_STATE_VALID + 1] = UBOOT_VAR_IMG_VALID "B",
+	[IMG_STATE_VERSION] = UBOOT_VAR_IMG_VERSION "A",
+	[IMG_STATE_VERSION + 1] = UBOOT_VAR_IMG_VERSION "B",
+};
+
+enum pon_adapter_errno pon_img_state_get(struct pon_img_context *ctx,
+					 struct pon_img_state *state)
+{
+	char val[IMG_STATE_VARS][UBOOT_VAL_LEN_MAX + 1];
+	struct pon_img_bank_state *bank;
+	enum pon_adapter_errno ret;
+	const char *id;
+	int i;
+
+	dbg_in_args("%p, %p", ctx, state);
+
+	if (!state) {
+		ret = PON_ADAPTER_ERR_PTR_INVALID;
+		goto exit;
+	}
+
+	ret = pon_uboot_get_multi(ctx, img_state_names, val, IMG_STATE_VARS);
+	if (ret != PON_ADAPTER_SUCCESS)
+		goto exit;
+
+	memset(state, 0, sizeof(*state));
+	for (i = 0; i < PON_IMG_BANKS; i++) {
+		bank = &state->bank[i];
+		id = get_id_str((char)i);
+
+		if (val[IMG_STATE_ACTIVE][0]) {
+			bank->present |= PON_IMG_STATE_ACTIVE;
+			bank->active = strcmp(id, val[IMG_STATE_ACTIVE]) == 0;
+		}
+		if (val[IMG_STATE_COMMIT][0]) {
+			bank->present |= PON_IMG_STATE_COMMITTED;
+			bank->committed =
+				strcmp(id, val[IMG_STATE_COMMIT]) == 0;
+		}
+		if (val[IMG_STATE_ACTIVATE][0]) {
+			bank->present |= PON_IMG_STATE_ACTIVATE;
+			bank->activate_pending =
+				strcmp(id, val[IMG_STATE_ACTIVATE]) == 0;
+		}
+		if (val[IMG_STATE_VALID + i][0]) {
+			bank->present |= PON_IMG_STATE_VALID;
+			bank->valid =
+				strcmp("true", val[IMG_STATE_VALID + i]) == 0;
+		}
+		/*
+		 * Set version to 0.0 if version field is empty. This is a
+		 * workaround for some systems which do not store an image
+		 * version like URX. Some OLTs need a version.
+		 */
+		if (val[IMG_STATE_VERSION + i][0]) {
+			bank->present |= PON_IMG_STATE_VERSION;
+			memcpy(bank->version, val[IMG_STATE_VERSION + i],
+			       sizeof(bank->version));
+		} else {
+			memcpy(bank->version, DEFAULT_VERSION,
+			       sizeof(DEFAULT_VERSION));
+		}
+	}
+
+exit:
+	dbg_out_ret("%d", ret);
+	return ret;
+}
+
+/* State of one bank for the single value getters, which fail like a
+ * direct read of the U-Boot variable if it is not set
+ */
+static enum pon_adapter_errno img_bank_state_get(struct pon_img_context *ctx,
+						 const char id,
+						 uint8_t present,
+						 struct pon_img_bank_state *bank)
+{
+	struct pon_img_state state;
+	enum pon_adapter_errno ret;
+
+	ret = pon_img_state_get(ctx, &state);
+	if (ret != PON_ADAPTER_SUCCESS)
+		return ret;
+
+	*bank = state.bank[get_id_bool(id)];
+	if (!(bank->present & present)) {
+		dbg_err("U-Boot state 0x%x of bank %s not found\n", present,
+			get_id_str(id));
+		return PON_ADAPTER_ERR_RESOURCE_NOT_FOUND;
+	}
+
+	return PON_ADAPTER_SUCCESS;
+}
+
 enum pon_adapter_errno pon_img_active_get(struct pon_img_context *ctx,
 					  const char id, bool *active)
 {
-	char uboot_val[UBOOT_VAL_LEN_MAX];
+	struct pon_img_bank_state bank;
 	enum pon_adapter_errno ret = PON_ADAPTER_ERROR;
 
 	dbg_in_args("%c, %p", id, active);
@@ -229,27 +591,11 @@ enum pon_adapter_errno pon_img_active_get(struct pon_img_context *ctx,
 	if (!active)
 		goto exit;
 
-	ret = pon_uboot_get(ctx, UBOOT_VAR_IMG_ACTIVE, uboot_val,
-			    sizeof(uboot_val));
+	ret = img_bank_state_get(ctx, id, PON_IMG_STATE_ACTIVE, &bank);
 	if (ret != PON_ADAPTER_SUCCESS)
 		goto exit;
 
-	/*
-	 * If the variable active_bank is not set, assume that the first
-	 * image (A) is active. This is a workaround for some systems which
-	 * do not store an image version like URX. Some OLTs need a version.
-	 */
-	if (strnlen_s(uboot_val, sizeof(uboot_val)) == 0) {
-		if (strcmp(get_id_str(id), "A"))
-			*active = true;
-		else
-			*active = false;
-	} else {
-		if (strcmp(get_id_str(id), uboot_val) == 0)
-			*active = true;
-		else
-			*active = false;
-	}
+	*active = bank.active;
 
 exit:
 	dbg_out_ret("%d", ret);
@@ -280,7 +626,7 @@ exit:
 enum pon_adapter_errno pon_img_commit_get(struct pon_img_context *ctx,
 					  const char id, bool *committed)
 {
-	char uboot_val[UBOOT_VAL_LEN_MAX];
+	struct pon_img_bank_state bank;
 	enum pon_adapter_errno ret = PON_ADAPTER_ERROR;
 
 	dbg_in_args("%c, %p", id, committed);
@@ -288,15 +634,11 @@ enum pon_adapter_errno pon_img_commit_get(struct pon_img_context *ctx,
 	if (!committed)
 		goto exit;
 
-	ret = pon_uboot_get(ctx, UBOOT_VAR_IMG_COMMIT, uboot_val,
-			    sizeof(uboot_val));
+	ret = img_bank_state_get(ctx, id, PON_IMG_STATE_COMMITTED, &bank);
 	if (ret != PON_ADAPTER_SUCCESS)
 		goto exit;
 
-	if (strcmp(get_id_str(id), uboot_val) == 0)
-		*committed = true;
-	else
-		*committed = false;
+	*committed = bank.committed;
 
 exit:
 	dbg_out_ret("%d", ret);
@@ -330,8 +672,7 @@ enum pon_adapter_errno pon_img_version_get(struct pon_img_context *ctx,
 					   const char id, char *buff,
 					   const uint8_t len)
 {
-	char var[UBOOT_VAL_LEN_MAX];
-	char uboot_val[UBOOT_VAL_LEN_MAX] = { 0 };
+	struct pon_img_bank_state bank;
 	enum pon_adapter_errno ret = PON_ADAPTER_ERROR;
 	size_t count;
 
@@ -342,26 +683,13 @@ enum pon_adapter_errno pon_img_version_get(struct pon_img_context *ctx,
 
 	memset(buff, 0, len);
 
-	snprintf(var, UBOOT_VAL_LEN_MAX, "%s%c", UBOOT_VAR_IMG_VERSION, id);
-
-	ret = pon_uboot_get(ctx, var, uboot_val, sizeof(uboot_val));
+	ret = img_bank_state_get(ctx, id, PON_IMG_STATE_VERSION, &bank);
 	if (ret != PON_ADAPTER_SUCCESS)
 		goto exit;
 
-	/*
-	 * Set version to 0.0 if version field is empty. This is a workaround
-	 * for some systems which do not store an image version like URX.
-	 * Some OLTs need a version.
-	 */
-	if (strnlen_s(uboot_val, sizeof(uboot_val)) == 0) {
-		count = min(sizeof(DEFAULT_VERSION), len);
-		if (memcpy_s(buff, len, DEFAULT_VERSION, count))
-			ret = PON_ADAPTER_ERR_MEM_ACCESS;
-	} else {
-		count = min(sizeof(uboot_val), len);
-		if (memcpy_s(buff, len, uboot_val, count))
-			ret = PON_ADAPTER_ERR_MEM_ACCESS;
-	}
+	count = min(sizeof(bank.version), len);
+	if (memcpy_s(buff, len, bank.version, count))
+		ret = PON_ADAPTER_ERR_MEM_ACCESS;
 	if (count < len)
 		buff[count] = '\x00';
 
@@ -390,11 +718,58 @@ enum pon_adapter_errno pon_img_valid_set(struct pon_img_context *ctx,
 	return PON_ADAPTER_SUCCESS;
 }
 
+enum pon_adapter_errno pon_img_ident_set(struct pon_img_context *ctx,
+					 const char id, const char *ident)
+{
+	char var[UBOOT_VAL_LEN_MAX];
+	enum pon_adapter_errno ret;
+
+	dbg_in_args("%c %s", id, ident);
+
+	snprintf(var, UBOOT_VAL_LEN_MAX, "%s%c", UBOOT_VAR_IMG_IDENT, id);
+
+	ret = pon_uboot_set_str(ctx, var, ident);
+	if (ret != PON_ADAPTER_SUCCESS)
+		dbg_err_fn_ret(pon_uboot_set_str, ret);
+
+	dbg_out_ret("%d", ret);
+	return ret;
+}
+
+enum pon_adapter_errno pon_img_ident_get(struct pon_img_context *ctx,
+					 const char id, char *ident,
+					 size_t size)
+{
+	char val[1][UBOOT_VAL_LEN_MAX + 1];
+	char var[UBOOT_VAL_LEN_MAX];
+	const char *name = var;
+	enum pon_adapter_errno ret;
+
+	dbg_in_args("%c %p %zu", id, ident, size);
+
+	if (!ident || !size) {
+		ret = PON_ADAPTER_ERR_PTR_INVALID;
+		goto exit;
+	}
+
+	snprintf(var, UBOOT_VAL_LEN_MAX, "%s%c", UBOOT_VAR_IMG_IDENT, id);
+
+	/* a variable which is not set reads as an empty string */
+	ret = pon_uboot_get_multi(ctx, &name, val, 1);
+	if (ret != PON_ADAPTER_SUCCESS)
+		goto exit;
+
+	snprintf(ident, size, "%s", val[0]);
+
+exit:
+	dbg_out_ret("%d", ret);
+	return ret;
+}
+
 enum pon_adapter_errno pon_img_valid_get(struct pon_img_context *ctx,
 					 const char id, bool *valid)
 {
-	char var[UBOOT_VAL_LEN_MAX];
-	char uboot_val[UBOOT_VAL_LEN_MAX];
+	struct pon_img_bank_state bank;
 	enum pon_adapter_errno ret = PON_ADAPTER_ERROR;
 
 	dbg_in_args("%c", id);
@@ -402,20 +777,190 @@ enum pon_adapter_errno pon_img_valid_get(struct pon_img_context *ctx,
 	if (!valid)
 		goto exit;
 
-	snprintf(var, UBOOT_VAL_LEN_MAX, "%s%c", UBOOT_VAR_IMG_VALID, id);
-
-	ret = pon_uboot_get(ctx, var, uboot_val, sizeof(uboot_val));
+	ret = img_bank_state_get(ctx, id, PON_IMG_STATE_VALID, &bank);
 	if (ret != PON_ADAPTER_SUCCESS)
 		goto exit;
 
-	if (strcmp("true", uboot_val) == 0)
-		*valid = true;
-	else
-		*valid = false;
+	*valid = bank.valid;
+
+exit:
+	dbg_out_ret("%d", ret);
+	return ret;
+}
+
+static enum pon_adapter_errno
+img_upgrade_run(struct pon_img_context *ctx, struct pon_img_async_req *req)
+{
+	return pon_img_upgrade_digest(ctx, req->bank, req->path,
+				      req->sha256[0] ? req->sha256 : NULL,
+				      req->sha384[0] ? req->sha384 : NULL);
+}
+
+/* Copy an optional string argument of an asynchronous call */
+static enum pon_adapter_errno img_async_str(char *dst, size_t size,
+					    const char *src)
+{
+	size_t len;
+
+	if (!src)
+		return PON_ADAPTER_SUCCESS;
+
+	len = strnlen_s(src, size);
+	if (len >= size || strncpy_s(dst, size, src, len))
+		return PON_ADAPTER_ERR_SIZE;
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+enum pon_adapter_errno pon_img_upgrade_async(struct pon_img_context *ctx,
+					     const char id,
+					     const char *filename,
+					     const char *sha256,
+					     const char *sha384,
+					     pon_img_async_cb cb, void *priv,
+					     uint32_t *req_id)
+{
+	struct pon_img_async_req *req;
+	enum pon_adapter_errno ret;
+
+	dbg_in_args("%c, %s, %p, %p", id, filename, sha256, sha384);
+
+	if (!filename) {
+		ret = PON_ADAPTER_ERR_PTR_INVALID;
+		goto exit;
+	}
+
+	req = pon_img_async_req_alloc(img_upgrade_run, cb, priv);
+	if (!req) {
+		ret = PON_ADAPTER_ERR_NO_MEMORY;
+		goto exit;
+	}
+	req->bank = id;
+	ret = img_async_str(req->path, sizeof(req->path), filename);
+	if (ret == PON_ADAPTER_SUCCESS)
+		ret = img_async_str(req->sha256, sizeof(req->sha256), sha256);
+	if (ret == PON_ADAPTER_SUCCESS)
+		ret = img_async_str(req->sha384, sizeof(req->sha384), sha384);
+	if (ret != PON_ADAPTER_SUCCESS) {
+		free(req);
+		goto exit;
+	}
+
+	ret = pon_img_async_submit(ctx, req, req_id);
 
 exit:
 	dbg_out_ret("%d", ret);
 	return ret;
 }
 
+static enum pon_adapter_errno
+img_active_set_run(struct pon_img_context *ctx, struct pon_img_async_req *req)
+{
+	return pon_img_active_set(ctx, req->bank);
+}
+
+static enum pon_adapter_errno
+img_commit_set_run(struct pon_img_context *ctx, struct pon_img_async_req *req)
+{
+	return pon_img_commit_set(ctx, req->bank);
+}
+
+static enum pon_adapter_errno
+img_version_set_run(struct pon_img_context *ctx, struct pon_img_async_req *req)
+{
+	return pon_img_version_set(ctx, req->bank, req->str);
+}
+
+static enum pon_adapter_errno
+img_valid_set_run(struct pon_img_context *ctx, struct pon_img_async_req *req)
+{
+	return pon_img_valid_set(ctx, req->bank, req->flag);
+}
+
+static enum pon_adapter_errno
+img_state_get_run(struct pon_img_context *ctx, struct pon_img_async_req *req)
+{
+	return pon_img_state_get(ctx, req->data);
+}
+
+/* Queue a call which takes the bank and at most one other argument */
+static enum pon_adapter_errno img_async_bank(struct pon_img_context *ctx,
+					     pon_img_async_fn fn,
+					     const char id, const char *str,
+					     bool flag, void *data,
+					     pon_img_async_cb cb, void *priv,
+					     uint32_t *req_id)
+{
+	struct pon_img_async_req *req;
+	enum pon_adapter_errno ret;
+
+	req = pon_img_async_req_alloc(fn, cb, priv);
+	if (!req)
+		return PON_ADAPTER_ERR_NO_MEMORY;
+
+	req->bank = id;
+	req->flag = flag;
+	req->data = data;
+	ret = img_async_str(req->str, sizeof(req->str), str);
+	if (ret != PON_ADAPTER_SUCCESS) {
+		free(req);
+		return ret;
+	}
+
+	return pon_img_async_submit(ctx, req, req_id);
+}
+
+enum pon_adapter_errno pon_img_active_set_async(struct pon_img_context *ctx,
+						const char id,
+						pon_img_async_cb cb,
+						void *priv, uint32_t *req)
+{
+	return img_async_bank(ctx, img_active_set_run, id, NULL, false, NULL,
+			      cb, priv, req);
+}
+
+enum pon_adapter_errno pon_img_commit_set_async(struct pon_img_context *ctx,
+						const char id,
+						pon_img_async_cb cb,
+						void *priv, uint32_t *req)
+{
+	return img_async_bank(ctx, img_commit_set_run, id, NULL, false, NULL,
+			      cb, priv, req);
+}
+
+enum pon_adapter_errno pon_img_version_set_async(struct pon_img_context *ctx,
+						 const char id,
+						 const char *buff,
+						 pon_img_async_cb cb,
+						 void *priv, uint32_t *req)
+{
+	if (!buff)
+		return PON_ADAPTER_ERR_PTR_INVALID;
+
+	return img_async_bank(ctx, img_version_set_run, id, buff, false, NULL,
+			      cb, priv, req);
+}
+
+enum pon_adapter_errno pon_img_valid_set_async(struct pon_img_context *ctx,
+					       const char id,
+					       const bool valid,
+					       pon_img_async_cb cb,
+					       void *priv, uint32_t *req)
+{
+	return img_async_bank(ctx, img_valid_set_run, id, NULL, valid, NULL,
+			      cb, priv, req);
+}
+
+enum pon_adapter_errno pon_img_state_get_async(struct pon_img_context *ctx,
+					       struct pon_img_state *state,
+					       pon_img_async_cb cb,
+					       void *priv, uint32_t *req)
+{
+	if (!state)
+		return PON_ADAPTER_ERR_PTR_INVALID;
+
+	return img_async_bank(ctx, img_state_get_run, 0, NULL, false, state,
+			      cb, priv, req);
+}
+
 /** @} */
@@ -0,0 +1,391 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include <ifxos_thread.h>
+#include <ifxos_event.h>
+
+#include "pon_img_async.h"
+#include "pon_img_common.h"
+#include "pon_img_debug.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+#define IFXOS_THREAD_PRIO_ASYNC		5
+
+/** Poll interval of the worker thread in ms, the shutdown is checked in
+ *  this interval
+ */
+#define ASYNC_POLL_TIME			200
+/** Time in ms to wait for the running request at the shutdown, an image
+ *  upgrade can take up to its ubus timeout
+ */
+#define ASYNC_SHUTDOWN_TIME		(UBUS_TIMEOUT_UPGRADE + 1000)
+
+struct pon_img_async {
+	/** Protects the lists and counters */
+	pthread_mutex_t lock;
+	/** Queued requests, run in this order */
+	struct pon_img_async_req *head;
+	/** Last queued request */
+	struct pon_img_async_req *tail;
+	/** Completed requests without a callback */
+	struct pon_img_async_req *done_head;
+	/** Last completed request */
+	struct pon_img_async_req *done_tail;
+	/** Number of queued and running requests */
+	unsigned int pending;
+	/** Number of completed requests which are not yet read */
+	unsigned int done;
+	/** Handle of the last request */
+	uint32_t last_id;
+	/** Readable while completed requests are not yet read */
+	int efd;
+	/** Signaled when a request is queued */
+	IFXOS_event_t event;
+	/** Signaled when a request is completed */
+	IFXOS_event_t idle_event;
+	/** Worker thread */
+	IFXOS_ThreadCtrl_t thread;
+	/** Worker thread, to detect a call from a completion callback */
+	pthread_t worker;
+	/** The worker thread is set */
+	bool worker_set;
+};
+
+/** Serializes the creation of the worker of a context */
+static pthread_mutex_t async_create_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void async_complete(struct pon_img_async *async,
+			   struct pon_img_async_req *req)
+{
+	uint64_t one = 1;
+
+	if (req->cb || req->reported) {
+		if (req->cb)
+			req->cb(req->priv, req->id, req->result);
+		free(req);
+		pthread_mutex_lock(&async->lock);
+	} else {
+		req->next = NULL;
+		pthread_mutex_lock(&async->lock);
+		if (async->done_tail)
+			async->done_tail->next = req;
+		else
+			async->done_head = req;
+		async->done_tail = req;
+		async->done++;
+		if (write(async->efd, &one, sizeof(one)) != sizeof(one))
+			dbg_wrn("async completion not signaled\n");
+	}
+	async->pending--;
+	pthread_mutex_unlock(&async->lock);
+
+	IFXOS_EventWakeUp(&async->idle_event);
+}
+
+/** Worker thread, runs the queued requests
+ *  \param[in] thr_params IFXOS_ThreadParams_t structure
+ */
+static int32_t async_thread(struct IFXOS_ThreadParams_s *thr_params)
+{
+	struct pon_img_async *async =
+		(struct pon_img_async *)thr_params->nArg1;
+	struct pon_img_context *ctx =
+		(struct pon_img_context *)thr_params->nArg2;
+	struct pon_img_async_req *req;
+	IFX_int32_t ret_code;
+
+	pthread_mutex_lock(&async->lock);
+	async->worker = pthread_self();
+	async->worker_set = true;
+	pthread_mutex_unlock(&async->lock);
+
+	while (!thr_params->bShutDown) {
+		pthread_mutex_lock(&async->lock);
+		req = async->head;
+		if (req) {
+			async->head = req->next;
+			if (!async->head)
+				async->tail = NULL;
+		}
+		pthread_mutex_unlock(&async->lock);
+
+		if (!req) {
+			IFXOS_EventWait(&async->event, ASYNC_POLL_TIME,
+					&ret_code);
+			continue;
+		}
+
+		req->result = req->fn(ctx, req);
+		dbg_prn("async request %u: %d\n", req->id, req->result);
+		async_complete(async, req);
+	}
+
+	return 0;
+}
+
+enum pon_adapter_errno pon_img_async_create(struct pon_img_async **async_out)
+{
+	struct pon_img_async *async;
+
+	async = calloc(1, sizeof(*async));
+	if (!async)
+		return PON_ADAPTER_ERR_NO_MEMORY;
+
+	async->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (async->efd < 0)
+		goto err_free;
+	if (pthread_mutex_init(&async->lock, NULL))
+		goto err_close;
+	if (IFXOS_EventInit(&async->event) != IFX_SUCCESS)
+		goto err_mutex;
+	if (IFXOS_EventInit(&async->idle_event) != IFX_SUCCESS)
+		goto err_event;
+
+	*async_out = async;
+
+	return PON_ADAPTER_SUCCESS;
+
+err_event:
+	IFXOS_EventDelete(&async->event);
+err_mutex:
+	pthread_mutex_destroy(&async->lock);
+err_close:
+	if (async->efd >= 0)
+		close(async->efd);
+err_free:
+	free(async);
+	return PON_ADAPTER_ERROR;
+}
+
+/* Get the worker of a context, it is created by the first asynchronous
+ * call, a context which never uses them has no worker
+ */
+static struct pon_img_async *async_get(struct pon_img_context *ctx)
+{
+	struct pon_img_async *async;
+
+	async = __atomic_load_n(&ctx->async, __ATOMIC_ACQUIRE);
+	if (async)
+		return async;
+
+	pthread_mutex_lock(&async_create_lock);
+	async = ctx->async;
+	if (!async && pon_img_async_create(&async) == PON_ADAPTER_SUCCESS)
+		__atomic_store_n(&ctx->async, async, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&async_create_lock);
+
+	return async;
+}
+
+static unsigned int async_list_free(struct pon_img_async_req *req)
+{
+	struct pon_img_async_req *next;
+	unsigned int count = 0;
+
+	for (; req; req = next) {
+		next = req->next;
+		free(req);
+		count++;
+	}
+
+	return count;
+}
+
+void pon_img_async_destroy(struct pon_img_async *async)
+{
+	unsigned int dropped;
+
+	if (!async)
+		return;
+
+	if (IFXOS_THREAD_INIT_VALID(&async->thread)) {
+		IFXOS_EventWakeUp(&async->event);
+		(void)IFXOS_ThreadShutdown(&async->thread,
+					   ASYNC_SHUTDOWN_TIME);
+	}
+
+	dropped = async_list_free(async->head);
+	if (dropped)
+		dbg_wrn("%u async requests dropped\n", dropped);
+	(void)async_list_free(async->done_head);
+
+	IFXOS_EventDelete(&async->idle_event);
+	IFXOS_EventDelete(&async->event);
+	pthread_mutex_destroy(&async->lock);
+	close(async->efd);
+	free(async);
+}
+
+struct pon_img_async_req *pon_img_async_req_alloc(pon_img_async_fn fn,
+						  pon_img_async_cb cb,
+						  void *priv)
+{
+	struct pon_img_async_req *req;
+
+	req = calloc(1, sizeof(*req));
+	if (!req)
+		return NULL;
+
+	req->fn = fn;
+	req->cb = cb;
+	req->priv = priv;
+
+	return req;
+}
+
+enum pon_adapter_errno pon_img_async_submit(struct pon_img_context *ctx,
+					    struct pon_img_async_req *req,
+					    uint32_t *id)
+{
+	enum pon_adapter_errno ret = PON_ADAPTER_SUCCESS;
+	struct pon_img_async *async;
+	uint32_t req_id;
+
+	dbg_in_args("%p, %p, %p", ctx, req, id);
+
+	async = async_get(ctx);
+	if (!async) {
+		dbg_err("Can't create async worker\n");
+		free(req);
+		dbg_out_ret("%d", PON_ADAPTER_ERR_NO_MEMORY);
+		return PON_ADAPTER_ERR_NO_MEMORY;
+	}
+
+	pthread_mutex_lock(&async->lock);
+
+	if (async->pending + async->done >= PON_IMG_ASYNC_QUEUE_MAX) {
+		dbg_err("too many async requests\n");
+		ret = PON_ADAPTER_ERR_OUT_OF_BOUNDS;
+		goto err_unlock;
+	}
+
+	if (!IFXOS_THREAD_INIT_VALID(&async->thread) &&
+	    IFXOS_ThreadInit(&async->thread, "imgasync", async_thread,
+			     IFXOS_DEFAULT_STACK_SIZE,
+			     IFXOS_THREAD_PRIO_ASYNC,
+			     (IFX_ulong_t)async, (IFX_ulong_t)ctx)) {
+		dbg_err("Can't start async worker thread\n");
+		ret = PON_ADAPTER_ERROR;
+		goto err_unlock;
+	}
+
+	/* 0 is never a valid handle */
+	req_id = ++async->last_id;
+	if (!req_id)
+		req_id = ++async->last_id;
+	req->id = req_id;
+	req->next = NULL;
+	if (async->tail)
+		async->tail->next = req;
+	else
+		async->head = req;
+	async->tail = req;
+	async->pending++;
+
+	pthread_mutex_unlock(&async->lock);
+
+	IFXOS_EventWakeUp(&async->event);
+
+	if (id)
+		*id = req_id;
+
+	dbg_out_ret("%d", PON_ADAPTER_SUCCESS);
+	return PON_ADAPTER_SUCCESS;
+
+err_unlock:
+	pthread_mutex_unlock(&async->lock);
+	free(req);
+	dbg_out_ret("%d", ret);
+	return ret;
+}
+
+bool pon_img_async_busy(struct pon_img_context *ctx)
+{
+	struct pon_img_async *async;
+	unsigned int pending;
+
+	async = __atomic_load_n(&ctx->async, __ATOMIC_ACQUIRE);
+	if (!async)
+		return false;
+
+	pthread_mutex_lock(&async->lock);
+	pending = async->pending;
+	/* a completion callback does not count its own request */
+	if (pending && async->worker_set &&
+	    pthread_equal(async->worker, pthread_self()))
+		pending--;
+	pthread_mutex_unlock(&async->lock);
+
+	return pending != 0;
+}
+
+int pon_img_async_fd(struct pon_img_context *ctx)
+{
+	struct pon_img_async *async;
+
+	if (!ctx)
+		return -1;
+
+	/* the fd can be polled before the first call */
+	async = async_get(ctx);
+	if (!async)
+		return -1;
+
+	return async->efd;
+}
+
+enum pon_adapter_errno pon_img_async_result(struct pon_img_context *ctx,
+					    uint32_t *id,
+					    enum pon_adapter_errno *result)
+{
+	struct pon_img_async *async;
+	struct pon_img_async_req *req;
+	uint64_t count;
+
+	if (!ctx || !id || !result)
+		return PON_ADAPTER_ERR_INVALID_VAL;
+	/* without a worker no call was made */
+	async = __atomic_load_n(&ctx->async, __ATOMIC_ACQUIRE);
+	if (!async)
+		return PON_ADAPTER_ERR_NO_DATA;
+
+	pthread_mutex_lock(&async->lock);
+	req = async->done_head;
+	if (req) {
+		async->done_head = req->next;
+		if (!async->done_head) {
+			async->done_tail = NULL;
+			/* the fd is readable until all results are read */
+			if (read(async->efd, &count, sizeof(count)) < 0)
+				dbg_wrn("async completion not cleared\n");
+		}
+		async->done--;
+	}
+	pthread_mutex_unlock(&async->lock);
+
+	if (!req)
+		return PON_ADAPTER_ERR_NO_DATA;
+
+	*id = req->id;
+	*result = req->result;
+	free(req);
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/** @} */
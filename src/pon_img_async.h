@@ -0,0 +1,117 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ ******************************************************************************/
+/**
+   \file pon_img_async.h
+   Worker thread of the asynchronous API.
+
+   A call queues a request and returns its handle at once. The worker
+   thread of the context runs the requests in order with the blocking
+   ubus calls. The result is passed to the completion callback of the
+   request, or without a callback it is queued for
+   \ref pon_img_async_result and signaled on \ref pon_img_async_fd.
+*/
+
+#ifndef _PON_IMG_ASYNC_H_
+#define _PON_IMG_ASYNC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pon_adapter.h>
+
+#include "pon_img.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Maximum number of queued requests of a context */
+#define PON_IMG_ASYNC_QUEUE_MAX	16
+
+struct pon_img_async;
+struct pon_img_async_req;
+
+/** Blocking call which is run by the worker thread */
+typedef enum pon_adapter_errno
+(*pon_img_async_fn)(struct pon_img_context *ctx,
+		    struct pon_img_async_req *req);
+
+/** Queued call and its arguments */
+struct pon_img_async_req {
+	/** Next request in the queue */
+	struct pon_img_async_req *next;
+	/** Handle returned to the caller */
+	uint32_t id;
+	/** Call to run */
+	pon_img_async_fn fn;
+	/** Completion callback, NULL to queue the result */
+	pon_img_async_cb cb;
+	/** The call reports its result itself, e.g. with an event, the
+	 *  result is not queued
+	 */
+	bool reported;
+	/** Argument of the completion callback */
+	void *priv;
+	/** Result of the call */
+	enum pon_adapter_errno result;
+	/** Bank of the call, 'A' or 'B' */
+	char bank;
+	/** Boolean argument */
+	bool flag;
+	/** Image file path */
+	char path[PON_IMG_PATH_LEN];
+	/** SHA-256 of the image in hex, empty if unknown */
+	char sha256[PON_IMG_DIGEST_LEN];
+	/** SHA-384 of the image in hex, empty if unknown */
+	char sha384[PON_IMG_DIGEST_LEN];
+	/** String argument, e.g. a version */
+	char str[UBOOT_VAL_LEN_MAX + 1];
+	/** Output of the call, owned by the caller */
+	void *data;
+};
+
+/**	Allocate the request queue of a context, the worker thread is started
+ *	with the first request. \ref pon_img_async_submit does this for the
+ *	first asynchronous call of a context.
+ */
+enum pon_adapter_errno pon_img_async_create(struct pon_img_async **async);
+
+/**	Stop the worker thread after the running request, the queued requests
+ *	are dropped without a completion.
+ */
+void pon_img_async_destroy(struct pon_img_async *async);
+
+/**	Allocate a request, the caller fills in the call and its arguments. */
+struct pon_img_async_req *pon_img_async_req_alloc(pon_img_async_fn fn,
+						  pon_img_async_cb cb,
+						  void *priv);
+
+/**	Queue a request, it is freed after its completion or on error.
+ *
+ *	\param[in] ctx		Library context
+ *	\param[in] req		Request
+ *	\param[out] id		Request handle, can be NULL
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- PON_ADAPTER_ERR_NO_MEMORY: The worker can not be created
+ *	- PON_ADAPTER_ERR_OUT_OF_BOUNDS: Too many queued requests
+ *	- Other: An error code in case of error.
+ */
+enum pon_adapter_errno pon_img_async_submit(struct pon_img_context *ctx,
+					    struct pon_img_async_req *req,
+					    uint32_t *id);
+
+/**	Check if requests are queued or running. A call from a completion
+ *	callback does not count the request which is completed.
+ */
+bool pon_img_async_busy(struct pon_img_context *ctx);
+
+/** @} */
+
+#endif
@@ -0,0 +1,1010 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include <mtd/mtd-user.h>
+#include <mtd/ubi-user.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wredundant-decls"
+#include <safe_lib.h>
+#include <safe_mem_lib.h>
+#pragma GCC diagnostic pop
+
+#include "pon_img_bank.h"
+#include "pon_img_crc.h"
+#include "pon_img_debug.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** sysfs directory of the UBI devices and volumes */
+#define UBI_SYSFS_PATH		"/sys/class/ubi"
+/** List of the MTD partitions */
+#define MTD_PROC_PATH		"/proc/mtd"
+/** Block size of file-backed volumes, a typical NAND erase block */
+#define BANK_FILE_BLOCK		(128 * 1024)
+/** Read size of an image file */
+#define BANK_READ_SIZE		(1024 * 1024)
+/** Maximum length of a volume name */
+#define BANK_VOL_NAME_LEN	32
+
+/** Kind of the current volume */
+enum bank_vol_type {
+	/** Plain file, the blocks are compared and rewritten in place */
+	BANK_VOL_FILE,
+	/** Dynamic UBI volume, changed blocks are replaced atomically */
+	BANK_VOL_UBI,
+	/** Static UBI volume, it can only be written completely */
+	BANK_VOL_UBI_STATIC,
+	/** MTD partition, changed blocks are erased and written */
+	BANK_VOL_MTD
+};
+
+struct pon_img_bank {
+	/** Bank identifier */
+	char id;
+	/** Directory of file-backed volumes, NULL for UBI and MTD */
+	const char *dir;
+	/** Current volume */
+	int fd;
+	/** Kind of the current volume */
+	enum bank_vol_type type;
+	/** Name of the current volume */
+	char name[BANK_VOL_NAME_LEN];
+	/** Announced size of the current volume */
+	uint32_t size;
+	/** Bytes written to the current volume */
+	uint32_t written;
+	/** Erase block or LEB size of the current volume */
+	uint32_t block;
+	/** Minimum write unit, trailing erased units are not written */
+	uint32_t min_io;
+	/** Number of blocks of the current volume */
+	uint32_t blocks;
+	/** Next logical block of the current volume */
+	uint32_t lnum;
+	/** Flash offset of the next block, bad blocks are skipped */
+	uint64_t offset;
+	/** The MTD partition can have bad blocks */
+	bool bad_blocks;
+	/** Bytes collected in buf */
+	uint32_t buf_len;
+	/** Allocated size of buf and cmp */
+	uint32_t buf_size;
+	/** Write buffer, one block */
+	uint8_t *buf;
+	/** Current content of the block */
+	uint8_t *cmp;
+	/** Check each sub-image before its volume is written */
+	bool selective;
+	/** The volume of the current sub-image already holds it */
+	bool part_skip;
+	/** A sub-image was found which the bank does not hold */
+	bool part_missing;
+	/** Block counters of the current volume */
+	struct pon_img_bank_stats vol;
+	/** Block counters of all finished volumes */
+	struct pon_img_bank_stats stats;
+};
+
+/* Read the first line of a sysfs attribute */
+static int sysfs_read(const char *path, char *buf, size_t size)
+{
+	FILE *f;
+	int ret = 0;
+
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	if (!fgets(buf, size, f))
+		ret = -1;
+	fclose(f);
+	buf[strcspn(buf, "\n")] = 0;
+
+	return ret;
+}
+
+static uint32_t sysfs_read_u32(const char *dir, const char *attr)
+{
+	char path[256], val[32];
+
+	snprintf(path, sizeof(path), UBI_SYSFS_PATH "/%s/%s", dir, attr);
+	if (sysfs_read(path, val, sizeof(val)))
+		return 0;
+
+	return (uint32_t)strtoul(val, NULL, 0);
+}
+
+/* Find the UBI volume with the given name and return its sysfs entry */
+static int ubi_vol_find(const char *name, char *vol, size_t vol_size)
+{
+	char path[256], vol_name[BANK_VOL_NAME_LEN + 2];
+	struct dirent *ent;
+	DIR *dir;
+	int ret = -1;
+
+	dir = opendir(UBI_SYSFS_PATH);
+	if (!dir)
+		return -1;
+
+	while ((ent = readdir(dir)) != NULL) {
+		/* volumes are named ubiX_Y, devices ubiX */
+		if (strncmp(ent->d_name, "ubi", 3) || !strchr(ent->d_name, '_'))
+			continue;
+
+		snprintf(path, sizeof(path), UBI_SYSFS_PATH "/%s/name",
+			 ent->d_name);
+		if (sysfs_read(path, vol_name, sizeof(vol_name)))
+			continue;
+
+		if (strcmp(vol_name, name) == 0) {
+			snprintf(vol, vol_size, "%s", ent->d_name);
+			ret = 0;
+			break;
+		}
+	}
+	closedir(dir);
+
+	return ret;
+}
+
+/* Find the MTD partition with the given name and return its device node */
+static int mtd_part_find(const char *name, char *dev, size_t dev_size)
+{
+	char line[128], part[BANK_VOL_NAME_LEN + 2];
+	unsigned int num;
+	FILE *f;
+	int ret = -1;
+
+	f = fopen(MTD_PROC_PATH, "r");
+	if (!f)
+		return -1;
+
+	/* mtd3: 00800000 00020000 "kernelA" */
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "mtd%u: %*x %*x \"%33[^\"]\"", &num, part) != 2)
+			continue;
+		if (strcmp(part, name) == 0) {
+			snprintf(dev, dev_size, "/dev/mtd%u", num);
+			ret = 0;
+			break;
+		}
+	}
+	fclose(f);
+
+	return ret;
+}
+
+static int write_all(int fd, const uint8_t *data, uint32_t len)
+{
+	uint32_t done = 0;
+	ssize_t ret;
+
+	while (done < len) {
+		ret = write(fd, data + done, len - done);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		done += ret;
+	}
+
+	return 0;
+}
+
+static int pwrite_all(int fd, const uint8_t *data, uint32_t len,
+		      uint64_t offset)
+{
+	uint32_t done = 0;
+	ssize_t ret;
+
+	while (done < len) {
+		ret = pwrite(fd, data + done, len - done, offset + done);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		done += ret;
+	}
+
+	return 0;
+}
+
+/* Read a complete block, false if it is shorter or not readable */
+static bool pread_all(int fd, uint8_t *data, uint32_t len, uint64_t offset)
+{
+	uint32_t done = 0;
+	ssize_t ret;
+
+	while (done < len) {
+		ret = pread(fd, data + done, len - done, offset + done);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return false;
+		done += ret;
+	}
+
+	return true;
+}
+
+/* Length without the trailing erased write units, 0 for an erased block */
+static uint32_t data_len(const uint8_t *data, uint32_t len, uint32_t min_io)
+{
+	while (len && data[len - 1] == 0xff)
+		len--;
+
+	return min_io ? (len + min_io - 1) / min_io * min_io : len;
+}
+
+enum pon_adapter_errno pon_img_bank_open(struct pon_img_bank **bank_out,
+					 const char id, const char *dir)
+{
+	struct pon_img_bank *bank;
+
+	dbg_in_args("%p, %c, %s", bank_out, id, dir ? dir : "ubi");
+
+	bank = calloc(1, sizeof(*bank));
+	if (!bank)
+		return PON_ADAPTER_ERR_NO_MEMORY;
+
+	bank->id = id;
+	bank->dir = dir;
+	bank->fd = -1;
+
+	*bank_out = bank;
+
+	dbg_out_ret("%d", PON_ADAPTER_SUCCESS);
+	return PON_ADAPTER_SUCCESS;
+}
+
+static enum pon_adapter_errno bank_file_open(struct pon_img_bank *bank)
+{
+	char path[256];
+
+	snprintf(path, sizeof(path), "%s/%s", bank->dir, bank->name);
+	/* the content is compared, the file is truncated at the end */
+	bank->fd = open(path, O_CREAT | O_RDWR, 0600);
+	if (bank->fd < 0) {
+		dbg_err("%s can not be opened: %s\n", path, strerror(errno));
+		return PON_ADAPTER_ERROR;
+	}
+	bank->type = BANK_VOL_FILE;
+	bank->block = BANK_FILE_BLOCK;
+	bank->min_io = 0;
+	bank->blocks = (bank->size + bank->block - 1) / bank->block;
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+static enum pon_adapter_errno bank_ubi_open(struct pon_img_bank *bank,
+					    const char *vol)
+{
+	char path[256], dev[16], type[16];
+	int64_t bytes = bank->size;
+	uint64_t capacity;
+
+	snprintf(path, sizeof(path), "/dev/%s", vol);
+	bank->fd = open(path, O_RDWR);
+	if (bank->fd < 0) {
+		dbg_err("%s can not be opened: %s\n", path, strerror(errno));
+		return PON_ADAPTER_ERROR;
+	}
+
+	snprintf(path, sizeof(path), UBI_SYSFS_PATH "/%s/type", vol);
+	if (sysfs_read(path, type, sizeof(type)) == 0 &&
+	    strcmp(type, "static") == 0) {
+		/* start the volume update, this also checks the size */
+		if (ioctl(bank->fd, UBI_IOCVOLUP, &bytes)) {
+			dbg_err("volume update of %s (%u bytes) failed: %s\n",
+				bank->name, bank->size, strerror(errno));
+			return PON_ADAPTER_ERR_SIZE;
+		}
+		bank->type = BANK_VOL_UBI_STATIC;
+		bank->block = BANK_FILE_BLOCK;
+		return PON_ADAPTER_SUCCESS;
+	}
+
+	/* ubiX_Y belongs to the device ubiX */
+	snprintf(dev, sizeof(dev), "%.*s", (int)strcspn(vol, "_"), vol);
+
+	bank->type = BANK_VOL_UBI;
+	bank->block = sysfs_read_u32(vol, "usable_eb_size");
+	bank->blocks = sysfs_read_u32(vol, "reserved_ebs");
+	bank->min_io = sysfs_read_u32(dev, "min_io_size");
+	capacity = (uint64_t)bank->block * bank->blocks;
+	if (!bank->block || bank->size > capacity) {
+		dbg_err("volume %s too small: %u of %llu bytes\n", bank->name,
+			bank->size, (unsigned long long)capacity);
+		return PON_ADAPTER_ERR_SIZE;
+	}
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+static enum pon_adapter_errno bank_mtd_open(struct pon_img_bank *bank,
+					    const char *dev)
+{
+	struct mtd_info_user info;
+
+	bank->fd = open(dev, O_RDWR);
+	if (bank->fd < 0) {
+		dbg_err("%s can not be opened: %s\n", dev, strerror(errno));
+		return PON_ADAPTER_ERROR;
+	}
+	if (ioctl(bank->fd, MEMGETINFO, &info)) {
+		dbg_err("%s is no MTD device: %s\n", dev, strerror(errno));
+		return PON_ADAPTER_ERROR;
+	}
+	if (bank->size > info.size) {
+		dbg_err("partition %s too small: %u of %u bytes\n", bank->name,
+			bank->size, info.size);
+		return PON_ADAPTER_ERR_SIZE;
+	}
+
+	bank->type = BANK_VOL_MTD;
+	bank->block = info.erasesize;
+	bank->blocks = info.size / info.erasesize;
+	bank->min_io = info.writesize;
+	bank->bad_blocks = info.type == MTD_NANDFLASH ||
+			   info.type == MTD_MLCNANDFLASH;
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+enum pon_adapter_errno pon_img_bank_vol_begin(struct pon_img_bank *bank,
+					      const char *name,
+					      uint32_t size)
+{
+	enum pon_adapter_errno error;
+	char path[256];
+	uint8_t *buf;
+
+	dbg_in_args("%p, %s, %u", bank, name, size);
+
+	if (bank->fd >= 0) {
+		dbg_err("volume %s is still open\n", bank->name);
+		return PON_ADAPTER_ERROR;
+	}
+
+	snprintf(bank->name, sizeof(bank->name), "%s%c", name, bank->id);
+	bank->size = size;
+	bank->written = 0;
+	bank->buf_len = 0;
+	bank->lnum = 0;
+	bank->offset = 0;
+	bank->bad_blocks = false;
+	memset(&bank->vol, 0, sizeof(bank->vol));
+
+	if (bank->dir)
+		error = bank_file_open(bank);
+	else if (ubi_vol_find(bank->name, path, sizeof(path)) == 0)
+		error = bank_ubi_open(bank, path);
+	else if (mtd_part_find(bank->name, path, sizeof(path)) == 0)
+		error = bank_mtd_open(bank, path);
+	else {
+		dbg_err("volume %s not found\n", bank->name);
+		return PON_ADAPTER_ERR_RESOURCE_NOT_FOUND;
+	}
+	if (error != PON_ADAPTER_SUCCESS)
+		goto err_close;
+
+	if (bank->block > bank->buf_size) {
+		buf = realloc(bank->buf, bank->block);
+		if (!buf)
+			goto err_nomem;
+		bank->buf = buf;
+		buf = realloc(bank->cmp, bank->block);
+		if (!buf)
+			goto err_nomem;
+		bank->cmp = buf;
+		bank->buf_size = bank->block;
+	}
+
+	dbg_msg("writing %u bytes into volume %s, %u byte blocks\n", size,
+		bank->name, bank->block);
+
+	dbg_out_ret("%d", PON_ADAPTER_SUCCESS);
+	return PON_ADAPTER_SUCCESS;
+
+err_nomem:
+	error = PON_ADAPTER_ERR_NO_MEMORY;
+err_close:
+	if (bank->fd >= 0) {
+		close(bank->fd);
+		bank->fd = -1;
+	}
+	dbg_out_ret("%d", error);
+	return error;
+}
+
+/* Skip the bad blocks, the data goes into the next good one */
+static enum pon_adapter_errno bank_mtd_good(struct pon_img_bank *bank)
+{
+	loff_t offset;
+	int ret;
+
+	while (bank->bad_blocks) {
+		if (bank->offset + bank->block > (uint64_t)bank->blocks *
+						  bank->block) {
+			dbg_err("partition %s has too many bad blocks\n",
+				bank->name);
+			return PON_ADAPTER_ERR_SIZE;
+		}
+		offset = (loff_t)bank->offset;
+		ret = ioctl(bank->fd, MEMGETBADBLOCK, &offset);
+		if (ret < 0) {
+			dbg_err("bad block check of %s failed: %s\n",
+				bank->name, strerror(errno));
+			return PON_ADAPTER_ERROR;
+		}
+		if (!ret)
+			break;
+		dbg_wrn("skipping bad block at 0x%llx of %s\n",
+			(unsigned long long)bank->offset, bank->name);
+		bank->offset += bank->block;
+	}
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* Write a changed block of a dynamic UBI volume, the LEB is replaced
+ * atomically. An erased block is only unmapped.
+ */
+static int bank_ubi_change(struct pon_img_bank *bank, uint32_t len)
+{
+	struct ubi_leb_change_req req = {
+		.lnum = (int32_t)bank->lnum,
+		.bytes = (int32_t)len,
+	};
+	int32_t lnum = (int32_t)bank->lnum;
+
+	if (!len)
+		return ioctl(bank->fd, UBI_IOCEBUNMAP, &lnum);
+
+	if (ioctl(bank->fd, UBI_IOCEBCH, &req))
+		return -1;
+
+	return write_all(bank->fd, bank->buf, len);
+}
+
+/* Write a changed block of an MTD partition */
+static int bank_mtd_change(struct pon_img_bank *bank, uint32_t len)
+{
+	struct erase_info_user erase = {
+		.start = (uint32_t)bank->offset,
+		.length = bank->block,
+	};
+
+	if (ioctl(bank->fd, MEMERASE, &erase))
+		return -1;
+
+	return pwrite_all(bank->fd, bank->buf, len, bank->offset);
+}
+
+/* Write the collected block if it differs from the flash content */
+static enum pon_adapter_errno bank_flush(struct pon_img_bank *bank)
+{
+	enum pon_adapter_errno error;
+	uint32_t len = bank->buf_len;
+	int ret;
+
+	if (!len)
+		return PON_ADAPTER_SUCCESS;
+
+	/* a static volume is written as a stream */
+	if (bank->type == BANK_VOL_UBI_STATIC) {
+		ret = write_all(bank->fd, bank->buf, len);
+		bank->vol.written++;
+		goto exit;
+	}
+
+	if (bank->type == BANK_VOL_MTD) {
+		error = bank_mtd_good(bank);
+		if (error != PON_ADAPTER_SUCCESS)
+			return error;
+	}
+
+	/* flash is erased behind the data */
+	if (bank->type != BANK_VOL_FILE) {
+		if (memset_s(bank->buf + len, bank->block - len, 0xff,
+			     bank->block - len))
+			return PON_ADAPTER_ERR_MEM_ACCESS;
+		len = bank->block;
+	}
+
+	if (pread_all(bank->fd, bank->cmp, len, bank->offset) &&
+	    memcmp(bank->buf, bank->cmp, len) == 0) {
+		bank->vol.skipped++;
+		ret = 0;
+		goto exit;
+	}
+
+	switch (bank->type) {
+	case BANK_VOL_UBI:
+		len = data_len(bank->buf, len, bank->min_io);
+		ret = bank_ubi_change(bank, len);
+		break;
+	case BANK_VOL_MTD:
+		len = data_len(bank->buf, len, bank->min_io);
+		ret = bank_mtd_change(bank, len);
+		break;
+	default:
+		/* a file must read back as written, an erased block is
+		 * written with 0xFF and counted like a flash erase
+		 */
+		ret = pwrite_all(bank->fd, bank->buf, len, bank->offset);
+		len = data_len(bank->buf, len, 0) ? len : 0;
+		break;
+	}
+	if (len)
+		bank->vol.written++;
+	else
+		bank->vol.erased++;
+
+exit:
+	if (ret) {
+		dbg_err("write to volume %s failed: %s\n",
+			bank->name, strerror(errno));
+		return PON_ADAPTER_ERROR;
+	}
+	bank->buf_len = 0;
+	bank->lnum++;
+	bank->offset += bank->block;
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+enum pon_adapter_errno pon_img_bank_vol_write(struct pon_img_bank *bank,
+					      const uint8_t *data,
+					      uint32_t len)
+{
+	enum pon_adapter_errno error;
+	uint32_t count;
+
+	if (bank->fd < 0)
+		return PON_ADAPTER_ERROR;
+
+	if (len > bank->size - bank->written) {
+		dbg_err("volume %s overflow\n", bank->name);
+		return PON_ADAPTER_ERR_SIZE;
+	}
+	bank->written += len;
+
+	while (len) {
+		count = bank->block - bank->buf_len;
+		if (count > len)
+			count = len;
+		if (memcpy_s(bank->buf + bank->buf_len,
+			     bank->block - bank->buf_len, data, count))
+			return PON_ADAPTER_ERR_MEM_ACCESS;
+		bank->buf_len += count;
+		data += count;
+		len -= count;
+
+		if (bank->buf_len == bank->block) {
+			error = bank_flush(bank);
+			if (error != PON_ADAPTER_SUCCESS)
+				return error;
+		}
+	}
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* Clear the blocks behind the data, as a volume update does */
+static enum pon_adapter_errno bank_ubi_tail(struct pon_img_bank *bank)
+{
+	int32_t lnum;
+	int ret;
+
+	for (lnum = (int32_t)bank->lnum; lnum < (int32_t)bank->blocks;
+	     lnum++) {
+		ret = ioctl(bank->fd, UBI_IOCEBISMAP, &lnum);
+		if (ret == 1) {
+			ret = ioctl(bank->fd, UBI_IOCEBUNMAP, &lnum);
+			bank->vol.erased++;
+		}
+		if (ret < 0) {
+			dbg_err("unmap of block %d of %s failed: %s\n", lnum,
+				bank->name, strerror(errno));
+			return PON_ADAPTER_ERROR;
+		}
+	}
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+enum pon_adapter_errno pon_img_bank_vol_end(struct pon_img_bank *bank)
+{
+	enum pon_adapter_errno error;
+
+	dbg_in_args("%p", bank);
+
+	if (bank->fd < 0)
+		return PON_ADAPTER_ERROR;
+
+	error = bank_flush(bank);
+
+	if (error == PON_ADAPTER_SUCCESS && bank->written != bank->size) {
+		dbg_err("volume %s incomplete: %u of %u bytes\n",
+			bank->name, bank->written, bank->size);
+		error = PON_ADAPTER_ERR_SIZE;
+	}
+
+	if (error == PON_ADAPTER_SUCCESS && bank->type == BANK_VOL_UBI)
+		error = bank_ubi_tail(bank);
+
+	if (error == PON_ADAPTER_SUCCESS && bank->type == BANK_VOL_FILE &&
+	    ftruncate(bank->fd, bank->size)) {
+		dbg_err("volume %s can not be truncated: %s\n",
+			bank->name, strerror(errno));
+		error = PON_ADAPTER_ERROR;
+	}
+
+	if (error == PON_ADAPTER_SUCCESS && fsync(bank->fd)) {
+		dbg_err("sync of volume %s failed: %s\n",
+			bank->name, strerror(errno));
+		error = PON_ADAPTER_ERROR;
+	}
+
+	bank->stats.written += bank->vol.written;
+	bank->stats.skipped += bank->vol.skipped;
+	bank->stats.erased += bank->vol.erased;
+	dbg_msg("volume %s: %u blocks written, %u unchanged, %u erased\n",
+		bank->name, bank->vol.written, bank->vol.skipped,
+		bank->vol.erased);
+
+	close(bank->fd);
+	bank->fd = -1;
+
+	dbg_out_ret("%d", error);
+	return error;
+}
+
+void pon_img_bank_stats_get(const struct pon_img_bank *bank,
+			    struct pon_img_bank_stats *stats)
+{
+	*stats = bank->stats;
+}
+
+void pon_img_bank_close(struct pon_img_bank *bank)
+{
+	if (!bank)
+		return;
+
+	if (bank->fd >= 0) {
+		dbg_wrn("volume %s left incomplete\n", bank->name);
+		close(bank->fd);
+	}
+	free(bank->buf);
+	free(bank->cmp);
+	free(bank);
+}
+
+/* Volume of a sub-image, the same mapping as in pon_img_split */
+static const char *bank_part_vol(const struct pon_img_uimage_part *part)
+{
+	if (part->hdr.ih_type == IH_TYPE_FILESYSTEM)
+		return PON_IMG_VOL_ROOTFS;
+	if (strncmp((const char *)part->hdr.ih_name, IH_NAME_BOOTCORE,
+		    sizeof(part->hdr.ih_name)) == 0)
+		return PON_IMG_VOL_BOOTCORE;
+	return PON_IMG_VOL_KERNEL;
+}
+
+/* Open a volume of the bank for reading */
+static int bank_vol_open_ro(struct pon_img_bank *bank, const char *name)
+{
+	char path[256], vol[BANK_VOL_NAME_LEN];
+
+	if (bank->dir)
+		snprintf(path, sizeof(path), "%s/%s", bank->dir, name);
+	else if (ubi_vol_find(name, vol, sizeof(vol)) == 0)
+		snprintf(path, sizeof(path), "/dev/%s", vol);
+	else if (mtd_part_find(name, path, sizeof(path)))
+		return -1;
+
+	return open(path, O_RDONLY);
+}
+
+/* Check the data CRC of a sub-image in a volume */
+static bool bank_crc_check(int fd, uint64_t offset, uint32_t size,
+			   uint32_t dcrc)
+{
+	uint32_t crc = 0, count;
+	uint8_t *buf;
+	bool ok = true;
+
+	buf = malloc(BANK_READ_SIZE);
+	if (!buf)
+		return false;
+
+	while (ok && size) {
+		count = size < BANK_READ_SIZE ? size : BANK_READ_SIZE;
+		ok = pread_all(fd, buf, count, offset);
+		crc = pon_img_crc32_ieee(crc, buf, count);
+		offset += count;
+		size -= count;
+	}
+	free(buf);
+
+	return ok && crc == dcrc;
+}
+
+/* Check if the volume already holds the sub-image. A kernel volume starts
+ * with the U-Boot header, which is compared first. The data CRC is always
+ * checked, an interrupted write can leave a matching header.
+ */
+static bool bank_part_present(struct pon_img_bank *bank,
+			      const struct pon_img_uimage_part *part)
+{
+	char name[BANK_VOL_NAME_LEN];
+	struct image_header hdr;
+	uint64_t offset = 0;
+	bool same;
+	int fd;
+
+	snprintf(name, sizeof(name), "%s%c", bank_part_vol(part), bank->id);
+	fd = bank_vol_open_ro(bank, name);
+	if (fd < 0)
+		return false;
+
+	if (part->hdr.ih_type != IH_TYPE_FILESYSTEM) {
+		offset = sizeof(hdr);
+		same = pread_all(fd, (uint8_t *)&hdr, sizeof(hdr), 0) &&
+		       hdr.ih_magic == part->hdr.ih_magic &&
+		       hdr.ih_dcrc == part->hdr.ih_dcrc &&
+		       hdr.ih_size == part->hdr.ih_size &&
+		       memcmp(hdr.ih_name, part->hdr.ih_name,
+			      sizeof(hdr.ih_name)) == 0;
+		if (!same)
+			goto exit;
+	}
+
+	same = bank_crc_check(fd, offset, ntohl(part->hdr.ih_size),
+			      ntohl(part->hdr.ih_dcrc));
+
+exit:
+	close(fd);
+	dbg_msg("volume %s %s %.*s\n", name, same ? "holds" : "does not hold",
+		IH_NMLEN, part->hdr.ih_name);
+
+	return same;
+}
+
+int pon_img_bank_vol_open(struct pon_img_bank *bank, const char *name)
+{
+	char vol[BANK_VOL_NAME_LEN];
+	int fd;
+
+	snprintf(vol, sizeof(vol), "%s%c", name, bank->id);
+	fd = bank_vol_open_ro(bank, vol);
+	if (fd < 0)
+		dbg_err("volume %s can not be opened\n", vol);
+
+	return fd;
+}
+
+static enum pon_adapter_errno
+bank_part_begin(void *priv, const struct pon_img_uimage_part *part,
+		uint32_t len)
+{
+	struct pon_img_bank *bank = priv;
+
+	/* an unchanged sub-image is not written */
+	if (bank->selective && bank_part_present(bank, part)) {
+		bank->part_skip = true;
+		bank->stats.parts_skipped++;
+		return PON_ADAPTER_SUCCESS;
+	}
+
+	return pon_img_bank_vol_begin(bank, bank_part_vol(part), len);
+}
+
+static enum pon_adapter_errno bank_part_write(void *priv,
+					      const uint8_t *data,
+					      uint32_t len)
+{
+	struct pon_img_bank *bank = priv;
+
+	if (bank->part_skip)
+		return PON_ADAPTER_SUCCESS;
+
+	return pon_img_bank_vol_write(bank, data, len);
+}
+
+static enum pon_adapter_errno bank_part_end(void *priv)
+{
+	struct pon_img_bank *bank = priv;
+
+	if (bank->part_skip) {
+		bank->part_skip = false;
+		return PON_ADAPTER_SUCCESS;
+	}
+
+	return pon_img_bank_vol_end(bank);
+}
+
+const struct pon_img_uimage_sink pon_img_bank_sink = {
+	.begin = bank_part_begin,
+	.write = bank_part_write,
+	.end = bank_part_end,
+};
+
+/* Only checks the sub-images, stops at the first one which differs */
+static enum pon_adapter_errno
+bank_check_begin(void *priv, const struct pon_img_uimage_part *part,
+		 uint32_t len)
+{
+	struct pon_img_bank *bank = priv;
+
+	(void)len;
+	if (!bank_part_present(bank, part)) {
+		bank->part_missing = true;
+		return PON_ADAPTER_ERR_RESOURCE_NOT_FOUND;
+	}
+	bank->stats.parts_skipped++;
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+static enum pon_adapter_errno bank_check_write(void *priv,
+					       const uint8_t *data,
+					       uint32_t len)
+{
+	(void)priv;
+	(void)data;
+	(void)len;
+	return PON_ADAPTER_SUCCESS;
+}
+
+static enum pon_adapter_errno bank_check_end(void *priv)
+{
+	(void)priv;
+	return PON_ADAPTER_SUCCESS;
+}
+
+static const struct pon_img_uimage_sink bank_check_sink = {
+	.begin = bank_check_begin,
+	.write = bank_check_write,
+	.end = bank_check_end,
+};
+
+/* Pass an image file through the U-Boot header parser to a receiver */
+static enum pon_adapter_errno
+bank_file_parse(struct pon_img_bank *bank, const char *filename,
+		const struct pon_img_uimage_sink *sink,
+		char *version, size_t version_size)
+{
+	enum pon_adapter_errno error;
+	struct pon_img_uimage *ui = NULL;
+	uint8_t *buf = NULL;
+	struct stat st;
+	ssize_t len;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		dbg_err("%s can not be opened: %s\n", filename, strerror(errno));
+		return PON_ADAPTER_ERROR;
+	}
+	if (fstat(fd, &st) || st.st_size > UINT32_MAX) {
+		error = PON_ADAPTER_ERR_SIZE;
+		goto exit;
+	}
+	(void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	ui = malloc(sizeof(*ui));
+	buf = malloc(BANK_READ_SIZE);
+	if (!ui || !buf) {
+		error = PON_ADAPTER_ERR_NO_MEMORY;
+		goto exit;
+	}
+
+	/* the headers and data CRCs are checked while the sub-images are
+	 * passed on
+	 */
+	pon_img_uimage_init(ui, (uint32_t)st.st_size,
+			    pon_img_uimage_arch_native());
+	pon_img_uimage_sink_set(ui, sink, bank);
+
+	for (;;) {
+		len = read(fd, buf, BANK_READ_SIZE);
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len < 0) {
+			dbg_err("read of %s failed: %s\n", filename,
+				strerror(errno));
+			error = PON_ADAPTER_ERROR;
+			goto exit;
+		}
+		if (!len)
+			break;
+		error = pon_img_uimage_feed(ui, buf, (uint32_t)len);
+		if (error != PON_ADAPTER_SUCCESS)
+			goto exit;
+	}
+
+	error = pon_img_uimage_finish(ui);
+	if (error != PON_ADAPTER_SUCCESS)
+		goto exit;
+
+	if (version && version_size)
+		snprintf(version, version_size, "%.*s", IH_NMLEN,
+			 ui->part[0].hdr.ih_name);
+
+exit:
+	free(buf);
+	free(ui);
+	close(fd);
+	return error;
+}
+
+enum pon_adapter_errno pon_img_bank_write_file(struct pon_img_bank *bank,
+					       const char *filename,
+					       char *version,
+					       size_t version_size)
+{
+	enum pon_adapter_errno error;
+
+	dbg_in_args("%p, %s, %p, %zu", bank, filename, version, version_size);
+
+	bank->selective = true;
+	bank->part_skip = false;
+	error = bank_file_parse(bank, filename, &pon_img_bank_sink, version,
+				version_size);
+	bank->selective = false;
+
+	if (error == PON_ADAPTER_SUCCESS)
+		dbg_msg("%s written into bank %c: %u sub-images unchanged, %u blocks written, %u unchanged, %u erased\n",
+			filename, bank->id, bank->stats.parts_skipped,
+			bank->stats.written, bank->stats.skipped,
+			bank->stats.erased);
+
+	dbg_out_ret("%d", error);
+	return error;
+}
+
+enum pon_adapter_errno pon_img_bank_check_file(struct pon_img_bank *bank,
+					       const char *filename,
+					       bool *present)
+{
+	enum pon_adapter_errno error;
+
+	dbg_in_args("%p, %s, %p", bank, filename, present);
+
+	bank->part_missing = false;
+	bank->stats.parts_skipped = 0;
+	error = bank_file_parse(bank, filename, &bank_check_sink, NULL, 0);
+
+	*present = false;
+	if (bank->part_missing)
+		error = PON_ADAPTER_SUCCESS;
+	else if (error == PON_ADAPTER_SUCCESS)
+		*present = bank->stats.parts_skipped != 0;
+
+	dbg_out_ret("%d", error);
+	return error;
+}
+
+/** @} */
@@ -0,0 +1,159 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ ******************************************************************************/
+/**
+   \file pon_img_bank.h
+   Direct write of the sub-images into the volumes of an image bank.
+
+   The volumes of bank 'A' are named "kernelA", "rootfsA" and "bootcoreA",
+   the same for bank 'B'. They are UBI volumes, MTD partitions, or for
+   testing plain files in a directory.
+
+   A volume is written in blocks of its erase block or LEB size. Each block
+   is compared with the current content and only written if it changed.
+   An erased block is not written, a LEB of a dynamic UBI volume is
+   unmapped and an MTD block is only erased. A changed LEB is replaced
+   atomically, a static UBI volume is updated completely. A file-backed
+   volume is written in 128 KiB blocks and truncated behind the data, an
+   erased block is written with 0xFF.
+*/
+
+#ifndef _PON_IMG_BANK_H_
+#define _PON_IMG_BANK_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pon_adapter.h>
+
+#include "pon_img_uimage.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Volume name of the kernel */
+#define PON_IMG_VOL_KERNEL	"kernel"
+/** Volume name of the root file system */
+#define PON_IMG_VOL_ROOTFS	"rootfs"
+/** Volume name of the bootcore */
+#define PON_IMG_VOL_BOOTCORE	"bootcore"
+
+struct pon_img_bank;
+
+/** Block counters of a bank */
+struct pon_img_bank_stats {
+	/** Changed blocks which were written */
+	uint32_t written;
+	/** Blocks which already had the content */
+	uint32_t skipped;
+	/** Erased blocks which were unmapped or only erased */
+	uint32_t erased;
+	/** Sub-images which the volumes already held, they were not
+	 *  written
+	 */
+	uint32_t parts_skipped;
+};
+
+/** Receiver of the sub-images of a fullimage, writes them into the volumes
+ *  of the bank given as private data
+ */
+extern const struct pon_img_uimage_sink pon_img_bank_sink;
+
+/**	Prepare writing into the volumes of a bank.
+ *
+ *	\param[out] bank	Bank handle
+ *	\param[in] id		Bank identifier ('A' or 'B')
+ *	\param[in] dir		Directory with file-backed volumes,
+ *				NULL to use the UBI volumes.
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- Other: An error code in case of error.
+ */
+enum pon_adapter_errno pon_img_bank_open(struct pon_img_bank **bank,
+					 const char id, const char *dir);
+
+/**	Start writing a volume, the complete size must be known in advance.
+ *
+ *	\param[in] bank		Bank handle
+ *	\param[in] name		Volume name without bank identifier
+ *	\param[in] size		Number of bytes which will be written
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- PON_ADAPTER_ERR_RESOURCE_NOT_FOUND: Volume does not exist
+ *	- Other: An error code in case of error.
+ */
+enum pon_adapter_errno pon_img_bank_vol_begin(struct pon_img_bank *bank,
+					      const char *name,
+					      uint32_t size);
+
+/**	Write the next part of the current volume. */
+enum pon_adapter_errno pon_img_bank_vol_write(struct pon_img_bank *bank,
+					      const uint8_t *data,
+					      uint32_t len);
+
+/**	Finish the current volume, all announced bytes must be written. */
+enum pon_adapter_errno pon_img_bank_vol_end(struct pon_img_bank *bank);
+
+/**	Write a fullimage file into the volumes of the bank. The U-Boot
+ *	image headers and data CRCs are checked while it is written. A volume
+ *	which already holds its sub-image, same header and data CRC, is not
+ *	written.
+ *
+ *	\param[in] bank		Bank handle
+ *	\param[in] filename	Path of the image file
+ *	\param[out] version	Version of the image, can be NULL
+ *	\param[in] version_size	Size of the version buffer
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- PON_ADAPTER_ERR_CRC: Header or data CRC mismatch, the bank is
+ *	  left incomplete
+ *	- Other: An error code in case of error.
+ */
+enum pon_adapter_errno pon_img_bank_write_file(struct pon_img_bank *bank,
+					       const char *filename,
+					       char *version,
+					       size_t version_size);
+
+/**	Check if the volumes of the bank already hold all sub-images of a
+ *	fullimage file, with the same header and data CRC.
+ *
+ *	\param[in] bank		Bank handle
+ *	\param[in] filename	Path of the image file
+ *	\param[out] present	Set if all sub-images are in the bank
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If the check was done
+ *	- Other: The image file is not valid or can not be read
+ */
+enum pon_adapter_errno pon_img_bank_check_file(struct pon_img_bank *bank,
+					       const char *filename,
+					       bool *present);
+
+/**	Open a volume of the bank for reading.
+ *
+ *	\param[in] bank		Bank handle
+ *	\param[in] name		Volume name without bank identifier
+ *
+ *	\return File descriptor of the volume, -1 if it can not be opened
+ */
+int pon_img_bank_vol_open(struct pon_img_bank *bank, const char *name);
+
+/**	Read the block counters of all volumes written so far. */
+void pon_img_bank_stats_get(const struct pon_img_bank *bank,
+			    struct pon_img_bank_stats *stats);
+
+/**	Close the bank, an unfinished volume is left incomplete. */
+void pon_img_bank_close(struct pon_img_bank *bank);
+
+/** @} */
+
+#endif
@@ -0,0 +1,270 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include <pon_adapter.h>
+
+#include "pon_img_bank.h"
+#include "pon_img_crc.h"
+#include "pon_img_uimage.h"
+#include "pon_img_test.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Block size of file-backed volumes */
+#define BANK_TEST_BLOCK		(128 * 1024)
+/** Largest volume of the test */
+#define BANK_TEST_SIZE		(5 * BANK_TEST_BLOCK)
+/** Write size, not aligned to the blocks */
+#define BANK_TEST_CHUNK		10000
+/** Kernel size of the fullimage */
+#define BANK_TEST_KERNEL	(100 * 1024 + 5)
+/** Rootfs size of the fullimage */
+#define BANK_TEST_ROOTFS	(3 * BANK_TEST_BLOCK)
+
+static uint8_t data[BANK_TEST_SIZE];
+static uint8_t kernel[BANK_TEST_KERNEL];
+static uint8_t rootfs[BANK_TEST_ROOTFS];
+static uint8_t image[2 * BANK_TEST_SIZE];
+
+/* Write the volume through a new bank handle, its counters start at 0 */
+static int run(const char *dir, const char *name, uint32_t size,
+	       uint32_t written, uint32_t skipped, uint32_t erased)
+{
+	struct pon_img_bank_stats stats = {0};
+	enum pon_adapter_errno ret;
+	struct pon_img_bank *bank;
+	char path[PON_IMG_PATH_LEN];
+	uint32_t offset, len;
+
+	ret = pon_img_bank_open(&bank, 'A', dir);
+	if (ret != PON_ADAPTER_SUCCESS) {
+		printf("%s: open failed with %d\n", name, ret);
+		return 1;
+	}
+
+	ret = pon_img_bank_vol_begin(bank, PON_IMG_VOL_KERNEL, size);
+	for (offset = 0; ret == PON_ADAPTER_SUCCESS && offset < size;
+	     offset += len) {
+		len = size - offset;
+		if (len > BANK_TEST_CHUNK)
+			len = BANK_TEST_CHUNK;
+		ret = pon_img_bank_vol_write(bank, data + offset, len);
+	}
+	if (ret == PON_ADAPTER_SUCCESS)
+		ret = pon_img_bank_vol_end(bank);
+	pon_img_bank_stats_get(bank, &stats);
+	pon_img_bank_close(bank);
+
+	snprintf(path, sizeof(path), "%s/" PON_IMG_VOL_KERNEL "A", dir);
+	if (ret != PON_ADAPTER_SUCCESS ||
+	    !pon_img_test_file_check(path, data, size)) {
+		printf("%s: failed with %d\n", name, ret);
+		return 1;
+	}
+	if (stats.written != written || stats.skipped != skipped ||
+	    stats.erased != erased) {
+		printf("%s: %u written, %u skipped, %u erased, expected %u, %u, %u\n",
+		       name, stats.written, stats.skipped, stats.erased,
+		       written, skipped, erased);
+		return 1;
+	}
+	printf("%s: passed\n", name);
+
+	return 0;
+}
+
+/* Fill in the U-Boot header of a sub-image */
+static void hdr_put(uint8_t *p, uint8_t type, const char *name,
+		    const uint8_t *part, uint32_t size)
+{
+	struct image_header hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.ih_magic = htonl(IH_MAGIC);
+	hdr.ih_size = htonl(size);
+	hdr.ih_dcrc = htonl(pon_img_crc32_ieee(0, part, size));
+	hdr.ih_arch = pon_img_uimage_arch_native();
+	hdr.ih_type = type;
+	snprintf((char *)hdr.ih_name, sizeof(hdr.ih_name), "%s", name);
+	hdr.ih_hcrc = htonl(pon_img_crc32_ieee(0, (const uint8_t *)&hdr,
+					       sizeof(hdr)));
+	memcpy(p, &hdr, sizeof(hdr));
+}
+
+/* Add a sub-image with its header, padded like by mkimage */
+static uint32_t part_put(uint8_t *p, uint8_t type, const char *name,
+			 const uint8_t *part, uint32_t size)
+{
+	uint32_t len = sizeof(struct image_header) + size;
+
+	hdr_put(p, type, name, part, size);
+	memcpy(p + sizeof(struct image_header), part, size);
+	while (len % IH_DATA_ALIGN)
+		p[len++] = 0;
+
+	return len;
+}
+
+/* Write a fullimage of the kernel and rootfs into a file */
+static int image_write(const char *path, const char *version)
+{
+	uint8_t *body = image + sizeof(struct image_header);
+	uint32_t len = IH_MULTI_LIST_SIZE;
+	FILE *f;
+
+	memset(body, 0, IH_MULTI_LIST_SIZE);
+	len += part_put(body + len, IH_TYPE_KERNEL, version, kernel,
+			BANK_TEST_KERNEL);
+	len += part_put(body + len, IH_TYPE_FILESYSTEM, "rootfs", rootfs,
+			BANK_TEST_ROOTFS);
+	hdr_put(image, IH_TYPE_MULTI, version, body, len);
+	len += sizeof(struct image_header);
+
+	f = fopen(path, "w");
+	if (!f)
+		return -1;
+	if (fwrite(image, 1, len, f) != len) {
+		fclose(f);
+		return -1;
+	}
+
+	return fclose(f);
+}
+
+/* Write a fullimage into the bank, parts is the number of sub-images the
+ * bank already holds
+ */
+static int run_file(const char *dir, const char *name, const char *path,
+		    const char *expect, uint32_t parts, uint32_t written)
+{
+	struct pon_img_bank_stats stats = {0};
+	char version[IH_NMLEN + 1] = "";
+	enum pon_adapter_errno ret;
+	struct pon_img_bank *bank;
+
+	ret = pon_img_bank_open(&bank, 'B', dir);
+	if (ret == PON_ADAPTER_SUCCESS) {
+		ret = pon_img_bank_write_file(bank, path, version,
+					      sizeof(version));
+		pon_img_bank_stats_get(bank, &stats);
+		pon_img_bank_close(bank);
+	}
+
+	if (ret != PON_ADAPTER_SUCCESS || strcmp(version, expect) != 0) {
+		printf("%s: failed with %d, version %s\n", name, ret, version);
+		return 1;
+	}
+	if (stats.parts_skipped != parts || stats.written != written) {
+		printf("%s: %u sub-images skipped, %u blocks written, expected %u, %u\n",
+		       name, stats.parts_skipped, stats.written, parts,
+		       written);
+		return 1;
+	}
+	printf("%s: passed\n", name);
+
+	return 0;
+}
+
+/* Only the sub-images which the volumes do not hold are written */
+static int selective_write(const char *dir, const char *path)
+{
+	char vol[PON_IMG_PATH_LEN + sizeof(PON_IMG_VOL_KERNEL "B")];
+	int failed = 0;
+	FILE *f;
+
+	pon_img_test_fill(kernel, BANK_TEST_KERNEL, 21);
+	pon_img_test_fill(rootfs, BANK_TEST_ROOTFS, 22);
+	if (image_write(path, "1.0"))
+		return 1;
+	failed += run_file(dir, "new bank", path, "1.0", 0, 4);
+	failed += run_file(dir, "same image", path, "1.0", 2, 0);
+
+	/* the kernel header holds the version */
+	rootfs[BANK_TEST_BLOCK + 7] ^= 0x55;
+	if (image_write(path, "2.0"))
+		return failed + 1;
+	failed += run_file(dir, "new version", path, "2.0", 0, 2);
+
+	rootfs[2 * BANK_TEST_BLOCK] ^= 0x55;
+	if (image_write(path, "2.0"))
+		return failed + 1;
+	failed += run_file(dir, "changed rootfs", path, "2.0", 1, 1);
+
+	/* a volume with a matching header and damaged data is written */
+	snprintf(vol, sizeof(vol), "%s/" PON_IMG_VOL_KERNEL "B", dir);
+	f = fopen(vol, "r+");
+	if (!f || fseek(f, 1000, SEEK_SET) || fputc(0, f) == EOF) {
+		if (f)
+			fclose(f);
+		return failed + 1;
+	}
+	if (fclose(f))
+		return failed + 1;
+	failed += run_file(dir, "damaged kernel volume", path, "2.0", 1, 1);
+
+	return failed;
+}
+
+int main(void)
+{
+	char dir[PON_IMG_PATH_LEN], path[PON_IMG_PATH_LEN];
+	struct pon_img_test test;
+	int failed = 0;
+
+	if (pon_img_test_open(&test, "pon_img_bank_test"))
+		return 1;
+	pon_img_test_path(&test, "bank", dir, sizeof(dir));
+	if (mkdir(dir, 0700)) {
+		perror("bank");
+		pon_img_test_close(&test);
+		return 1;
+	}
+
+	/* the third block is erased, the last one is partial */
+	pon_img_test_fill(data, BANK_TEST_SIZE, 11);
+	memset(data + 2 * BANK_TEST_BLOCK, 0xff, BANK_TEST_BLOCK);
+	failed += run(dir, "new volume", 4 * BANK_TEST_BLOCK + 1000, 4, 0, 1);
+
+	failed += run(dir, "unchanged volume", 4 * BANK_TEST_BLOCK + 1000,
+		      0, 5, 0);
+
+	data[BANK_TEST_BLOCK + 100] ^= 0x55;
+	failed += run(dir, "one changed block", 4 * BANK_TEST_BLOCK + 1000,
+		      1, 4, 0);
+
+	/* the trailing erased blocks are not counted as written, also the
+	 * one behind the old end of the volume
+	 */
+	pon_img_test_fill(data + 2 * BANK_TEST_BLOCK, BANK_TEST_BLOCK, 12);
+	memset(data + 3 * BANK_TEST_BLOCK, 0xff, 2 * BANK_TEST_BLOCK);
+	failed += run(dir, "trailing erased blocks", BANK_TEST_SIZE, 1, 2, 2);
+
+	/* the blocks behind the new end are truncated, the data in front
+	 * of it is unchanged
+	 */
+	failed += run(dir, "shorter volume", BANK_TEST_BLOCK + 10, 0, 2, 0);
+
+	pon_img_test_path(&test, "fullimage", path, sizeof(path));
+	failed += selective_write(dir, path);
+
+	pon_img_test_close(&test);
+
+	return failed ? 1 : 0;
+}
+
+/** @} */
@@ -0,0 +1,99 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "pon_img_ckpt.h"
+#include "pon_img_crc.h"
+#include "pon_img_debug.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Checkpoint format identifier */
+#define CKPT_MAGIC	0x504f4e31
+
+static uint32_t ckpt_check(const struct pon_img_ckpt *ckpt)
+{
+	return pon_img_crc32_ieee(0, (const uint8_t *)ckpt,
+				  offsetof(struct pon_img_ckpt, check));
+}
+
+enum pon_adapter_errno pon_img_ckpt_load(const char *path,
+					 struct pon_img_ckpt *ckpt)
+{
+	ssize_t ret;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return PON_ADAPTER_ERR_RESOURCE_NOT_FOUND;
+
+	ret = read(fd, ckpt, sizeof(*ckpt));
+	close(fd);
+
+	if (ret != sizeof(*ckpt) || ckpt->magic != CKPT_MAGIC ||
+	    ckpt->head_len > sizeof(ckpt->head) ||
+	    ckpt->check != ckpt_check(ckpt)) {
+		dbg_wrn("invalid checkpoint %s\n", path);
+		return PON_ADAPTER_ERR_CRC;
+	}
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+enum pon_adapter_errno pon_img_ckpt_save(const char *path,
+					 struct pon_img_ckpt *ckpt)
+{
+	char tmp[256];
+	ssize_t ret;
+	int fd;
+
+	ckpt->magic = CKPT_MAGIC;
+	ckpt->check = ckpt_check(ckpt);
+
+	/* replace the previous checkpoint only by a complete one */
+	snprintf(tmp, sizeof(tmp), "%s.new", path);
+	fd = open(tmp, O_CREAT | O_WRONLY | O_TRUNC, 0600);
+	if (fd < 0)
+		goto err;
+
+	ret = write(fd, ckpt, sizeof(*ckpt));
+	if (ret != sizeof(*ckpt) || fsync(fd)) {
+		close(fd);
+		goto err;
+	}
+	close(fd);
+
+	if (rename(tmp, path))
+		goto err;
+
+	return PON_ADAPTER_SUCCESS;
+
+err:
+	dbg_err("checkpoint %s can not be written: %s\n", path,
+		strerror(errno));
+	unlink(tmp);
+	return PON_ADAPTER_ERROR;
+}
+
+void pon_img_ckpt_remove(const char *path)
+{
+	if (unlink(path) && errno != ENOENT)
+		dbg_wrn("checkpoint %s can not be removed: %s\n", path,
+			strerror(errno));
+}
+
+/** @} */
@@ -0,0 +1,69 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ ******************************************************************************/
+/**
+   \file pon_img_ckpt.h
+   Persisted progress of a SW download, used to resume an interrupted
+   download of the same image.
+*/
+
+#ifndef _PON_IMG_CKPT_H_
+#define _PON_IMG_CKPT_H_
+
+#include <stdint.h>
+#include <pon_adapter.h>
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Number of leading image bytes stored to identify the image */
+#define PON_IMG_CKPT_HEAD_LEN	64
+
+/** Download progress, all image data up to offset is stored durably */
+struct pon_img_ckpt {
+	/** Format identifier */
+	uint32_t magic;
+	/** SW image id */
+	uint32_t id;
+	/** Declared image size */
+	uint32_t size;
+	/** Number of stored bytes */
+	uint32_t offset;
+	/** OMCI CRC register after offset bytes */
+	uint32_t crc;
+	/** Next window number after offset bytes */
+	uint32_t next_window;
+	/** Number of valid bytes in head */
+	uint32_t head_len;
+	/** Leading bytes of the image, this is the U-Boot multi-file header */
+	uint8_t head[PON_IMG_CKPT_HEAD_LEN];
+	/** CRC of all fields above */
+	uint32_t check;
+};
+
+/**	Read a checkpoint.
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If a valid checkpoint was read
+ *	- PON_ADAPTER_ERR_RESOURCE_NOT_FOUND: No checkpoint exists
+ *	- PON_ADAPTER_ERR_CRC: The checkpoint is corrupted
+ */
+enum pon_adapter_errno pon_img_ckpt_load(const char *path,
+					 struct pon_img_ckpt *ckpt);
+
+/**	Write a checkpoint atomically, it is durable when this returns. */
+enum pon_adapter_errno pon_img_ckpt_save(const char *path,
+					 struct pon_img_ckpt *ckpt);
+
+/**	Remove a checkpoint. */
+void pon_img_ckpt_remove(const char *path);
+
+/** @} */
+
+#endif
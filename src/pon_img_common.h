@@ -47,6 +47,10 @@
 /** Reference to SW Image operations provided by this library */
 extern const struct pa_sw_image_ops sw_image_ops;
 
+struct pon_img_context;
+/** Stop a running SW download and release the image store */
+void pon_sw_image_release(struct pon_img_context *ctx);
+
 struct ubus_request;
 struct blob_attr;
 /** Callback for ubus_call to get a "retval" */
@@ -0,0 +1,476 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define CRC_HAVE_PCLMUL
+#endif
+
+#if defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#include <arm_neon.h>
+#define CRC_HAVE_PMULL
+#endif
+
+#include "pon_img_common.h"
+#include "pon_img_crc.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Generator polynomial without the x^32 term */
+#define CRC32_POLY		0x04C11DB7
+/** Bit reversed IEEE 802.3 generator polynomial */
+#define CRC32_IEEE_POLY		0xEDB88320
+
+/** Minimum length for the carry-less multiply kernels */
+#define CRC_CLMUL_MIN_LEN	64
+
+typedef uint32_t (*crc32_fn_t)(uint32_t crc, const uint8_t *data,
+			       size_t len);
+
+/** Slicing tables, crc_table[0] is the classic byte-at-a-time table,
+ *  crc_table[k] advances a byte by k additional zero bytes.
+ */
+static uint32_t crc_table[16][256];
+/** Slicing tables for the reflected IEEE 802.3 CRC */
+static uint32_t crc_ieee_table[8][256];
+
+/** Fold constants x^n mod P for the carry-less multiply kernels */
+static struct {
+	/* fold 4 x 128 bit by 512 bit */
+	uint64_t k512[2];
+	/* fold 128 bit by 128 bit */
+	uint64_t k128[2];
+	/* fold 128 bit lanes by 256 and 384 bit */
+	uint64_t k256[2];
+	uint64_t k384[2];
+} crc_fold;
+
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+static crc32_fn_t crc_fn;
+static const char *crc_fn_name;
+
+static inline uint32_t load_be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+	       ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint32_t load_le32(const uint8_t *p)
+{
+	return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) |
+	       ((uint32_t)p[1] << 8) | p[0];
+}
+
+static uint32_t crc32_bytewise(uint32_t crc, const uint8_t *data, size_t len)
+{
+	while (len--)
+		crc = (crc << 8) ^ crc_table[0][(crc >> 24) ^ *data++];
+
+	return crc;
+}
+
+static uint32_t crc32_slice8(uint32_t crc, const uint8_t *data, size_t len)
+{
+	uint32_t a, b;
+
+	while (len >= 8) {
+		a = crc ^ load_be32(data);
+		b = load_be32(data + 4);
+		crc = crc_table[7][a >> 24] ^
+		      crc_table[6][(a >> 16) & 0xff] ^
+		      crc_table[5][(a >> 8) & 0xff] ^
+		      crc_table[4][a & 0xff] ^
+		      crc_table[3][b >> 24] ^
+		      crc_table[2][(b >> 16) & 0xff] ^
+		      crc_table[1][(b >> 8) & 0xff] ^
+		      crc_table[0][b & 0xff];
+		data += 8;
+		len -= 8;
+	}
+
+	return crc32_bytewise(crc, data, len);
+}
+
+static uint32_t crc32_slice16(uint32_t crc, const uint8_t *data, size_t len)
+{
+	uint32_t a, b, c, d;
+
+	while (len >= 16) {
+		a = crc ^ load_be32(data);
+		b = load_be32(data + 4);
+		c = load_be32(data + 8);
+		d = load_be32(data + 12);
+		crc = crc_table[15][a >> 24] ^
+		      crc_table[14][(a >> 16) & 0xff] ^
+		      crc_table[13][(a >> 8) & 0xff] ^
+		      crc_table[12][a & 0xff] ^
+		      crc_table[11][b >> 24] ^
+		      crc_table[10][(b >> 16) & 0xff] ^
+		      crc_table[9][(b >> 8) & 0xff] ^
+		      crc_table[8][b & 0xff] ^
+		      crc_table[7][c >> 24] ^
+		      crc_table[6][(c >> 16) & 0xff] ^
+		      crc_table[5][(c >> 8) & 0xff] ^
+		      crc_table[4][c & 0xff] ^
+		      crc_table[3][d >> 24] ^
+		      crc_table[2][(d >> 16) & 0xff] ^
+		      crc_table[1][(d >> 8) & 0xff] ^
+		      crc_table[0][d & 0xff];
+		data += 16;
+		len -= 16;
+	}
+
+	return crc32_slice8(crc, data, len);
+}
+
+/* Multiply two polynomials modulo P, bit i is the coefficient of x^i */
+static uint32_t gf2_mulmod(uint32_t a, uint32_t b)
+{
+	uint32_t res = 0;
+	int i;
+
+	for (i = 31; i >= 0; i--) {
+		res = (res & 0x80000000) ? (res << 1) ^ CRC32_POLY : res << 1;
+		if (b & (1u << i))
+			res ^= a;
+	}
+
+	return res;
+}
+
+/* Calculate x^n mod P */
+static uint32_t gf2_xpow(uint64_t n)
+{
+	/* x^1 */
+	uint32_t sq = 2, res = 1;
+
+	while (n) {
+		if (n & 1)
+			res = gf2_mulmod(res, sq);
+		sq = gf2_mulmod(sq, sq);
+		n >>= 1;
+	}
+
+	return res;
+}
+
+uint32_t pon_img_crc32_combine(uint32_t crc_a, uint32_t crc_b, size_t len_b)
+{
+	return pon_img_crc32_combine_op(crc_a, crc_b,
+					pon_img_crc32_combine_prep(len_b));
+}
+
+uint32_t pon_img_crc32_combine_prep(size_t len_b)
+{
+	return gf2_xpow((uint64_t)len_b * 8);
+}
+
+uint32_t pon_img_crc32_combine_op(uint32_t crc_a, uint32_t crc_b, uint32_t op)
+{
+	/* Shifting the register of the first block over the second block
+	 * is a multiplication with x^(8 * len_b). The initial value was
+	 * applied to both blocks, it must be removed once.
+	 */
+	return gf2_mulmod(crc_a ^ PON_IMG_CRC32_INIT, op) ^ crc_b;
+}
+
+/* The carry-less multiply kernels fold the data in 128 bit blocks, the
+ * first byte is the most significant one. The remaining 128 bit value has
+ * the same CRC as the data folded into it, it is fed into the table code.
+ */
+#ifdef CRC_HAVE_PCLMUL
+__attribute__((target("pclmul,ssse3")))
+static inline __m128i clmul_fold(__m128i val, const uint64_t *k)
+{
+	__m128i kv = _mm_set_epi64x((long long)k[0], (long long)k[1]);
+
+	return _mm_xor_si128(_mm_clmulepi64_si128(val, kv, 0x11),
+			     _mm_clmulepi64_si128(val, kv, 0x00));
+}
+
+__attribute__((target("pclmul,ssse3")))
+static uint32_t crc32_pclmul(uint32_t crc, const uint8_t *data, size_t len)
+{
+	const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+					   8, 9, 10, 11, 12, 13, 14, 15);
+	__m128i x0, x1, x2, x3;
+	uint8_t rest[16];
+
+	if (len < CRC_CLMUL_MIN_LEN)
+		return crc32_slice8(crc, data, len);
+
+#define LOAD(i) _mm_shuffle_epi8(_mm_loadu_si128( \
+		(const __m128i *)(data + 16 * (i))), bswap)
+	x0 = LOAD(0);
+	x1 = LOAD(1);
+	x2 = LOAD(2);
+	x3 = LOAD(3);
+	/* the register is added to the first 32 bit of the data */
+	x0 = _mm_xor_si128(x0, _mm_set_epi32((int)crc, 0, 0, 0));
+	data += 64;
+	len -= 64;
+
+	while (len >= 64) {
+		x0 = _mm_xor_si128(clmul_fold(x0, crc_fold.k512), LOAD(0));
+		x1 = _mm_xor_si128(clmul_fold(x1, crc_fold.k512), LOAD(1));
+		x2 = _mm_xor_si128(clmul_fold(x2, crc_fold.k512), LOAD(2));
+		x3 = _mm_xor_si128(clmul_fold(x3, crc_fold.k512), LOAD(3));
+		data += 64;
+		len -= 64;
+	}
+
+	x0 = _mm_xor_si128(_mm_xor_si128(clmul_fold(x0, crc_fold.k384),
+					 clmul_fold(x1, crc_fold.k256)),
+			   _mm_xor_si128(clmul_fold(x2, crc_fold.k128), x3));
+
+	while (len >= 16) {
+		x0 = _mm_xor_si128(clmul_fold(x0, crc_fold.k128), LOAD(0));
+		data += 16;
+		len -= 16;
+	}
+#undef LOAD
+
+	_mm_storeu_si128((__m128i *)rest, _mm_shuffle_epi8(x0, bswap));
+	crc = crc32_slice8(0, rest, sizeof(rest));
+
+	return crc32_slice8(crc, data, len);
+}
+
+static bool crc_cpu_has_pclmul(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return false;
+
+	return (ecx & bit_PCLMUL) && (ecx & bit_SSSE3);
+}
+#endif
+
+#ifdef CRC_HAVE_PMULL
+__attribute__((target("+crypto")))
+static inline uint8x16_t pmull_fold(uint8x16_t val, const uint64_t *k)
+{
+	uint64x2_t v = vreinterpretq_u64_u8(val);
+	poly128_t hi, lo;
+
+	hi = vmull_p64((poly64_t)vgetq_lane_u64(v, 1), (poly64_t)k[0]);
+	lo = vmull_p64((poly64_t)vgetq_lane_u64(v, 0), (poly64_t)k[1]);
+
+	return veorq_u8(vreinterpretq_u8_p128(hi), vreinterpretq_u8_p128(lo));
+}
+
+/* byte reverse 128 bit, afterwards lane 1 holds the first 8 bytes */
+static inline uint8x16_t bswap128(uint8x16_t v)
+{
+	v = vrev64q_u8(v);
+	return vextq_u8(v, v, 8);
+}
+
+__attribute__((target("+crypto")))
+static uint32_t crc32_pmull(uint32_t crc, const uint8_t *data, size_t len)
+{
+	uint8x16_t x0, x1, x2, x3;
+	uint32x4_t init = { 0, 0, 0, crc };
+	uint8_t rest[16];
+
+	if (len < CRC_CLMUL_MIN_LEN)
+		return crc32_slice8(crc, data, len);
+
+#define LOAD(i) bswap128(vld1q_u8(data + 16 * (i)))
+	x0 = LOAD(0);
+	x1 = LOAD(1);
+	x2 = LOAD(2);
+	x3 = LOAD(3);
+	x0 = veorq_u8(x0, vreinterpretq_u8_u32(init));
+	data += 64;
+	len -= 64;
+
+	while (len >= 64) {
+		x0 = veorq_u8(pmull_fold(x0, crc_fold.k512), LOAD(0));
+		x1 = veorq_u8(pmull_fold(x1, crc_fold.k512), LOAD(1));
+		x2 = veorq_u8(pmull_fold(x2, crc_fold.k512), LOAD(2));
+		x3 = veorq_u8(pmull_fold(x3, crc_fold.k512), LOAD(3));
+		data += 64;
+		len -= 64;
+	}
+
+	x0 = veorq_u8(veorq_u8(pmull_fold(x0, crc_fold.k384),
+			       pmull_fold(x1, crc_fold.k256)),
+		      veorq_u8(pmull_fold(x2, crc_fold.k128), x3));
+
+	while (len >= 16) {
+		x0 = veorq_u8(pmull_fold(x0, crc_fold.k128), LOAD(0));
+		data += 16;
+		len -= 16;
+	}
+#undef LOAD
+
+	vst1q_u8(rest, bswap128(x0));
+	crc = crc32_slice8(0, rest, sizeof(rest));
+
+	return crc32_slice8(crc, data, len);
+}
+
+static bool crc_cpu_has_pmull(void)
+{
+	return (getauxval(AT_HWCAP) & HWCAP_PMULL) != 0;
+}
+#endif
+
+static const struct {
+	const char *name;
+	crc32_fn_t fn;
+} crc_impl[] = {
+#ifdef CRC_HAVE_PCLMUL
+	{ "pclmul", crc32_pclmul },
+#endif
+#ifdef CRC_HAVE_PMULL
+	{ "pmull", crc32_pmull },
+#endif
+	{ "slice16", crc32_slice16 },
+	{ "slice8", crc32_slice8 },
+	{ "bytewise", crc32_bytewise },
+};
+
+static bool crc_impl_supported(crc32_fn_t fn)
+{
+#ifdef CRC_HAVE_PCLMUL
+	if (fn == crc32_pclmul)
+		return crc_cpu_has_pclmul();
+#endif
+#ifdef CRC_HAVE_PMULL
+	if (fn == crc32_pmull)
+		return crc_cpu_has_pmull();
+#endif
+	return fn != NULL;
+}
+
+/* The fold constant pairs are x^(n + 64) mod P and x^n mod P, the low
+ * 64 bit of a block are moved by n bit, the high 64 bit by n + 64 bit.
+ */
+static void crc_fold_init(uint64_t *k, unsigned int n)
+{
+	k[0] = gf2_xpow(n + 64);
+	k[1] = gf2_xpow(n);
+}
+
+static void crc_init(void)
+{
+	uint32_t crc;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		crc = (uint32_t)i << 24;
+		for (j = 0; j < 8; j++)
+			crc = (crc & 0x80000000) ? (crc << 1) ^ CRC32_POLY :
+						   crc << 1;
+		crc_table[0][i] = crc;
+	}
+	for (i = 0; i < 256; i++)
+		for (j = 1; j < 16; j++)
+			crc_table[j][i] = (crc_table[j - 1][i] << 8) ^
+				crc_table[0][crc_table[j - 1][i] >> 24];
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc & 1) ? (crc >> 1) ^ CRC32_IEEE_POLY :
+					  crc >> 1;
+		crc_ieee_table[0][i] = crc;
+	}
+	for (i = 0; i < 256; i++)
+		for (j = 1; j < 8; j++)
+			crc_ieee_table[j][i] = (crc_ieee_table[j - 1][i] >> 8) ^
+				crc_ieee_table[0][crc_ieee_table[j - 1][i] & 0xff];
+
+	crc_fold_init(crc_fold.k512, 512);
+	crc_fold_init(crc_fold.k384, 384);
+	crc_fold_init(crc_fold.k256, 256);
+	crc_fold_init(crc_fold.k128, 128);
+
+	for (i = 0; i < ARRAY_SIZE(crc_impl); i++) {
+		if (!crc_impl_supported(crc_impl[i].fn))
+			continue;
+		crc_fn = crc_impl[i].fn;
+		crc_fn_name = crc_impl[i].name;
+		break;
+	}
+}
+
+uint32_t pon_img_crc32(uint32_t crc, const uint8_t *data, size_t len)
+{
+	pthread_once(&crc_once, crc_init);
+
+	return crc_fn(crc, data, len);
+}
+
+uint32_t pon_img_crc32_ieee(uint32_t crc, const uint8_t *data, size_t len)
+{
+	uint32_t a, b;
+
+	pthread_once(&crc_once, crc_init);
+
+	crc = ~crc;
+	while (len >= 8) {
+		a = crc ^ load_le32(data);
+		b = load_le32(data + 4);
+		crc = crc_ieee_table[7][a & 0xff] ^
+		      crc_ieee_table[6][(a >> 8) & 0xff] ^
+		      crc_ieee_table[5][(a >> 16) & 0xff] ^
+		      crc_ieee_table[4][a >> 24] ^
+		      crc_ieee_table[3][b & 0xff] ^
+		      crc_ieee_table[2][(b >> 8) & 0xff] ^
+		      crc_ieee_table[1][(b >> 16) & 0xff] ^
+		      crc_ieee_table[0][b >> 24];
+		data += 8;
+		len -= 8;
+	}
+	while (len--)
+		crc = (crc >> 8) ^ crc_ieee_table[0][(crc ^ *data++) & 0xff];
+
+	return ~crc;
+}
+
+const char *pon_img_crc32_impl(void)
+{
+	pthread_once(&crc_once, crc_init);
+
+	return crc_fn_name;
+}
+
+int pon_img_crc32_impl_set(const char *name)
+{
+	int i;
+
+	pthread_once(&crc_once, crc_init);
+
+	for (i = 0; i < ARRAY_SIZE(crc_impl); i++) {
+		if (strcmp(name, crc_impl[i].name) != 0)
+			continue;
+		if (!crc_impl_supported(crc_impl[i].fn))
+			return -1;
+		crc_fn = crc_impl[i].fn;
+		crc_fn_name = crc_impl[i].name;
+		return 0;
+	}
+
+	return -1;
+}
+
+/** @} */
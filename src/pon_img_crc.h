@@ -0,0 +1,100 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ ******************************************************************************/
+/**
+   \file pon_img_crc.h
+   CRC-32 according to ITU-T I.363.5 as used by OMCI for the SW download
+   (polynomial 0x04C11DB7, most significant bit first).
+
+   The functions work on the CRC register, the caller starts with
+   \ref PON_IMG_CRC32_INIT and inverts the final value, exactly like it is
+   done with pa_omci_crc32().
+
+   Additionally the IEEE 802.3 CRC-32 used by zlib and U-Boot for the image
+   header and data checksums is provided.
+*/
+
+#ifndef _PON_IMG_CRC_H_
+#define _PON_IMG_CRC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Initial value of the CRC register */
+#define PON_IMG_CRC32_INIT	0xffffffff
+
+/**	Update the CRC register with a data block.
+ *
+ *	The fastest implementation supported by the CPU is selected on the
+ *	first call, the result is bit-exact to pa_omci_crc32().
+ *
+ *	\param[in] crc	CRC register
+ *	\param[in] data	Data block
+ *	\param[in] len	Length of data block
+ *
+ *	\return Updated CRC register.
+ */
+uint32_t pon_img_crc32(uint32_t crc, const uint8_t *data, size_t len);
+
+/**	Combine the CRC registers of two consecutive data blocks.
+ *
+ *	Both CRC registers must be calculated starting with
+ *	\ref PON_IMG_CRC32_INIT.
+ *
+ *	\param[in] crc_a	CRC register of the first block
+ *	\param[in] crc_b	CRC register of the second block
+ *	\param[in] len_b	Length of the second block
+ *
+ *	\return CRC register of the concatenation of both blocks.
+ */
+uint32_t pon_img_crc32_combine(uint32_t crc_a, uint32_t crc_b, size_t len_b);
+
+/**	Prepare \ref pon_img_crc32_combine_op for blocks of a fixed length.
+ *
+ *	\param[in] len_b	Length of the second block
+ *
+ *	\return Operator for \ref pon_img_crc32_combine_op.
+ */
+uint32_t pon_img_crc32_combine_prep(size_t len_b);
+
+/**	Same as \ref pon_img_crc32_combine with a prepared operator, this
+ *	avoids the calculation per block if many blocks have the same length.
+ */
+uint32_t pon_img_crc32_combine_op(uint32_t crc_a, uint32_t crc_b, uint32_t op);
+
+/**	Name of the implementation selected by \ref pon_img_crc32. */
+const char *pon_img_crc32_impl(void);
+
+/**	Force an implementation, for comparison and benchmarking.
+ *
+ *	\param[in] name	"bytewise", "slice8", "slice16", "pclmul" or "pmull"
+ *
+ *	\return 0 if successful, -1 if the implementation is not available.
+ */
+int pon_img_crc32_impl_set(const char *name);
+
+/**	Update an IEEE 802.3 CRC-32 (reflected, polynomial 0xEDB88320).
+ *
+ *	Same semantic as crc32() of zlib: start with 0, the returned value is
+ *	the final CRC and can be passed again to continue the calculation.
+ *
+ *	\param[in] crc	Previous CRC value
+ *	\param[in] data	Data block
+ *	\param[in] len	Length of data block
+ *
+ *	\return Updated CRC value.
+ */
+uint32_t pon_img_crc32_ieee(uint32_t crc, const uint8_t *data, size_t len);
+
+/** @} */
+
+#endif
@@ -0,0 +1,193 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <pon_adapter.h>
+#include <pon_adapter_crc.h>
+
+#include "pon_img_crc.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Default size of the throughput buffer in MiB */
+#define BENCH_SIZE_DEFAULT	8
+/** Number of random blocks compared per implementation */
+#define BENCH_CASES		20000
+/** Maximum length of a random block */
+#define BENCH_CASE_LEN		4096
+
+static const char *impls[] = {
+	"bytewise", "slice8", "slice16", "pclmul", "pmull"
+};
+
+static const char *help =
+	"Compares all CRC-32 implementations with pa_omci_crc32() and\n"
+	"reports their throughput.\n"
+	"Options:\n"
+	"-s, --size	Size of the throughput buffer in MiB (default 8).\n"
+	"-h, --help	Print help and exit.\n"
+	;
+
+static struct option long_opts[] = {
+	{"size", required_argument, 0, 's'},
+	{"help", no_argument, 0, 'h'},
+	{0, 0, 0, 0}
+};
+
+/** Options string */
+static const char opt_string[] = "s:h";
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* Random blocks with random offsets and initial values, the reference is
+ * pa_omci_crc32() which the SW download used before
+ */
+static int check_impl(const char *name, const uint8_t *buf)
+{
+	uint32_t crc, ref, init, crc_b, len, len_b, off;
+	unsigned int i;
+
+	srand(1);
+	for (i = 0; i < BENCH_CASES; i++) {
+		len = rand() % BENCH_CASE_LEN;
+		off = rand() % 64;
+		init = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+
+		ref = pa_omci_crc32(init, buf + off, len);
+		crc = pon_img_crc32(init, buf + off, len);
+		if (crc != ref) {
+			printf("%-10s len %u offset %u init 0x%08x: 0x%08x, expected 0x%08x\n",
+			       name, len, off, init, crc, ref);
+			return 1;
+		}
+
+		/* the combined CRC of two blocks must match the CRC of
+		 * both blocks
+		 */
+		len_b = rand() % BENCH_CASE_LEN;
+		ref = pa_omci_crc32(PON_IMG_CRC32_INIT, buf + off,
+				    len + len_b);
+		crc = pon_img_crc32(PON_IMG_CRC32_INIT, buf + off, len);
+		crc_b = pon_img_crc32(PON_IMG_CRC32_INIT, buf + off + len,
+				      len_b);
+		if (pon_img_crc32_combine(crc, crc_b, len_b) != ref ||
+		    pon_img_crc32_combine_op(crc, crc_b,
+			pon_img_crc32_combine_prep(len_b)) != ref) {
+			printf("%-10s combine of %u and %u bytes failed\n",
+			       name, len, len_b);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static double throughput(uint32_t (*fn)(uint32_t, const uint8_t *, size_t),
+			 const uint8_t *buf, size_t size, uint32_t *crc)
+{
+	double start, elapsed;
+	unsigned int loops = 0;
+
+	start = now_ms();
+	do {
+		*crc = fn(PON_IMG_CRC32_INIT, buf, size);
+		loops++;
+		elapsed = now_ms() - start;
+	} while (elapsed < 200);
+
+	return (double)size * loops / 1e3 / elapsed;
+}
+
+/* pa_omci_crc32() takes a 32 bit length */
+static uint32_t omci_crc32(uint32_t crc, const uint8_t *data, size_t len)
+{
+	return pa_omci_crc32(crc, data, (uint32_t)len);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t size = BENCH_SIZE_DEFAULT << 20, i;
+	uint32_t ref, crc;
+	unsigned int n;
+	uint8_t *buf;
+	int c, index, failed = 0;
+
+	while ((c = getopt_long(argc, argv, opt_string, long_opts,
+				&index)) != -1) {
+		switch (c) {
+		case 's':
+			size = strtoul(optarg, NULL, 0) << 20;
+			break;
+		default:
+			printf("Usage: %s [options]\n%s", argv[0], help);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if (size < BENCH_CASE_LEN * 2 + 64)
+		size = BENCH_CASE_LEN * 2 + 64;
+
+	buf = malloc(size);
+	if (!buf) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	srand(7);
+	for (i = 0; i < size; i++)
+		buf[i] = rand();
+
+	/* check value of the CRC-32/MPEG-2 register for "123456789" */
+	crc = pon_img_crc32(PON_IMG_CRC32_INIT, (const uint8_t *)"123456789",
+			    9);
+	if (crc != 0x0376e6e7) {
+		printf("check value 0x%08x, expected 0x0376e6e7\n", crc);
+		failed = 1;
+	}
+
+	printf("%-14s %10.1f MB/s\n", "pa_omci_crc32",
+	       throughput(omci_crc32, buf, size, &ref));
+
+	for (n = 0; n < sizeof(impls) / sizeof(impls[0]); n++) {
+		if (pon_img_crc32_impl_set(impls[n]) != 0) {
+			printf("%-14s not available\n", impls[n]);
+			continue;
+		}
+		if (check_impl(impls[n], buf)) {
+			failed = 1;
+			continue;
+		}
+		printf("%-14s %10.1f MB/s", impls[n],
+		       throughput(pon_img_crc32, buf, size, &crc));
+		if (crc != ref) {
+			printf(", CRC 0x%08x, expected 0x%08x\n", crc, ref);
+			failed = 1;
+			continue;
+		}
+		printf(", bit-exact\n");
+	}
+
+	free(buf);
+
+	return failed;
+}
+
+/** @} */
@@ -0,0 +1,450 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "pon_img_crc.h"
+#include "pon_img_debug.h"
+#include "pon_img_delta.h"
+#include "pon_img_sha.h"
+#include "pon_img_uimage.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Size of each buffer used to build the new image */
+#define DELTA_BUF_SIZE		(64 * 1024)
+
+/** State of building the new image */
+struct delta {
+	/** Delta image */
+	int fd;
+	/** Read buffer of the delta image */
+	uint8_t *in;
+	/** Bytes in the read buffer */
+	uint32_t in_len;
+	/** Read position in the read buffer */
+	uint32_t in_pos;
+	/** Volumes of the base image */
+	const int *base_fd;
+	/** Volume sizes of the base image */
+	const struct pon_img_delta_vol *base_vol;
+	/** Size of the base image */
+	uint32_t base_size;
+	/** Bytes read from the base image */
+	uint8_t *base;
+	/** Data of the current command */
+	uint8_t *data;
+	/** New image */
+	int out_fd;
+	/** Write buffer of the new image */
+	uint8_t *out;
+	/** Bytes in the write buffer */
+	uint32_t out_len;
+	/** Expected size of the new image */
+	uint32_t size;
+	/** Bytes of the new image produced so far */
+	uint32_t done;
+	/** CRC register of the new image */
+	uint32_t crc;
+	/** Optional check of the new image */
+	struct pon_img_uimage *uimage;
+	/** Optional digests of the new image */
+	struct pon_img_digest *digest;
+};
+
+static ssize_t read_full(int fd, uint8_t *buf, size_t len)
+{
+	size_t done = 0;
+	ssize_t ret;
+
+	while (done < len) {
+		ret = read(fd, buf + done, len - done);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0)
+			return -1;
+		if (ret == 0)
+			break;
+		done += ret;
+	}
+
+	return done;
+}
+
+static enum pon_adapter_errno write_full(int fd, const uint8_t *buf,
+					 size_t len)
+{
+	ssize_t ret;
+
+	while (len) {
+		ret = write(fd, buf, len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0) {
+			dbg_err("image write failed: %s\n", strerror(errno));
+			return PON_ADAPTER_ERROR;
+		}
+		buf += ret;
+		len -= ret;
+	}
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* Refill the read buffer, returns false at the end of the delta image */
+static bool delta_fill(struct delta *d)
+{
+	ssize_t ret;
+
+	if (d->in_pos < d->in_len)
+		return true;
+
+	ret = read_full(d->fd, d->in, DELTA_BUF_SIZE);
+	if (ret <= 0)
+		return false;
+
+	d->in_len = ret;
+	d->in_pos = 0;
+
+	return true;
+}
+
+static enum pon_adapter_errno delta_read(struct delta *d, uint8_t *dst,
+					 uint32_t len)
+{
+	uint32_t count;
+
+	while (len) {
+		if (!delta_fill(d)) {
+			dbg_err("delta image is truncated\n");
+			return PON_ADAPTER_ERR_SIZE;
+		}
+		count = d->in_len - d->in_pos;
+		if (count > len)
+			count = len;
+		memcpy(dst, d->in + d->in_pos, count);
+		d->in_pos += count;
+		dst += count;
+		len -= count;
+	}
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+static enum pon_adapter_errno delta_read_u32(struct delta *d, uint32_t *val)
+{
+	enum pon_adapter_errno error;
+	uint32_t be;
+
+	error = delta_read(d, (uint8_t *)&be, sizeof(be));
+	*val = ntohl(be);
+
+	return error;
+}
+
+/* Read from the base image, which continues from one volume to the next */
+static enum pon_adapter_errno base_read(const struct pon_img_delta_vol *vol,
+					const int *base_fd, uint8_t *buf,
+					uint32_t off, uint32_t len)
+{
+	uint32_t start = 0, count;
+	size_t done = 0;
+	ssize_t ret;
+	int i;
+
+	for (i = 0; i < PON_IMG_DELTA_VOLS && len; start += vol[i++].size) {
+		if (off >= start + vol[i].size)
+			continue;
+
+		count = start + vol[i].size - off;
+		if (count > len)
+			count = len;
+		for (done = 0; done < count; done += ret) {
+			ret = pread(base_fd[i], buf + done, count - done,
+				    (off_t)(off - start) + done);
+			if (ret < 0 && errno == EINTR) {
+				ret = 0;
+				continue;
+			}
+			if (ret <= 0) {
+				dbg_err("volume %.*s is shorter than %u bytes\n",
+					PON_IMG_DELTA_VOLLEN, vol[i].name,
+					vol[i].size);
+				return PON_ADAPTER_ERROR;
+			}
+		}
+		buf += count;
+		off += count;
+		len -= count;
+	}
+
+	return len ? PON_ADAPTER_ERR_OUT_OF_BOUNDS : PON_ADAPTER_SUCCESS;
+}
+
+static enum pon_adapter_errno delta_base_read(struct delta *d, uint32_t off,
+					      uint32_t len)
+{
+	return base_read(d->base_vol, d->base_fd, d->base, off, len);
+}
+
+/* Append bytes to the new image */
+static enum pon_adapter_errno delta_emit(struct delta *d, const uint8_t *data,
+					 uint32_t len)
+{
+	enum pon_adapter_errno error;
+	uint32_t count;
+
+	if (len > d->size - d->done) {
+		dbg_err("delta image exceeds the image size of %u bytes\n",
+			d->size);
+		return PON_ADAPTER_ERR_SIZE;
+	}
+
+	d->crc = pon_img_crc32(d->crc, data, len);
+	if (d->digest)
+		pon_img_digest_update(d->digest, data, len);
+	if (d->uimage) {
+		error = pon_img_uimage_feed(d->uimage, data, len);
+		if (error != PON_ADAPTER_SUCCESS)
+			return error;
+	}
+	d->done += len;
+
+	while (len) {
+		count = DELTA_BUF_SIZE - d->out_len;
+		if (count > len)
+			count = len;
+		memcpy(d->out + d->out_len, data, count);
+		d->out_len += count;
+		data += count;
+		len -= count;
+
+		if (d->out_len == DELTA_BUF_SIZE) {
+			error = write_full(d->out_fd, d->out, d->out_len);
+			if (error != PON_ADAPTER_SUCCESS)
+				return error;
+			d->out_len = 0;
+		}
+	}
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+static enum pon_adapter_errno delta_command(struct delta *d)
+{
+	enum pon_adapter_errno error;
+	uint32_t len, off = 0, count, i;
+	uint8_t type;
+
+	error = delta_read(d, &type, sizeof(type));
+	if (error != PON_ADAPTER_SUCCESS)
+		return error;
+	error = delta_read_u32(d, &len);
+	if (error != PON_ADAPTER_SUCCESS)
+		return error;
+
+	switch (type) {
+	case PON_IMG_DELTA_COPY:
+	case PON_IMG_DELTA_ADD:
+		error = delta_read_u32(d, &off);
+		if (error != PON_ADAPTER_SUCCESS)
+			return error;
+		if ((uint64_t)off + len > d->base_size) {
+			dbg_err("delta command exceeds the base image\n");
+			return PON_ADAPTER_ERR_OUT_OF_BOUNDS;
+		}
+		break;
+	case PON_IMG_DELTA_DATA:
+		break;
+	default:
+		dbg_err("unknown delta command %u\n", type);
+		return PON_ADAPTER_ERR_NOT_SUPPORTED;
+	}
+
+	for (; len; len -= count, off += count) {
+		count = len < DELTA_BUF_SIZE ? len : DELTA_BUF_SIZE;
+
+		if (type == PON_IMG_DELTA_DATA) {
+			error = delta_read(d, d->data, count);
+			if (error != PON_ADAPTER_SUCCESS)
+				return error;
+			error = delta_emit(d, d->data, count);
+			if (error != PON_ADAPTER_SUCCESS)
+				return error;
+			continue;
+		}
+
+		error = delta_base_read(d, off, count);
+		if (error != PON_ADAPTER_SUCCESS)
+			return error;
+		if (type == PON_IMG_DELTA_ADD) {
+			error = delta_read(d, d->data, count);
+			if (error != PON_ADAPTER_SUCCESS)
+				return error;
+			for (i = 0; i < count; i++)
+				d->base[i] += d->data[i];
+		}
+		error = delta_emit(d, d->base, count);
+		if (error != PON_ADAPTER_SUCCESS)
+			return error;
+	}
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+bool pon_img_delta_detect(const uint8_t *data, uint32_t len)
+{
+	uint32_t magic;
+
+	if (!data || len < sizeof(magic))
+		return false;
+
+	memcpy(&magic, data, sizeof(magic));
+
+	return ntohl(magic) == PON_IMG_DELTA_MAGIC;
+}
+
+enum pon_adapter_errno pon_img_delta_hdr_read(int fd,
+					      struct pon_img_delta_hdr *hdr)
+{
+	uint64_t size = 0;
+	int i;
+
+	if (read_full(fd, (uint8_t *)hdr, sizeof(*hdr)) != sizeof(*hdr) ||
+	    ntohl(hdr->magic) != PON_IMG_DELTA_MAGIC) {
+		dbg_err("invalid delta image header\n");
+		return PON_ADAPTER_ERR_INVALID_VAL;
+	}
+
+	hdr->magic = ntohl(hdr->magic);
+	hdr->version = ntohl(hdr->version);
+	hdr->base_size = ntohl(hdr->base_size);
+	hdr->base_crc = ntohl(hdr->base_crc);
+	hdr->size = ntohl(hdr->size);
+	hdr->crc = ntohl(hdr->crc);
+
+	if (hdr->version != PON_IMG_DELTA_VERSION) {
+		dbg_err("delta image version %u is not supported\n",
+			hdr->version);
+		return PON_ADAPTER_ERR_NOT_SUPPORTED;
+	}
+
+	for (i = 0; i < PON_IMG_DELTA_VOLS; i++) {
+		hdr->base_vol[i].size = ntohl(hdr->base_vol[i].size);
+		if (hdr->base_vol[i].size && !hdr->base_vol[i].name[0]) {
+			dbg_err("delta base volume %d has no name\n", i);
+			return PON_ADAPTER_ERR_INVALID_VAL;
+		}
+		size += hdr->base_vol[i].size;
+	}
+	if (size != hdr->base_size) {
+		dbg_err("delta base volumes hold %llu bytes, expected %u\n",
+			(unsigned long long)size, hdr->base_size);
+		return PON_ADAPTER_ERR_INVALID_VAL;
+	}
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+enum pon_adapter_errno
+pon_img_delta_base_check(const struct pon_img_delta_hdr *hdr,
+			 const int *base_fd)
+{
+	enum pon_adapter_errno error = PON_ADAPTER_SUCCESS;
+	uint32_t crc = PON_IMG_CRC32_INIT, off, count;
+	uint8_t *buf;
+
+	buf = malloc(DELTA_BUF_SIZE);
+	if (!buf)
+		return PON_ADAPTER_ERR_NO_MEMORY;
+
+	for (off = 0; off < hdr->base_size; off += count) {
+		count = hdr->base_size - off;
+		if (count > DELTA_BUF_SIZE)
+			count = DELTA_BUF_SIZE;
+		error = base_read(hdr->base_vol, base_fd, buf, off, count);
+		if (error != PON_ADAPTER_SUCCESS)
+			goto exit;
+		crc = pon_img_crc32(crc, buf, count);
+	}
+
+	if ((crc ^ 0xffffffff) != hdr->base_crc) {
+		dbg_err("base image CRC 0x%08x, expected 0x%08x\n",
+			crc ^ 0xffffffff, hdr->base_crc);
+		error = PON_ADAPTER_ERR_CRC;
+	}
+
+exit:
+	free(buf);
+	return error;
+}
+
+enum pon_adapter_errno pon_img_delta_apply(int fd,
+					   const struct pon_img_delta_hdr *hdr,
+					   const int *base_fd, int out_fd,
+					   struct pon_img_uimage *uimage,
+					   struct pon_img_digest *digest)
+{
+	enum pon_adapter_errno error;
+	struct delta d = {
+		.fd = fd,
+		.base_fd = base_fd,
+		.base_vol = hdr->base_vol,
+		.base_size = hdr->base_size,
+		.out_fd = out_fd,
+		.size = hdr->size,
+		.crc = PON_IMG_CRC32_INIT,
+		.uimage = uimage,
+		.digest = digest,
+	};
+
+	d.in = malloc(4 * DELTA_BUF_SIZE);
+	if (!d.in)
+		return PON_ADAPTER_ERR_NO_MEMORY;
+	d.base = d.in + DELTA_BUF_SIZE;
+	d.data = d.base + DELTA_BUF_SIZE;
+	d.out = d.data + DELTA_BUF_SIZE;
+
+	while (d.done < d.size) {
+		error = delta_command(&d);
+		if (error != PON_ADAPTER_SUCCESS)
+			goto exit;
+	}
+
+	error = write_full(out_fd, d.out, d.out_len);
+	if (error != PON_ADAPTER_SUCCESS)
+		goto exit;
+
+	if (delta_fill(&d)) {
+		dbg_err("delta image has data after the last command\n");
+		error = PON_ADAPTER_ERR_SIZE;
+		goto exit;
+	}
+
+	if ((d.crc ^ 0xffffffff) != hdr->crc) {
+		dbg_err("rebuilt image CRC 0x%08x, expected 0x%08x\n",
+			d.crc ^ 0xffffffff, hdr->crc);
+		error = PON_ADAPTER_ERR_CRC;
+		goto exit;
+	}
+
+	error = PON_ADAPTER_SUCCESS;
+
+exit:
+	free(d.in);
+	return error;
+}
+
+/** @} */
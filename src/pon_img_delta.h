@@ -0,0 +1,145 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ ******************************************************************************/
+/**
+   \file pon_img_delta.h
+   Delta images, which describe a new image by the differences to a base
+   image on the ONU.
+
+   A delta image starts with \ref pon_img_delta_hdr, followed by a list of
+   commands up to the end of the file. All numbers are in network byte
+   order. Each command starts with a type byte and the length:
+
+   - \ref PON_IMG_DELTA_COPY, length, base offset:
+     copy the bytes of the base image
+   - \ref PON_IMG_DELTA_ADD, length, base offset, data:
+     add the data bytewise to the bytes of the base image, like bsdiff
+   - \ref PON_IMG_DELTA_DATA, length, data:
+     bytes which are not in the base image
+
+   The commands produce the new image from start to end, the base image is
+   read at any offset. The base image is the content of the active bank:
+   the volumes listed in the header, each up to its given size, one after
+   the other. Its size and CRC, the same CRC as used for the SW download,
+   are checked against the volumes before the new image is built.
+*/
+
+#ifndef _PON_IMG_DELTA_H_
+#define _PON_IMG_DELTA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pon_adapter.h>
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Magic number of a delta image, "PDLT" */
+#define PON_IMG_DELTA_MAGIC	0x50444c54
+/** Supported format version */
+#define PON_IMG_DELTA_VERSION	2
+/** Length of the version names */
+#define PON_IMG_DELTA_NMLEN	32
+/** Maximum number of volumes of the base image */
+#define PON_IMG_DELTA_VOLS	3
+/** Length of the volume names */
+#define PON_IMG_DELTA_VOLLEN	16
+
+/** Copy from the base image */
+#define PON_IMG_DELTA_COPY	1
+/** Add to the base image */
+#define PON_IMG_DELTA_ADD	2
+/** New data */
+#define PON_IMG_DELTA_DATA	3
+
+struct pon_img_uimage;
+struct pon_img_digest;
+
+/** Volume of the base image, network byte order */
+struct pon_img_delta_vol {
+	/** Volume name without the bank identifier, like "kernel" */
+	uint8_t name[PON_IMG_DELTA_VOLLEN];
+	/** Bytes of the volume used for the base image, 0 if not used */
+	uint32_t size;
+};
+
+/** Header of a delta image, network byte order */
+struct pon_img_delta_hdr {
+	/** \ref PON_IMG_DELTA_MAGIC */
+	uint32_t magic;
+	/** \ref PON_IMG_DELTA_VERSION */
+	uint32_t version;
+	/** Size of the base image, the sum of the volume sizes */
+	uint32_t base_size;
+	/** CRC of the base image */
+	uint32_t base_crc;
+	/** Size of the new image */
+	uint32_t size;
+	/** CRC of the new image */
+	uint32_t crc;
+	/** Version of the base image, the name in its first header */
+	uint8_t base_name[PON_IMG_DELTA_NMLEN];
+	/** Volumes of the base image */
+	struct pon_img_delta_vol base_vol[PON_IMG_DELTA_VOLS];
+};
+
+/**	Check whether the data starts like a delta image. */
+bool pon_img_delta_detect(const uint8_t *data, uint32_t len);
+
+/**	Read and check the header of a delta image, the numbers are
+ *	converted to host byte order.
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- PON_ADAPTER_ERR_NOT_SUPPORTED: Unknown format version
+ *	- Other: An error code in case of error.
+ */
+enum pon_adapter_errno pon_img_delta_hdr_read(int fd,
+					      struct pon_img_delta_hdr *hdr);
+
+/**	Check that the volumes hold the base image.
+ *
+ *	\param[in] hdr		Header in host byte order
+ *	\param[in] base_fd	Volumes in the order of the header, -1 for
+ *				the unused ones
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- PON_ADAPTER_ERR_CRC: The volumes hold another base image
+ *	- Other: An error code in case of error.
+ */
+enum pon_adapter_errno
+pon_img_delta_base_check(const struct pon_img_delta_hdr *hdr,
+			 const int *base_fd);
+
+/**	Build the new image from the commands, which follow the header.
+ *	Memory use does not depend on the image size.
+ *
+ *	\param[in] fd		Delta image, positioned after the header
+ *	\param[in] hdr		Header in host byte order
+ *	\param[in] base_fd	Volumes of the base image, as for
+ *				\ref pon_img_delta_base_check
+ *	\param[in] out_fd	New image
+ *	\param[in] uimage	Parser to check the new image, optional
+ *	\param[in] digest	Digests of the new image, optional
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- PON_ADAPTER_ERR_CRC: The new image has not the expected CRC
+ *	- Other: An error code in case of error.
+ */
+enum pon_adapter_errno pon_img_delta_apply(int fd,
+					   const struct pon_img_delta_hdr *hdr,
+					   const int *base_fd, int out_fd,
+					   struct pon_img_uimage *uimage,
+					   struct pon_img_digest *digest);
+
+/** @} */
+
+#endif
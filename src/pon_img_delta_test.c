@@ -0,0 +1,276 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include <pon_adapter.h>
+#include <omci/pon_adapter_omci.h>
+#include <omci/me/pon_adapter_sw_image.h>
+
+#include <pon_img_register.h>
+#include <pon_uboot.h>
+#include "pon_img_common.h"
+#include "pon_img_bank.h"
+#include "pon_img_crc.h"
+#include "pon_img_delta.h"
+#include "pon_img_test.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Size of the environment file */
+#define DELTA_TEST_ENV_SIZE	0x4000
+/** Size of the kernel volume of the base image */
+#define DELTA_TEST_KERNEL	(48 * 1024)
+/** Size of the rootfs volume of the base image */
+#define DELTA_TEST_ROOTFS	(200 * 1024)
+/** Size of the base image */
+#define DELTA_TEST_BASE		(DELTA_TEST_KERNEL + DELTA_TEST_ROOTFS)
+/** Size of the new image */
+#define DELTA_TEST_SIZE		(DELTA_TEST_BASE + 1000)
+/** Version of the base image */
+#define DELTA_TEST_VERSION	"base_1.0"
+
+static uint8_t base[DELTA_TEST_BASE];
+static uint8_t image[DELTA_TEST_SIZE];
+static uint8_t delta[DELTA_TEST_SIZE + 1024];
+
+static int file_write(const char *path, const uint8_t *data, uint32_t size)
+{
+	FILE *f;
+
+	f = fopen(path, "w");
+	if (!f)
+		return -1;
+	if (fwrite(data, 1, size, f) != size) {
+		fclose(f);
+		return -1;
+	}
+
+	return fclose(f);
+}
+
+/* The environment holds the active bank and the version of the base */
+static int env_setup(struct pon_img_test *test, char *env_path,
+		     char *config_path)
+{
+	FILE *f;
+
+	pon_img_test_path(test, "uboot.env", env_path, PON_IMG_PATH_LEN);
+	pon_img_test_path(test, "fw_env.config", config_path,
+			  PON_IMG_PATH_LEN);
+
+	f = fopen(env_path, "w");
+	if (!f)
+		return -1;
+	if (ftruncate(fileno(f), DELTA_TEST_ENV_SIZE)) {
+		fclose(f);
+		return -1;
+	}
+	if (fclose(f))
+		return -1;
+
+	f = fopen(config_path, "w");
+	if (!f)
+		return -1;
+	fprintf(f, "%s 0x0 0x%x\n", env_path, DELTA_TEST_ENV_SIZE);
+
+	return fclose(f);
+}
+
+static int env_set(struct pon_img_context *ctx, const char *version)
+{
+	if (pon_uboot_txn_begin(ctx) != PON_ADAPTER_SUCCESS)
+		return -1;
+	if (pon_uboot_set_str(ctx, UBOOT_VAR_IMG_ACTIVE, "A") !=
+	    PON_ADAPTER_SUCCESS ||
+	    pon_uboot_set_str(ctx, UBOOT_VAR_IMG_VERSION "A", version) !=
+	    PON_ADAPTER_SUCCESS) {
+		pon_uboot_txn_abort(ctx);
+		return -1;
+	}
+
+	return pon_uboot_txn_commit(ctx) == PON_ADAPTER_SUCCESS ? 0 : -1;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t val)
+{
+	val = htonl(val);
+	memcpy(p, &val, sizeof(val));
+
+	return p + sizeof(val);
+}
+
+static uint8_t *put_cmd(uint8_t *p, uint8_t type, uint32_t len, uint32_t off)
+{
+	*p++ = type;
+	p = put_u32(p, len);
+	if (type != PON_IMG_DELTA_DATA)
+		p = put_u32(p, off);
+
+	return p;
+}
+
+/* The new image takes the base with a few changed bytes and new data
+ * at the end, each command type is used.
+ */
+static uint32_t delta_make(void)
+{
+	struct pon_img_delta_hdr hdr = {0};
+	uint32_t i, copy = DELTA_TEST_BASE - 4096;
+	uint8_t *p = delta + sizeof(hdr);
+
+	memcpy(image, base, DELTA_TEST_BASE);
+	for (i = 0; i < 4096; i += 64)
+		image[copy + i] += (uint8_t)i + 1;
+	pon_img_test_fill(image + DELTA_TEST_BASE,
+			  DELTA_TEST_SIZE - DELTA_TEST_BASE, 3);
+
+	p = put_cmd(p, PON_IMG_DELTA_COPY, copy, 0);
+	p = put_cmd(p, PON_IMG_DELTA_ADD, 4096, copy);
+	for (i = 0; i < 4096; i++)
+		*p++ = (uint8_t)(image[copy + i] - base[copy + i]);
+	p = put_cmd(p, PON_IMG_DELTA_DATA, DELTA_TEST_SIZE - DELTA_TEST_BASE,
+		    0);
+	memcpy(p, image + DELTA_TEST_BASE, DELTA_TEST_SIZE - DELTA_TEST_BASE);
+	p += DELTA_TEST_SIZE - DELTA_TEST_BASE;
+
+	hdr.magic = htonl(PON_IMG_DELTA_MAGIC);
+	hdr.version = htonl(PON_IMG_DELTA_VERSION);
+	hdr.base_size = htonl(DELTA_TEST_BASE);
+	hdr.base_crc = htonl(pon_img_crc32(PON_IMG_CRC32_INIT, base,
+					   DELTA_TEST_BASE) ^ 0xffffffff);
+	hdr.size = htonl(DELTA_TEST_SIZE);
+	hdr.crc = htonl(pon_img_crc32(PON_IMG_CRC32_INIT, image,
+				      DELTA_TEST_SIZE) ^ 0xffffffff);
+	memcpy(hdr.base_name, DELTA_TEST_VERSION, sizeof(DELTA_TEST_VERSION));
+	memcpy(hdr.base_vol[0].name, PON_IMG_VOL_KERNEL,
+	       sizeof(PON_IMG_VOL_KERNEL));
+	hdr.base_vol[0].size = htonl(DELTA_TEST_KERNEL);
+	memcpy(hdr.base_vol[1].name, PON_IMG_VOL_ROOTFS,
+	       sizeof(PON_IMG_VOL_ROOTFS));
+	hdr.base_vol[1].size = htonl(DELTA_TEST_ROOTFS);
+	memcpy(delta, &hdr, sizeof(hdr));
+
+	return (uint32_t)(p - delta);
+}
+
+/* The volumes of bank A hold the base, the rootfs volume is longer */
+static int bank_setup(const char *dir)
+{
+	char path[PON_IMG_PATH_LEN];
+	static uint8_t rootfs[DELTA_TEST_ROOTFS + 4096];
+
+	memcpy(rootfs, base + DELTA_TEST_KERNEL, DELTA_TEST_ROOTFS);
+	memset(rootfs + DELTA_TEST_ROOTFS, 0xff,
+	       sizeof(rootfs) - DELTA_TEST_ROOTFS);
+
+	snprintf(path, sizeof(path), "%s/" PON_IMG_VOL_KERNEL "A", dir);
+	if (file_write(path, base, DELTA_TEST_KERNEL))
+		return -1;
+	snprintf(path, sizeof(path), "%s/" PON_IMG_VOL_ROOTFS "A", dir);
+
+	return file_write(path, rootfs, sizeof(rootfs));
+}
+
+static int run(struct pon_img_test *test, const char *name,
+	       uint32_t delta_size, bool expect_ok)
+{
+	const struct pa_sw_image_ops *ops =
+		test->pa_ops->omci_me_ops->sw_image;
+	char path[PON_IMG_PATH_LEN];
+	enum pon_adapter_errno ret;
+	bool ok;
+
+	ret = pon_img_test_download(test, 1, delta, delta_size, path,
+				    sizeof(path));
+	if (ret != PON_ADAPTER_SUCCESS)
+		(void)ops->download_stop(test->ctx, 1);
+
+	ok = ret == PON_ADAPTER_SUCCESS &&
+	     pon_img_test_file_check(path, image, DELTA_TEST_SIZE);
+	if (ok != expect_ok) {
+		printf("%s: failed with %d\n", name, ret);
+		return 1;
+	}
+	printf("%s: passed\n", name);
+
+	return 0;
+}
+
+int main(void)
+{
+	char env_path[PON_IMG_PATH_LEN], config_path[PON_IMG_PATH_LEN];
+	char bank_dir[PON_IMG_PATH_LEN], path[PON_IMG_PATH_LEN];
+	struct pon_img_test test;
+	uint32_t delta_size;
+	int failed = 0;
+
+	pon_img_test_fill(base, DELTA_TEST_BASE, 1);
+	delta_size = delta_make();
+
+	if (pon_img_test_open(&test, "pon_img_delta_test"))
+		return 1;
+	pon_img_test_path(&test, "bank", bank_dir, sizeof(bank_dir));
+	if (mkdir(bank_dir, 0700) || bank_setup(bank_dir) ||
+	    env_setup(&test, env_path, config_path)) {
+		perror("setup");
+		failed = 1;
+		goto exit;
+	}
+	test.ctx->uboot_env_config = config_path;
+	test.ctx->dl_bank_dir = bank_dir;
+	test.ctx->dl_no_checkpoint = true;
+	if (pon_img_test_start(&test) ||
+	    env_set(test.ctx, DELTA_TEST_VERSION)) {
+		failed = 1;
+		goto exit;
+	}
+
+	failed += run(&test, "delta on the active bank", delta_size, true);
+
+	/* another image is running */
+	if (env_set(test.ctx, "base_2.0")) {
+		failed++;
+		goto exit;
+	}
+	failed += run(&test, "other active version", delta_size, false);
+	(void)env_set(test.ctx, DELTA_TEST_VERSION);
+
+	/* the volumes hold another base */
+	base[DELTA_TEST_KERNEL + 100] ^= 1;
+	snprintf(path, sizeof(path), "%s/" PON_IMG_VOL_ROOTFS "A", bank_dir);
+	if (file_write(path, base + DELTA_TEST_KERNEL, DELTA_TEST_ROOTFS)) {
+		failed++;
+		goto exit;
+	}
+	failed += run(&test, "changed rootfs volume", delta_size, false);
+
+	/* the volume is shorter than the base part */
+	if (truncate(path, DELTA_TEST_ROOTFS / 2)) {
+		failed++;
+		goto exit;
+	}
+	failed += run(&test, "short rootfs volume", delta_size, false);
+
+exit:
+	pon_img_test_close(&test);
+
+	return failed ? 1 : 0;
+}
+
+/** @} */
@@ -0,0 +1,964 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <mtd/mtd-user.h>
+#include <mtd/ubi-user.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wredundant-decls"
+#include <safe_lib.h>
+#include <safe_mem_lib.h>
+#pragma GCC diagnostic pop
+
+#include "pon_img_common.h"
+#include "pon_img_crc.h"
+#include "pon_img_debug.h"
+#include "pon_img_env.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Maximum length of a device path */
+#define ENV_PATH_LEN		128
+/** Maximum length of a configuration line */
+#define ENV_LINE_LEN		256
+/** Flag of the valid copy on NOR flash */
+#define ENV_FLAG_ACTIVE		1
+/** Flag of the outdated copy on NOR flash */
+#define ENV_FLAG_OBSOLETE	0
+/** Minimum number of index slots */
+#define ENV_INDEX_MIN		16
+
+/** Device type of an environment copy */
+enum env_dev_type {
+	/** Plain file, written in place */
+	ENV_DEV_FILE,
+	/** UBI volume, written with a volume update */
+	ENV_DEV_UBI,
+	/** NOR flash, the sectors are erased and written */
+	ENV_DEV_MTD_NOR,
+	/** NAND or other MTD, bad blocks are skipped */
+	ENV_DEV_MTD
+};
+
+/** Location of an environment copy */
+struct env_dev {
+	/** Device or file */
+	char path[ENV_PATH_LEN];
+	/** Offset of the copy in the device */
+	uint64_t offset;
+	/** Erase sector size */
+	uint32_t sector;
+	/** Number of sectors which can hold the copy, bad blocks included */
+	uint32_t sectors;
+	/** Device type */
+	enum env_dev_type type;
+};
+
+/** Index entry of a variable, the name and value stay in the image */
+struct env_var {
+	/** Hash of the name */
+	uint32_t hash;
+	/** Offset of the name in the data */
+	uint32_t off;
+	/** Offset of the value in the data */
+	uint32_t val_off;
+	/** Length of the name, 0 for a free slot */
+	uint16_t name_len;
+};
+
+struct pon_img_env {
+	/** Locations of the copies */
+	struct env_dev dev[PON_IMG_ENV_COPIES];
+	/** Number of copies, 2 for a redundant environment */
+	unsigned int copies;
+	/** Size of a copy, header included */
+	uint32_t size;
+	/** The copies use the active/obsolete flags of NOR flash */
+	bool flag_bool;
+	/** A valid copy was read */
+	bool valid;
+	/** Copy which was read, a write goes to the other one */
+	unsigned int current;
+	/** Flag of the current copy */
+	uint8_t flags;
+	/** CRC of the current copy */
+	uint32_t crc;
+	/** Current copy */
+	uint8_t *image;
+	/** Modified copy of the image, NULL while unchanged */
+	uint8_t *work;
+	/** A variable of the work image was changed */
+	bool dirty;
+	/** Hash index of the variables, a power of two slots */
+	struct env_var *index;
+	/** Number of index slots */
+	uint32_t index_size;
+	/** Lock file while the lock is held, -1 otherwise */
+	int lock_fd;
+	/** Nesting depth of the lock */
+	unsigned int lock_count;
+};
+
+static uint32_t env_hdr_len(const struct pon_img_env *env)
+{
+	/* a redundant copy has a flag byte after the CRC */
+	return env->copies > 1 ? 5 : 4;
+}
+
+static uint32_t env_data_len(const struct pon_img_env *env)
+{
+	return env->size - env_hdr_len(env);
+}
+
+static uint8_t *env_data(const struct pon_img_env *env)
+{
+	return (env->work ? env->work : env->image) + env_hdr_len(env);
+}
+
+/* FNV-1a */
+static uint32_t env_hash(const char *name, size_t len)
+{
+	uint32_t hash = 2166136261u;
+
+	while (len--) {
+		hash ^= (uint8_t)*name++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/* Offset of the terminating empty string, data_len if there is none */
+static uint32_t env_data_end(const uint8_t *data, uint32_t data_len)
+{
+	uint32_t pos = 0;
+
+	while (pos < data_len && data[pos])
+		pos += strnlen((const char *)data + pos, data_len - pos) + 1;
+
+	return pos < data_len ? pos : data_len;
+}
+
+static struct env_var *env_slot(const struct pon_img_env *env,
+				const uint8_t *data, const char *name,
+				size_t len, uint32_t hash)
+{
+	uint32_t mask = env->index_size - 1;
+	struct env_var *var;
+	uint32_t i;
+
+	for (i = hash & mask; ; i = (i + 1) & mask) {
+		var = &env->index[i];
+		if (!var->name_len)
+			return var;
+		if (var->hash == hash && var->name_len == len &&
+		    memcmp(data + var->off, name, len) == 0)
+			return var;
+	}
+}
+
+/* Index all variables, a later definition of a name replaces the earlier */
+static enum pon_adapter_errno env_index_build(struct pon_img_env *env)
+{
+	uint32_t data_len = env_data_len(env);
+	const uint8_t *data = env->image || env->work ? env_data(env) : NULL;
+	uint32_t pos, len, count = 0, size = ENV_INDEX_MIN;
+	const char *entry, *eq;
+	struct env_var *var;
+
+	free(env->index);
+	env->index = NULL;
+	env->index_size = 0;
+
+	for (pos = 0; data && pos < data_len && data[pos]; pos += len + 1) {
+		len = strnlen((const char *)data + pos, data_len - pos);
+		count++;
+	}
+	while (size < 2 * count)
+		size <<= 1;
+
+	env->index = calloc(size, sizeof(*env->index));
+	if (!env->index)
+		return PON_ADAPTER_ERR_NO_MEMORY;
+	env->index_size = size;
+
+	for (pos = 0; data && pos < data_len && data[pos]; pos += len + 1) {
+		entry = (const char *)data + pos;
+		len = strnlen(entry, data_len - pos);
+		/* the last variable is not terminated */
+		if (pos + len >= data_len)
+			break;
+		eq = memchr(entry, '=', len);
+		if (!eq || eq == entry || eq - entry > UINT16_MAX)
+			continue;
+
+		var = env_slot(env, data, entry, eq - entry,
+			       env_hash(entry, eq - entry));
+		var->hash = env_hash(entry, eq - entry);
+		var->off = pos;
+		var->val_off = pos + (eq - entry) + 1;
+		var->name_len = eq - entry;
+	}
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+static struct env_var *env_lookup(const struct pon_img_env *env,
+				  const char *name)
+{
+	size_t len = strlen(name);
+	struct env_var *var;
+
+	if (!env->index_size || !len)
+		return NULL;
+
+	var = env_slot(env, env_data(env), name, len, env_hash(name, len));
+
+	return var->name_len ? var : NULL;
+}
+
+const char *pon_img_env_get(struct pon_img_env *env, const char *name)
+{
+	struct env_var *var;
+
+	if (!env || !name)
+		return NULL;
+
+	var = env_lookup(env, name);
+	if (!var)
+		return NULL;
+
+	return (const char *)env_data(env) + var->val_off;
+}
+
+static int env_read_all(int fd, uint8_t *buf, uint32_t len, uint64_t offset)
+{
+	uint32_t done = 0;
+	ssize_t ret;
+
+	while (done < len) {
+		ret = pread(fd, buf + done, len - done, offset + done);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return -1;
+		done += ret;
+	}
+
+	return 0;
+}
+
+static int env_write_all(int fd, const uint8_t *buf, uint32_t len,
+			 uint64_t offset)
+{
+	uint32_t done = 0;
+	ssize_t ret;
+
+	while (done < len) {
+		ret = pwrite(fd, buf + done, len - done, offset + done);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return -1;
+		done += ret;
+	}
+
+	return 0;
+}
+
+/* Read a copy from NAND, bad blocks are skipped */
+static int env_mtd_read(int fd, const struct env_dev *dev, uint8_t *buf,
+			uint32_t size)
+{
+	uint64_t blk, end = dev->offset + (uint64_t)dev->sectors * dev->sector;
+	uint32_t done = 0, len;
+	loff_t pos;
+
+	for (blk = dev->offset; done < size && blk < end; blk += dev->sector) {
+		pos = blk;
+		if (ioctl(fd, MEMGETBADBLOCK, &pos) > 0) {
+			dbg_wrn("%s: bad block at 0x%llx skipped\n", dev->path,
+				(unsigned long long)blk);
+			continue;
+		}
+		len = size - done < dev->sector ? size - done : dev->sector;
+		if (env_read_all(fd, buf + done, len, blk))
+			return -1;
+		done += len;
+	}
+
+	return done == size ? 0 : -1;
+}
+
+/* Read a copy into a buffer. The copy is not mapped, a write or truncation
+ * of the file by another process would change a mapping after the CRC check.
+ */
+static int env_copy_read(struct pon_img_env *env, unsigned int i,
+			 uint8_t **image)
+{
+	const struct env_dev *dev = &env->dev[i];
+	uint8_t *buf;
+	int fd, ret;
+
+	fd = open(dev->path, O_RDONLY);
+	if (fd < 0) {
+		dbg_err("%s can not be opened: %s\n", dev->path,
+			strerror(errno));
+		return -1;
+	}
+
+	buf = malloc(env->size);
+	if (!buf) {
+		close(fd);
+		return -1;
+	}
+
+	if (dev->type == ENV_DEV_MTD)
+		ret = env_mtd_read(fd, dev, buf, env->size);
+	else
+		ret = env_read_all(fd, buf, env->size, dev->offset);
+	close(fd);
+	if (ret) {
+		dbg_err("%s: environment can not be read\n", dev->path);
+		free(buf);
+		return -1;
+	}
+
+	*image = buf;
+	return 0;
+}
+
+static uint32_t env_get_le32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static bool env_copy_valid(const struct pon_img_env *env,
+			   const uint8_t *image)
+{
+	uint32_t hdr = env_hdr_len(env);
+
+	return image && env_get_le32(image) ==
+		pon_img_crc32_ieee(0, image + hdr, env->size - hdr);
+}
+
+/* Select the newer of two valid copies, the same way as U-Boot */
+static unsigned int env_select(const struct pon_img_env *env, uint8_t f0,
+			       uint8_t f1)
+{
+	if (env->flag_bool) {
+		if (f0 == ENV_FLAG_ACTIVE && f1 == ENV_FLAG_OBSOLETE)
+			return 0;
+		if (f0 == ENV_FLAG_OBSOLETE && f1 == ENV_FLAG_ACTIVE)
+			return 1;
+		if (f0 == f1 || f0 == 0xff)
+			return 0;
+		return f1 == 0xff ? 1 : 0;
+	}
+
+	/* the counter wraps around */
+	if (f0 == 0xff && f1 == 0)
+		return 1;
+	if (f1 == 0xff && f0 == 0)
+		return 0;
+
+	return f1 > f0 ? 1 : 0;
+}
+
+enum pon_adapter_errno pon_img_env_lock(struct pon_img_env *env)
+{
+	int fd;
+
+	if (!env)
+		return PON_ADAPTER_ERR_PTR_INVALID;
+
+	if (env->lock_count) {
+		env->lock_count++;
+		return PON_ADAPTER_SUCCESS;
+	}
+
+	/* the same lock as fw_printenv and fw_setenv */
+	fd = open(PON_IMG_ENV_LOCK, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		dbg_err("%s can not be opened: %s\n", PON_IMG_ENV_LOCK,
+			strerror(errno));
+		return PON_ADAPTER_ERROR;
+	}
+	while (flock(fd, LOCK_EX)) {
+		if (errno == EINTR)
+			continue;
+		dbg_err("%s can not be locked: %s\n", PON_IMG_ENV_LOCK,
+			strerror(errno));
+		close(fd);
+		return PON_ADAPTER_ERROR;
+	}
+
+	env->lock_fd = fd;
+	env->lock_count = 1;
+	return PON_ADAPTER_SUCCESS;
+}
+
+void pon_img_env_unlock(struct pon_img_env *env)
+{
+	if (!env || !env->lock_count || --env->lock_count)
+		return;
+
+	/* closing the file releases the lock */
+	close(env->lock_fd);
+	env->lock_fd = -1;
+}
+
+/* Read all copies and keep the valid one */
+static enum pon_adapter_errno env_load(struct pon_img_env *env)
+{
+	uint8_t *image[PON_IMG_ENV_COPIES] = { NULL, };
+	bool valid[PON_IMG_ENV_COPIES] = { false, };
+	unsigned int i, cur;
+
+	for (i = 0; i < env->copies; i++) {
+		if (env_copy_read(env, i, &image[i]))
+			continue;
+		valid[i] = env_copy_valid(env, image[i]);
+		if (!valid[i])
+			dbg_wrn("%s: bad CRC of the environment at 0x%llx\n",
+				env->dev[i].path,
+				(unsigned long long)env->dev[i].offset);
+	}
+
+	if (env->copies > 1 && valid[0] && valid[1])
+		cur = env_select(env, image[0][4], image[1][4]);
+	else
+		cur = env->copies > 1 && valid[1] ? 1 : 0;
+
+	for (i = 0; i < env->copies; i++)
+		if (i != cur || !valid[i])
+			free(image[i]);
+
+	free(env->image);
+	free(env->work);
+	env->work = NULL;
+	env->dirty = false;
+
+	env->current = cur;
+	env->valid = valid[cur];
+	if (env->valid) {
+		env->image = image[cur];
+		env->crc = env_get_le32(env->image);
+		env->flags = env->copies > 1 ? env->image[4] : 0;
+	} else {
+		dbg_wrn("no valid U-Boot environment, it is empty\n");
+		env->image = NULL;
+		env->crc = 0;
+		env->flags = 0;
+	}
+
+	return env_index_build(env);
+}
+
+enum pon_adapter_errno pon_img_env_reload(struct pon_img_env *env,
+					  bool *changed)
+{
+	enum pon_adapter_errno error;
+	unsigned int current;
+	uint32_t crc;
+	uint8_t flags;
+	bool valid;
+
+	if (!env)
+		return PON_ADAPTER_ERR_PTR_INVALID;
+
+	current = env->current;
+	crc = env->crc;
+	flags = env->flags;
+	valid = env->valid;
+
+	error = pon_img_env_lock(env);
+	if (error != PON_ADAPTER_SUCCESS)
+		return error;
+	error = env_load(env);
+	pon_img_env_unlock(env);
+
+	if (changed)
+		*changed = current != env->current || crc != env->crc ||
+			   flags != env->flags || valid != env->valid;
+
+	return error;
+}
+
+/* Determine the device type, the sector size of an MTD is its erase size */
+static enum pon_adapter_errno env_dev_probe(struct env_dev *dev,
+					    uint32_t size)
+{
+	struct mtd_info_user mtd;
+	struct stat st;
+	int fd;
+
+	fd = open(dev->path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		dbg_err("%s can not be opened: %s\n", dev->path,
+			strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return PON_ADAPTER_ERR_RESOURCE_NOT_FOUND;
+	}
+
+	if (S_ISCHR(st.st_mode) && !ioctl(fd, MEMGETINFO, &mtd)) {
+		dev->type = mtd.type == MTD_NORFLASH ? ENV_DEV_MTD_NOR :
+						       ENV_DEV_MTD;
+		if (!dev->sector)
+			dev->sector = mtd.erasesize;
+	} else if (S_ISCHR(st.st_mode)) {
+		dev->type = ENV_DEV_UBI;
+	} else {
+		dev->type = ENV_DEV_FILE;
+	}
+	close(fd);
+
+	if (!dev->sector)
+		dev->sector = size;
+	/* at least the sectors which are needed without bad blocks */
+	if ((uint64_t)dev->sectors * dev->sector < size)
+		dev->sectors = (size + dev->sector - 1) / dev->sector;
+
+	if (dev->type == ENV_DEV_UBI && dev->offset) {
+		dbg_err("%s: a UBI volume holds one copy at offset 0\n",
+			dev->path);
+		return PON_ADAPTER_ERR_INVALID_VAL;
+	}
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* Read the fw_env.config compatible file */
+static enum pon_adapter_errno env_config_parse(struct pon_img_env *env,
+					       const char *config)
+{
+	char line[ENV_LINE_LEN];
+	char *tok, *save, *end;
+	uint64_t val[4];
+	struct env_dev *dev;
+	unsigned int n;
+	FILE *f;
+
+	f = fopen(config, "r");
+	if (!f) {
+		dbg_err("%s can not be opened: %s\n", config, strerror(errno));
+		return PON_ADAPTER_ERR_RESOURCE_NOT_FOUND;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		tok = strtok_r(line, " \t\r\n", &save);
+		if (!tok || tok[0] == '#')
+			continue;
+		if (env->copies == PON_IMG_ENV_COPIES) {
+			dbg_err("%s: more than %d environment copies\n",
+				config, PON_IMG_ENV_COPIES);
+			goto err;
+		}
+		dev = &env->dev[env->copies];
+		if (snprintf(dev->path, sizeof(dev->path), "%s", tok) >=
+		    (int)sizeof(dev->path))
+			goto err;
+
+		memset(val, 0, sizeof(val));
+		for (n = 0; n < ARRAY_SIZE(val); n++) {
+			tok = strtok_r(NULL, " \t\r\n", &save);
+			if (!tok || tok[0] == '#')
+				break;
+			val[n] = strtoull(tok, &end, 0);
+			if (*end)
+				goto err;
+		}
+		/* device, offset and size are mandatory */
+		if (n < 2 || val[1] < 5 || val[1] > UINT32_MAX ||
+		    val[2] > UINT32_MAX || val[3] > UINT32_MAX)
+			goto err;
+		if (env->copies && val[1] != env->size) {
+			dbg_err("%s: the copies differ in size\n", config);
+			goto err;
+		}
+		dev->offset = val[0];
+		env->size = (uint32_t)val[1];
+		dev->sector = (uint32_t)val[2];
+		dev->sectors = (uint32_t)val[3];
+		env->copies++;
+	}
+	fclose(f);
+
+	if (!env->copies) {
+		dbg_err("%s: no environment configured\n", config);
+		return PON_ADAPTER_ERR_INVALID_VAL;
+	}
+
+	return PON_ADAPTER_SUCCESS;
+
+err:
+	dbg_err("%s: invalid line %u\n", config, env->copies + 1);
+	fclose(f);
+	return PON_ADAPTER_ERR_INVALID_VAL;
+}
+
+enum pon_adapter_errno pon_img_env_open(struct pon_img_env **env,
+					const char *config)
+{
+	enum pon_adapter_errno error;
+	struct pon_img_env *e;
+	unsigned int i;
+
+	dbg_in_args("%p, %s", env, config);
+
+	if (!env || !config)
+		return PON_ADAPTER_ERR_PTR_INVALID;
+
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return PON_ADAPTER_ERR_NO_MEMORY;
+	e->lock_fd = -1;
+
+	error = env_config_parse(e, config);
+	for (i = 0; error == PON_ADAPTER_SUCCESS && i < e->copies; i++)
+		error = env_dev_probe(&e->dev[i], e->size);
+	if (error != PON_ADAPTER_SUCCESS)
+		goto err;
+
+	/* U-Boot uses the active/obsolete flags only on NOR flash */
+	e->flag_bool = e->dev[0].type == ENV_DEV_MTD_NOR;
+
+	error = pon_img_env_lock(e);
+	if (error != PON_ADAPTER_SUCCESS)
+		goto err;
+	error = env_load(e);
+	pon_img_env_unlock(e);
+	if (error != PON_ADAPTER_SUCCESS)
+		goto err;
+
+	dbg_msg("U-Boot environment %s, %u bytes, %u copies, copy %u used\n",
+		e->dev[e->current].path, e->size, e->copies, e->current);
+
+	*env = e;
+
+	dbg_out_ret("%d", PON_ADAPTER_SUCCESS);
+	return PON_ADAPTER_SUCCESS;
+
+err:
+	pon_img_env_close(e);
+	dbg_out_ret("%d", error);
+	return error;
+}
+
+void pon_img_env_close(struct pon_img_env *env)
+{
+	if (!env)
+		return;
+
+	if (env->lock_count) {
+		env->lock_count = 1;
+		pon_img_env_unlock(env);
+	}
+	free(env->image);
+	free(env->work);
+	free(env->index);
+	free(env);
+}
+
+enum pon_adapter_errno pon_img_env_set(struct pon_img_env *env,
+				       const char *name, const char *value)
+{
+	size_t name_len, val_len, old_len = 0, need;
+	uint32_t data_len, end;
+	struct env_var *var;
+	uint8_t *data;
+
+	if (!env || !name)
+		return PON_ADAPTER_ERR_PTR_INVALID;
+
+	name_len = strlen(name);
+	val_len = value ? strlen(value) : 0;
+	if (!name_len || name_len > UINT16_MAX || strchr(name, '='))
+		return PON_ADAPTER_ERR_INVALID_VAL;
+
+	if (!env->work) {
+		env->work = calloc(1, env->size);
+		if (!env->work)
+			return PON_ADAPTER_ERR_NO_MEMORY;
+		if (env->image && memcpy_s(env->work, env->size, env->image,
+					   env->size)) {
+			free(env->work);
+			env->work = NULL;
+			return PON_ADAPTER_ERR_MEM_ACCESS;
+		}
+	}
+
+	data = env_data(env);
+	data_len = env_data_len(env);
+	var = env_lookup(env, name);
+	if (var)
+		old_len = strlen((const char *)data + var->val_off);
+
+	/* a value of the same length is replaced in place */
+	if (var && val_len && val_len == old_len) {
+		if (memcmp(data + var->val_off, value, val_len)) {
+			memcpy(data + var->val_off, value, val_len);
+			env->dirty = true;
+		}
+		return PON_ADAPTER_SUCCESS;
+	}
+	if (!var && !val_len)
+		return PON_ADAPTER_SUCCESS;
+
+	end = env_data_end(data, data_len);
+	/* "name=value" and its terminator, the empty string after it */
+	need = val_len ? name_len + 1 + val_len + 1 : 0;
+	if (var)
+		need = need > name_len + 1 + old_len + 1 ?
+			need - (name_len + 1 + old_len + 1) : 0;
+	if (end + need + 1 > data_len) {
+		dbg_err("U-Boot environment is full, %s is not set\n", name);
+		return PON_ADAPTER_ERR_SIZE;
+	}
+
+	if (var) {
+		old_len += name_len + 2;
+		memmove(data + var->off, data + var->off + old_len,
+			end - var->off - old_len);
+		end -= old_len;
+	}
+	if (val_len) {
+		memcpy(data + end, name, name_len);
+		data[end + name_len] = '=';
+		memcpy(data + end + name_len + 1, value, val_len);
+		end += name_len + 1 + val_len;
+		data[end++] = '\0';
+	}
+	data[end] = '\0';
+	env->dirty = true;
+
+	return env_index_build(env);
+}
+
+/* Write a copy into a NOR flash, the sectors around it are kept */
+static int env_nor_write(int fd, const struct env_dev *dev,
+			 const uint8_t *image, uint32_t size)
+{
+	uint64_t start = dev->offset - dev->offset % dev->sector;
+	uint64_t len = dev->offset + size - start;
+	struct erase_info_user erase;
+	uint8_t *buf;
+	int ret = -1;
+
+	len = (len + dev->sector - 1) / dev->sector * dev->sector;
+	if (len > UINT32_MAX)
+		return -1;
+
+	buf = malloc(len);
+	if (!buf)
+		return -1;
+
+	if (env_read_all(fd, buf, (uint32_t)len, start))
+		goto exit;
+	memcpy(buf + (dev->offset - start), image, size);
+
+	erase.start = (uint32_t)start;
+	erase.length = (uint32_t)len;
+	if (ioctl(fd, MEMERASE, &erase)) {
+		dbg_err("%s: erase failed: %s\n", dev->path, strerror(errno));
+		goto exit;
+	}
+	ret = env_write_all(fd, buf, (uint32_t)len, start);
+
+exit:
+	free(buf);
+	return ret;
+}
+
+/* Write a copy into a NAND flash, bad blocks are skipped and each block is
+ * written completely
+ */
+static int env_mtd_write(int fd, const struct env_dev *dev,
+			 const uint8_t *image, uint32_t size)
+{
+	uint64_t blk, end = dev->offset + (uint64_t)dev->sectors * dev->sector;
+	struct erase_info_user erase;
+	uint32_t done = 0, len;
+	uint8_t *buf;
+	loff_t pos;
+	int ret = -1;
+
+	buf = malloc(dev->sector);
+	if (!buf)
+		return -1;
+
+	for (blk = dev->offset; done < size && blk < end; blk += dev->sector) {
+		pos = blk;
+		if (ioctl(fd, MEMGETBADBLOCK, &pos) > 0)
+			continue;
+		erase.start = (uint32_t)blk;
+		erase.length = dev->sector;
+		if (ioctl(fd, MEMERASE, &erase)) {
+			dbg_err("%s: erase failed: %s\n", dev->path,
+				strerror(errno));
+			goto exit;
+		}
+		len = size - done < dev->sector ? size - done : dev->sector;
+		memset(buf, 0xff, dev->sector);
+		memcpy(buf, image + done, len);
+		if (env_write_all(fd, buf, dev->sector, blk))
+			goto exit;
+		done += len;
+	}
+	if (done == size)
+		ret = 0;
+	else
+		dbg_err("%s: too many bad blocks\n", dev->path);
+
+exit:
+	free(buf);
+	return ret;
+}
+
+static int env_copy_write(struct pon_img_env *env, unsigned int i,
+			  const uint8_t *image)
+{
+	const struct env_dev *dev = &env->dev[i];
+	int64_t bytes = env->size;
+	int fd, ret = -1;
+
+	fd = open(dev->path, dev->type == ENV_DEV_FILE ? O_RDWR | O_CREAT :
+			     dev->type == ENV_DEV_UBI ? O_WRONLY : O_RDWR,
+		  0600);
+	if (fd < 0) {
+		dbg_err("%s can not be opened: %s\n", dev->path,
+			strerror(errno));
+		return -1;
+	}
+
+	switch (dev->type) {
+	case ENV_DEV_UBI:
+		/* the volume update replaces the volume atomically */
+		if (ioctl(fd, UBI_IOCVOLUP, &bytes)) {
+			dbg_err("%s: volume update failed: %s\n", dev->path,
+				strerror(errno));
+			break;
+		}
+		ret = env_write_all(fd, image, env->size, 0);
+		break;
+	case ENV_DEV_MTD_NOR:
+		ret = env_nor_write(fd, dev, image, env->size);
+		break;
+	case ENV_DEV_MTD:
+		ret = env_mtd_write(fd, dev, image, env->size);
+		break;
+	default:
+		ret = env_write_all(fd, image, env->size, dev->offset);
+		break;
+	}
+
+	if (!ret && fsync(fd) && errno != EINVAL)
+		ret = -1;
+	if (ret)
+		dbg_err("%s: environment write failed: %s\n", dev->path,
+			strerror(errno));
+	close(fd);
+
+	return ret;
+}
+
+/* On NOR flash the flag of the old copy is cleared without an erase */
+static void env_flag_obsolete(struct pon_img_env *env, unsigned int i)
+{
+	const struct env_dev *dev = &env->dev[i];
+	uint8_t flag = ENV_FLAG_OBSOLETE;
+	int fd;
+
+	fd = open(dev->path, O_RDWR);
+	if (fd < 0 || env_write_all(fd, &flag, 1, dev->offset + 4))
+		dbg_wrn("%s: old environment can not be marked obsolete\n",
+			dev->path);
+	if (fd >= 0)
+		close(fd);
+}
+
+enum pon_adapter_errno pon_img_env_commit(struct pon_img_env *env)
+{
+	enum pon_adapter_errno error;
+	unsigned int target, old;
+	uint32_t crc, hdr;
+	bool old_valid;
+
+	dbg_in_args("%p", env);
+
+	if (!env)
+		return PON_ADAPTER_ERR_PTR_INVALID;
+
+	if (!env->dirty) {
+		free(env->work);
+		env->work = NULL;
+		error = env_index_build(env);
+		dbg_out_ret("%d", error);
+		return error;
+	}
+
+	error = pon_img_env_lock(env);
+	if (error != PON_ADAPTER_SUCCESS) {
+		dbg_out_ret("%d", error);
+		return error;
+	}
+
+	hdr = env_hdr_len(env);
+	crc = pon_img_crc32_ieee(0, env->work + hdr, env->size - hdr);
+	env->work[0] = crc & 0xff;
+	env->work[1] = (crc >> 8) & 0xff;
+	env->work[2] = (crc >> 16) & 0xff;
+	env->work[3] = crc >> 24;
+
+	old = env->current;
+	old_valid = env->valid;
+	target = 0;
+	if (env->copies > 1) {
+		/* the current copy stays intact until the new one is written */
+		target = old_valid ? !old : 0;
+		env->work[4] = env->flag_bool ? ENV_FLAG_ACTIVE :
+				(uint8_t)(env->flags + 1);
+	}
+
+	if (env_copy_write(env, target, env->work)) {
+		(void)env_load(env);
+		error = PON_ADAPTER_ERROR;
+		goto exit;
+	}
+
+	if (env->copies > 1 && env->flag_bool && old_valid)
+		env_flag_obsolete(env, old);
+
+	/* read back, the written copy must be the valid one now */
+	error = env_load(env);
+	if (error == PON_ADAPTER_SUCCESS &&
+	    (!env->valid || env->current != target || env->crc != crc)) {
+		dbg_err("U-Boot environment verification failed\n");
+		error = PON_ADAPTER_ERR_CRC;
+	}
+
+exit:
+	pon_img_env_unlock(env);
+	dbg_out_ret("%d", error);
+	return error;
+}
+
+/** @} */
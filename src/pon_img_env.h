@@ -0,0 +1,122 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ ******************************************************************************/
+/**
+   \file pon_img_env.h
+   Direct access to the U-Boot environment, compatible with fw_printenv and
+   fw_setenv.
+
+   The locations are read from a file in the format of fw_env.config, one
+   line per copy:
+
+       # device   offset   env size   [sector size   [number of sectors]]
+       /dev/mtd3  0x0      0x10000    0x10000
+       /dev/mtd3  0x10000  0x10000    0x10000
+
+   A device can be an MTD device, a UBI volume or a plain file. With two
+   lines the environment is redundant, the copy with a valid CRC and the
+   newer flag is used and a write goes to the other copy. NOR flash uses
+   the active/obsolete flags, all other devices a counter.
+
+   The environment is parsed once into a hash index, a lookup does not scan
+   the variables.
+
+   Each read and write holds the lock file of fw_printenv and fw_setenv, a
+   read-modify-write holds it with \ref pon_img_env_lock.
+*/
+
+#ifndef _PON_IMG_ENV_H_
+#define _PON_IMG_ENV_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pon_adapter.h>
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Number of environment copies of a redundant environment */
+#define PON_IMG_ENV_COPIES	2
+/** Lock file shared with fw_printenv and fw_setenv */
+#define PON_IMG_ENV_LOCK	"/var/lock/fw_printenv.lock"
+
+struct pon_img_env;
+
+/**	Open the U-Boot environment and read it.
+ *
+ *	\param[out] env		Environment handle
+ *	\param[in] config	Path of the fw_env.config compatible file
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful, also if no copy is valid, the
+ *	  environment is empty then
+ *	- PON_ADAPTER_ERR_INVALID_VAL: Configuration can not be parsed
+ *	- Other: An error code in case of error.
+ */
+enum pon_adapter_errno pon_img_env_open(struct pon_img_env **env,
+					const char *config);
+
+/**	Close the environment, changes which are not committed are lost. */
+void pon_img_env_close(struct pon_img_env *env);
+
+/**	Lock the environment against other processes until
+ *	\ref pon_img_env_unlock, the calls can be nested. The lock is needed
+ *	when the variables are set based on a reload, the reload and commit
+ *	calls take it by themselves.
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- PON_ADAPTER_ERROR: The lock file can not be opened or locked
+ */
+enum pon_adapter_errno pon_img_env_lock(struct pon_img_env *env);
+
+/**	Release the lock of \ref pon_img_env_lock. */
+void pon_img_env_unlock(struct pon_img_env *env);
+
+/**	Read the environment again, it may have been changed by another
+ *	process. Changes which are not committed are lost.
+ *
+ *	\param[in] env		Environment handle
+ *	\param[out] changed	Set if the environment differs from the last
+ *				one, can be NULL
+ */
+enum pon_adapter_errno pon_img_env_reload(struct pon_img_env *env,
+					  bool *changed);
+
+/**	Look up a variable.
+ *
+ *	\return Value of the variable, valid until the environment is changed
+ *	or reloaded, NULL if the variable does not exist.
+ */
+const char *pon_img_env_get(struct pon_img_env *env, const char *name);
+
+/**	Set a variable in memory, \ref pon_img_env_commit writes it.
+ *
+ *	\param[in] env		Environment handle
+ *	\param[in] name		Variable name
+ *	\param[in] value	Value, NULL or an empty string deletes the
+ *				variable
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- PON_ADAPTER_ERR_SIZE: The environment is full
+ *	- Other: An error code in case of error.
+ */
+enum pon_adapter_errno pon_img_env_set(struct pon_img_env *env,
+				       const char *name, const char *value);
+
+/**	Write the changed environment into the flash, nothing is written if
+ *	no variable was changed. After a failed write the environment is read
+ *	again.
+ */
+enum pon_adapter_errno pon_img_env_commit(struct pon_img_env *env);
+
+/** @} */
+
+#endif
@@ -0,0 +1,251 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+#include <pon_adapter.h>
+
+#include "pon_img_crc.h"
+#include "pon_img_env.h"
+#include "pon_img_test.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Size of an environment copy */
+#define ENV_TEST_SIZE	0x1000
+/** Header of a redundant copy, CRC and flag */
+#define ENV_TEST_HDR	5
+
+static char env_path[PON_IMG_ENV_COPIES][PON_IMG_PATH_LEN];
+static char config_path[PON_IMG_PATH_LEN];
+
+/* Write a redundant copy with one variable, the CRC is broken on request */
+static int copy_write(unsigned int i, uint8_t flag, const char *value,
+		      bool bad_crc)
+{
+	uint8_t buf[ENV_TEST_SIZE] = {0};
+	uint32_t crc;
+	FILE *f;
+	int len;
+
+	len = snprintf((char *)buf + ENV_TEST_HDR, sizeof(buf) - ENV_TEST_HDR,
+		       "ver=%s", value);
+	if (len < 0 || len + ENV_TEST_HDR + 2 > (int)sizeof(buf))
+		return -1;
+
+	crc = pon_img_crc32_ieee(0, buf + ENV_TEST_HDR,
+				 sizeof(buf) - ENV_TEST_HDR);
+	if (bad_crc)
+		crc ^= 1;
+	buf[0] = crc & 0xff;
+	buf[1] = (crc >> 8) & 0xff;
+	buf[2] = (crc >> 16) & 0xff;
+	buf[3] = crc >> 24;
+	buf[4] = flag;
+
+	f = fopen(env_path[i], "w");
+	if (!f)
+		return -1;
+	if (fwrite(buf, 1, sizeof(buf), f) != sizeof(buf)) {
+		fclose(f);
+		return -1;
+	}
+
+	return fclose(f);
+}
+
+static int copy_flag(unsigned int i)
+{
+	uint8_t buf[ENV_TEST_HDR];
+	FILE *f;
+	size_t n;
+
+	f = fopen(env_path[i], "r");
+	if (!f)
+		return -1;
+	n = fread(buf, 1, sizeof(buf), f);
+	fclose(f);
+
+	return n == sizeof(buf) ? buf[4] : -1;
+}
+
+/* Open the environment and check the value which is read */
+static int check(const char *name, const char *expect)
+{
+	struct pon_img_env *env;
+	const char *value;
+	bool ok;
+
+	if (pon_img_env_open(&env, config_path) != PON_ADAPTER_SUCCESS) {
+		printf("%s: open failed\n", name);
+		return 1;
+	}
+	value = pon_img_env_get(env, "ver");
+	ok = expect ? value && strcmp(value, expect) == 0 : !value;
+	if (ok)
+		printf("%s: passed\n", name);
+	else
+		printf("%s: read %s instead of %s\n", name,
+		       value ? value : "nothing", expect ? expect : "nothing");
+	pon_img_env_close(env);
+
+	return ok ? 0 : 1;
+}
+
+/* Set the variable, the write must go to the older copy */
+static int commit(const char *name, const char *value, unsigned int target,
+		  int flag)
+{
+	struct pon_img_env *env = NULL;
+	int failed = 0;
+
+	if (pon_img_env_open(&env, config_path) != PON_ADAPTER_SUCCESS ||
+	    pon_img_env_set(env, "ver", value) != PON_ADAPTER_SUCCESS ||
+	    pon_img_env_commit(env) != PON_ADAPTER_SUCCESS) {
+		printf("%s: write failed\n", name);
+		failed = 1;
+	} else if (copy_flag(target) != flag) {
+		printf("%s: copy %u has flag %d instead of %d\n", name,
+		       target, copy_flag(target), flag);
+		failed = 1;
+	}
+	if (env)
+		pon_img_env_close(env);
+
+	return failed ? failed : check(name, value);
+}
+
+/* The lock file of fw_setenv is held until the unlock */
+static int lock_check(void)
+{
+	struct pon_img_env *env;
+	bool held;
+	int fd;
+
+	if (pon_img_env_open(&env, config_path) != PON_ADAPTER_SUCCESS ||
+	    pon_img_env_lock(env) != PON_ADAPTER_SUCCESS) {
+		printf("lock: failed\n");
+		return 1;
+	}
+
+	fd = open(PON_IMG_ENV_LOCK, O_WRONLY);
+	held = fd >= 0 && flock(fd, LOCK_EX | LOCK_NB) &&
+	       errno == EWOULDBLOCK;
+	pon_img_env_unlock(env);
+	if (held && flock(fd, LOCK_EX | LOCK_NB))
+		held = false;
+	if (fd >= 0)
+		close(fd);
+	pon_img_env_close(env);
+
+	if (!held) {
+		printf("lock: not held or not released\n");
+		return 1;
+	}
+	printf("lock: passed\n");
+
+	return 0;
+}
+
+int main(void)
+{
+	struct pon_img_test test;
+	int failed = 0;
+	FILE *f;
+
+	if (pon_img_test_open(&test, "pon_img_env_test"))
+		return 1;
+	pon_img_test_path(&test, "env0", env_path[0], PON_IMG_PATH_LEN);
+	pon_img_test_path(&test, "env1", env_path[1], PON_IMG_PATH_LEN);
+	pon_img_test_path(&test, "fw_env.config", config_path,
+			  sizeof(config_path));
+
+	f = fopen(config_path, "w");
+	if (!f) {
+		perror("config");
+		failed = 1;
+		goto exit;
+	}
+	fprintf(f, "%s 0x0 0x%x\n%s 0x0 0x%x\n", env_path[0], ENV_TEST_SIZE,
+		env_path[1], ENV_TEST_SIZE);
+	if (fclose(f)) {
+		failed = 1;
+		goto exit;
+	}
+
+	/* the copy with the higher counter is used */
+	if (copy_write(0, 5, "old", false) || copy_write(1, 6, "new", false)) {
+		failed = 1;
+		goto exit;
+	}
+	failed += check("newer second copy", "new");
+
+	if (copy_write(0, 7, "newer", false)) {
+		failed++;
+		goto exit;
+	}
+	failed += check("newer first copy", "newer");
+
+	/* the counter wraps around */
+	if (copy_write(0, 0xff, "old", false) ||
+	    copy_write(1, 0, "wrapped", false)) {
+		failed++;
+		goto exit;
+	}
+	failed += check("wrapped counter", "wrapped");
+
+	/* a copy with a bad CRC is not used, also if it is newer */
+	if (copy_write(0, 1, "bad", true)) {
+		failed++;
+		goto exit;
+	}
+	failed += check("bad CRC of the newer copy", "wrapped");
+
+	if (copy_write(1, 0, "bad", true)) {
+		failed++;
+		goto exit;
+	}
+	failed += check("bad CRC of both copies", NULL);
+
+	/* a write goes to the older copy with the next counter, the newer
+	 * one stays intact
+	 */
+	if (copy_write(0, 3, "first", false) ||
+	    copy_write(1, 2, "second", false)) {
+		failed++;
+		goto exit;
+	}
+	failed += commit("write to the older copy", "third", 1, 4);
+	failed += commit("write to the other copy", "fourth", 0, 5);
+
+	/* without a valid copy the first one is written */
+	if (copy_write(0, 1, "bad", true) || copy_write(1, 1, "bad", true)) {
+		failed++;
+		goto exit;
+	}
+	failed += commit("write without a valid copy", "fifth", 0, 1);
+
+	failed += lock_check();
+
+exit:
+	pon_img_test_close(&test);
+
+	return failed ? 1 : 0;
+}
+
+/** @} */
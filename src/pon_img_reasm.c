@@ -0,0 +1,122 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+
+#include "pon_img_crc.h"
+#include "pon_img_debug.h"
+#include "pon_img_reasm.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+enum pon_adapter_errno pon_img_reasm_create(struct pon_img_reasm **reasm)
+{
+	*reasm = calloc(1, sizeof(**reasm));
+	if (!*reasm)
+		return PON_ADAPTER_ERR_NO_MEMORY;
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+void pon_img_reasm_destroy(struct pon_img_reasm *reasm)
+{
+	if (!reasm)
+		return;
+
+	free(reasm->buf);
+	free(reasm);
+}
+
+enum pon_adapter_errno pon_img_reasm_win_size_set(struct pon_img_reasm *reasm,
+						  uint32_t win_size,
+						  uint32_t nr,
+						  uint32_t offset)
+{
+	uint8_t *buf;
+
+	buf = realloc(reasm->buf, win_size);
+	if (!buf)
+		return PON_ADAPTER_ERR_NO_MEMORY;
+
+	reasm->buf = buf;
+	reasm->win_size = win_size;
+	reasm->win_op = pon_img_crc32_combine_prep(win_size);
+	reasm->base_nr = nr;
+	reasm->base_offset = offset;
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+bool pon_img_reasm_offset(const struct pon_img_reasm *reasm, uint32_t nr,
+			  uint64_t *offset)
+{
+	if (!reasm->win_size || nr < reasm->base_nr)
+		return false;
+
+	*offset = reasm->base_offset +
+		  (uint64_t)(nr - reasm->base_nr) * reasm->win_size;
+	return true;
+}
+
+void pon_img_reasm_pending_drop(struct pon_img_reasm *reasm)
+{
+	int i;
+
+	for (i = 0; i < PON_IMG_REASM_SLOTS && reasm->pending; i++) {
+		if (reasm->slot[i].state != PON_IMG_REASM_PENDING)
+			continue;
+		reasm->slot[i].state = PON_IMG_REASM_EMPTY;
+		reasm->pending--;
+	}
+}
+
+struct pon_img_reasm_slot *
+pon_img_reasm_find(struct pon_img_reasm *reasm, uint32_t nr,
+		   enum pon_img_reasm_state state)
+{
+	struct pon_img_reasm_slot *slot;
+
+	slot = &reasm->slot[nr % PON_IMG_REASM_SLOTS];
+	if (slot->state != state || slot->nr != nr)
+		return NULL;
+
+	return slot;
+}
+
+void pon_img_reasm_set(struct pon_img_reasm *reasm, uint32_t nr,
+		       uint32_t len, uint32_t crc,
+		       enum pon_img_reasm_state state)
+{
+	struct pon_img_reasm_slot *slot;
+
+	slot = &reasm->slot[nr % PON_IMG_REASM_SLOTS];
+	if (slot->state == PON_IMG_REASM_PENDING)
+		reasm->pending--;
+	if (state == PON_IMG_REASM_PENDING)
+		reasm->pending++;
+
+	slot->nr = nr;
+	slot->len = len;
+	slot->crc = crc;
+	slot->state = state;
+}
+
+uint32_t pon_img_reasm_crc_append(const struct pon_img_reasm *reasm,
+				  uint32_t crc, uint32_t win_crc,
+				  uint32_t len)
+{
+	if (len == reasm->win_size)
+		return pon_img_crc32_combine_op(crc, win_crc, reasm->win_op);
+
+	return pon_img_crc32_combine(crc, win_crc, len);
+}
+
+/** @} */
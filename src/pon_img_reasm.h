@@ -0,0 +1,133 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ ******************************************************************************/
+/**
+   \file pon_img_reasm.h
+   Bookkeeping of the SW download windows, allows to accept windows which
+   arrive ahead of the next expected one and to verify retransmitted
+   windows.
+
+   All windows have the same size except the last one, so the image offset
+   of a window follows from its number. If the size changes during the
+   download, the offsets are counted from the first window of the new
+   size.
+*/
+
+#ifndef _PON_IMG_REASM_H_
+#define _PON_IMG_REASM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pon_adapter.h>
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Number of windows which are accepted ahead of the next expected one,
+ *  the same number of completed windows is kept for the verification of
+ *  retransmissions.
+ */
+#define PON_IMG_REASM_AHEAD	256
+
+/** Number of window slots */
+#define PON_IMG_REASM_SLOTS	(2 * PON_IMG_REASM_AHEAD)
+
+/** State of a window */
+enum pon_img_reasm_state {
+	/** Window not received */
+	PON_IMG_REASM_EMPTY,
+	/** Window received ahead and stored, not yet part of the image CRC */
+	PON_IMG_REASM_PENDING,
+	/** Window completed in order */
+	PON_IMG_REASM_DONE
+};
+
+/** Received window */
+struct pon_img_reasm_slot {
+	/** Window number */
+	uint32_t nr;
+	/** Window length */
+	uint32_t len;
+	/** CRC register of the window alone */
+	uint32_t crc;
+	/** Window state */
+	enum pon_img_reasm_state state;
+};
+
+/** Window bookkeeping of a download */
+struct pon_img_reasm {
+	/** Size of all windows except the last one, 0 if not known yet */
+	uint32_t win_size;
+	/** First window of win_size bytes */
+	uint32_t base_nr;
+	/** Image offset of the window base_nr */
+	uint32_t base_offset;
+	/** CRC combine operator for win_size */
+	uint32_t win_op;
+	/** Number of pending windows */
+	unsigned int pending;
+	/** Buffer of win_size bytes to read back a pending window */
+	uint8_t *buf;
+	/** Window slots, indexed by the window number */
+	struct pon_img_reasm_slot slot[PON_IMG_REASM_SLOTS];
+};
+
+/**	Allocate the bookkeeping for a new download. */
+enum pon_adapter_errno pon_img_reasm_create(struct pon_img_reasm **reasm);
+
+/**	Free the bookkeeping. */
+void pon_img_reasm_destroy(struct pon_img_reasm *reasm);
+
+/**	Set the size of the windows, learned from the first full window.
+ *
+ *	\param[in] reasm	Bookkeeping
+ *	\param[in] win_size	Window size
+ *	\param[in] nr		First window of this size
+ *	\param[in] offset	Image offset of the window nr
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- PON_ADAPTER_ERR_NO_MEMORY: No memory for the read back buffer
+ */
+enum pon_adapter_errno pon_img_reasm_win_size_set(struct pon_img_reasm *reasm,
+						  uint32_t win_size,
+						  uint32_t nr,
+						  uint32_t offset);
+
+/**	Image offset of a window of the current size.
+ *
+ *	\return false if the window is before the first window of this size
+ */
+bool pon_img_reasm_offset(const struct pon_img_reasm *reasm, uint32_t nr,
+			  uint64_t *offset);
+
+/**	Forget all pending windows, needed if the window size changes. */
+void pon_img_reasm_pending_drop(struct pon_img_reasm *reasm);
+
+/**	Find a window in the given state.
+ *
+ *	\return The window slot or NULL if the window is not in this state.
+ */
+struct pon_img_reasm_slot *
+pon_img_reasm_find(struct pon_img_reasm *reasm, uint32_t nr,
+		   enum pon_img_reasm_state state);
+
+/**	Record a window. */
+void pon_img_reasm_set(struct pon_img_reasm *reasm, uint32_t nr,
+		       uint32_t len, uint32_t crc,
+		       enum pon_img_reasm_state state);
+
+/**	Append the CRC register of a window to the image CRC register. */
+uint32_t pon_img_reasm_crc_append(const struct pon_img_reasm *reasm,
+				  uint32_t crc, uint32_t win_crc,
+				  uint32_t len);
+
+/** @} */
+
+#endif
@@ -13,7 +13,13 @@
 #include <pon_adapter_config.h>
 #include <omci/pon_adapter_omci.h>
 
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
 #include <unistd.h>       /* for getpid */
+#include <pthread.h>
 #include <ifxos_thread.h>
 #include <ifxos_time.h>   /* for IFXOS_MSecSleep */
 #include <libubus.h> /* for UBUS enum errors */
@@ -21,32 +27,220 @@
 #include "pon_img_register.h"
 #include "pon_img_common.h"
 #include "pon_img_debug.h"
+#include "pon_uboot.h"
+#include "pon_img_async.h"
+#include "pon_img_stats.h"
 
 #define IFXOS_THREAD_PRIO_LOWEST	5
 
+/** Maximum number of registrations of a process */
+#define PON_IMG_INSTANCES_MAX	32
+
 /** \addtogroup PON_IMG_LIB
  *  @{
  */
 
-/** ONU reboot thread control structure */
-static IFXOS_ThreadCtrl_t pon_img_reboot_thread_control;
+/** Type of an option of the context */
+enum pon_img_option_type {
+	/** bool, "1", "true", "yes", "on" or the name alone set it */
+	PON_IMG_OPTION_BOOL,
+	/** uint32_t, decimal or hex */
+	PON_IMG_OPTION_U32,
+	/** uint64_t, decimal or hex */
+	PON_IMG_OPTION_U64,
+	/** const char *, the value is copied */
+	PON_IMG_OPTION_STR
+};
+
+/** Option of the context which can be set by init_data */
+struct pon_img_option {
+	/** Name, the same as of the context member */
+	const char *name;
+	/** Type of the member */
+	enum pon_img_option_type type;
+	/** Offset of the member in the context */
+	size_t offset;
+};
+
+#define PON_IMG_OPTION(name, type) \
+	{ #name, PON_IMG_OPTION_##type, offsetof(struct pon_img_context, name) }
+
+/** Options of the context, see struct pon_img_context */
+static const struct pon_img_option pon_img_options[] = {
+	PON_IMG_OPTION(dl_image_path, STR),
+	PON_IMG_OPTION(upgrade_path, STR),
+	PON_IMG_OPTION(dl_chunk_size, U32),
+	PON_IMG_OPTION(dl_write_behind, BOOL),
+	PON_IMG_OPTION(dl_ring_size, U32),
+	PON_IMG_OPTION(dl_mmap, BOOL),
+	PON_IMG_OPTION(dl_no_header_check, BOOL),
+	PON_IMG_OPTION(dl_no_unpack, BOOL),
+	PON_IMG_OPTION(dl_unpack_mem, U32),
+	PON_IMG_OPTION(dl_unpack_max, U32),
+	PON_IMG_OPTION(dl_no_checkpoint, BOOL),
+	PON_IMG_OPTION(dl_checkpoint_interval, U32),
+	PON_IMG_OPTION(dl_resume_dir, STR),
+	PON_IMG_OPTION(dl_direct, BOOL),
+	PON_IMG_OPTION(dl_bank_dir, STR),
+	PON_IMG_OPTION(dl_native_write, BOOL),
+	PON_IMG_OPTION(dl_store_dir, STR),
+	PON_IMG_OPTION(dl_store_budget, U64),
+	PON_IMG_OPTION(dl_no_digest, BOOL),
+	PON_IMG_OPTION(dl_sha384, BOOL),
+	PON_IMG_OPTION(dl_no_stats, BOOL),
+	PON_IMG_OPTION(dl_progress_interval, U32),
+	PON_IMG_OPTION(dl_async_store, BOOL),
+	PON_IMG_OPTION(uboot_env_config, STR),
+};
 
-static struct pon_img_context g_pon_img_context;
+/** Library instance, created for each registration. The context is the
+ *  first member, the lower layer handle points to both.
+ */
+struct pon_img_instance {
+	/** Context shared with the other parts of the library */
+	struct pon_img_context ctx;
+	/** ONU reboot thread control structure */
+	IFXOS_ThreadCtrl_t reboot_thread_control;
+	/** Copies of the string options given by init_data */
+	char *option_str[ARRAY_SIZE(pon_img_options)];
+	/** The registration number in the context is taken */
+	bool numbered;
+};
+
+/** Numbers of the registrations in use, a number is used again after the
+ *  shutdown. The default staging file depends on it.
+ */
+static uint32_t instances_used;
+static pthread_mutex_t instances_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /** List which holds supported UBUS interfaces */
 static const char * const pon_img_list_of_path[] = {"fwupgrade", UBUS_SYSTEM_PATH};
 
+static enum pon_adapter_errno option_bool(const char *val, bool *out)
+{
+	static const char * const on[] = { "1", "true", "yes", "on" };
+	static const char * const off[] = { "0", "false", "no", "off" };
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(on); i++) {
+		if (strcasecmp(val, on[i]) == 0) {
+			*out = true;
+			return PON_ADAPTER_SUCCESS;
+		}
+		if (strcasecmp(val, off[i]) == 0) {
+			*out = false;
+			return PON_ADAPTER_SUCCESS;
+		}
+	}
+
+	return PON_ADAPTER_ERR_INVALID_VAL;
+}
+
+static enum pon_adapter_errno option_num(const char *val, uint64_t max,
+					 uint64_t *out)
+{
+	unsigned long long num;
+	char *end;
+
+	errno = 0;
+	num = strtoull(val, &end, 0);
+	if (errno || end == val || *end || *val == '-' || num > max)
+		return PON_ADAPTER_ERR_INVALID_VAL;
+
+	*out = num;
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* Set one option, given as "name=value" or as "name" for a bool */
+static enum pon_adapter_errno option_set(struct pon_img_instance *inst,
+					 const char *opt)
+{
+	const struct pon_img_option *o = NULL;
+	const char *val;
+	size_t len;
+	uint64_t num;
+	char *ptr;
+	int i;
+
+	val = strchr(opt, '=');
+	len = val ? (size_t)(val - opt) : strlen(opt);
+
+	for (i = 0; i < ARRAY_SIZE(pon_img_options); i++) {
+		if (strlen(pon_img_options[i].name) == len &&
+		    strncmp(pon_img_options[i].name, opt, len) == 0) {
+			o = &pon_img_options[i];
+			break;
+		}
+	}
+	if (!o) {
+		dbg_wrn("unknown option %s is ignored\n", opt);
+		return PON_ADAPTER_SUCCESS;
+	}
+	ptr = (char *)&inst->ctx + o->offset;
+
+	if (!val) {
+		if (o->type != PON_IMG_OPTION_BOOL)
+			goto invalid;
+		*(bool *)ptr = true;
+		return PON_ADAPTER_SUCCESS;
+	}
+	val++;
+
+	switch (o->type) {
+	case PON_IMG_OPTION_BOOL:
+		if (option_bool(val, (bool *)ptr) != PON_ADAPTER_SUCCESS)
+			goto invalid;
+		break;
+	case PON_IMG_OPTION_U32:
+		if (option_num(val, UINT32_MAX, &num) != PON_ADAPTER_SUCCESS)
+			goto invalid;
+		*(uint32_t *)ptr = (uint32_t)num;
+		break;
+	case PON_IMG_OPTION_U64:
+		if (option_num(val, UINT64_MAX, &num) != PON_ADAPTER_SUCCESS)
+			goto invalid;
+		*(uint64_t *)ptr = num;
+		break;
+	case PON_IMG_OPTION_STR:
+		if (!*val || strlen(val) >= PON_IMG_PATH_LEN)
+			goto invalid;
+		free(inst->option_str[i]);
+		inst->option_str[i] = strdup(val);
+		if (!inst->option_str[i])
+			return PON_ADAPTER_ERR_NO_MEMORY;
+		*(const char **)ptr = inst->option_str[i];
+		break;
+	}
+
+	dbg_msg("option %s\n", opt);
+	return PON_ADAPTER_SUCCESS;
+
+invalid:
+	dbg_err("invalid option %s\n", opt);
+	return PON_ADAPTER_ERR_INVALID_VAL;
+}
+
 static enum pon_adapter_errno
 pon_img_init(char const * const *init_data,
 	     const struct pa_config *pa_config,
 	     const struct pa_eh_ops *event_handler,
 	     void *ll_handle)
 {
-	struct pon_img_context *ctx = ll_handle;
+	struct pon_img_instance *inst = ll_handle;
+	struct pon_img_context *ctx = &inst->ctx;
+	enum pon_adapter_errno ret;
 
 	dbg_in_args("%p, %p, %p, %p", init_data, pa_config, event_handler,
 		    ll_handle);
 
+	for (; init_data && *init_data; init_data++) {
+		ret = option_set(inst, *init_data);
+		if (ret != PON_ADAPTER_SUCCESS) {
+			dbg_out_ret("%d", ret);
+			return ret;
+		}
+	}
+
 	ctx->pa_config = pa_config;
 
 	if (!ctx->pa_config->ubus_call) {
@@ -55,6 +249,14 @@ pon_img_init(char const * const *init_data,
 		return PON_ADAPTER_ERROR;
 	}
 
+	if (ctx->uboot_env_config) {
+		ret = pon_uboot_env_open(ctx, ctx->uboot_env_config);
+		if (ret != PON_ADAPTER_SUCCESS) {
+			dbg_out_ret("%d", ret);
+			return ret;
+		}
+	}
+
 	dbg_out_ret("%d", PON_ADAPTER_SUCCESS);
 	return PON_ADAPTER_SUCCESS;
 }
@@ -72,16 +274,23 @@ static enum pon_adapter_errno pon_img_start(void *ll_handle)
 				NULL, NULL, NULL, PON_UBUS_TIMEOUT);
 		if (err == PON_ADAPTER_SUCCESS) {
 			ctx->ubus_path = pon_img_list_of_path[i];
+			/* the variables are read again on demand */
+			if (pon_uboot_cache_start(ctx) != PON_ADAPTER_SUCCESS)
+				dbg_wrn("U-Boot variables can not be read\n");
 			dbg_out_ret("%d", PON_ADAPTER_SUCCESS);
 			return PON_ADAPTER_SUCCESS;
 		}
 	}
 
-	if (err == UBUS_STATUS_METHOD_NOT_FOUND) {
+	/* a directly accessed environment does not need the method */
+	if (err == UBUS_STATUS_METHOD_NOT_FOUND || ctx->uboot_env_config) {
 		/* reboot is expected to work in any case */
 		dbg_prn("Only system reboot supported.\n");
 		ctx->ubus_reboot_only = true;
 		ctx->ubus_path = UBUS_SYSTEM_PATH;
+		if (ctx->uboot_env_config &&
+		    pon_uboot_cache_start(ctx) != PON_ADAPTER_SUCCESS)
+			dbg_wrn("U-Boot variables can not be read\n");
 		dbg_out_ret("%d", PON_ADAPTER_SUCCESS);
 		return PON_ADAPTER_SUCCESS;
 	}
@@ -119,7 +328,8 @@ static int32_t pon_img_reboot_thread(struct IFXOS_ThreadParams_s *thr_params)
 static enum pon_adapter_errno pon_img_reboot(void *llhandle,
 					     unsigned long timeout_ms)
 {
-	IFXOS_ThreadCtrl_t *p_thread = &pon_img_reboot_thread_control;
+	struct pon_img_instance *inst = llhandle;
+	IFXOS_ThreadCtrl_t *p_thread = &inst->reboot_thread_control;
 
 	if (IFXOS_THREAD_INIT_VALID(p_thread))
 		(void)IFXOS_ThreadDelete(p_thread, 0);
@@ -138,11 +348,76 @@ static enum pon_adapter_errno pon_img_reboot(void *llhandle,
 	return PON_ADAPTER_SUCCESS;
 }
 
+/* Take the lowest free registration number */
+static enum pon_adapter_errno instance_number_get(unsigned int *num)
+{
+	enum pon_adapter_errno ret = PON_ADAPTER_ERR_OUT_OF_BOUNDS;
+	unsigned int i;
+
+	pthread_mutex_lock(&instances_lock);
+	for (i = 0; i < PON_IMG_INSTANCES_MAX; i++) {
+		if (!(instances_used & (1u << i))) {
+			instances_used |= 1u << i;
+			*num = i;
+			ret = PON_ADAPTER_SUCCESS;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&instances_lock);
+
+	if (ret != PON_ADAPTER_SUCCESS)
+		dbg_err("more than %u registrations\n", PON_IMG_INSTANCES_MAX);
+
+	return ret;
+}
+
+static void instance_number_put(unsigned int num)
+{
+	pthread_mutex_lock(&instances_lock);
+	instances_used &= ~(1u << num);
+	pthread_mutex_unlock(&instances_lock);
+}
+
+static void pon_img_instance_free(struct pon_img_instance *inst)
+{
+	int i;
+
+	pon_img_async_destroy(inst->ctx.async);
+	pon_uboot_cache_destroy(&inst->ctx);
+	pon_img_stats_destroy(inst->ctx.stats);
+	for (i = 0; i < ARRAY_SIZE(inst->option_str); i++)
+		free(inst->option_str[i]);
+	if (inst->numbered)
+		instance_number_put(inst->ctx.instance);
+	free(inst);
+}
+
+static enum pon_adapter_errno pon_img_shutdown(void *ll_handle)
+{
+	struct pon_img_instance *inst = ll_handle;
+
+	dbg_in_args("%p", ll_handle);
+
+	if (IFXOS_THREAD_INIT_VALID(&inst->reboot_thread_control))
+		(void)IFXOS_ThreadDelete(&inst->reboot_thread_control, 0);
+
+	/* an asynchronous store uses the SW image */
+	pon_img_async_destroy(inst->ctx.async);
+	inst->ctx.async = NULL;
+
+	pon_sw_image_release(&inst->ctx);
+
+	pon_img_instance_free(inst);
+
+	dbg_out_ret("%d", PON_ADAPTER_SUCCESS);
+	return PON_ADAPTER_SUCCESS;
+}
+
 static const struct pa_system_ops system_ops = {
 	.init = pon_img_init,
 	.start = pon_img_start,
 	.reboot = pon_img_reboot,
-	.shutdown = NULL,
+	.shutdown = pon_img_shutdown,
 };
 
 static const struct pa_omci_me_ops omci_me_ops = {
@@ -163,6 +438,7 @@ libponimg_ll_register_ops(void *hl_handle_legacy,
 			  uint32_t if_version)
 {
 	enum pon_adapter_errno ret = PON_ADAPTER_ERROR;
+	struct pon_img_instance *inst;
 
 	dbg_in_args("%p, %p, %p, %p, %d",
 		    hl_handle_legacy, pa_ops, ll_handle, hl_handle, if_version);
@@ -174,12 +450,34 @@ libponimg_ll_register_ops(void *hl_handle_legacy,
 	}
 
 	if (PA_IF_VERSION_CHECK_COMPATIBLE(if_version)) {
-		g_pon_img_context.hl_handle = hl_handle;
+		inst = calloc(1, sizeof(*inst));
+		if (!inst) {
+			ret = PON_ADAPTER_ERR_NO_MEMORY;
+			goto exit;
+		}
+		inst->ctx.image.fd = -1;
+		inst->ctx.hl_handle = hl_handle;
+
+		ret = instance_number_get(&inst->ctx.instance);
+		if (ret != PON_ADAPTER_SUCCESS) {
+			pon_img_instance_free(inst);
+			goto exit;
+		}
+		inst->numbered = true;
+
+		ret = pon_uboot_cache_create(&inst->ctx);
+		if (ret == PON_ADAPTER_SUCCESS)
+			ret = pon_img_stats_create(&inst->ctx.stats);
+		if (ret != PON_ADAPTER_SUCCESS) {
+			pon_img_instance_free(inst);
+			goto exit;
+		}
+
 		*pa_ops = &pon_img_pa_ops;
-		*ll_handle = &g_pon_img_context;
-		ret = PON_ADAPTER_SUCCESS;
+		*ll_handle = &inst->ctx;
 	}
 
+exit:
 	dbg_out_ret("%d", ret);
 	return ret;
 }
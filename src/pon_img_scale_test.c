@@ -0,0 +1,178 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include <pon_adapter.h>
+#include <pon_adapter_system.h>
+#include <omci/pon_adapter_omci.h>
+#include <omci/me/pon_adapter_sw_image.h>
+
+#include <pon_img_register.h>
+#include "pon_img_test.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Maximum number of contexts */
+#define SCALE_CONTEXTS_MAX	64
+
+static const char *help =
+	"Runs SW downloads in parallel, each thread with its own library\n"
+	"context and staging file, and checks the received images.\n"
+	"Options:\n"
+	"-n, --contexts	Number of contexts (default 8).\n"
+	"-d, --downloads	Downloads per context (default 4).\n"
+	"-s, --size	Image size in KiB (default 400).\n"
+	"-p, --path	Directory of the test directories (default /tmp).\n"
+	"-h, --help	Print help and exit.\n"
+	;
+
+static struct option long_opts[] = {
+	{"contexts", required_argument, 0, 'n'},
+	{"downloads", required_argument, 0, 'd'},
+	{"size", required_argument, 0, 's'},
+	{"path", required_argument, 0, 'p'},
+	{"help", no_argument, 0, 'h'},
+	{0, 0, 0, 0}
+};
+
+/** Options string */
+static const char opt_string[] = "n:d:s:p:h";
+
+struct scale_thread {
+	pthread_t thread;
+	unsigned int num;
+	unsigned int failed;
+};
+
+static unsigned int downloads = 4;
+static const char *dir = "/tmp";
+static uint8_t *image;
+static uint32_t image_size = 400 * 1024;
+
+static unsigned int download(struct pon_img_test *test, const uint8_t id)
+{
+	char path[PON_IMG_PATH_LEN];
+	enum pon_adapter_errno ret;
+
+	ret = pon_img_test_download(test, id, image, image_size, path,
+				    sizeof(path));
+	if (ret != PON_ADAPTER_SUCCESS) {
+		printf("%s: download failed with %d\n", test->dir, ret);
+		return 1;
+	}
+	/* the staging file of the context must hold exactly the image */
+	if (strncmp(path, test->upgrade_path, strlen(test->upgrade_path)) ||
+	    !pon_img_test_file_check(path, image, image_size)) {
+		printf("%s: image differs from the sent one\n", path);
+		return 1;
+	}
+
+	return 0;
+}
+
+static void *scale_thread(void *arg)
+{
+	struct scale_thread *thr = arg;
+	char name[PON_IMG_PATH_LEN];
+	struct pon_img_test test;
+	unsigned int i;
+
+	snprintf(name, sizeof(name), "%s/pon_img_scale.%u", dir, thr->num);
+	if (pon_img_test_open(&test, name)) {
+		thr->failed = downloads;
+		return NULL;
+	}
+
+	/* the options are set like by the higher layer */
+	test.ctx->dl_no_header_check = true;
+	test.ctx->dl_no_checkpoint = true;
+
+	for (i = 0; i < downloads; i++)
+		thr->failed += download(&test, thr->num & 1);
+
+	pon_img_test_close(&test);
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	static struct scale_thread thr[SCALE_CONTEXTS_MAX];
+	unsigned int contexts = 8, failed = 0, i;
+	double start;
+	int c, index;
+
+	while ((c = getopt_long(argc, argv, opt_string, long_opts,
+				&index)) != -1) {
+		switch (c) {
+		case 'n':
+			contexts = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			downloads = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			image_size = strtoul(optarg, NULL, 0) * 1024;
+			break;
+		case 'p':
+			dir = optarg;
+			break;
+		default:
+			printf("Usage: %s [options]\n%s", argv[0], help);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if (!contexts || contexts > SCALE_CONTEXTS_MAX || !image_size) {
+		printf("1 to %u contexts with a non-empty image\n",
+		       SCALE_CONTEXTS_MAX);
+		return 1;
+	}
+
+	image = malloc(image_size);
+	if (!image) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	pon_img_test_fill(image, image_size, 7);
+
+	start = pon_img_test_now_ms();
+	for (i = 0; i < contexts; i++) {
+		thr[i].num = i;
+		if (pthread_create(&thr[i].thread, NULL, scale_thread,
+				   &thr[i])) {
+			printf("context %u: thread not started\n", i);
+			contexts = i;
+			failed++;
+			break;
+		}
+	}
+	for (i = 0; i < contexts; i++) {
+		pthread_join(thr[i].thread, NULL);
+		failed += thr[i].failed;
+	}
+
+	printf("%u contexts x %u downloads of %u KiB: %u failed, %.1f ms\n",
+	       contexts, downloads, image_size / 1024, failed,
+	       pon_img_test_now_ms() - start);
+
+	free(image);
+
+	return failed ? 1 : 0;
+}
+
+/** @} */
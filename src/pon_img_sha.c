@@ -0,0 +1,527 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define SHA_HAVE_SHANI
+#endif
+
+#if defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#include <arm_neon.h>
+#define SHA_HAVE_ARMV8
+#endif
+
+#include "pon_img_common.h"
+#include "pon_img_sha.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+typedef void (*sha256_fn_t)(uint32_t *h, const uint8_t *data, size_t blocks);
+
+static pthread_once_t sha_once = PTHREAD_ONCE_INIT;
+static sha256_fn_t sha256_fn;
+static const char *sha256_fn_name;
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint64_t sha512_k[80] = {
+	0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
+	0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+	0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL,
+	0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+	0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+	0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+	0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL, 0x2de92c6f592b0275ULL,
+	0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+	0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL,
+	0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+	0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL,
+	0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+	0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL,
+	0x92722c851482353bULL, 0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+	0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+	0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+	0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL,
+	0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+	0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL,
+	0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+	0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL,
+	0xc67178f2e372532bULL, 0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+	0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL,
+	0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+	0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+	0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+	0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+static inline uint32_t load_be32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+	       (uint32_t)p[2] << 8 | p[3];
+}
+
+static inline uint64_t load_be64(const uint8_t *p)
+{
+	return (uint64_t)load_be32(p) << 32 | load_be32(p + 4);
+}
+
+static inline void store_be64(uint8_t *p, uint64_t v)
+{
+	int i;
+
+	for (i = 7; i >= 0; i--, v >>= 8)
+		p[i] = (uint8_t)v;
+}
+
+static inline uint32_t ror32(uint32_t x, unsigned int n)
+{
+	return (x >> n) | (x << (32 - n));
+}
+
+static inline uint64_t ror64(uint64_t x, unsigned int n)
+{
+	return (x >> n) | (x << (64 - n));
+}
+
+static void sha256_blocks_generic(uint32_t *h, const uint8_t *data,
+				  size_t blocks)
+{
+	uint32_t w[64], a, b, c, d, e, f, g, hh, t1, t2;
+	int i;
+
+	for (; blocks; blocks--, data += 64) {
+		for (i = 0; i < 16; i++)
+			w[i] = load_be32(data + 4 * i);
+		for (i = 16; i < 64; i++)
+			w[i] = w[i - 16] + w[i - 7] +
+			       (ror32(w[i - 15], 7) ^ ror32(w[i - 15], 18) ^
+				(w[i - 15] >> 3)) +
+			       (ror32(w[i - 2], 17) ^ ror32(w[i - 2], 19) ^
+				(w[i - 2] >> 10));
+
+		a = h[0]; b = h[1]; c = h[2]; d = h[3];
+		e = h[4]; f = h[5]; g = h[6]; hh = h[7];
+		for (i = 0; i < 64; i++) {
+			t1 = hh + (ror32(e, 6) ^ ror32(e, 11) ^ ror32(e, 25)) +
+			     ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+			t2 = (ror32(a, 2) ^ ror32(a, 13) ^ ror32(a, 22)) +
+			     ((a & b) ^ (a & c) ^ (b & c));
+			hh = g; g = f; f = e; e = d + t1;
+			d = c; c = b; b = a; a = t1 + t2;
+		}
+		h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+		h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+	}
+}
+
+#ifdef SHA_HAVE_SHANI
+/* The state is kept as ABEF and CDGH, each sha256rnds2 does two rounds */
+__attribute__((target("sha,sse4.1")))
+static void sha256_blocks_shani(uint32_t *h, const uint8_t *data,
+				size_t blocks)
+{
+	const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+					     0x0405060700010203ULL);
+	__m128i abef, cdgh, abef_save, cdgh_save, tmp, k, m[4];
+	int i;
+
+	tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&h[0]), 0xb1);
+	cdgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&h[4]), 0x1b);
+	abef = _mm_alignr_epi8(tmp, cdgh, 8);
+	cdgh = _mm_blend_epi16(cdgh, tmp, 0xf0);
+
+	for (; blocks; blocks--, data += 64) {
+		abef_save = abef;
+		cdgh_save = cdgh;
+
+		for (i = 0; i < 16; i++) {
+			if (i < 4)
+				m[i] = _mm_shuffle_epi8(
+					_mm_loadu_si128((const __m128i *)
+							(data + 16 * i)),
+					bswap);
+			else
+				m[i & 3] = _mm_sha256msg2_epu32(
+					_mm_add_epi32(
+						_mm_sha256msg1_epu32(m[i & 3],
+							m[(i + 1) & 3]),
+						_mm_alignr_epi8(m[(i + 3) & 3],
+								m[(i + 2) & 3],
+								4)),
+					m[(i + 3) & 3]);
+
+			k = _mm_add_epi32(m[i & 3],
+					  _mm_loadu_si128((const __m128i *)
+							  &sha256_k[4 * i]));
+			cdgh = _mm_sha256rnds2_epu32(cdgh, abef, k);
+			abef = _mm_sha256rnds2_epu32(abef, cdgh,
+						     _mm_shuffle_epi32(k, 0x0e));
+		}
+
+		abef = _mm_add_epi32(abef, abef_save);
+		cdgh = _mm_add_epi32(cdgh, cdgh_save);
+	}
+
+	tmp = _mm_shuffle_epi32(abef, 0x1b);
+	cdgh = _mm_shuffle_epi32(cdgh, 0xb1);
+	_mm_storeu_si128((__m128i *)&h[0], _mm_blend_epi16(tmp, cdgh, 0xf0));
+	_mm_storeu_si128((__m128i *)&h[4], _mm_alignr_epi8(cdgh, tmp, 8));
+}
+
+static bool sha_cpu_has_shani(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) ||
+	    !(ecx & bit_SSE4_1) || !(ecx & bit_SSSE3))
+		return false;
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+		return false;
+
+	return (ebx & bit_SHA) != 0;
+}
+#endif
+
+#ifdef SHA_HAVE_ARMV8
+__attribute__((target("+crypto")))
+static void sha256_blocks_armv8(uint32_t *h, const uint8_t *data,
+				size_t blocks)
+{
+	uint32x4_t abcd, efgh, abcd_save, efgh_save, prev, k, m[4];
+	int i;
+
+	abcd = vld1q_u32(&h[0]);
+	efgh = vld1q_u32(&h[4]);
+
+	for (; blocks; blocks--, data += 64) {
+		abcd_save = abcd;
+		efgh_save = efgh;
+
+		for (i = 0; i < 16; i++) {
+			if (i < 4)
+				m[i] = vreinterpretq_u32_u8(
+					vrev32q_u8(vld1q_u8(data + 16 * i)));
+			else
+				m[i & 3] = vsha256su1q_u32(
+					vsha256su0q_u32(m[i & 3],
+							m[(i + 1) & 3]),
+					m[(i + 2) & 3], m[(i + 3) & 3]);
+
+			k = vaddq_u32(m[i & 3], vld1q_u32(&sha256_k[4 * i]));
+			prev = abcd;
+			abcd = vsha256hq_u32(abcd, efgh, k);
+			efgh = vsha256h2q_u32(efgh, prev, k);
+		}
+
+		abcd = vaddq_u32(abcd, abcd_save);
+		efgh = vaddq_u32(efgh, efgh_save);
+	}
+
+	vst1q_u32(&h[0], abcd);
+	vst1q_u32(&h[4], efgh);
+}
+
+static bool sha_cpu_has_armv8(void)
+{
+	return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+}
+#endif
+
+static const struct {
+	const char *name;
+	sha256_fn_t fn;
+} sha256_impl[] = {
+#ifdef SHA_HAVE_SHANI
+	{ "shani", sha256_blocks_shani },
+#endif
+#ifdef SHA_HAVE_ARMV8
+	{ "armv8", sha256_blocks_armv8 },
+#endif
+	{ "generic", sha256_blocks_generic },
+};
+
+static bool sha_impl_supported(sha256_fn_t fn)
+{
+#ifdef SHA_HAVE_SHANI
+	if (fn == sha256_blocks_shani)
+		return sha_cpu_has_shani();
+#endif
+#ifdef SHA_HAVE_ARMV8
+	if (fn == sha256_blocks_armv8)
+		return sha_cpu_has_armv8();
+#endif
+	return fn != NULL;
+}
+
+static void sha_init(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(sha256_impl); i++) {
+		if (!sha_impl_supported(sha256_impl[i].fn))
+			continue;
+		sha256_fn = sha256_impl[i].fn;
+		sha256_fn_name = sha256_impl[i].name;
+		break;
+	}
+}
+
+void pon_img_sha256_init(struct pon_img_sha256 *s)
+{
+	static const uint32_t iv[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+
+	memcpy(s->h, iv, sizeof(s->h));
+	s->len = 0;
+}
+
+void pon_img_sha256_update(struct pon_img_sha256 *s, const uint8_t *data,
+			   size_t len)
+{
+	size_t fill = s->len % sizeof(s->buf), count;
+
+	pthread_once(&sha_once, sha_init);
+
+	s->len += len;
+
+	if (fill) {
+		count = sizeof(s->buf) - fill;
+		if (count > len)
+			count = len;
+		memcpy(s->buf + fill, data, count);
+		data += count;
+		len -= count;
+		if (fill + count < sizeof(s->buf))
+			return;
+		sha256_fn(s->h, s->buf, 1);
+	}
+
+	if (len >= sizeof(s->buf)) {
+		sha256_fn(s->h, data, len / sizeof(s->buf));
+		data += len & ~(sizeof(s->buf) - 1);
+		len &= sizeof(s->buf) - 1;
+	}
+
+	memcpy(s->buf, data, len);
+}
+
+void pon_img_sha256_final(struct pon_img_sha256 *s,
+			  uint8_t out[PON_IMG_SHA256_LEN])
+{
+	uint64_t bits = s->len * 8;
+	size_t fill = s->len % sizeof(s->buf);
+	int i;
+
+	pthread_once(&sha_once, sha_init);
+
+	s->buf[fill++] = 0x80;
+	if (fill > sizeof(s->buf) - 8) {
+		memset(s->buf + fill, 0, sizeof(s->buf) - fill);
+		sha256_fn(s->h, s->buf, 1);
+		fill = 0;
+	}
+	memset(s->buf + fill, 0, sizeof(s->buf) - 8 - fill);
+	store_be64(s->buf + sizeof(s->buf) - 8, bits);
+	sha256_fn(s->h, s->buf, 1);
+
+	for (i = 0; i < 8; i++) {
+		out[4 * i] = s->h[i] >> 24;
+		out[4 * i + 1] = s->h[i] >> 16;
+		out[4 * i + 2] = s->h[i] >> 8;
+		out[4 * i + 3] = s->h[i];
+	}
+}
+
+static void sha512_blocks(uint64_t *h, const uint8_t *data, size_t blocks)
+{
+	uint64_t w[80], a, b, c, d, e, f, g, hh, t1, t2;
+	int i;
+
+	for (; blocks; blocks--, data += 128) {
+		for (i = 0; i < 16; i++)
+			w[i] = load_be64(data + 8 * i);
+		for (i = 16; i < 80; i++)
+			w[i] = w[i - 16] + w[i - 7] +
+			       (ror64(w[i - 15], 1) ^ ror64(w[i - 15], 8) ^
+				(w[i - 15] >> 7)) +
+			       (ror64(w[i - 2], 19) ^ ror64(w[i - 2], 61) ^
+				(w[i - 2] >> 6));
+
+		a = h[0]; b = h[1]; c = h[2]; d = h[3];
+		e = h[4]; f = h[5]; g = h[6]; hh = h[7];
+		for (i = 0; i < 80; i++) {
+			t1 = hh + (ror64(e, 14) ^ ror64(e, 18) ^ ror64(e, 41)) +
+			     ((e & f) ^ (~e & g)) + sha512_k[i] + w[i];
+			t2 = (ror64(a, 28) ^ ror64(a, 34) ^ ror64(a, 39)) +
+			     ((a & b) ^ (a & c) ^ (b & c));
+			hh = g; g = f; f = e; e = d + t1;
+			d = c; c = b; b = a; a = t1 + t2;
+		}
+		h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+		h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+	}
+}
+
+void pon_img_sha384_init(struct pon_img_sha512 *s)
+{
+	static const uint64_t iv[8] = {
+		0xcbbb9d5dc1059ed8ULL, 0x629a292a367cd507ULL,
+		0x9159015a3070dd17ULL, 0x152fecd8f70e5939ULL,
+		0x67332667ffc00b31ULL, 0x8eb44a8768581511ULL,
+		0xdb0c2e0d64f98fa7ULL, 0x47b5481dbefa4fa4ULL
+	};
+
+	memcpy(s->h, iv, sizeof(s->h));
+	s->len = 0;
+}
+
+void pon_img_sha384_update(struct pon_img_sha512 *s, const uint8_t *data,
+			   size_t len)
+{
+	size_t fill = s->len % sizeof(s->buf), count;
+
+	s->len += len;
+
+	if (fill) {
+		count = sizeof(s->buf) - fill;
+		if (count > len)
+			count = len;
+		memcpy(s->buf + fill, data, count);
+		data += count;
+		len -= count;
+		if (fill + count < sizeof(s->buf))
+			return;
+		sha512_blocks(s->h, s->buf, 1);
+	}
+
+	if (len >= sizeof(s->buf)) {
+		sha512_blocks(s->h, data, len / sizeof(s->buf));
+		data += len & ~(sizeof(s->buf) - 1);
+		len &= sizeof(s->buf) - 1;
+	}
+
+	memcpy(s->buf, data, len);
+}
+
+void pon_img_sha384_final(struct pon_img_sha512 *s,
+			  uint8_t out[PON_IMG_SHA384_LEN])
+{
+	size_t fill = s->len % sizeof(s->buf);
+	int i;
+
+	s->buf[fill++] = 0x80;
+	if (fill > sizeof(s->buf) - 16) {
+		memset(s->buf + fill, 0, sizeof(s->buf) - fill);
+		sha512_blocks(s->h, s->buf, 1);
+		fill = 0;
+	}
+	/* the upper 64 bit of the 128 bit length are always zero here */
+	memset(s->buf + fill, 0, sizeof(s->buf) - 8 - fill);
+	store_be64(s->buf + sizeof(s->buf) - 8, s->len * 8);
+	sha512_blocks(s->h, s->buf, 1);
+
+	for (i = 0; i < PON_IMG_SHA384_LEN / 8; i++)
+		store_be64(out + 8 * i, s->h[i]);
+}
+
+const char *pon_img_sha256_impl(void)
+{
+	pthread_once(&sha_once, sha_init);
+
+	return sha256_fn_name;
+}
+
+int pon_img_sha256_impl_set(const char *name)
+{
+	unsigned int i;
+
+	pthread_once(&sha_once, sha_init);
+
+	for (i = 0; i < ARRAY_SIZE(sha256_impl); i++) {
+		if (strcmp(name, sha256_impl[i].name) != 0)
+			continue;
+		if (!sha_impl_supported(sha256_impl[i].fn))
+			return -1;
+		sha256_fn = sha256_impl[i].fn;
+		sha256_fn_name = sha256_impl[i].name;
+		return 0;
+	}
+
+	return -1;
+}
+
+void pon_img_digest_init(struct pon_img_digest *d, bool sha384)
+{
+	pon_img_sha256_init(&d->sha256);
+	d->use_sha384 = sha384;
+	if (sha384)
+		pon_img_sha384_init(&d->sha384);
+}
+
+void pon_img_digest_update(struct pon_img_digest *d, const uint8_t *data,
+			   size_t len)
+{
+	pon_img_sha256_update(&d->sha256, data, len);
+	if (d->use_sha384)
+		pon_img_sha384_update(&d->sha384, data, len);
+}
+
+static void sha_hex(char *hex, const uint8_t *digest, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		sprintf(hex + 2 * i, "%02x", digest[i]);
+	hex[2 * len] = '\0';
+}
+
+void pon_img_digest_final(struct pon_img_digest *d, char *sha256,
+			  char *sha384)
+{
+	uint8_t out[PON_IMG_SHA384_LEN];
+
+	pon_img_sha256_final(&d->sha256, out);
+	sha_hex(sha256, out, PON_IMG_SHA256_LEN);
+
+	sha384[0] = '\0';
+	if (!d->use_sha384)
+		return;
+	pon_img_sha384_final(&d->sha384, out);
+	sha_hex(sha384, out, PON_IMG_SHA384_LEN);
+}
+
+/** @} */
@@ -0,0 +1,128 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ ******************************************************************************/
+/**
+   \file pon_img_sha.h
+   Incremental SHA-256 and SHA-384 (FIPS 180-4) of a SW download image.
+
+   The digest is calculated while the image is received, the component which
+   writes the image into the flash does not need to read it again to check
+   its hash.
+*/
+
+#ifndef _PON_IMG_SHA_H_
+#define _PON_IMG_SHA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Length of a SHA-256 digest */
+#define PON_IMG_SHA256_LEN	32
+/** Length of a SHA-384 digest */
+#define PON_IMG_SHA384_LEN	48
+/** Buffer size of a SHA-256 digest in hex with terminating zero */
+#define PON_IMG_SHA256_HEX_LEN	(2 * PON_IMG_SHA256_LEN + 1)
+/** Buffer size of a SHA-384 digest in hex with terminating zero */
+#define PON_IMG_SHA384_HEX_LEN	(2 * PON_IMG_SHA384_LEN + 1)
+
+/** SHA-256 state */
+struct pon_img_sha256 {
+	/** Hash value */
+	uint32_t h[8];
+	/** Number of bytes hashed */
+	uint64_t len;
+	/** Bytes of an incomplete block */
+	uint8_t buf[64];
+};
+
+/** SHA-512 state, used for SHA-384 */
+struct pon_img_sha512 {
+	/** Hash value */
+	uint64_t h[8];
+	/** Number of bytes hashed */
+	uint64_t len;
+	/** Bytes of an incomplete block */
+	uint8_t buf[128];
+};
+
+/** Digests of a SW download image */
+struct pon_img_digest {
+	/** SHA-256, always calculated */
+	struct pon_img_sha256 sha256;
+	/** SHA-384, only if enabled */
+	struct pon_img_sha512 sha384;
+	/** SHA-384 is calculated */
+	bool use_sha384;
+};
+
+/**	Start a SHA-256 calculation. */
+void pon_img_sha256_init(struct pon_img_sha256 *s);
+
+/**	Add a data block to a SHA-256 calculation.
+ *
+ *	The fastest implementation supported by the CPU is selected on the
+ *	first call.
+ */
+void pon_img_sha256_update(struct pon_img_sha256 *s, const uint8_t *data,
+			   size_t len);
+
+/**	Finish a SHA-256 calculation. */
+void pon_img_sha256_final(struct pon_img_sha256 *s,
+			  uint8_t out[PON_IMG_SHA256_LEN]);
+
+/**	Start a SHA-384 calculation. */
+void pon_img_sha384_init(struct pon_img_sha512 *s);
+
+/**	Add a data block to a SHA-384 calculation. */
+void pon_img_sha384_update(struct pon_img_sha512 *s, const uint8_t *data,
+			   size_t len);
+
+/**	Finish a SHA-384 calculation. */
+void pon_img_sha384_final(struct pon_img_sha512 *s,
+			  uint8_t out[PON_IMG_SHA384_LEN]);
+
+/**	Name of the SHA-256 implementation. */
+const char *pon_img_sha256_impl(void);
+
+/**	Force a SHA-256 implementation, for comparison and benchmarking.
+ *
+ *	\param[in] name	"generic", "shani" or "armv8"
+ *
+ *	\return 0 if successful, -1 if the implementation is not available.
+ */
+int pon_img_sha256_impl_set(const char *name);
+
+/**	Start the digests of an image.
+ *
+ *	\param[in] d		Digests
+ *	\param[in] sha384	Calculate SHA-384 in addition to SHA-256
+ */
+void pon_img_digest_init(struct pon_img_digest *d, bool sha384);
+
+/**	Add image data to the digests. */
+void pon_img_digest_update(struct pon_img_digest *d, const uint8_t *data,
+			   size_t len);
+
+/**	Finish the digests and convert them to lower case hex strings.
+ *	The SHA-384 string is empty if it was not calculated.
+ *
+ *	\param[in] d		Digests
+ *	\param[out] sha256	SHA-256, \ref PON_IMG_SHA256_HEX_LEN bytes
+ *	\param[out] sha384	SHA-384, \ref PON_IMG_SHA384_HEX_LEN bytes
+ */
+void pon_img_digest_final(struct pon_img_digest *d, char *sha256,
+			  char *sha384);
+
+/** @} */
+
+#endif
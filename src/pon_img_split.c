@@ -18,12 +18,12 @@
 #include <getopt.h>
 #include <arpa/inet.h>
 
+#include "pon_img_uimage.h"
+
 /** \addtogroup PON_IMG_LIB
  *  @{
  */
 
-/** Image Name Length */
-#define IH_NMLEN		32
 /** Maximum volume name length */
 #define MAX_VOLUME_NAME		64
 
@@ -33,41 +33,6 @@
 #define IMG_BOOTCORE	"img-bootcore"
 #define IMG_VERSION	"img-version"
 
-/** OS Kernel Image */
-#define IH_TYPE_KERNEL		2
-/** Multi-file Image */
-#define IH_TYPE_MULTI		4
-/** Filesystem Image (any type) */
-#define IH_TYPE_FILESYSTEM	7
-
-/** This structure decode image headers */
-struct image_header {
-	/** Image Header Magic Number */
-	uint32_t	ih_magic;
-	/** Image Header CRC Checksum */
-	uint32_t	ih_hcrc;
-	/** Image Creation Timestamp */
-	uint32_t	ih_time;
-	/** Image Data Size */
-	uint32_t	ih_size;
-	/** Data Load Address */
-	uint32_t	ih_load;
-	/** Entry Point Address */
-	uint32_t	ih_ep;
-	/** Image Data CRC Checksum */
-	uint32_t	ih_dcrc;
-	/** Operating System */
-	uint8_t		ih_os;
-	/** CPU Architecture */
-	uint8_t		ih_arch;
-	/** Image Type */
-	uint8_t		ih_type;
-	/** Compression Type */
-	uint8_t		ih_comp;
-	/** Image Name */
-	uint8_t		ih_name[IH_NMLEN];
-};
-
 static const char *help =
 	"Options:\n"
 	"-f, --filename	Mandatory! Name of the file containing image.\n"
@@ -290,7 +255,7 @@ static int pon_img_split(const char *filename)
 				img_version_set = true;
 			}
 			/* Prepare partition name */
-			if (strncmp((char *)img_hdr.ih_name, "MIPS 4Kec Bootcore",
+			if (strncmp((char *)img_hdr.ih_name, IH_NAME_BOOTCORE,
 				    sizeof(img_hdr.ih_name)) == 0)
 				name = IMG_BOOTCORE;
 			else
@@ -0,0 +1,181 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "pon_img_stats.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+struct pon_img_stats {
+	/** Protects all fields against a concurrent reader */
+	pthread_mutex_t lock;
+	/** Published telemetry */
+	struct pon_img_dl_stats s;
+	/** Sample interval in us */
+	uint64_t interval;
+	/** Time of the download start */
+	uint64_t start;
+	/** Start of the current sample interval */
+	uint64_t sample;
+	/** Received bytes at the start of the current sample interval */
+	uint64_t sample_bytes;
+};
+
+uint64_t pon_img_stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+enum pon_adapter_errno pon_img_stats_create(struct pon_img_stats **st)
+{
+	struct pon_img_stats *s;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return PON_ADAPTER_ERR_NO_MEMORY;
+
+	if (pthread_mutex_init(&s->lock, NULL)) {
+		free(s);
+		return PON_ADAPTER_ERROR;
+	}
+
+	*st = s;
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+void pon_img_stats_destroy(struct pon_img_stats *st)
+{
+	if (!st)
+		return;
+
+	pthread_mutex_destroy(&st->lock);
+	free(st);
+}
+
+void pon_img_stats_start(struct pon_img_stats *st, uint32_t size,
+			 uint32_t interval)
+{
+	pthread_mutex_lock(&st->lock);
+	memset(&st->s, 0, sizeof(st->s));
+	st->s.active = true;
+	st->s.size = size;
+	st->interval = (uint64_t)(interval ? interval :
+					     PON_IMG_STATS_INTERVAL) * 1000;
+	st->start = pon_img_stats_now();
+	st->sample = st->start;
+	st->sample_bytes = 0;
+	pthread_mutex_unlock(&st->lock);
+}
+
+/* Bucket 0 holds latencies below 16 us, each further bucket doubles */
+static unsigned int stats_bucket(uint64_t us)
+{
+	unsigned int bucket = 0;
+
+	for (us >>= 4; us && bucket < PON_IMG_DL_LAT_BUCKETS - 1; us >>= 1)
+		bucket++;
+
+	return bucket;
+}
+
+static void stats_rates(struct pon_img_stats *st, uint64_t now)
+{
+	struct pon_img_dl_stats *s = &st->s;
+	uint64_t rate;
+
+	s->elapsed_ms = (uint32_t)((now - st->start) / 1000);
+	if (now > st->start)
+		s->rate_avg = (uint32_t)(s->bytes * 1000000 /
+					 (now - st->start));
+
+	rate = s->rate ? s->rate : s->rate_avg;
+	s->eta_s = rate ? (uint32_t)((s->size - s->offset) / rate) : 0;
+}
+
+bool pon_img_stats_window(struct pon_img_stats *st, uint32_t len,
+			  uint32_t offset, uint64_t start)
+{
+	struct pon_img_dl_stats *s = &st->s;
+	uint64_t now = pon_img_stats_now();
+	uint64_t latency = now - start;
+	bool sample = false;
+
+	pthread_mutex_lock(&st->lock);
+
+	s->bytes += len;
+	s->windows++;
+	s->offset = offset;
+	s->latency[stats_bucket(latency)]++;
+	if (latency > s->latency_max_us)
+		s->latency_max_us = (uint32_t)latency;
+
+	if (now - st->sample >= st->interval) {
+		s->rate = (uint32_t)((s->bytes - st->sample_bytes) * 1000000 /
+				     (now - st->sample));
+		st->sample = now;
+		st->sample_bytes = s->bytes;
+		sample = true;
+	}
+	stats_rates(st, now);
+
+	pthread_mutex_unlock(&st->lock);
+
+	return sample;
+}
+
+void pon_img_stats_stall(struct pon_img_stats *st, uint64_t start)
+{
+	uint64_t stall = pon_img_stats_now() - start;
+
+	pthread_mutex_lock(&st->lock);
+	st->s.stall_us += stall;
+	pthread_mutex_unlock(&st->lock);
+}
+
+bool pon_img_stats_stop(struct pon_img_stats *st)
+{
+	bool active;
+
+	pthread_mutex_lock(&st->lock);
+	active = st->s.active;
+	if (active) {
+		stats_rates(st, pon_img_stats_now());
+		st->s.active = false;
+		st->s.eta_s = 0;
+	}
+	pthread_mutex_unlock(&st->lock);
+
+	return active;
+}
+
+bool pon_img_stats_get(struct pon_img_stats *st,
+		       struct pon_img_dl_stats *stats)
+{
+	bool started;
+
+	pthread_mutex_lock(&st->lock);
+	*stats = st->s;
+	started = st->start != 0;
+	pthread_mutex_unlock(&st->lock);
+
+	return started;
+}
+
+/** @} */
@@ -0,0 +1,84 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ ******************************************************************************/
+/**
+   \file pon_img_stats.h
+   Telemetry of the SW download, updated by the OMCI thread and read at any
+   time by \ref pon_img_dl_stats_get.
+
+   The receive rate is sampled once per interval, the same interval is used
+   for the progress events.
+*/
+
+#ifndef _PON_IMG_STATS_H_
+#define _PON_IMG_STATS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pon_adapter.h>
+
+#include "pon_img_register.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Default sample and progress event interval in ms */
+#define PON_IMG_STATS_INTERVAL	1000
+
+struct pon_img_stats;
+
+/**	Current time in us, from a monotonic clock. */
+uint64_t pon_img_stats_now(void);
+
+/**	Allocate the telemetry of a context. */
+enum pon_adapter_errno pon_img_stats_create(struct pon_img_stats **st);
+
+/**	Free the telemetry. */
+void pon_img_stats_destroy(struct pon_img_stats *st);
+
+/**	Reset the telemetry for a new download.
+ *
+ *	\param[in] st		Telemetry
+ *	\param[in] size		Image size
+ *	\param[in] interval	Sample interval in ms, 0 selects the default
+ */
+void pon_img_stats_start(struct pon_img_stats *st, uint32_t size,
+			 uint32_t interval);
+
+/**	Account a received window.
+ *
+ *	\param[in] st		Telemetry
+ *	\param[in] len		Window length
+ *	\param[in] offset	Contiguous image bytes after the window
+ *	\param[in] start	Time when the window processing started
+ *
+ *	\return true if a sample interval ended, a progress event is due.
+ */
+bool pon_img_stats_window(struct pon_img_stats *st, uint32_t len,
+			  uint32_t offset, uint64_t start);
+
+/**	Account the time spent writing the image since \p start. */
+void pon_img_stats_stall(struct pon_img_stats *st, uint64_t start);
+
+/**	Mark the download as finished, the final rates are kept.
+ *
+ *	\return true if a download was active.
+ */
+bool pon_img_stats_stop(struct pon_img_stats *st);
+
+/**	Copy the current telemetry.
+ *
+ *	\return false if no download was started yet.
+ */
+bool pon_img_stats_get(struct pon_img_stats *st,
+		       struct pon_img_dl_stats *stats);
+
+/** @} */
+
+#endif
@@ -0,0 +1,449 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "pon_img_debug.h"
+#include "pon_img_store.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** File name of a stored image, from size and CRC */
+#define STORE_NAME_FMT		"%08x-%08x.img"
+/** Read size of the image compare */
+#define STORE_CMP_SIZE		(64 * 1024)
+
+/** Image in the store */
+struct store_entry {
+	/** Next image */
+	struct store_entry *next;
+	/** Image size */
+	uint32_t size;
+	/** Image CRC */
+	uint32_t crc;
+	/** Number of references */
+	unsigned int refs;
+	/** Time of the last use, in store ticks */
+	uint64_t used;
+};
+
+struct pon_img_store {
+	/** Next store of the process */
+	struct pon_img_store *next;
+	/** Store directory */
+	char dir[PON_IMG_STORE_DIR_LEN];
+	/** Byte budget */
+	uint64_t budget;
+	/** Bytes of all stored images */
+	uint64_t total;
+	/** Use counter for the LRU order */
+	uint64_t tick;
+	/** Stored images */
+	struct store_entry *entry;
+};
+
+/** Open stores, only to keep their directories apart. The list and the
+ *  stores are protected by store_lock, a store is also used by the worker
+ *  thread of its context.
+ */
+static struct pon_img_store *store_list;
+static pthread_mutex_t store_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void store_path(const struct pon_img_store *store,
+		       const struct store_entry *entry,
+		       char *path, size_t path_size)
+{
+	snprintf(path, path_size, "%s/" STORE_NAME_FMT, store->dir,
+		 entry->size, entry->crc);
+}
+
+static struct store_entry *store_find(struct pon_img_store *store,
+				      uint32_t size, uint32_t crc)
+{
+	struct store_entry *entry;
+
+	for (entry = store->entry; entry; entry = entry->next)
+		if (entry->size == size && entry->crc == crc)
+			return entry;
+
+	return NULL;
+}
+
+static struct store_entry *store_find_path(struct pon_img_store *store,
+					   const char *path)
+{
+	struct store_entry *entry;
+	char name[PON_IMG_STORE_DIR_LEN + 32];
+
+	for (entry = store->entry; entry; entry = entry->next) {
+		store_path(store, entry, name, sizeof(name));
+		if (!strcmp(name, path))
+			return entry;
+	}
+
+	return NULL;
+}
+
+static struct store_entry *store_insert(struct pon_img_store *store,
+					uint32_t size, uint32_t crc)
+{
+	struct store_entry *entry;
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry)
+		return NULL;
+
+	entry->size = size;
+	entry->crc = crc;
+	entry->next = store->entry;
+	store->entry = entry;
+	store->total += size;
+
+	return entry;
+}
+
+static void store_remove(struct pon_img_store *store,
+			 struct store_entry *entry, bool unlink_file)
+{
+	struct store_entry **pp;
+	char path[PON_IMG_STORE_DIR_LEN + 32];
+
+	if (unlink_file) {
+		store_path(store, entry, path, sizeof(path));
+		if (unlink(path) && errno != ENOENT)
+			dbg_wrn("%s can not be removed: %s\n", path,
+				strerror(errno));
+		else
+			dbg_msg("%s removed from the store\n", path);
+	}
+
+	for (pp = &store->entry; *pp; pp = &(*pp)->next) {
+		if (*pp == entry) {
+			*pp = entry->next;
+			break;
+		}
+	}
+	store->total -= entry->size;
+	free(entry);
+}
+
+/* The file of an image can vanish, for example if it was moved by
+ * the upgrade on a file system without hard links.
+ */
+static bool store_valid(const struct pon_img_store *store,
+			const struct store_entry *entry)
+{
+	char path[PON_IMG_STORE_DIR_LEN + 32];
+	struct stat st;
+
+	store_path(store, entry, path, sizeof(path));
+
+	return stat(path, &st) == 0 && S_ISREG(st.st_mode) &&
+	       st.st_size == entry->size;
+}
+
+/* Remove unreferenced images, least recently used first */
+static void store_evict(struct pon_img_store *store)
+{
+	struct store_entry *entry, *lru;
+
+	while (store->total > store->budget) {
+		lru = NULL;
+		for (entry = store->entry; entry; entry = entry->next)
+			if (!entry->refs && (!lru || entry->used < lru->used))
+				lru = entry;
+		if (!lru)
+			break;
+		store_remove(store, lru, true);
+	}
+}
+
+static bool files_equal(const char *a, const char *b, uint32_t size)
+{
+	uint8_t *buf;
+	ssize_t len, len_b;
+	bool equal = false;
+	int fd_a, fd_b = -1;
+
+	fd_a = open(a, O_RDONLY);
+	if (fd_a < 0)
+		return false;
+	fd_b = open(b, O_RDONLY);
+	buf = malloc(2 * STORE_CMP_SIZE);
+	if (fd_b < 0 || !buf)
+		goto exit;
+
+	while (size) {
+		len = read(fd_a, buf, STORE_CMP_SIZE);
+		if (len <= 0)
+			goto exit;
+		len_b = read(fd_b, buf + STORE_CMP_SIZE, len);
+		if (len_b != len ||
+		    memcmp(buf, buf + STORE_CMP_SIZE, len))
+			goto exit;
+		size -= len < size ? len : size;
+	}
+	equal = true;
+
+exit:
+	free(buf);
+	if (fd_b >= 0)
+		close(fd_b);
+	close(fd_a);
+	return equal;
+}
+
+static int mkdir_all(const char *dir)
+{
+	char path[PON_IMG_STORE_DIR_LEN];
+	char *p;
+
+	snprintf(path, sizeof(path), "%s", dir);
+	for (p = path + 1; *p; p++) {
+		if (*p != '/')
+			continue;
+		*p = '\0';
+		if (mkdir(path, 0700) && errno != EEXIST)
+			return -1;
+		*p = '/';
+	}
+	if (mkdir(path, 0700) && errno != EEXIST)
+		return -1;
+
+	return 0;
+}
+
+/* Take over the images of an earlier run, they are the oldest ones */
+static void store_scan(struct pon_img_store *store)
+{
+	char path[PON_IMG_STORE_DIR_LEN + 32];
+	struct dirent *de;
+	struct stat st;
+	uint32_t size, crc;
+	int len;
+	DIR *d;
+
+	d = opendir(store->dir);
+	if (!d)
+		return;
+
+	while ((de = readdir(d)) != NULL) {
+		len = 0;
+		if (sscanf(de->d_name, STORE_NAME_FMT "%n", &size, &crc,
+			   &len) != 2 || de->d_name[len] != '\0')
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", store->dir, de->d_name);
+		if (stat(path, &st) || !S_ISREG(st.st_mode) ||
+		    st.st_size != size || store_find(store, size, crc)) {
+			(void)unlink(path);
+			continue;
+		}
+		if (!store_insert(store, size, crc))
+			break;
+	}
+	closedir(d);
+}
+
+enum pon_adapter_errno pon_img_store_open(struct pon_img_store **store,
+					  const char *dir, uint64_t budget)
+{
+	enum pon_adapter_errno ret = PON_ADAPTER_SUCCESS;
+	struct pon_img_store *s;
+
+	if (strlen(dir) >= PON_IMG_STORE_DIR_LEN)
+		return PON_ADAPTER_ERR_SIZE;
+
+	pthread_mutex_lock(&store_lock);
+
+	for (s = store_list; s; s = s->next) {
+		if (!strcmp(s->dir, dir)) {
+			dbg_err("store %s is used by another registration\n",
+				dir);
+			ret = PON_ADAPTER_ERR_RESOURCE_EXISTS;
+			goto exit;
+		}
+	}
+
+	if (mkdir_all(dir)) {
+		dbg_err("store %s can not be created: %s\n", dir,
+			strerror(errno));
+		ret = PON_ADAPTER_ERROR;
+		goto exit;
+	}
+	s = calloc(1, sizeof(*s));
+	if (!s) {
+		ret = PON_ADAPTER_ERR_NO_MEMORY;
+		goto exit;
+	}
+	snprintf(s->dir, sizeof(s->dir), "%s", dir);
+	s->budget = budget ? budget : PON_IMG_STORE_BUDGET;
+	store_scan(s);
+	store_evict(s);
+	s->next = store_list;
+	store_list = s;
+	*store = s;
+
+exit:
+	pthread_mutex_unlock(&store_lock);
+	return ret;
+}
+
+void pon_img_store_close(struct pon_img_store *store)
+{
+	struct pon_img_store **pp;
+
+	if (!store)
+		return;
+
+	pthread_mutex_lock(&store_lock);
+
+	for (pp = &store_list; *pp; pp = &(*pp)->next) {
+		if (*pp == store) {
+			*pp = store->next;
+			break;
+		}
+	}
+	while (store->entry)
+		store_remove(store, store->entry, false);
+	free(store);
+
+	pthread_mutex_unlock(&store_lock);
+}
+
+enum pon_adapter_errno pon_img_store_add(struct pon_img_store *store,
+					 const char *src, uint32_t size,
+					 uint32_t crc, char *path,
+					 size_t path_size)
+{
+	enum pon_adapter_errno ret = PON_ADAPTER_SUCCESS;
+	struct store_entry *entry;
+
+	pthread_mutex_lock(&store_lock);
+
+	entry = store_find(store, size, crc);
+	if (entry && !store_valid(store, entry)) {
+		store_remove(store, entry, false);
+		entry = NULL;
+	}
+
+	if (entry) {
+		store_path(store, entry, path, path_size);
+		if (!files_equal(src, path, size)) {
+			dbg_wrn("%s differs from %s with the same CRC\n",
+				src, path);
+			ret = PON_ADAPTER_ERR_RESOURCE_EXISTS;
+			goto exit;
+		}
+		(void)unlink(src);
+		dbg_msg("image already stored as %s\n", path);
+	} else {
+		entry = store_insert(store, size, crc);
+		if (!entry) {
+			ret = PON_ADAPTER_ERR_NO_MEMORY;
+			goto exit;
+		}
+		store_path(store, entry, path, path_size);
+		if (rename(src, path)) {
+			dbg_wrn("%s can not be moved to the store: %s\n",
+				src, strerror(errno));
+			store_remove(store, entry, false);
+			ret = PON_ADAPTER_ERROR;
+			goto exit;
+		}
+		dbg_msg("image stored as %s\n", path);
+	}
+
+	entry->refs++;
+	entry->used = ++store->tick;
+	store_evict(store);
+
+exit:
+	pthread_mutex_unlock(&store_lock);
+	return ret;
+}
+
+enum pon_adapter_errno pon_img_store_lookup(struct pon_img_store *store,
+					    uint32_t size, uint32_t crc,
+					    char *path, size_t path_size)
+{
+	enum pon_adapter_errno ret = PON_ADAPTER_SUCCESS;
+	struct store_entry *entry;
+
+	pthread_mutex_lock(&store_lock);
+
+	entry = store_find(store, size, crc);
+	if (entry && !store_valid(store, entry)) {
+		if (!entry->refs)
+			store_remove(store, entry, false);
+		entry = NULL;
+	}
+	if (!entry) {
+		ret = PON_ADAPTER_ERR_RESOURCE_NOT_FOUND;
+		goto exit;
+	}
+	store_path(store, entry, path, path_size);
+	entry->refs++;
+	entry->used = ++store->tick;
+
+exit:
+	pthread_mutex_unlock(&store_lock);
+	return ret;
+}
+
+enum pon_adapter_errno pon_img_store_get(struct pon_img_store *store,
+					 const char *path)
+{
+	enum pon_adapter_errno ret = PON_ADAPTER_SUCCESS;
+	struct store_entry *entry;
+
+	pthread_mutex_lock(&store_lock);
+
+	entry = store_find_path(store, path);
+	if (!entry) {
+		ret = PON_ADAPTER_ERR_RESOURCE_NOT_FOUND;
+		goto exit;
+	}
+	entry->refs++;
+	entry->used = ++store->tick;
+
+exit:
+	pthread_mutex_unlock(&store_lock);
+	return ret;
+}
+
+void pon_img_store_put(struct pon_img_store *store, const char *path)
+{
+	struct store_entry *entry;
+
+	pthread_mutex_lock(&store_lock);
+
+	entry = store_find_path(store, path);
+	if (entry && entry->refs) {
+		entry->refs--;
+		entry->used = ++store->tick;
+		if (!entry->refs && !store_valid(store, entry))
+			store_remove(store, entry, false);
+		store_evict(store);
+	}
+
+	pthread_mutex_unlock(&store_lock);
+}
+
+/** @} */
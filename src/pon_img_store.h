@@ -0,0 +1,107 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ ******************************************************************************/
+/**
+   \file pon_img_store.h
+   Store of completed SW download images of one registration, each store
+   has its own directory.
+
+   An image is identified by its size and OMCI CRC, the file name is derived
+   from both. A completed download of an image which is already in the store
+   is dropped after a byte compare, the stored file is used instead.
+
+   Each user of an image holds a reference. Images without a reference are
+   removed in least recently used order if the store exceeds its byte
+   budget.
+*/
+
+#ifndef _PON_IMG_STORE_H_
+#define _PON_IMG_STORE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pon_adapter.h>
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Default byte budget of a store */
+#define PON_IMG_STORE_BUDGET	(64 * 1024 * 1024)
+
+/** Maximum length of the store directory */
+#define PON_IMG_STORE_DIR_LEN	96
+
+struct pon_img_store;
+
+/**	Open the store in a directory. Each registration needs its own
+ *	directory, a directory which is already open is refused.
+ *	Images left in the directory by an earlier run are taken over.
+ *
+ *	\param[out] store	Store handle
+ *	\param[in] dir		Store directory, created if needed
+ *	\param[in] budget	Byte budget, 0 selects the default
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- PON_ADAPTER_ERR_SIZE: Directory name too long
+ *	- PON_ADAPTER_ERR_RESOURCE_EXISTS: The directory is already open
+ *	- Other: An error code in case of error.
+ */
+enum pon_adapter_errno pon_img_store_open(struct pon_img_store **store,
+					  const char *dir, uint64_t budget);
+
+/**	Close the store handle, the images stay in the directory. */
+void pon_img_store_close(struct pon_img_store *store);
+
+/**	Add a completed image and take a reference to it.
+ *
+ *	The file is moved into the store. If the same image is already
+ *	stored, the file is removed instead.
+ *
+ *	\param[in] store	Store handle
+ *	\param[in] src		Completed image file
+ *	\param[in] size		Image size
+ *	\param[in] crc		Image CRC
+ *	\param[out] path	Path of the image in the store
+ *	\param[in] path_size	Size of the path buffer
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- Other: The image was not added, the file stays at \p src.
+ */
+enum pon_adapter_errno pon_img_store_add(struct pon_img_store *store,
+					 const char *src, uint32_t size,
+					 uint32_t crc, char *path,
+					 size_t path_size);
+
+/**	Take a reference to a stored image, selected by size and CRC.
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- PON_ADAPTER_ERR_RESOURCE_NOT_FOUND: The image is not stored
+ */
+enum pon_adapter_errno pon_img_store_lookup(struct pon_img_store *store,
+					    uint32_t size, uint32_t crc,
+					    char *path, size_t path_size);
+
+/**	Take another reference to a stored image.
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- PON_ADAPTER_ERR_RESOURCE_NOT_FOUND: The file is not in the store
+ */
+enum pon_adapter_errno pon_img_store_get(struct pon_img_store *store,
+					 const char *path);
+
+/**	Release a reference, the image may be removed afterwards. */
+void pon_img_store_put(struct pon_img_store *store, const char *path);
+
+/** @} */
+
+#endif
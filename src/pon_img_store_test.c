@@ -0,0 +1,89 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <pon_adapter.h>
+#include <pon_adapter_system.h>
+#include <omci/pon_adapter_omci.h>
+#include <omci/me/pon_adapter_sw_image.h>
+
+#include <pon_img_register.h>
+#include "pon_img_common.h"
+#include "pon_img_test.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Image size of the test */
+#define STORE_TEST_SIZE		(256 * 1024)
+
+int main(void)
+{
+	static uint8_t image_a[STORE_TEST_SIZE], image_b[STORE_TEST_SIZE];
+	char path_a[PON_IMG_PATH_LEN], path_b[PON_IMG_PATH_LEN];
+	char store_dir[PON_IMG_PATH_LEN];
+	const struct pa_sw_image_ops *ops;
+	struct pon_img_test test;
+	int failed = 1;
+
+	pon_img_test_fill(image_a, STORE_TEST_SIZE, 7);
+	pon_img_test_fill(image_b, STORE_TEST_SIZE, 8);
+
+	if (pon_img_test_open(&test, "pon_img_store_test"))
+		return 1;
+	ops = test.pa_ops->omci_me_ops->sw_image;
+
+	/* the default staging file is also the path of the upgrade daemon */
+	pon_img_test_path(&test, "store", store_dir, sizeof(store_dir));
+	test.ctx->dl_store_dir = store_dir;
+	test.ctx->dl_no_header_check = true;
+	test.ctx->dl_no_checkpoint = true;
+
+	if (pon_img_test_start(&test))
+		goto exit;
+
+	if (pon_img_test_download(&test, 1, image_a, STORE_TEST_SIZE, path_a,
+				  sizeof(path_a)) != PON_ADAPTER_SUCCESS ||
+	    ops->store(test.ctx, 1, sizeof(path_a), path_a) !=
+	    PON_ADAPTER_SUCCESS || test.upgrades != 1) {
+		printf("download and store of image A failed\n");
+		goto exit;
+	}
+
+	/* the next download reuses the staging file which was handed over
+	 * to the upgrade daemon
+	 */
+	if (pon_img_test_download(&test, 1, image_b, STORE_TEST_SIZE, path_b,
+				  sizeof(path_b)) != PON_ADAPTER_SUCCESS) {
+		printf("download of image B failed\n");
+		goto exit;
+	}
+
+	if (!pon_img_test_file_check(path_a, image_a, STORE_TEST_SIZE)) {
+		printf("stored image A %s was changed\n", path_a);
+		goto exit;
+	}
+	if (!pon_img_test_file_check(path_b, image_b, STORE_TEST_SIZE)) {
+		printf("stored image B %s differs\n", path_b);
+		goto exit;
+	}
+
+	printf("stored image kept after the next download\n");
+	failed = 0;
+
+exit:
+	pon_img_test_close(&test);
+
+	return failed;
+}
+
+/** @} */
@@ -0,0 +1,198 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <time.h>
+#include <libubus.h>
+
+#include <pon_adapter.h>
+#include <pon_adapter_system.h>
+#include <omci/pon_adapter_omci.h>
+#include <omci/me/pon_adapter_sw_image.h>
+
+#include <pon_img_register.h>
+#include "pon_img_common.h"
+#include "pon_img_crc.h"
+#include "pon_img_test.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/* The upgrade daemon and the U-Boot variables are not available, all
+ * calls succeed without a reply. The image writes are only counted.
+ */
+static int ubus_call(void *hl_handle, const char *path, const char *method,
+		     struct blob_attr *msg, ubus_data_handler_t cb, void *priv,
+		     int timeout)
+{
+	struct pon_img_test *test = hl_handle;
+
+	(void)path;
+	(void)msg;
+	(void)cb;
+	(void)priv;
+	(void)timeout;
+
+	if (strcmp(method, UBUS_METHOD_UPGRADE) == 0) {
+		test->upgrades++;
+		if (test->upgrade_fail)
+			return -1;
+	}
+
+	return 0;
+}
+
+static const struct pa_config pa_config = {
+	.ubus_call = ubus_call,
+};
+
+int pon_img_test_open(struct pon_img_test *test, const char *name)
+{
+	void *ll_handle;
+
+	memset(test, 0, sizeof(*test));
+	snprintf(test->dir, sizeof(test->dir), "%s%s.XXXXXX",
+		 strchr(name, '/') ? "" : "/tmp/", name);
+	if (!mkdtemp(test->dir)) {
+		perror("mkdtemp");
+		test->dir[0] = '\0';
+		return -1;
+	}
+
+	if (libponimg_ll_register_ops(NULL, &test->pa_ops, &ll_handle, test,
+				      PA_IF_1ST_VER_NUMBER) !=
+	    PON_ADAPTER_SUCCESS) {
+		printf("%s: registration failed\n", name);
+		pon_img_test_close(test);
+		return -1;
+	}
+
+	/* nothing is written outside of the temporary directory */
+	test->ctx = ll_handle;
+	pon_img_test_path(test, SWIMAGE_NAME, test->upgrade_path,
+			  sizeof(test->upgrade_path));
+	test->ctx->upgrade_path = test->upgrade_path;
+
+	return 0;
+}
+
+int pon_img_test_start(struct pon_img_test *test)
+{
+	const struct pa_system_ops *ops = test->pa_ops->system_ops;
+
+	if (ops->init(NULL, &pa_config, NULL, test->ctx) !=
+	    PON_ADAPTER_SUCCESS ||
+	    ops->start(test->ctx) != PON_ADAPTER_SUCCESS) {
+		printf("start failed\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int file_remove(const char *path, const struct stat *st, int flag,
+		       struct FTW *ftw)
+{
+	(void)st;
+	(void)flag;
+	(void)ftw;
+
+	return remove(path);
+}
+
+void pon_img_test_close(struct pon_img_test *test)
+{
+	if (test->ctx)
+		(void)test->pa_ops->system_ops->shutdown(test->ctx);
+	test->ctx = NULL;
+
+	if (test->dir[0])
+		(void)nftw(test->dir, file_remove, 8, FTW_DEPTH | FTW_PHYS);
+	test->dir[0] = '\0';
+}
+
+void pon_img_test_path(const struct pon_img_test *test, const char *name,
+		       char *path, size_t path_size)
+{
+	snprintf(path, path_size, "%s/%s", test->dir, name);
+}
+
+void pon_img_test_fill(uint8_t *buf, uint32_t size, unsigned int seed)
+{
+	uint32_t i;
+
+	srand(seed);
+	for (i = 0; i < size; i++)
+		buf[i] = rand();
+}
+
+enum pon_adapter_errno pon_img_test_download(struct pon_img_test *test,
+					     uint8_t id, const uint8_t *image,
+					     uint32_t size, char *path,
+					     uint8_t path_size)
+{
+	const struct pa_sw_image_ops *ops =
+		test->pa_ops->omci_me_ops->sw_image;
+	uint32_t offset = 0, window = 0, len, crc;
+	enum pon_adapter_errno ret;
+
+	crc = pon_img_crc32(PON_IMG_CRC32_INIT, image, size) ^ 0xffffffff;
+
+	ret = ops->download_start(test->ctx, id, size);
+	while (ret == PON_ADAPTER_SUCCESS && offset < size) {
+		len = size - offset;
+		if (len > PON_IMG_TEST_WINDOW)
+			len = PON_IMG_TEST_WINDOW;
+		ret = ops->handle_window(test->ctx, id, window++,
+					 image + offset, (uint16_t)len);
+		offset += len;
+	}
+	if (ret == PON_ADAPTER_SUCCESS)
+		ret = ops->download_end(test->ctx, id, size, crc, path_size,
+					path);
+
+	return ret;
+}
+
+bool pon_img_test_file_check(const char *path, const uint8_t *data,
+			     uint32_t size)
+{
+	uint8_t *buf;
+	bool same;
+	FILE *f;
+
+	f = fopen(path, "rb");
+	if (!f)
+		return false;
+	buf = malloc(size + 1);
+	same = buf && fread(buf, 1, size + 1, f) == size &&
+	       memcmp(buf, data, size) == 0;
+	free(buf);
+	fclose(f);
+
+	return same;
+}
+
+double pon_img_test_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/** @} */
@@ -0,0 +1,100 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+/**
+   \file pon_img_test.h
+   Helpers shared by the check programs. Each test runs the library without
+   an OMCI stack and an upgrade daemon, all files are kept in a temporary
+   directory.
+*/
+
+#ifndef _PON_IMG_TEST_H_
+#define _PON_IMG_TEST_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <pon_adapter.h>
+
+#include <pon_img_register.h>
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Window size of the OMCI baseline message set */
+#define PON_IMG_TEST_WINDOW	961
+
+/** Library context of a test */
+struct pon_img_test {
+	/** Operations of the registration */
+	const struct pa_ops *pa_ops;
+	/** Library context, NULL if not registered */
+	struct pon_img_context *ctx;
+	/** Temporary directory of the test files */
+	char dir[PON_IMG_PATH_LEN];
+	/** Image file handed over to the upgrade daemon */
+	char upgrade_path[PON_IMG_PATH_LEN];
+	/** Number of the image writes requested from the upgrade daemon */
+	unsigned int upgrades;
+	/** Fail the image writes requested from the upgrade daemon */
+	bool upgrade_fail;
+};
+
+/**	Create the temporary directory and register a library context.
+ *	The options of the context can be set before pon_img_test_start().
+ *
+ *	\param[out] test	Test context
+ *	\param[in] name		Name of the test, used for the directory in
+ *				/tmp, or path prefix of the directory
+ *
+ *	\return 0 if successful, -1 otherwise
+ */
+int pon_img_test_open(struct pon_img_test *test, const char *name);
+
+/**	Initialize and start the library context */
+int pon_img_test_start(struct pon_img_test *test);
+
+/**	Shut the library context down and remove the temporary directory */
+void pon_img_test_close(struct pon_img_test *test);
+
+/**	Build a path in the temporary directory */
+void pon_img_test_path(const struct pon_img_test *test, const char *name,
+		       char *path, size_t path_size);
+
+/**	Fill a buffer with reproducible random data */
+void pon_img_test_fill(uint8_t *buf, uint32_t size, unsigned int seed);
+
+/**	Send an image in windows of \ref PON_IMG_TEST_WINDOW bytes and end
+ *	the download.
+ *
+ *	\param[in] test		Test context
+ *	\param[in] id		Image instance
+ *	\param[in] image	Image data
+ *	\param[in] size		Image size
+ *	\param[out] path	Path of the received image
+ *	\param[in] path_size	Size of the path buffer
+ *
+ *	\return The result of the first failed download operation
+ */
+enum pon_adapter_errno pon_img_test_download(struct pon_img_test *test,
+					     uint8_t id, const uint8_t *image,
+					     uint32_t size, char *path,
+					     uint8_t path_size);
+
+/**	Check that a file holds exactly the data */
+bool pon_img_test_file_check(const char *path, const uint8_t *data,
+			     uint32_t size);
+
+/**	Monotonic time in ms */
+double pon_img_test_now_ms(void);
+
+/** @} */
+
+#endif
@@ -0,0 +1,264 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include <pon_adapter.h>
+
+#include <pon_img_register.h>
+#include <pon_uboot.h>
+#include "pon_img_common.h"
+#include "pon_img_test.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Maximum number of reader or writer threads */
+#define STRESS_THREADS_MAX	32
+/** Size of the environment file */
+#define STRESS_ENV_SIZE		0x4000
+
+static const char *help =
+	"Reads U-Boot variables without locks while other threads write\n"
+	"them through a file based environment, and checks that a reader\n"
+	"never sees a mix of two writes.\n"
+	"Options:\n"
+	"-r, --readers	Number of reader threads (default 4).\n"
+	"-w, --writers	Number of writer threads (default 2).\n"
+	"-t, --time	Run time in ms (default 1000).\n"
+	"-h, --help	Print help and exit.\n"
+	;
+
+static struct option long_opts[] = {
+	{"readers", required_argument, 0, 'r'},
+	{"writers", required_argument, 0, 'w'},
+	{"time", required_argument, 0, 't'},
+	{"help", no_argument, 0, 'h'},
+	{0, 0, 0, 0}
+};
+
+/** Options string */
+static const char opt_string[] = "r:w:t:h";
+
+/* Both variables are always written together with the same value */
+static const char * const names[] = {
+	UBOOT_VAR_IMG_VERSION "A", UBOOT_VAR_IMG_VERSION "B"
+};
+
+struct stress_thread {
+	pthread_t thread;
+	struct pon_img_context *ctx;
+	unsigned int num;
+	unsigned long ops;
+	unsigned long failed;
+};
+
+static volatile bool stop;
+
+static void *reader_thread(void *arg)
+{
+	char values[ARRAY_SIZE(names)][UBOOT_VAL_LEN_MAX + 1];
+	struct stress_thread *thr = arg;
+
+	while (!stop) {
+		if (pon_uboot_get_multi(thr->ctx, names, values,
+					ARRAY_SIZE(names)) !=
+		    PON_ADAPTER_SUCCESS) {
+			thr->failed++;
+			continue;
+		}
+		if (strcmp(values[0], values[1]) != 0) {
+			printf("reader %u: %s=%s, %s=%s\n", thr->num,
+			       names[0], values[0], names[1], values[1]);
+			thr->failed++;
+		}
+		thr->ops++;
+	}
+
+	return NULL;
+}
+
+static void *writer_thread(void *arg)
+{
+	struct stress_thread *thr = arg;
+	enum pon_adapter_errno ret;
+	char value[32];
+
+	while (!stop) {
+		snprintf(value, sizeof(value), "w%u.%lu", thr->num, thr->ops);
+
+		ret = pon_uboot_txn_begin(thr->ctx);
+		if (ret == PON_ADAPTER_SUCCESS)
+			ret = pon_uboot_set_str(thr->ctx, names[0], value);
+		if (ret == PON_ADAPTER_SUCCESS)
+			ret = pon_uboot_set_str(thr->ctx, names[1], value);
+		/* a variable which is not cached expires the cached values
+		 * while the readers use them
+		 */
+		if (ret == PON_ADAPTER_SUCCESS && !(thr->ops % 8))
+			ret = pon_uboot_set_str(thr->ctx, "pon_img_stress",
+						value);
+		if (ret == PON_ADAPTER_SUCCESS)
+			ret = pon_uboot_txn_commit(thr->ctx);
+		else
+			pon_uboot_txn_abort(thr->ctx);
+
+		if (ret != PON_ADAPTER_SUCCESS)
+			thr->failed++;
+		thr->ops++;
+	}
+
+	return NULL;
+}
+
+static int env_setup(const struct pon_img_test *test, char *env_path,
+		     char *config_path)
+{
+	FILE *f;
+
+	pon_img_test_path(test, "uboot.env", env_path, PON_IMG_PATH_LEN);
+	pon_img_test_path(test, "fw_env.config", config_path,
+			  PON_IMG_PATH_LEN);
+
+	/* an environment without a valid CRC is read as empty */
+	f = fopen(env_path, "w");
+	if (!f)
+		return -1;
+	if (ftruncate(fileno(f), STRESS_ENV_SIZE)) {
+		fclose(f);
+		return -1;
+	}
+	if (fclose(f))
+		return -1;
+
+	f = fopen(config_path, "w");
+	if (!f)
+		return -1;
+	fprintf(f, "%s 0x0 0x%x\n", env_path, STRESS_ENV_SIZE);
+
+	return fclose(f);
+}
+
+int main(int argc, char *argv[])
+{
+	static struct stress_thread rd[STRESS_THREADS_MAX];
+	static struct stress_thread wr[STRESS_THREADS_MAX];
+	char env_path[PON_IMG_PATH_LEN], config_path[PON_IMG_PATH_LEN];
+	unsigned int readers = 4, writers = 2, run_time = 1000, i;
+	unsigned long reads = 0, writes = 0, failed = 0;
+	struct pon_uboot_cache_stats stats = {0};
+	struct pon_img_context *ctx;
+	struct pon_img_test test;
+	double start, elapsed;
+	int c, index;
+
+	while ((c = getopt_long(argc, argv, opt_string, long_opts,
+				&index)) != -1) {
+		switch (c) {
+		case 'r':
+			readers = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			writers = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			run_time = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			printf("Usage: %s [options]\n%s", argv[0], help);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if (readers > STRESS_THREADS_MAX || writers > STRESS_THREADS_MAX) {
+		printf("up to %u readers and writers\n", STRESS_THREADS_MAX);
+		return 1;
+	}
+
+	if (pon_img_test_open(&test, "pon_img_uboot_stress"))
+		return 1;
+	if (env_setup(&test, env_path, config_path)) {
+		perror("environment");
+		failed = 1;
+		goto exit;
+	}
+	ctx = test.ctx;
+	ctx->uboot_env_config = config_path;
+
+	if (pon_img_test_start(&test) ||
+	    pon_uboot_txn_begin(ctx) != PON_ADAPTER_SUCCESS) {
+		failed = 1;
+		goto exit;
+	}
+	(void)pon_uboot_set_str(ctx, names[0], "w0");
+	(void)pon_uboot_set_str(ctx, names[1], "w0");
+	if (pon_uboot_txn_commit(ctx) != PON_ADAPTER_SUCCESS) {
+		printf("environment not writable\n");
+		failed = 1;
+		goto exit;
+	}
+
+	start = pon_img_test_now_ms();
+	for (i = 0; i < writers; i++) {
+		wr[i].ctx = ctx;
+		wr[i].num = i;
+		if (pthread_create(&wr[i].thread, NULL, writer_thread, &wr[i])) {
+			writers = i;
+			failed++;
+			break;
+		}
+	}
+	for (i = 0; i < readers; i++) {
+		rd[i].ctx = ctx;
+		rd[i].num = i;
+		if (pthread_create(&rd[i].thread, NULL, reader_thread, &rd[i])) {
+			readers = i;
+			failed++;
+			break;
+		}
+	}
+
+	usleep(run_time * 1000);
+	stop = true;
+
+	for (i = 0; i < writers; i++) {
+		pthread_join(wr[i].thread, NULL);
+		writes += wr[i].ops;
+		failed += wr[i].failed;
+	}
+	for (i = 0; i < readers; i++) {
+		pthread_join(rd[i].thread, NULL);
+		reads += rd[i].ops;
+		failed += rd[i].failed;
+	}
+	elapsed = pon_img_test_now_ms() - start;
+
+	(void)pon_uboot_cache_stats_get(ctx, &stats);
+	printf("%u readers: %lu reads, %.0f/s\n", readers, reads,
+	       reads * 1e3 / elapsed);
+	printf("%u writers: %lu writes, %.0f/s\n", writers, writes,
+	       writes * 1e3 / elapsed);
+	printf("cache: %u hits, %u misses, %u refreshes, %u elided\n",
+	       stats.hits, stats.misses, stats.refreshes, stats.elided);
+	printf("%lu failed\n", failed);
+
+exit:
+	pon_img_test_close(&test);
+
+	return failed ? 1 : 0;
+}
+
+/** @} */
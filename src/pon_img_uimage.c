@@ -0,0 +1,348 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+#include <string.h>
+#include <sys/utsname.h>
+#include <arpa/inet.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wredundant-decls"
+#include <safe_lib.h>
+#include <safe_mem_lib.h>
+#include <safe_str_lib.h>
+#pragma GCC diagnostic pop
+
+#include "pon_img_common.h"
+#include "pon_img_crc.h"
+#include "pon_img_debug.h"
+#include "pon_img_uimage.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+static uint32_t padded_len(uint32_t len, uint32_t pad)
+{
+	return ((len + pad - 1) / pad) * pad;
+}
+
+/* Map an architecture to its family, 32 and 64 bit kernels are accepted
+ * for both kinds of user space.
+ */
+static uint8_t arch_family(uint8_t arch)
+{
+	switch (arch) {
+	case IH_ARCH_X86_64:
+		return IH_ARCH_I386;
+	case IH_ARCH_MIPS64:
+		return IH_ARCH_MIPS;
+	case IH_ARCH_ARM64:
+		return IH_ARCH_ARM;
+	default:
+		return arch;
+	}
+}
+
+uint8_t pon_img_uimage_arch_native(void)
+{
+	static const struct {
+		const char *prefix;
+		uint8_t arch;
+	} machine[] = {
+		{ "x86_64", IH_ARCH_X86_64 },
+		{ "i386", IH_ARCH_I386 },
+		{ "i486", IH_ARCH_I386 },
+		{ "i586", IH_ARCH_I386 },
+		{ "i686", IH_ARCH_I386 },
+		{ "mips64", IH_ARCH_MIPS64 },
+		{ "mips", IH_ARCH_MIPS },
+		{ "aarch64", IH_ARCH_ARM64 },
+		{ "arm", IH_ARCH_ARM },
+	};
+	struct utsname uts;
+	int i;
+
+	if (uname(&uts))
+		return 0;
+
+	for (i = 0; i < ARRAY_SIZE(machine); i++)
+		if (strncmp(uts.machine, machine[i].prefix,
+			    strnlen_s(machine[i].prefix,
+				      sizeof(uts.machine))) == 0)
+			return machine[i].arch;
+
+	return 0;
+}
+
+void pon_img_uimage_init(struct pon_img_uimage *ui, uint32_t image_size,
+			 uint8_t arch)
+{
+	memset(ui, 0, sizeof(*ui));
+	ui->state = PON_IMG_UIMAGE_HDR;
+	ui->image_size = image_size;
+	ui->end = image_size;
+	ui->arch = arch;
+}
+
+void pon_img_uimage_sink_set(struct pon_img_uimage *ui,
+			     const struct pon_img_uimage_sink *sink,
+			     void *priv)
+{
+	ui->sink = sink;
+	ui->sink_priv = priv;
+}
+
+/* Announce a volume to the receiver, kernel images include the header */
+static enum pon_adapter_errno
+uimage_sink_begin(struct pon_img_uimage *ui,
+		  const struct pon_img_uimage_part *part)
+{
+	uint32_t size = padded_len(ntohl(part->hdr.ih_size), IH_DATA_ALIGN);
+	enum pon_adapter_errno error;
+
+	if (!ui->sink)
+		return PON_ADAPTER_SUCCESS;
+
+	if (part->hdr.ih_type == IH_TYPE_FILESYSTEM) {
+		ui->sink_remain = size;
+		return ui->sink->begin(ui->sink_priv, part, size);
+	}
+
+	ui->sink_remain = size;
+	error = ui->sink->begin(ui->sink_priv, part, sizeof(ui->hdr) + size);
+	if (error != PON_ADAPTER_SUCCESS)
+		return error;
+
+	return ui->sink->write(ui->sink_priv, ui->hdr, sizeof(ui->hdr));
+}
+
+/* Pass data and padding of the current sub-image to the receiver */
+static enum pon_adapter_errno uimage_sink_data(struct pon_img_uimage *ui,
+					       const uint8_t *data,
+					       uint32_t len)
+{
+	enum pon_adapter_errno error;
+
+	if (!ui->sink_remain)
+		return PON_ADAPTER_SUCCESS;
+
+	if (len > ui->sink_remain)
+		len = ui->sink_remain;
+
+	error = ui->sink->write(ui->sink_priv, data, len);
+	if (error != PON_ADAPTER_SUCCESS)
+		return error;
+
+	ui->sink_remain -= len;
+	if (!ui->sink_remain)
+		return ui->sink->end(ui->sink_priv);
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* Check a complete header and select what follows it */
+static enum pon_adapter_errno uimage_hdr_check(struct pon_img_uimage *ui)
+{
+	struct image_header hdr;
+	uint32_t hdr_offset = ui->offset - sizeof(hdr);
+	uint32_t size, hcrc;
+
+	if (ui->parts == PON_IMG_UIMAGE_PARTS_MAX) {
+		dbg_err("too many sub-images\n");
+		return PON_ADAPTER_ERR_INVALID_VAL;
+	}
+
+	if (memcpy_s(&hdr, sizeof(hdr), ui->hdr, sizeof(hdr)))
+		return PON_ADAPTER_ERR_MEM_ACCESS;
+
+	if (ntohl(hdr.ih_magic) != IH_MAGIC && !ui->parts && ui->optional) {
+		dbg_msg("no U-Boot image, the image headers are not checked\n");
+		ui->state = PON_IMG_UIMAGE_DONE;
+		return PON_ADAPTER_SUCCESS;
+	}
+	if (ntohl(hdr.ih_magic) != IH_MAGIC) {
+		dbg_err("no U-Boot image header at offset %u\n", hdr_offset);
+		return PON_ADAPTER_ERR_INVALID_VAL;
+	}
+
+	hcrc = ntohl(hdr.ih_hcrc);
+	hdr.ih_hcrc = 0;
+	if (pon_img_crc32_ieee(0, (const uint8_t *)&hdr, sizeof(hdr)) != hcrc) {
+		dbg_err("image header CRC mismatch at offset %u\n",
+			hdr_offset);
+		return PON_ADAPTER_ERR_CRC;
+	}
+	hdr.ih_hcrc = htonl(hcrc);
+
+	size = ntohl(hdr.ih_size);
+	if (size < 1 || size > ui->end - ui->offset) {
+		dbg_err("image '%.*s' size %u exceeds the image (%u of %u bytes left)\n",
+			IH_NMLEN, hdr.ih_name, size, ui->end - ui->offset,
+			ui->image_size);
+		return PON_ADAPTER_ERR_SIZE;
+	}
+
+	if (!ui->parts) {
+		/* The first multi image is defining the file size. */
+		if (hdr.ih_type != IH_TYPE_MULTI) {
+			dbg_err("image type %u is not a multi-file image\n",
+				hdr.ih_type);
+			return PON_ADAPTER_ERR_INVALID_VAL;
+		}
+		ui->end = ui->offset + size;
+	}
+
+	if (hdr.ih_type == IH_TYPE_KERNEL && ui->arch &&
+	    strncmp((char *)hdr.ih_name, IH_NAME_BOOTCORE,
+		    sizeof(hdr.ih_name)) != 0 &&
+	    arch_family(hdr.ih_arch) != arch_family(ui->arch)) {
+		dbg_err("kernel '%.*s' is built for architecture %u, expected %u\n",
+			IH_NMLEN, hdr.ih_name, hdr.ih_arch, ui->arch);
+		return PON_ADAPTER_ERR_INVALID_VAL;
+	}
+
+	dbg_prn("image header '%.*s': type %u, size %u, offset %u\n",
+		IH_NMLEN, hdr.ih_name, hdr.ih_type, size, hdr_offset);
+
+	ui->part[ui->parts].offset = hdr_offset;
+	ui->part[ui->parts].hdr = hdr;
+	ui->parts++;
+
+	/* Follow the same layout as pon_img_split */
+	switch (hdr.ih_type) {
+	case IH_TYPE_MULTI:
+		ui->state = PON_IMG_UIMAGE_SKIP;
+		ui->remain = IH_MULTI_LIST_SIZE;
+		break;
+	case IH_TYPE_KERNEL:
+	case IH_TYPE_FILESYSTEM:
+		ui->state = PON_IMG_UIMAGE_DATA;
+		ui->remain = size;
+		ui->skip = padded_len(size, IH_DATA_ALIGN) - size;
+		ui->dcrc = 0;
+		return uimage_sink_begin(ui, &ui->part[ui->parts - 1]);
+	default:
+		ui->state = PON_IMG_UIMAGE_DATA;
+		ui->remain = size;
+		ui->skip = padded_len(size, IH_DATA_ALIGN) - size +
+			   IH_MULTI_LIST_SIZE;
+		ui->dcrc = 0;
+		break;
+	}
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* Continue with the next header or finish at the end of the multi image */
+static void uimage_next(struct pon_img_uimage *ui)
+{
+	if (ui->offset >= ui->end ||
+	    ui->end - ui->offset < sizeof(struct image_header))
+		ui->state = PON_IMG_UIMAGE_DONE;
+	else
+		ui->state = PON_IMG_UIMAGE_HDR;
+	ui->hdr_len = 0;
+}
+
+static enum pon_adapter_errno uimage_data_check(struct pon_img_uimage *ui)
+{
+	const struct image_header *hdr = &ui->part[ui->parts - 1].hdr;
+
+	if (ui->dcrc != ntohl(hdr->ih_dcrc)) {
+		dbg_err("image '%.*s' data CRC mismatch: 0x%08x, expected 0x%08x\n",
+			IH_NMLEN, hdr->ih_name, ui->dcrc,
+			ntohl(hdr->ih_dcrc));
+		return PON_ADAPTER_ERR_CRC;
+	}
+	dbg_msg("image '%.*s' data CRC checked successfully\n",
+		IH_NMLEN, hdr->ih_name);
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+enum pon_adapter_errno pon_img_uimage_feed(struct pon_img_uimage *ui,
+					   const uint8_t *data, uint32_t len)
+{
+	enum pon_adapter_errno error = PON_ADAPTER_SUCCESS;
+	uint32_t count;
+
+	while (len && error == PON_ADAPTER_SUCCESS) {
+		switch (ui->state) {
+		case PON_IMG_UIMAGE_HDR:
+			count = sizeof(ui->hdr) - ui->hdr_len;
+			if (count > len)
+				count = len;
+			if (memcpy_s(ui->hdr + ui->hdr_len,
+				     sizeof(ui->hdr) - ui->hdr_len,
+				     data, count)) {
+				error = PON_ADAPTER_ERR_MEM_ACCESS;
+				break;
+			}
+			ui->hdr_len += count;
+			ui->offset += count;
+			if (ui->hdr_len == sizeof(ui->hdr))
+				error = uimage_hdr_check(ui);
+			break;
+		case PON_IMG_UIMAGE_DATA:
+			count = ui->remain < len ? ui->remain : len;
+			ui->dcrc = pon_img_crc32_ieee(ui->dcrc, data, count);
+			ui->remain -= count;
+			ui->offset += count;
+			error = uimage_sink_data(ui, data, count);
+			if (ui->remain || error != PON_ADAPTER_SUCCESS)
+				break;
+			error = uimage_data_check(ui);
+			ui->remain = ui->skip;
+			if (ui->remain)
+				ui->state = PON_IMG_UIMAGE_SKIP;
+			else
+				uimage_next(ui);
+			break;
+		case PON_IMG_UIMAGE_SKIP:
+			count = ui->remain < len ? ui->remain : len;
+			ui->remain -= count;
+			ui->offset += count;
+			error = uimage_sink_data(ui, data, count);
+			if (!ui->remain)
+				uimage_next(ui);
+			break;
+		case PON_IMG_UIMAGE_DONE:
+			/* trailing data after the multi image is ignored */
+			ui->offset += len;
+			return PON_ADAPTER_SUCCESS;
+		case PON_IMG_UIMAGE_ERROR:
+		default:
+			return PON_ADAPTER_ERR_INVALID_VAL;
+		}
+		data += count;
+		len -= count;
+	}
+
+	if (error != PON_ADAPTER_SUCCESS)
+		ui->state = PON_IMG_UIMAGE_ERROR;
+
+	return error;
+}
+
+enum pon_adapter_errno pon_img_uimage_finish(struct pon_img_uimage *ui)
+{
+	/* too short for a header */
+	if (ui->state == PON_IMG_UIMAGE_HDR && !ui->parts && ui->optional)
+		return PON_ADAPTER_SUCCESS;
+
+	if (ui->state != PON_IMG_UIMAGE_DONE) {
+		dbg_err("image incomplete or invalid (state %d, offset %u of %u)\n",
+			ui->state, ui->offset, ui->end);
+		return PON_ADAPTER_ERR_SIZE;
+	}
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/** @} */
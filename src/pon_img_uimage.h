@@ -0,0 +1,210 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ * Copyright (c) 2018 - 2019 Intel Corporation
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ ******************************************************************************/
+/**
+   \file pon_img_uimage.h
+   U-Boot image header definitions and the incremental parser, which checks
+   a fullimage while it is received.
+*/
+
+#ifndef _PON_IMG_UIMAGE_H_
+#define _PON_IMG_UIMAGE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pon_adapter.h>
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Image Magic Number */
+#define IH_MAGIC		0x27051956
+/** Image Name Length */
+#define IH_NMLEN		32
+
+/** OS Kernel Image */
+#define IH_TYPE_KERNEL		2
+/** Multi-file Image */
+#define IH_TYPE_MULTI		4
+/** Filesystem Image (any type) */
+#define IH_TYPE_FILESYSTEM	7
+
+/** ARM CPU architecture */
+#define IH_ARCH_ARM		2
+/** Intel x86 CPU architecture */
+#define IH_ARCH_I386		3
+/** MIPS CPU architecture */
+#define IH_ARCH_MIPS		5
+/** MIPS 64 bit CPU architecture */
+#define IH_ARCH_MIPS64		6
+/** ARM64 CPU architecture */
+#define IH_ARCH_ARM64		22
+/** AMD x86_64, Intel and Via CPU architecture */
+#define IH_ARCH_X86_64		24
+
+/** Name of the bootcore kernel image, detected the same way as in U-Boot */
+#define IH_NAME_BOOTCORE	"MIPS 4Kec Bootcore"
+
+/** Size of the sub-image list following a multi-file image header */
+#define IH_MULTI_LIST_SIZE	8
+/** Alignment of sub-images within the fullimage */
+#define IH_DATA_ALIGN		16
+
+/** This structure decode image headers */
+struct image_header {
+	/** Image Header Magic Number */
+	uint32_t	ih_magic;
+	/** Image Header CRC Checksum */
+	uint32_t	ih_hcrc;
+	/** Image Creation Timestamp */
+	uint32_t	ih_time;
+	/** Image Data Size */
+	uint32_t	ih_size;
+	/** Data Load Address */
+	uint32_t	ih_load;
+	/** Entry Point Address */
+	uint32_t	ih_ep;
+	/** Image Data CRC Checksum */
+	uint32_t	ih_dcrc;
+	/** Operating System */
+	uint8_t		ih_os;
+	/** CPU Architecture */
+	uint8_t		ih_arch;
+	/** Image Type */
+	uint8_t		ih_type;
+	/** Compression Type */
+	uint8_t		ih_comp;
+	/** Image Name */
+	uint8_t		ih_name[IH_NMLEN];
+};
+
+/** Maximum number of headers recorded by the parser */
+#define PON_IMG_UIMAGE_PARTS_MAX	16
+
+/** Header found in the fullimage */
+struct pon_img_uimage_part {
+	/** Offset of the header in the fullimage */
+	uint32_t offset;
+	/** Header as received, network byte order */
+	struct image_header hdr;
+};
+
+/** Receiver of the volume content of the sub-images, the bytes are the
+ *  same as written by pon_img_split into the image files.
+ */
+struct pon_img_uimage_sink {
+	/** A kernel or file system image starts, len is the volume size */
+	enum pon_adapter_errno (*begin)(void *priv,
+					const struct pon_img_uimage_part *part,
+					uint32_t len);
+	/** Next part of the volume content */
+	enum pon_adapter_errno (*write)(void *priv, const uint8_t *data,
+					uint32_t len);
+	/** All bytes of the volume were passed */
+	enum pon_adapter_errno (*end)(void *priv);
+};
+
+/** Parser state */
+enum pon_img_uimage_state {
+	/** Collecting the next header */
+	PON_IMG_UIMAGE_HDR,
+	/** Data of a sub-image, the data CRC is calculated */
+	PON_IMG_UIMAGE_DATA,
+	/** Padding or sub-image list */
+	PON_IMG_UIMAGE_SKIP,
+	/** End of the multi-file image reached */
+	PON_IMG_UIMAGE_DONE,
+	/** Invalid image */
+	PON_IMG_UIMAGE_ERROR
+};
+
+/** Incremental fullimage parser */
+struct pon_img_uimage {
+	/** Parser state */
+	enum pon_img_uimage_state state;
+	/** Declared size of the download */
+	uint32_t image_size;
+	/** End of the multi-file image, defined by the first header */
+	uint32_t end;
+	/** Number of bytes parsed */
+	uint32_t offset;
+	/** Remaining bytes of data or to skip */
+	uint32_t remain;
+	/** Bytes to skip after the current data */
+	uint32_t skip;
+	/** Running data CRC of the current sub-image */
+	uint32_t dcrc;
+	/** Number of bytes collected of the current header */
+	uint32_t hdr_len;
+	/** Current header */
+	uint8_t hdr[sizeof(struct image_header)];
+	/** Expected CPU architecture of kernel images, 0 to skip the check */
+	uint8_t arch;
+	/** Accept an image without a U-Boot header at its start, it is then
+	 *  passed without any check. Set after pon_img_uimage_init().
+	 */
+	bool optional;
+	/** Receiver of the volume content, optional */
+	const struct pon_img_uimage_sink *sink;
+	/** Private data of the receiver */
+	void *sink_priv;
+	/** Remaining bytes of the current volume */
+	uint32_t sink_remain;
+	/** Number of recorded headers */
+	unsigned int parts;
+	/** Recorded headers */
+	struct pon_img_uimage_part part[PON_IMG_UIMAGE_PARTS_MAX];
+};
+
+/**	Detect the U-Boot CPU architecture of the running system.
+ *
+ *	\return IH_ARCH_* value or 0 if unknown.
+ */
+uint8_t pon_img_uimage_arch_native(void);
+
+/**	Prepare the parser for a new image.
+ *
+ *	\param[in] ui		Parser
+ *	\param[in] image_size	Declared size of the download
+ *	\param[in] arch		Expected CPU architecture, 0 to skip the check
+ */
+void pon_img_uimage_init(struct pon_img_uimage *ui, uint32_t image_size,
+			 uint8_t arch);
+
+/**	Set the receiver of the volume content, must be called before the
+ *	first data is parsed.
+ */
+void pon_img_uimage_sink_set(struct pon_img_uimage *ui,
+			     const struct pon_img_uimage_sink *sink,
+			     void *priv);
+
+/**	Parse the next part of the image.
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If the image is valid so far
+ *	- PON_ADAPTER_ERR_INVALID_VAL: Invalid header or wrong architecture
+ *	- PON_ADAPTER_ERR_SIZE: Declared sizes do not fit
+ *	- PON_ADAPTER_ERR_CRC: Header or data CRC mismatch
+ */
+enum pon_adapter_errno pon_img_uimage_feed(struct pon_img_uimage *ui,
+					   const uint8_t *data, uint32_t len);
+
+/**	Check that the complete multi-file image was parsed. An image
+ *	without a U-Boot header is complete if the parser is optional.
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If the image is complete and valid
+ *	- Other: An error code in case of error.
+ */
+enum pon_adapter_errno pon_img_uimage_finish(struct pon_img_uimage *ui);
+
+/** @} */
+
+#endif
@@ -0,0 +1,410 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "pon_config.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#include <zstd_errors.h>
+#endif
+
+#include "pon_img_debug.h"
+#include "pon_img_unpack.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Size of the output buffer */
+#define UNPACK_OUT_SIZE		(64 * 1024)
+
+struct pon_img_unpack {
+	/** Compression format */
+	enum pon_img_unpack_type type;
+	/** Receiver of the decompressed data */
+	pon_img_unpack_out out;
+	/** Argument of the receiver */
+	void *priv;
+	/** The end of the compressed stream was reached */
+	bool done;
+	/** Number of decompressed bytes */
+	uint64_t size;
+	/** Maximum number of decompressed bytes */
+	uint32_t size_max;
+	/** Decoder state */
+	union {
+#ifdef HAVE_ZLIB
+		z_stream gz;
+#endif
+#ifdef HAVE_LZMA
+		lzma_stream xz;
+#endif
+#ifdef HAVE_ZSTD
+		ZSTD_DStream *zstd;
+#endif
+		int none;
+	} s;
+	/** Output buffer */
+	uint8_t buf[UNPACK_OUT_SIZE];
+};
+
+/** Signatures of the supported formats */
+static const struct {
+	/** Compression format */
+	enum pon_img_unpack_type type;
+	/** Length of the signature */
+	uint8_t len;
+	/** First bytes of the compressed stream */
+	uint8_t magic[6];
+} unpack_magic[] = {
+#ifdef HAVE_ZLIB
+	{ PON_IMG_UNPACK_GZIP, 3, { 0x1f, 0x8b, 0x08 } },
+#endif
+#ifdef HAVE_LZMA
+	{ PON_IMG_UNPACK_XZ, 6, { 0xfd, '7', 'z', 'X', 'Z', 0x00 } },
+#endif
+#ifdef HAVE_ZSTD
+	{ PON_IMG_UNPACK_ZSTD, 4, { 0x28, 0xb5, 0x2f, 0xfd } },
+#endif
+	{ PON_IMG_UNPACK_NONE, 0, { 0 } }
+};
+
+enum pon_img_unpack_type pon_img_unpack_detect(const uint8_t *data,
+					       uint32_t len)
+{
+	unsigned int i;
+
+	if (!data)
+		return PON_IMG_UNPACK_NONE;
+
+	for (i = 0; unpack_magic[i].len; i++)
+		if (len >= unpack_magic[i].len &&
+		    !memcmp(data, unpack_magic[i].magic, unpack_magic[i].len))
+			return unpack_magic[i].type;
+
+	return PON_IMG_UNPACK_NONE;
+}
+
+const char *pon_img_unpack_name(enum pon_img_unpack_type type)
+{
+	switch (type) {
+	case PON_IMG_UNPACK_GZIP:
+		return "gzip";
+	case PON_IMG_UNPACK_XZ:
+		return "xz";
+	case PON_IMG_UNPACK_ZSTD:
+		return "zstd";
+	default:
+		return "none";
+	}
+}
+
+/* Pass the filled part of the output buffer to the receiver */
+static enum pon_adapter_errno unpack_emit(struct pon_img_unpack *up,
+					  uint32_t len)
+{
+	if (!len)
+		return PON_ADAPTER_SUCCESS;
+
+	if (len > up->size_max - up->size) {
+		dbg_err("decompressed image exceeds %u bytes\n",
+			up->size_max);
+		return PON_ADAPTER_ERR_SIZE;
+	}
+	up->size += len;
+
+	return up->out(up->priv, up->buf, len);
+}
+
+#ifdef HAVE_ZSTD
+/* The decoder window is limited to the largest power of two within the
+ * memory limit.
+ */
+static int zstd_window_log(uint32_t mem_limit)
+{
+	int log = ZSTD_WINDOWLOG_ABSOLUTEMIN;
+
+	while (log < 31 && (2UL << log) <= mem_limit)
+		log++;
+
+	return log;
+}
+#endif
+
+enum pon_adapter_errno pon_img_unpack_create(struct pon_img_unpack **up,
+					     enum pon_img_unpack_type type,
+					     uint32_t mem_limit,
+					     uint32_t size_max,
+					     pon_img_unpack_out out,
+					     void *priv)
+{
+	enum pon_adapter_errno error = PON_ADAPTER_ERR_NOT_SUPPORTED;
+	struct pon_img_unpack *u;
+
+	if (!mem_limit)
+		mem_limit = PON_IMG_UNPACK_MEM;
+
+	u = calloc(1, sizeof(*u));
+	if (!u)
+		return PON_ADAPTER_ERR_NO_MEMORY;
+
+	u->type = type;
+	u->size_max = size_max ? size_max : PON_IMG_UNPACK_MAX;
+	u->out = out;
+	u->priv = priv;
+
+	switch (type) {
+#ifdef HAVE_ZLIB
+	case PON_IMG_UNPACK_GZIP:
+		/* 16 selects the gzip wrapper with its CRC and length */
+		if (inflateInit2(&u->s.gz, 16 + MAX_WBITS) == Z_OK)
+			error = PON_ADAPTER_SUCCESS;
+		else
+			error = PON_ADAPTER_ERR_NO_MEMORY;
+		break;
+#endif
+#ifdef HAVE_LZMA
+	case PON_IMG_UNPACK_XZ:
+		if (lzma_stream_decoder(&u->s.xz, mem_limit, 0) == LZMA_OK)
+			error = PON_ADAPTER_SUCCESS;
+		else
+			error = PON_ADAPTER_ERR_NO_MEMORY;
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case PON_IMG_UNPACK_ZSTD:
+		u->s.zstd = ZSTD_createDStream();
+		if (!u->s.zstd ||
+		    ZSTD_isError(ZSTD_DCtx_setParameter(u->s.zstd,
+						ZSTD_d_windowLogMax,
+						zstd_window_log(mem_limit)))) {
+			ZSTD_freeDStream(u->s.zstd);
+			error = PON_ADAPTER_ERR_NO_MEMORY;
+		} else {
+			error = PON_ADAPTER_SUCCESS;
+		}
+		break;
+#endif
+	default:
+		break;
+	}
+
+	if (error != PON_ADAPTER_SUCCESS) {
+		dbg_err("%s decoder can not be created\n",
+			pon_img_unpack_name(type));
+		free(u);
+		return error;
+	}
+
+	*up = u;
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+#ifdef HAVE_ZLIB
+static enum pon_adapter_errno unpack_gzip(struct pon_img_unpack *up,
+					  const uint8_t *data, uint32_t len)
+{
+	enum pon_adapter_errno error;
+	z_stream *s = &up->s.gz;
+	int ret;
+
+	s->next_in = (uint8_t *)data;
+	s->avail_in = len;
+
+	do {
+		s->next_out = up->buf;
+		s->avail_out = sizeof(up->buf);
+		ret = inflate(s, Z_NO_FLUSH);
+		if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+			dbg_err("gzip stream error %d: %s\n", ret,
+				s->msg ? s->msg : "");
+			return ret == Z_MEM_ERROR ? PON_ADAPTER_ERR_NO_MEMORY :
+						    PON_ADAPTER_ERR_CRC;
+		}
+		error = unpack_emit(up, sizeof(up->buf) - s->avail_out);
+		if (error != PON_ADAPTER_SUCCESS)
+			return error;
+		if (ret == Z_STREAM_END) {
+			up->done = true;
+			break;
+		}
+	} while (s->avail_in || !s->avail_out);
+
+	/* another gzip member or other data is not part of the image */
+	if (up->done && s->avail_in) {
+		dbg_err("%u bytes after the end of the gzip stream\n",
+			s->avail_in);
+		return PON_ADAPTER_ERR_SIZE;
+	}
+
+	return PON_ADAPTER_SUCCESS;
+}
+#endif
+
+#ifdef HAVE_LZMA
+static enum pon_adapter_errno unpack_xz(struct pon_img_unpack *up,
+					const uint8_t *data, uint32_t len)
+{
+	enum pon_adapter_errno error;
+	lzma_stream *s = &up->s.xz;
+	lzma_ret ret;
+
+	s->next_in = data;
+	s->avail_in = len;
+
+	do {
+		s->next_out = up->buf;
+		s->avail_out = sizeof(up->buf);
+		ret = lzma_code(s, LZMA_RUN);
+		if (ret != LZMA_OK && ret != LZMA_STREAM_END &&
+		    ret != LZMA_BUF_ERROR) {
+			dbg_err("xz stream error %d\n", ret);
+			return ret == LZMA_MEM_ERROR ||
+			       ret == LZMA_MEMLIMIT_ERROR ?
+					PON_ADAPTER_ERR_NO_MEMORY :
+					PON_ADAPTER_ERR_CRC;
+		}
+		error = unpack_emit(up, sizeof(up->buf) - s->avail_out);
+		if (error != PON_ADAPTER_SUCCESS)
+			return error;
+		if (ret == LZMA_STREAM_END) {
+			up->done = true;
+			break;
+		}
+	} while (s->avail_in || !s->avail_out);
+
+	if (up->done && s->avail_in) {
+		dbg_err("%zu bytes after the end of the xz stream\n",
+			s->avail_in);
+		return PON_ADAPTER_ERR_SIZE;
+	}
+
+	return PON_ADAPTER_SUCCESS;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static enum pon_adapter_errno unpack_zstd(struct pon_img_unpack *up,
+					  const uint8_t *data, uint32_t len)
+{
+	enum pon_adapter_errno error;
+	ZSTD_inBuffer in = { data, len, 0 };
+	ZSTD_outBuffer out;
+	size_t ret;
+
+	do {
+		out.dst = up->buf;
+		out.size = sizeof(up->buf);
+		out.pos = 0;
+		ret = ZSTD_decompressStream(up->s.zstd, &out, &in);
+		if (ZSTD_isError(ret)) {
+			dbg_err("zstd stream error: %s\n",
+				ZSTD_getErrorName(ret));
+			return ZSTD_getErrorCode(ret) ==
+				       ZSTD_error_frameParameter_windowTooLarge ?
+					PON_ADAPTER_ERR_NO_MEMORY :
+					PON_ADAPTER_ERR_CRC;
+		}
+		error = unpack_emit(up, out.pos);
+		if (error != PON_ADAPTER_SUCCESS)
+			return error;
+		/* a frame is complete, another one may follow */
+		up->done = ret == 0;
+	} while (in.pos < in.size || out.pos == out.size);
+
+	return PON_ADAPTER_SUCCESS;
+}
+#endif
+
+enum pon_adapter_errno pon_img_unpack_feed(struct pon_img_unpack *up,
+					   const uint8_t *data, uint32_t len)
+{
+	if (up->done && up->type != PON_IMG_UNPACK_ZSTD) {
+		dbg_err("data after the end of the %s stream\n",
+			pon_img_unpack_name(up->type));
+		return PON_ADAPTER_ERR_SIZE;
+	}
+
+	switch (up->type) {
+#ifdef HAVE_ZLIB
+	case PON_IMG_UNPACK_GZIP:
+		return unpack_gzip(up, data, len);
+#endif
+#ifdef HAVE_LZMA
+	case PON_IMG_UNPACK_XZ:
+		return unpack_xz(up, data, len);
+#endif
+#ifdef HAVE_ZSTD
+	case PON_IMG_UNPACK_ZSTD:
+		return unpack_zstd(up, data, len);
+#endif
+	default:
+		(void)data;
+		(void)len;
+		return PON_ADAPTER_ERR_NOT_SUPPORTED;
+	}
+}
+
+enum pon_adapter_errno pon_img_unpack_finish(struct pon_img_unpack *up)
+{
+	if (!up->done) {
+		dbg_err("%s stream is truncated after %llu bytes\n",
+			pon_img_unpack_name(up->type),
+			(unsigned long long)up->size);
+		return PON_ADAPTER_ERR_SIZE;
+	}
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+uint64_t pon_img_unpack_size(const struct pon_img_unpack *up)
+{
+	return up->size;
+}
+
+void pon_img_unpack_destroy(struct pon_img_unpack *up)
+{
+	if (!up)
+		return;
+
+	switch (up->type) {
+#ifdef HAVE_ZLIB
+	case PON_IMG_UNPACK_GZIP:
+		inflateEnd(&up->s.gz);
+		break;
+#endif
+#ifdef HAVE_LZMA
+	case PON_IMG_UNPACK_XZ:
+		lzma_end(&up->s.xz);
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case PON_IMG_UNPACK_ZSTD:
+		ZSTD_freeDStream(up->s.zstd);
+		break;
+#endif
+	default:
+		break;
+	}
+
+	free(up);
+}
+
+/** @} */
@@ -0,0 +1,115 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ ******************************************************************************/
+/**
+   \file pon_img_unpack.h
+   Streaming decompression of a compressed SW download image.
+
+   The format is detected from the first bytes. gzip, xz and zstd are
+   supported if the library was built with zlib, liblzma or libzstd.
+   The length and the checksum embedded in the compressed stream are
+   verified by the decoder. A gzip or xz image is a single stream, data
+   after its end, like a second gzip member, is rejected. The size of the
+   decompressed data is limited.
+*/
+
+#ifndef _PON_IMG_UNPACK_H_
+#define _PON_IMG_UNPACK_H_
+
+#include <stdint.h>
+#include <pon_adapter.h>
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Default memory limit of the decoder */
+#define PON_IMG_UNPACK_MEM	(16 * 1024 * 1024)
+/** Default maximum size of the decompressed data */
+#define PON_IMG_UNPACK_MAX	(256 * 1024 * 1024)
+
+/** Compression format */
+enum pon_img_unpack_type {
+	/** Not compressed or not supported */
+	PON_IMG_UNPACK_NONE,
+	/** gzip */
+	PON_IMG_UNPACK_GZIP,
+	/** xz */
+	PON_IMG_UNPACK_XZ,
+	/** zstd */
+	PON_IMG_UNPACK_ZSTD
+};
+
+struct pon_img_unpack;
+
+/** Receiver of the decompressed data */
+typedef enum pon_adapter_errno (*pon_img_unpack_out)(void *priv,
+						     const uint8_t *data,
+						     uint32_t len);
+
+/**	Detect a supported compression format from the first bytes. */
+enum pon_img_unpack_type pon_img_unpack_detect(const uint8_t *data,
+					       uint32_t len);
+
+/**	Name of a compression format. */
+const char *pon_img_unpack_name(enum pon_img_unpack_type type);
+
+/**	Create a decoder.
+ *
+ *	\param[out] up		Decoder
+ *	\param[in] type		Compression format
+ *	\param[in] mem_limit	Memory limit of the decoder state in bytes,
+ *				0 selects the default. gzip needs a fixed
+ *				amount.
+ *	\param[in] size_max	Maximum size of the decompressed data,
+ *				0 selects the default
+ *	\param[in] out		Receiver of the decompressed data
+ *	\param[in] priv		Argument of the receiver
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- PON_ADAPTER_ERR_NOT_SUPPORTED: Format not supported
+ *	- PON_ADAPTER_ERR_NO_MEMORY: Out of memory
+ */
+enum pon_adapter_errno pon_img_unpack_create(struct pon_img_unpack **up,
+					     enum pon_img_unpack_type type,
+					     uint32_t mem_limit,
+					     uint32_t size_max,
+					     pon_img_unpack_out out,
+					     void *priv);
+
+/**	Decompress the next part of the compressed stream.
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- PON_ADAPTER_ERR_NO_MEMORY: The memory limit is exceeded
+ *	- PON_ADAPTER_ERR_SIZE: The maximum size is exceeded or data
+ *	  follows the end of the stream
+ *	- PON_ADAPTER_ERR_CRC: Corrupted stream
+ *	- Other: An error code of the receiver.
+ */
+enum pon_adapter_errno pon_img_unpack_feed(struct pon_img_unpack *up,
+					   const uint8_t *data, uint32_t len);
+
+/**	Check that the compressed stream is complete.
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If the stream ended
+ *	- PON_ADAPTER_ERR_SIZE: The stream is truncated
+ */
+enum pon_adapter_errno pon_img_unpack_finish(struct pon_img_unpack *up);
+
+/**	Number of decompressed bytes. */
+uint64_t pon_img_unpack_size(const struct pon_img_unpack *up);
+
+/**	Free the decoder. */
+void pon_img_unpack_destroy(struct pon_img_unpack *up);
+
+/** @} */
+
+#endif
@@ -0,0 +1,337 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wredundant-decls"
+#include <safe_lib.h>
+#include <safe_mem_lib.h>
+#pragma GCC diagnostic pop
+
+#include <ifxos_thread.h>
+#include <ifxos_event.h>
+
+#include "pon_img_wb.h"
+#include "pon_img_debug.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+#define IFXOS_THREAD_PRIO_WB		10
+
+/** Poll interval in ms, wake-ups are only hints to the other side */
+#define WB_POLL_TIME			10
+
+/** Control structure of the write-behind ring.
+ *  "head" is only written by the producer (OMCI thread), "tail" and "error"
+ *  only by the consumer (writer thread). Both are free running counters,
+ *  the ring position is the counter masked with the ring size.
+ */
+struct pon_img_wb {
+	/** Image file */
+	int fd;
+	/** Ring buffer memory */
+	uint8_t *ring;
+	/** Ring size, power of two */
+	uint32_t size;
+	/** Write chunk size, power of two and not larger than the ring */
+	uint32_t chunk;
+	/** Number of bytes pushed into the ring */
+	uint32_t head;
+	/** Number of bytes drained from the ring */
+	uint32_t tail;
+	/** Request to write also a partially filled chunk */
+	uint32_t flush;
+	/** Latched errno of the first failed write */
+	int error;
+	/** Number of push calls which had to wait for space */
+	uint32_t stalls;
+	/** Signaled by the producer when data is available */
+	IFXOS_event_t data_event;
+	/** Signaled by the consumer when space is available */
+	IFXOS_event_t space_event;
+	/** Writer thread */
+	IFXOS_ThreadCtrl_t thread;
+};
+
+static int write_all(int fd, const uint8_t *data, uint32_t len)
+{
+	uint32_t done = 0;
+	ssize_t ret;
+
+	while (done < len) {
+		ret = write(fd, data + done, len - done);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		done += ret;
+	}
+
+	return 0;
+}
+
+/** Writer thread, drains the ring to the image file
+ *  \param[in] thr_params IFXOS_ThreadParams_t structure
+ */
+static int32_t wb_thread(struct IFXOS_ThreadParams_s *thr_params)
+{
+	struct pon_img_wb *wb = (struct pon_img_wb *)thr_params->nArg1;
+	uint32_t head, tail, len;
+	IFX_int32_t ret_code;
+	int err;
+
+	while (!thr_params->bShutDown) {
+		head = __atomic_load_n(&wb->head, __ATOMIC_ACQUIRE);
+		tail = wb->tail;
+
+		/* write up to the next chunk boundary, this keeps the file
+		 * writes aligned and never crosses the end of the ring
+		 */
+		len = wb->chunk - (tail & (wb->chunk - 1));
+		if (head - tail < len) {
+			if (head == tail ||
+			    !__atomic_load_n(&wb->flush, __ATOMIC_ACQUIRE)) {
+				IFXOS_EventWait(&wb->data_event, WB_POLL_TIME,
+						&ret_code);
+				continue;
+			}
+			len = head - tail;
+		}
+
+		/* after an error the data is dropped, the producer must not
+		 * be blocked
+		 */
+		if (!wb->error) {
+			err = write_all(wb->fd, wb->ring + (tail & (wb->size - 1)),
+					len);
+			if (err) {
+				dbg_err("image write failed: %s\n",
+					strerror(err));
+				__atomic_store_n(&wb->error, err,
+						 __ATOMIC_RELEASE);
+			}
+		}
+
+		__atomic_store_n(&wb->tail, tail + len, __ATOMIC_RELEASE);
+		IFXOS_EventWakeUp(&wb->space_event);
+	}
+
+	return 0;
+}
+
+static uint32_t roundup_pow2(uint32_t val)
+{
+	uint32_t res = 1;
+
+	while (res < val)
+		res <<= 1;
+
+	return res;
+}
+
+enum pon_adapter_errno pon_img_wb_create(struct pon_img_wb **wb_out, int fd,
+					 uint32_t ring_size,
+					 uint32_t chunk_size)
+{
+	struct pon_img_wb *wb;
+	void *ring;
+
+	dbg_in_args("%p, %d, %u, %u", wb_out, fd, ring_size, chunk_size);
+
+	if (!wb_out || !chunk_size)
+		return PON_ADAPTER_ERR_INVALID_VAL;
+
+	chunk_size = roundup_pow2(chunk_size);
+
+	if (!ring_size)
+		ring_size = PON_IMG_WB_RING_SIZE;
+	if (ring_size > PON_IMG_WB_RING_SIZE_MAX)
+		ring_size = PON_IMG_WB_RING_SIZE_MAX;
+	/* a window of max. 64 KiB must always fit next to a chunk
+	 * which is currently written
+	 */
+	if (ring_size < 2 * chunk_size + UINT16_MAX)
+		ring_size = 2 * chunk_size + UINT16_MAX;
+	ring_size = roundup_pow2(ring_size);
+
+	wb = calloc(1, sizeof(*wb));
+	if (!wb)
+		return PON_ADAPTER_ERR_NO_MEMORY;
+
+	if (posix_memalign(&ring, 4096, ring_size)) {
+		dbg_err("can not allocate %u bytes write-behind ring\n",
+			ring_size);
+		free(wb);
+		return PON_ADAPTER_ERR_NO_MEMORY;
+	}
+
+	wb->fd = fd;
+	wb->ring = ring;
+	wb->size = ring_size;
+	wb->chunk = chunk_size;
+
+	if (IFXOS_EventInit(&wb->data_event) != IFX_SUCCESS)
+		goto err_free;
+	if (IFXOS_EventInit(&wb->space_event) != IFX_SUCCESS)
+		goto err_data_event;
+
+	if (IFXOS_ThreadInit(&wb->thread, "imgwb", wb_thread,
+			     IFXOS_DEFAULT_STACK_SIZE, IFXOS_THREAD_PRIO_WB,
+			     (IFX_ulong_t)wb, 0)) {
+		dbg_err("Can't start image writer thread\n");
+		goto err_space_event;
+	}
+
+	*wb_out = wb;
+
+	dbg_out_ret("%d", PON_ADAPTER_SUCCESS);
+	return PON_ADAPTER_SUCCESS;
+
+err_space_event:
+	IFXOS_EventDelete(&wb->space_event);
+err_data_event:
+	IFXOS_EventDelete(&wb->data_event);
+err_free:
+	free(wb->ring);
+	free(wb);
+	dbg_out_ret("%d", PON_ADAPTER_ERROR);
+	return PON_ADAPTER_ERROR;
+}
+
+enum pon_adapter_errno pon_img_wb_push(struct pon_img_wb *wb,
+				       const uint8_t *data, uint32_t len)
+{
+	uint32_t head = wb->head, tail, pos, count;
+	unsigned int waited = 0;
+	IFX_int32_t ret_code;
+
+	if (len > wb->size)
+		return PON_ADAPTER_ERR_SIZE;
+
+	/* the writer drops the data after an error, report it at once */
+	if (__atomic_load_n(&wb->error, __ATOMIC_ACQUIRE))
+		return PON_ADAPTER_ERROR;
+
+	/* backpressure: wait for the writer, but only for a bounded time */
+	tail = __atomic_load_n(&wb->tail, __ATOMIC_ACQUIRE);
+	if (wb->size - (head - tail) < len) {
+		wb->stalls++;
+		do {
+			if (waited >= PON_IMG_WB_PUSH_TIMEOUT) {
+				dbg_wrn("write-behind ring full, %u bytes not taken\n",
+					len);
+				return PON_ADAPTER_ERR_NO_MEMORY;
+			}
+			IFXOS_EventWakeUp(&wb->data_event);
+			IFXOS_EventWait(&wb->space_event, WB_POLL_TIME,
+					&ret_code);
+			waited += WB_POLL_TIME;
+			tail = __atomic_load_n(&wb->tail, __ATOMIC_ACQUIRE);
+		} while (wb->size - (head - tail) < len);
+	}
+
+	pos = head & (wb->size - 1);
+	count = wb->size - pos;
+	if (count > len)
+		count = len;
+	if (memcpy_s(wb->ring + pos, wb->size - pos, data, count))
+		return PON_ADAPTER_ERR_MEM_ACCESS;
+	if (count < len &&
+	    memcpy_s(wb->ring, wb->size, data + count, len - count))
+		return PON_ADAPTER_ERR_MEM_ACCESS;
+
+	__atomic_store_n(&wb->head, head + len, __ATOMIC_RELEASE);
+
+	/* wake up the writer only if a chunk was completed */
+	if ((head ^ (head + len)) & ~(wb->chunk - 1))
+		IFXOS_EventWakeUp(&wb->data_event);
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+enum pon_adapter_errno pon_img_wb_drain(struct pon_img_wb *wb)
+{
+	enum pon_adapter_errno ret = PON_ADAPTER_SUCCESS;
+	unsigned int waited = 0;
+	IFX_int32_t ret_code;
+	uint32_t tail, last;
+	int err;
+
+	dbg_in_args("%p", wb);
+
+	__atomic_store_n(&wb->flush, 1, __ATOMIC_RELEASE);
+	IFXOS_EventWakeUp(&wb->data_event);
+
+	/* the writer may block in a write, the wait is bounded by the time
+	 * without progress, not by the amount of data
+	 */
+	tail = __atomic_load_n(&wb->tail, __ATOMIC_ACQUIRE);
+	while (tail != wb->head &&
+	       !__atomic_load_n(&wb->error, __ATOMIC_ACQUIRE)) {
+		if (waited >= PON_IMG_WB_DRAIN_TIMEOUT) {
+			dbg_err("image writer stalled, %u bytes not written\n",
+				wb->head - tail);
+			ret = PON_ADAPTER_ERROR;
+			break;
+		}
+		IFXOS_EventWait(&wb->space_event, WB_POLL_TIME, &ret_code);
+		last = tail;
+		tail = __atomic_load_n(&wb->tail, __ATOMIC_ACQUIRE);
+		waited = tail == last ? waited + WB_POLL_TIME : 0;
+	}
+	__atomic_store_n(&wb->flush, 0, __ATOMIC_RELEASE);
+
+	err = __atomic_load_n(&wb->error, __ATOMIC_ACQUIRE);
+	if (err) {
+		dbg_err("deferred image write error: %s\n", strerror(err));
+		ret = PON_ADAPTER_ERROR;
+	}
+
+	dbg_out_ret("%d", ret);
+	return ret;
+}
+
+uint32_t pon_img_wb_stalls_get(const struct pon_img_wb *wb)
+{
+	return wb->stalls;
+}
+
+void pon_img_wb_destroy(struct pon_img_wb *wb)
+{
+	dbg_in_args("%p", wb);
+
+	if (!wb)
+		return;
+
+	(void)pon_img_wb_drain(wb);
+
+	IFXOS_EventWakeUp(&wb->data_event);
+	if (IFXOS_ThreadShutdown(&wb->thread, 1000) != IFX_SUCCESS) {
+		/* a writer blocked in a write still uses the ring */
+		dbg_err("image writer thread not stopped, ring is leaked\n");
+		dbg_out();
+		return;
+	}
+
+	IFXOS_EventDelete(&wb->space_event);
+	IFXOS_EventDelete(&wb->data_event);
+	free(wb->ring);
+	free(wb);
+
+	dbg_out();
+}
+
+/** @} */
@@ -0,0 +1,96 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ ******************************************************************************/
+/**
+   \file pon_img_wb.h
+   Write-behind of the SW download image.
+
+   The OMCI thread copies each window into a bounded single-producer/
+   single-consumer ring, a dedicated writer thread drains the ring to the
+   image file in chunks. Write errors are latched by the writer thread and
+   reported when the ring is drained.
+*/
+
+#ifndef _PON_IMG_WB_H_
+#define _PON_IMG_WB_H_
+
+#include <stdint.h>
+#include <pon_adapter.h>
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Default size of the write-behind ring */
+#define PON_IMG_WB_RING_SIZE		(1024 * 1024)
+/** Maximum size of the write-behind ring */
+#define PON_IMG_WB_RING_SIZE_MAX	(16 * 1024 * 1024)
+/** Maximum time in ms to wait for free space in the ring */
+#define PON_IMG_WB_PUSH_TIMEOUT		1000
+/** Maximum time in ms the writer thread may make no progress while the
+ *  ring is drained
+ */
+#define PON_IMG_WB_DRAIN_TIMEOUT	10000
+
+struct pon_img_wb;
+
+/**	Create the ring and start the writer thread.
+ *
+ *	\param[out] wb		Write-behind handle
+ *	\param[in] fd		File descriptor of the image file
+ *	\param[in] ring_size	Ring size in bytes, 0 selects the default.
+ *				The size is rounded up to a power of two.
+ *	\param[in] chunk_size	Write chunk size, rounded up to a power of two
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- Other: An error code in case of error.
+ */
+enum pon_adapter_errno pon_img_wb_create(struct pon_img_wb **wb, int fd,
+					 uint32_t ring_size,
+					 uint32_t chunk_size);
+
+/**	Copy data into the ring.
+ *
+ *	The data is either copied completely or not at all. If the ring is
+ *	full, the function waits up to \ref PON_IMG_WB_PUSH_TIMEOUT for the
+ *	writer thread before it gives up.
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If successful
+ *	- PON_ADAPTER_ERR_NO_MEMORY: If the ring is still full after the
+ *	  timeout, the data was not taken and can be pushed again.
+ *	- PON_ADAPTER_ERROR: A previous write of the writer thread failed,
+ *	  the data was not taken.
+ *	- Other: An error code in case of error.
+ */
+enum pon_adapter_errno pon_img_wb_push(struct pon_img_wb *wb,
+				       const uint8_t *data, uint32_t len);
+
+/**	Wait until all data in the ring is written to the file. The wait
+ *	ends with the first failed write of the writer thread, or if it makes
+ *	no progress for \ref PON_IMG_WB_DRAIN_TIMEOUT.
+ *
+ *	\return Return value as follows:
+ *	- PON_ADAPTER_SUCCESS: If all data was written
+ *	- PON_ADAPTER_ERROR: A write failed or the writer thread stalled,
+ *	  the data in the ring is not written completely.
+ */
+enum pon_adapter_errno pon_img_wb_drain(struct pon_img_wb *wb);
+
+/**	Number of push calls which had to wait for free space in the ring. */
+uint32_t pon_img_wb_stalls_get(const struct pon_img_wb *wb);
+
+/**	Stop the writer thread and free the ring.
+ *	Data which is still in the ring is written before.
+ */
+void pon_img_wb_destroy(struct pon_img_wb *wb);
+
+/** @} */
+
+#endif
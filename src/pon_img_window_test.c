@@ -0,0 +1,184 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2026 MaxLinear, Inc.
+ *
+ * For licensing information, see the file 'LICENSE' in the root folder of
+ * this software module.
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <pon_adapter.h>
+#include <omci/pon_adapter_omci.h>
+#include <omci/me/pon_adapter_sw_image.h>
+
+#include <pon_img_register.h>
+#include "pon_img_common.h"
+#include "pon_img_crc.h"
+#include "pon_img_test.h"
+
+/** \addtogroup PON_IMG_LIB
+ *  @{
+ */
+
+/** Image size of the test */
+#define WINDOW_TEST_SIZE	(64 * 1024)
+/** Window size after the change */
+#define WINDOW_TEST_SMALL	500
+/** Image offset of the window size change */
+#define WINDOW_TEST_CHANGE	(20 * PON_IMG_TEST_WINDOW)
+
+/** Window of the test sequence */
+struct window_test_step {
+	/** Window number */
+	uint32_t nr;
+	/** Image offset */
+	uint32_t offset;
+	/** Window length */
+	uint32_t len;
+};
+
+static uint8_t image[WINDOW_TEST_SIZE];
+
+/* Split the image into windows, the size changes at an offset */
+static unsigned int windows_make(struct window_test_step *step,
+				 uint32_t change, uint32_t small)
+{
+	uint32_t offset = 0, len;
+	unsigned int n;
+
+	for (n = 0; offset < WINDOW_TEST_SIZE; n++) {
+		len = offset < change ? PON_IMG_TEST_WINDOW : small;
+		if (len > WINDOW_TEST_SIZE - offset)
+			len = WINDOW_TEST_SIZE - offset;
+		step[n].nr = n;
+		step[n].offset = offset;
+		step[n].len = len;
+		offset += len;
+	}
+
+	return n;
+}
+
+static enum pon_adapter_errno send(struct pon_img_test *test,
+				   const struct window_test_step *step,
+				   const uint8_t *data)
+{
+	return test->pa_ops->omci_me_ops->sw_image->handle_window(test->ctx,
+		1, step->nr, data, (uint16_t)step->len);
+}
+
+/* Send the windows in the given order, each index of order selects a
+ * window. An index may be repeated for a retransmission.
+ */
+static int run(struct pon_img_test *test, const char *name,
+	       const struct window_test_step *step,
+	       const unsigned int *order, unsigned int count)
+{
+	const struct pa_sw_image_ops *ops =
+		test->pa_ops->omci_me_ops->sw_image;
+	char path[PON_IMG_PATH_LEN];
+	enum pon_adapter_errno ret;
+	unsigned int i;
+	uint32_t crc;
+
+	crc = pon_img_crc32(PON_IMG_CRC32_INIT, image, WINDOW_TEST_SIZE) ^
+	      0xffffffff;
+
+	ret = ops->download_start(test->ctx, 1, WINDOW_TEST_SIZE);
+	for (i = 0; i < count && ret == PON_ADAPTER_SUCCESS; i++)
+		ret = send(test, &step[order[i]],
+			   image + step[order[i]].offset);
+	if (ret == PON_ADAPTER_SUCCESS)
+		ret = ops->download_end(test->ctx, 1, WINDOW_TEST_SIZE, crc,
+					sizeof(path), path);
+
+	if (ret != PON_ADAPTER_SUCCESS ||
+	    !pon_img_test_file_check(path, image, WINDOW_TEST_SIZE)) {
+		printf("%s: failed with %d\n", name, ret);
+		return 1;
+	}
+	printf("%s: passed\n", name);
+
+	return 0;
+}
+
+/* The order of the windows, some are swapped and some repeated */
+static unsigned int order_make(unsigned int *order, unsigned int windows,
+			       unsigned int swap_from)
+{
+	unsigned int i, n = 0;
+
+	for (i = 0; i < windows; i++) {
+		if (i >= swap_from && !(i % 5) && i + 1 < windows) {
+			order[n++] = i + 1;
+			order[n++] = i;
+			order[n++] = i + 1;
+			i++;
+			continue;
+		}
+		order[n++] = i;
+		if (!(i % 7))
+			order[n++] = i;
+	}
+
+	return n;
+}
+
+int main(void)
+{
+	static struct window_test_step step[WINDOW_TEST_SIZE / 100];
+	static unsigned int order[3 * ARRAY_SIZE(step)];
+	const struct pa_sw_image_ops *ops;
+	struct pon_img_test test;
+	unsigned int windows, count;
+	uint8_t other[PON_IMG_TEST_WINDOW];
+	int failed = 0;
+
+	pon_img_test_fill(image, WINDOW_TEST_SIZE, 7);
+	pon_img_test_fill(other, sizeof(other), 8);
+
+	if (pon_img_test_open(&test, "pon_img_window_test"))
+		return 1;
+	ops = test.pa_ops->omci_me_ops->sw_image;
+	test.ctx->dl_no_checkpoint = true;
+	if (pon_img_test_start(&test)) {
+		pon_img_test_close(&test);
+		return 1;
+	}
+
+	windows = windows_make(step, WINDOW_TEST_SIZE, 0);
+	count = order_make(order, windows, 1);
+	failed += run(&test, "windows out of order and repeated", step,
+		      order, count);
+
+	/* the windows ahead after the change are placed by the new size */
+	windows = windows_make(step, WINDOW_TEST_CHANGE, WINDOW_TEST_SMALL);
+	count = order_make(order, windows,
+			   WINDOW_TEST_CHANGE / PON_IMG_TEST_WINDOW + 1);
+	failed += run(&test, "window size change", step, order, count);
+
+	/* a retransmission must be identical to the first reception */
+	windows = windows_make(step, WINDOW_TEST_SIZE, 0);
+	if (ops->download_start(test.ctx, 1, WINDOW_TEST_SIZE) !=
+	    PON_ADAPTER_SUCCESS ||
+	    send(&test, &step[0], image) != PON_ADAPTER_SUCCESS ||
+	    send(&test, &step[2], image + step[2].offset) !=
+	    PON_ADAPTER_SUCCESS ||
+	    send(&test, &step[2], other) == PON_ADAPTER_SUCCESS ||
+	    send(&test, &step[0], other) == PON_ADAPTER_SUCCESS) {
+		printf("changed retransmission: accepted\n");
+		failed++;
+	} else {
+		printf("changed retransmission: passed\n");
+	}
+	(void)ops->download_stop(test.ctx, 1);
+
+	pon_img_test_close(&test);
+
+	return failed ? 1 : 0;
+}
+
+/** @} */
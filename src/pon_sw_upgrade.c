@@ -23,6 +23,7 @@
 #include "pon_img.h"
 #include "pon_img_debug.h"
 #include <pon_img_register.h>
+#include <pon_uboot.h>
 #include <pon_adapter_config.h>
 
 /** \addtogroup PON_IMG_LIB
@@ -130,8 +131,8 @@ int main(int argc, char *argv[])
 	struct pon_img_context ctx = {0, };
 	static struct ubus_context *ubus_ctx;
 	enum pon_adapter_errno ret;
+	struct pon_img_state state;
 	char partition = 'A';
-	bool active;
 	const struct pa_config pa_config = {
 		.ubus_call = ubus_call,
 	};
@@ -156,12 +157,23 @@ int main(int argc, char *argv[])
 	ctx.hl_handle = ubus_ctx;
 	ctx.pa_config = &pa_config;
 
-	ret = pon_img_active_get(&ctx, 'A', &active);
+	ret = pon_uboot_cache_create(&ctx);
 	if (ret != PON_ADAPTER_SUCCESS) {
-		printf("%s: Could not read active state of imageA\n", argv[0]);
+		printf("%s: Could not allocate U-Boot variable cache\n",
+		       argv[0]);
 		goto exit;
 	}
-	if (active) {
+
+	ret = pon_img_state_get(&ctx, &state);
+	if (ret == PON_ADAPTER_SUCCESS &&
+	    !(state.bank[0].present & PON_IMG_STATE_ACTIVE))
+		ret = PON_ADAPTER_ERR_RESOURCE_NOT_FOUND;
+	if (ret != PON_ADAPTER_SUCCESS) {
+		printf("%s: Could not read active state of the images\n",
+		       argv[0]);
+		goto exit;
+	}
+	if (state.bank[0].active) {
 		if (test_ctrl.verbose_enabled)
 			printf("%s: imageA is active\n", argv[0]);
 		partition = 'B';
@@ -170,12 +182,7 @@ int main(int argc, char *argv[])
 			printf("%s: imageA is inactive\n", argv[0]);
 	}
 
-	ret = pon_img_active_get(&ctx, 'B', &active);
-	if (ret != PON_ADAPTER_SUCCESS) {
-		printf("%s: Could not read active state of imageB\n", argv[0]);
-		goto exit;
-	}
-	if (active) {
+	if (state.bank[1].active) {
 		if (test_ctrl.verbose_enabled)
 			printf("%s: imageB is active\n", argv[0]);
 		partition = 'A';
@@ -201,6 +208,7 @@ int main(int argc, char *argv[])
 	printf("%s: Please reboot system to boot new image!\n", argv[0]);
 
 exit:
+	pon_uboot_cache_destroy(&ctx);
 	ubus_free(ubus_ctx);
 	return 0;
 }
@@ -8,7 +8,13 @@
  *
  *****************************************************************************/
 
+#include <stdlib.h>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <pthread.h>
 #include <pon_adapter.h>
+#include <ifxos_thread.h>
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wredundant-decls"
@@ -23,6 +29,22 @@
 #include "pon_uboot.h"
 #include "pon_img_common.h"
 #include "pon_img_debug.h"
+#include "pon_img_env.h"
+
+#define IFXOS_THREAD_PRIO_UBOOT_NOTIFY	5
+
+/** Maximum age of the cached variables in s without a subscription */
+#define UBOOT_CACHE_MAX_AGE		2
+/** Maximum age of the cached variables in s while subscribed to the
+ *  notifications, refreshes the cache if a notification was lost
+ */
+#define UBOOT_CACHE_MAX_AGE_NOTIFY	60
+/** Poll interval of the notification thread in ms, the shutdown is
+ *  checked in this interval
+ */
+#define UBOOT_NOTIFY_POLL_TIME		200
+/** Maximum number of variables in a transaction */
+#define UBOOT_TXN_VARS_MAX		8
 
 static const struct blobmsg_policy uboot_get_policy[] = {
 	{ .name = "message", .type = BLOBMSG_TYPE_STRING },
@@ -35,35 +57,163 @@ static const struct blobmsg_policy uboot_get_policy[] = {
 	{ .name = "img_versionB", .type = BLOBMSG_TYPE_STRING },
 	{ .name = "commit_bank", .type = BLOBMSG_TYPE_STRING },
 	{ .name = "img_activate", .type = BLOBMSG_TYPE_STRING },
+	{ .name = "img_identA", .type = BLOBMSG_TYPE_STRING },
+	{ .name = "img_identB", .type = BLOBMSG_TYPE_STRING },
 };
 
 struct uboot_get_cache_entry {
 	const char *name;
 	char value[UBOOT_VAL_LEN_MAX + 1];
 	unsigned int value_size;
+	/** The value was possibly changed by another ubus method */
+	bool stale;
 };
 
-static struct uboot_get_cache_entry uboot_cache[ARRAY_SIZE(uboot_get_policy)];
+/** Variable of a U-Boot environment transaction */
+struct uboot_txn_var {
+	char name[UBOOT_NAME_LEN_MAX + 1];
+	char value[UBOOT_VAL_LEN_MAX + 1];
+	unsigned int value_size;
+	/** Sent as boolean, the value is "true" or "false" */
+	bool is_bool;
+};
 
-static void uboot_get_cb(struct ubus_request *req,
-			 int type, struct blob_attr *msg)
+/** Access to the U-Boot environment */
+struct uboot_backend {
+	/** Read all variables into the cache */
+	enum pon_adapter_errno (*load)(struct pon_img_context *ctx);
+	/** Write the variables of the transaction */
+	enum pon_adapter_errno (*store)(struct pon_img_context *ctx);
+};
+
+/** U-Boot variables of a context, as read by the last ubus call or
+ *  received with the last notification
+ */
+struct pon_uboot_cache {
+	/** Serializes the writers of the entries and counters, e.g. the
+	 *  notification thread
+	 */
+	pthread_mutex_t lock;
+	/** Sequence counter of the entries, odd while a writer changes them.
+	 *  A reader copies a value without a lock and retries if the counter
+	 *  changed meanwhile.
+	 */
+	uint32_t seq;
+	/** Serializes the accesses to the environment, only one thread
+	 *  refreshes or writes it at a time
+	 */
+	pthread_mutex_t env_lock;
+	struct uboot_get_cache_entry entry[ARRAY_SIZE(uboot_get_policy)];
+	/** Counters, \ref pon_uboot_cache_stats_get */
+	struct pon_uboot_cache_stats stats;
+	/** Access to the environment, ubus or direct */
+	const struct uboot_backend *backend;
+	/** Directly accessed environment, NULL if ubus is used */
+	struct pon_img_env *env;
+	/** Incremented by a notification which did not carry the values */
+	uint32_t notify_gen;
+	/** Value of notify_gen when the last ubus call was started */
+	uint32_t fresh_gen;
+	/** Own ubus connection of the notification thread */
+	struct ubus_context *ubus;
+	/** Subscriber to the notifications of the ubus object */
+	struct ubus_subscriber sub;
+	/** Notification thread control structure */
+	IFXOS_ThreadCtrl_t thread;
+	/** Held by the thread with the open transaction, a transaction of
+	 *  another thread waits until it is committed
+	 */
+	pthread_mutex_t txn_lock;
+	/** Thread with the open transaction, valid if txn_depth is not 0 */
+	pthread_t txn_owner;
+	/** Nesting depth of the open transaction, 0 if none */
+	unsigned int txn_depth;
+	/** A nested transaction was aborted, the outermost one is not
+	 *  written
+	 */
+	bool txn_failed;
+	/** Refreshes when the transaction began, only values refreshed
+	 *  later are compared by the elision
+	 */
+	uint32_t txn_refreshes;
+	/** Number of variables in the transaction */
+	unsigned int txn_count;
+	/** Variables of the transaction, only used by the owner */
+	struct uboot_txn_var txn[UBOOT_TXN_VARS_MAX];
+};
+
+/* Start a change of the entries, the cache lock must be held */
+static void uboot_seq_write_begin(struct pon_uboot_cache *cache)
+{
+	__atomic_store_n(&cache->seq, cache->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void uboot_seq_write_end(struct pon_uboot_cache *cache)
+{
+	__atomic_store_n(&cache->seq, cache->seq + 1, __ATOMIC_RELEASE);
+}
+
+static uint32_t uboot_seq_read_begin(struct pon_uboot_cache *cache)
+{
+	uint32_t seq;
+
+	/* a writer only copies a few values, but it may be preempted */
+	while ((seq = __atomic_load_n(&cache->seq, __ATOMIC_ACQUIRE)) & 1)
+		sched_yield();
+
+	return seq;
+}
+
+/* Check if the entries were changed since \ref uboot_seq_read_begin,
+ * the values read in between must be dropped then
+ */
+static bool uboot_seq_read_retry(struct pon_uboot_cache *cache, uint32_t seq)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return __atomic_load_n(&cache->seq, __ATOMIC_RELAXED) != seq;
+}
+
+/* Store the variables of a get_uboot_env reply or a notification.
+ * A reply replaces all values, a notification only the ones it carries.
+ * Returns the number of stored variables.
+ */
+static int uboot_cache_parse(struct pon_uboot_cache *cache,
+			     struct blob_attr *msg, bool merge)
 {
 	struct blob_attr *tb[ARRAY_SIZE(uboot_get_policy)];
 	struct uboot_get_cache_entry *entry;
-	int i, len;
+	int i, j, len, found = 0;
 
-	(void)req; /* unused */
-	(void)type; /* unused */
 	blobmsg_parse(uboot_get_policy, ARRAY_SIZE(uboot_get_policy), tb,
 		      blob_data(msg), blob_len(msg));
 
+	pthread_mutex_lock(&cache->lock);
+	uboot_seq_write_begin(cache);
+
 	/* skip first entry, it is for "message" */
 	for (i = 1; i < ARRAY_SIZE(uboot_get_policy); i++) {
-		entry = &uboot_cache[i];
-		entry->value_size = 0;
+		entry = &cache->entry[i];
 		entry->name = uboot_get_policy[i].name;
-		if (!tb[i])
+		if (!merge)
+			entry->stale = false;
+		if (!tb[i]) {
+			if (!merge)
+				entry->value_size = 0;
 			continue;
+		}
+		entry->value_size = 0;
+		entry->stale = false;
+		found++;
+
+		/* a variable can be sent with a different type than
+		 * before, drop the value of the other type
+		 */
+		for (j = 1; merge && j < ARRAY_SIZE(uboot_get_policy); j++)
+			if (j != i && !tb[j] &&
+			    !strcmp(uboot_get_policy[j].name, entry->name))
+				cache->entry[j].value_size = 0;
 
 		if (uboot_get_policy[i].type == BLOBMSG_TYPE_INT32) {
 			len = snprintf(entry->value, sizeof(entry->value), "%s",
@@ -86,30 +236,172 @@ static void uboot_get_cb(struct ubus_request *req,
 		}
 		entry->value_size = len;
 	}
+
+	uboot_seq_write_end(cache);
+	pthread_mutex_unlock(&cache->lock);
+
+	return found;
+}
+
+static void uboot_get_cb(struct ubus_request *req,
+			 int type, struct blob_attr *msg)
+{
+	(void)type; /* unused */
+	(void)uboot_cache_parse(req->priv, msg, false);
+}
+
+/* Notification of the fwupgrade/system object. If it carries U-Boot
+ * variables, they are taken over, otherwise the cache is refreshed by the
+ * next read. Only a received notification proves that the object sends
+ * them, the cache is kept longer from then on.
+ */
+static int uboot_notify_cb(struct ubus_context *ubus, struct ubus_object *obj,
+			   struct ubus_request_data *req, const char *method,
+			   struct blob_attr *msg)
+{
+	struct pon_uboot_cache *cache =
+		container_of(obj, struct pon_uboot_cache, sub.obj);
+	int found;
+
+	(void)ubus; /* unused */
+	(void)req; /* unused */
+
+	found = msg ? uboot_cache_parse(cache, msg, true) : 0;
+	dbg_prn("ubus notification %s: %d U-Boot variables\n",
+		method ? method : "", found);
+
+	pthread_mutex_lock(&cache->lock);
+	uboot_seq_write_begin(cache);
+	cache->stats.notifications++;
+	cache->stats.subscribed = true;
+	if (!found)
+		cache->notify_gen++;
+	uboot_seq_write_end(cache);
+	pthread_mutex_unlock(&cache->lock);
+
+	return 0;
+}
+
+/* The subscribed object was removed, e.g. the daemon was restarted */
+static void uboot_notify_remove_cb(struct ubus_context *ubus,
+				   struct ubus_subscriber *sub, uint32_t id)
+{
+	struct pon_uboot_cache *cache =
+		container_of(sub, struct pon_uboot_cache, sub);
+
+	(void)ubus; /* unused */
+	(void)id; /* unused */
+
+	dbg_wrn("ubus object removed, U-Boot variables are polled again\n");
+
+	pthread_mutex_lock(&cache->lock);
+	uboot_seq_write_begin(cache);
+	cache->stats.subscribed = false;
+	cache->notify_gen++;
+	uboot_seq_write_end(cache);
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/** Notification thread, dispatches the messages of the own ubus connection
+ *  \param[in] thr_params IFXOS_ThreadParams_t structure
+ */
+static int32_t uboot_notify_thread(struct IFXOS_ThreadParams_s *thr_params)
+{
+	struct pon_uboot_cache *cache =
+		(struct pon_uboot_cache *)thr_params->nArg1;
+	struct pollfd pfd = {
+		.fd = cache->ubus->sock.fd,
+		.events = POLLIN,
+	};
+	int ret;
+
+	while (!thr_params->bShutDown) {
+		ret = poll(&pfd, 1, UBOOT_NOTIFY_POLL_TIME);
+		if (ret < 0 && errno != EINTR)
+			break;
+		if (ret > 0)
+			ubus_handle_event(cache->ubus);
+		if (cache->ubus->sock.eof || cache->ubus->sock.error)
+			break;
+	}
+
+	pthread_mutex_lock(&cache->lock);
+	if (cache->stats.subscribed)
+		dbg_wrn("ubus connection lost, U-Boot variables are polled again\n");
+	uboot_seq_write_begin(cache);
+	cache->stats.subscribed = false;
+	cache->notify_gen++;
+	uboot_seq_write_end(cache);
+	pthread_mutex_unlock(&cache->lock);
+
+	return 0;
 }
 
+/* Subscribe to the notifications of the ubus object which provides the
+ * U-Boot variables. The subscription uses an own ubus connection, the
+ * one of the higher layer is only accessible through ubus_call.
+ */
 static enum pon_adapter_errno
-uboot_get_cache_update(struct pon_img_context *ctx)
+uboot_cache_subscribe(struct pon_img_context *ctx)
 {
+	struct pon_uboot_cache *cache = ctx->uboot_cache;
+	uint32_t id;
 	int err;
-	time_t current_time = time(NULL);
 
-	dbg_in_args("%p", ctx);
+	cache->ubus = ubus_connect(NULL);
+	if (!cache->ubus) {
+		dbg_wrn("ubus_connect failed\n");
+		return PON_ADAPTER_ERROR;
+	}
 
-	if (ctx->ubus_reboot_only)
-		return PON_ADAPTER_ERR_NOT_SUPPORTED;
+	cache->sub.cb = uboot_notify_cb;
+	cache->sub.remove_cb = uboot_notify_remove_cb;
+	err = ubus_register_subscriber(cache->ubus, &cache->sub);
+	if (err) {
+		dbg_err_fn_ret(ubus_register_subscriber, err);
+		goto err_free;
+	}
 
-	/* if last update was less then two seconds ago, return */
-	if (current_time - ctx->last_ubus_ubootvars < 2) {
-		dbg_out_ret("%d", PON_ADAPTER_SUCCESS);
-		return PON_ADAPTER_SUCCESS;
+	err = ubus_lookup_id(cache->ubus, ctx->ubus_path, &id);
+	if (err) {
+		dbg_err_fn_ret(ubus_lookup_id, err);
+		goto err_free;
 	}
-	ctx->last_ubus_ubootvars = current_time;
+
+	err = ubus_subscribe(cache->ubus, &cache->sub, id);
+	if (err) {
+		dbg_err_fn_ret(ubus_subscribe, err);
+		goto err_free;
+	}
+
+	/* the values are polled until the first notification arrives */
+	if (IFXOS_ThreadInit(&cache->thread, "ubootntf", uboot_notify_thread,
+			     IFXOS_DEFAULT_STACK_SIZE,
+			     IFXOS_THREAD_PRIO_UBOOT_NOTIFY,
+			     (IFX_ulong_t)cache, 0)) {
+		dbg_err("Can't start U-Boot notification thread\n");
+		goto err_free;
+	}
+
+	return PON_ADAPTER_SUCCESS;
+
+err_free:
+	ubus_free(cache->ubus);
+	cache->ubus = NULL;
+	return PON_ADAPTER_ERROR;
+}
+
+static enum pon_adapter_errno uboot_ubus_load(struct pon_img_context *ctx)
+{
+	int err;
+
+	if (ctx->ubus_reboot_only)
+		return PON_ADAPTER_ERR_NOT_SUPPORTED;
 
 	err = ctx->pa_config->ubus_call(ctx->hl_handle,
 					ctx->ubus_path,
 					UBUS_METHOD_GET_UBOOTVARS,
-					NULL, uboot_get_cb, NULL,
+					NULL, uboot_get_cb, ctx->uboot_cache,
 					PON_UBUS_TIMEOUT);
 	if (err == UBUS_STATUS_METHOD_NOT_FOUND)
 		return PON_ADAPTER_ERR_NOT_SUPPORTED;
@@ -117,7 +409,298 @@ uboot_get_cache_update(struct pon_img_context *ctx)
 		dbg_err_fn_ret(ubus_call, err);
 		return PON_ADAPTER_ERROR;
 	}
-	dbg_out_ret("%d", PON_ADAPTER_SUCCESS);
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* Fill the cache from the directly read environment, which is read again
+ * as it may have been changed by another process
+ */
+static enum pon_adapter_errno uboot_env_load(struct pon_img_context *ctx)
+{
+	struct pon_uboot_cache *cache = ctx->uboot_cache;
+	struct uboot_get_cache_entry *entry;
+	enum pon_adapter_errno err;
+	const char *value;
+	size_t len;
+	int i;
+
+	err = pon_img_env_reload(cache->env, NULL);
+	if (err != PON_ADAPTER_SUCCESS)
+		return err;
+
+	pthread_mutex_lock(&cache->lock);
+	uboot_seq_write_begin(cache);
+	/* skip first entry, it is for "message" */
+	for (i = 1; i < ARRAY_SIZE(uboot_get_policy); i++) {
+		entry = &cache->entry[i];
+		entry->name = uboot_get_policy[i].name;
+		entry->stale = false;
+		entry->value_size = 0;
+		/* the environment holds strings only */
+		if (uboot_get_policy[i].type != BLOBMSG_TYPE_STRING)
+			continue;
+		value = pon_img_env_get(cache->env, entry->name);
+		if (!value)
+			continue;
+		len = strnlen_s(value, UBOOT_VAL_LEN_MAX);
+		if (strncpy_s(entry->value, sizeof(entry->value), value, len)) {
+			dbg_err_fn(strncpy_s);
+			continue;
+		}
+		entry->value_size = len;
+	}
+	uboot_seq_write_end(cache);
+	pthread_mutex_unlock(&cache->lock);
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* Check if the cached values can be used, the cache lock must be held or
+ * the result must be checked with \ref uboot_seq_read_retry.
+ * With a name, the variable must not be marked as stale.
+ */
+static bool uboot_cache_fresh(struct pon_img_context *ctx, const char *name,
+			      time_t current_time)
+{
+	struct pon_uboot_cache *cache = ctx->uboot_cache;
+	time_t max_age;
+	int i;
+
+	/* with the subscription, the values are kept up to date by the
+	 * notifications, they are only refreshed to recover a lost one
+	 */
+	max_age = cache->stats.subscribed ? UBOOT_CACHE_MAX_AGE_NOTIFY :
+					    UBOOT_CACHE_MAX_AGE;
+	if (!ctx->last_ubus_ubootvars ||
+	    cache->fresh_gen != cache->notify_gen ||
+	    current_time < ctx->last_ubus_ubootvars ||
+	    current_time - ctx->last_ubus_ubootvars >= max_age)
+		return false;
+
+	for (i = 1; name && i < ARRAY_SIZE(uboot_get_policy); i++)
+		if (cache->entry[i].stale &&
+		    strcmp(uboot_get_policy[i].name, name) == 0)
+			return false;
+
+	return true;
+}
+
+/* Read all variables into the cache, the environment lock must be held.
+ * gen is the notification count before the read was started.
+ */
+static enum pon_adapter_errno uboot_cache_load(struct pon_img_context *ctx,
+					       time_t current_time,
+					       uint32_t gen)
+{
+	struct pon_uboot_cache *cache = ctx->uboot_cache;
+	enum pon_adapter_errno err;
+
+	err = cache->backend->load(ctx);
+	if (err != PON_ADAPTER_SUCCESS)
+		return err;
+
+	pthread_mutex_lock(&cache->lock);
+	uboot_seq_write_begin(cache);
+	cache->stats.refreshes++;
+	/* a notification during the call is not covered by the reply */
+	cache->fresh_gen = gen;
+	ctx->last_ubus_ubootvars = current_time;
+	uboot_seq_write_end(cache);
+	pthread_mutex_unlock(&cache->lock);
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* Refresh the cache if it can not be used. Concurrent callers wait for
+ * the refresh of the first one instead of reading the environment again.
+ */
+static enum pon_adapter_errno
+uboot_get_cache_update(struct pon_img_context *ctx, const char *name)
+{
+	struct pon_uboot_cache *cache = ctx->uboot_cache;
+	time_t current_time = time(NULL);
+	enum pon_adapter_errno err = PON_ADAPTER_SUCCESS;
+	uint32_t gen;
+	bool fresh;
+
+	dbg_in_args("%p, %s", ctx, name ? name : "");
+
+	pthread_mutex_lock(&cache->env_lock);
+
+	pthread_mutex_lock(&cache->lock);
+	fresh = uboot_cache_fresh(ctx, name, current_time);
+	gen = cache->notify_gen;
+	pthread_mutex_unlock(&cache->lock);
+	if (fresh) {
+		__atomic_add_fetch(&cache->stats.hits, 1, __ATOMIC_RELAXED);
+		goto exit;
+	}
+	__atomic_add_fetch(&cache->stats.misses, 1, __ATOMIC_RELAXED);
+
+	err = uboot_cache_load(ctx, current_time, gen);
+
+exit:
+	pthread_mutex_unlock(&cache->env_lock);
+	dbg_out_ret("%d", err);
+	return err;
+}
+
+/* Force a refresh of the cached values by the next read. The time is read
+ * by the lock-free readers, so it is changed like the entries.
+ */
+static void uboot_cache_expire(struct pon_img_context *ctx)
+{
+	struct pon_uboot_cache *cache = ctx->uboot_cache;
+
+	pthread_mutex_lock(&cache->lock);
+	uboot_seq_write_begin(cache);
+	ctx->last_ubus_ubootvars = 0;
+	uboot_seq_write_end(cache);
+	pthread_mutex_unlock(&cache->lock);
+}
+
+enum pon_adapter_errno pon_uboot_cache_start(struct pon_img_context *ctx)
+{
+	enum pon_adapter_errno err;
+
+	dbg_in_args("%p", ctx);
+
+	/* a directly accessed environment is not notified */
+	if (!ctx->uboot_cache->env) {
+		if (ctx->ubus_reboot_only) {
+			dbg_out_ret("%d", PON_ADAPTER_SUCCESS);
+			return PON_ADAPTER_SUCCESS;
+		}
+		if (uboot_cache_subscribe(ctx) != PON_ADAPTER_SUCCESS)
+			dbg_wrn("No %s notifications, U-Boot variables are polled\n",
+				ctx->ubus_path);
+	}
+
+	uboot_cache_expire(ctx);
+	err = uboot_get_cache_update(ctx, NULL);
+	if (err == PON_ADAPTER_ERR_NOT_SUPPORTED)
+		err = PON_ADAPTER_SUCCESS;
+
+	dbg_out_ret("%d", err);
+	return err;
+}
+
+enum pon_adapter_errno
+pon_uboot_cache_stats_get(struct pon_img_context *ctx,
+			  struct pon_uboot_cache_stats *stats)
+{
+	if (!ctx || !ctx->uboot_cache || !stats)
+		return PON_ADAPTER_ERR_INVALID_VAL;
+
+	pthread_mutex_lock(&ctx->uboot_cache->lock);
+	*stats = ctx->uboot_cache->stats;
+	pthread_mutex_unlock(&ctx->uboot_cache->lock);
+	/* counted by the readers without the lock */
+	stats->hits = __atomic_load_n(&ctx->uboot_cache->stats.hits,
+				      __ATOMIC_RELAXED);
+	stats->misses = __atomic_load_n(&ctx->uboot_cache->stats.misses,
+					__ATOMIC_RELAXED);
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+void pon_uboot_cache_invalidate(struct pon_img_context *ctx, const char *name)
+{
+	struct pon_uboot_cache *cache = ctx->uboot_cache;
+	int i;
+
+	if (!cache)
+		return;
+
+	pthread_mutex_lock(&cache->lock);
+	uboot_seq_write_begin(cache);
+	for (i = 1; i < ARRAY_SIZE(uboot_get_policy); i++)
+		if (strcmp(uboot_get_policy[i].name, name) == 0)
+			cache->entry[i].stale = true;
+	uboot_seq_write_end(cache);
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/* Copy a cached value, returns the length or -1 if the variable is not
+ * cached. The result must be checked with \ref uboot_seq_read_retry.
+ */
+static int uboot_cache_read(struct pon_uboot_cache *cache, const char *name,
+			    char *value)
+{
+	struct uboot_get_cache_entry *entry;
+	unsigned int len;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(cache->entry); i++) {
+		entry = &cache->entry[i];
+		len = entry->value_size;
+		if (!len || len > UBOOT_VAL_LEN_MAX)
+			continue;
+		if (!entry->name || strcmp(name, entry->name) != 0)
+			continue;
+
+		memcpy(value, entry->value, len);
+		value[len] = '\0';
+		return (int)len;
+	}
+
+	value[0] = '\0';
+	return -1;
+}
+
+/* Copy the values of several variables from one state of the cache, which
+ * is refreshed first if needed. A variable which is not set gets the
+ * length -1 and an empty value.
+ */
+static enum pon_adapter_errno
+uboot_cache_copy(struct pon_img_context *ctx, const char * const *names,
+		 char (*values)[UBOOT_VAL_LEN_MAX + 1], int *lens,
+		 unsigned int count)
+{
+	struct pon_uboot_cache *cache = ctx->uboot_cache;
+	time_t current_time = time(NULL);
+	enum pon_adapter_errno err;
+	bool updated = false;
+	const char *stale;
+	unsigned int i;
+	uint32_t seq;
+
+	if (!cache) {
+		dbg_err("no U-Boot variable cache\n");
+		return PON_ADAPTER_ERR_INVALID_VAL;
+	}
+
+	/* the readers never block, they only wait for a refresh */
+	for (;;) {
+		do {
+			seq = uboot_seq_read_begin(cache);
+			stale = NULL;
+			for (i = 0; i < count; i++) {
+				if (!updated && !stale &&
+				    !uboot_cache_fresh(ctx, names[i],
+						       current_time))
+					stale = names[i];
+				lens[i] = uboot_cache_read(cache, names[i],
+							   values[i]);
+			}
+		} while (uboot_seq_read_retry(cache, seq));
+
+		if (!stale)
+			break;
+
+		err = uboot_get_cache_update(ctx, stale);
+		if (err != PON_ADAPTER_SUCCESS &&
+		    err != PON_ADAPTER_ERR_NOT_SUPPORTED) {
+			dbg_err_fn_ret(uboot_get_cache_update, err);
+			return err;
+		}
+		updated = true;
+	}
+
+	if (!updated)
+		__atomic_add_fetch(&cache->stats.hits, 1, __ATOMIC_RELAXED);
+
 	return PON_ADAPTER_SUCCESS;
 }
 
@@ -125,53 +708,181 @@ enum pon_adapter_errno pon_uboot_get(struct pon_img_context *ctx,
 				     const char *name, char *value,
 				     const unsigned int value_size)
 {
+	char buf[1][UBOOT_VAL_LEN_MAX + 1];
 	enum pon_adapter_errno err;
-	int i, len;
+	int len;
 
 	dbg_in_args("%p, %s, %p, %u", ctx, name, value, value_size);
 
-	err = uboot_get_cache_update(ctx);
-	if (err != PON_ADAPTER_SUCCESS &&
-	    err != PON_ADAPTER_ERR_NOT_SUPPORTED) {
-		dbg_err_fn_ret(uboot_get_cache_update, err);
+	err = uboot_cache_copy(ctx, &name, buf, &len, 1);
+	if (err != PON_ADAPTER_SUCCESS)
 		return err;
+
+	if (len < 0) {
+		dbg_err("U-Boot variable '%s' not found\n", name);
+		return PON_ADAPTER_ERR_RESOURCE_NOT_FOUND;
 	}
 
-	for (i = 0; i < ARRAY_SIZE(uboot_cache); i++) {
-		if (!uboot_cache[i].value_size)
-			continue;
-		if (strcmp(name, uboot_cache[i].name) != 0)
-			continue;
+	dbg_prn("get %s: len %d, val %s\n", name, len, buf[0]);
+	if (strncpy_s(value, value_size, buf[0], len)) {
+		dbg_err_fn(strncpy_s);
+		return PON_ADAPTER_ERROR;
+	}
 
-		len = uboot_cache[i].value_size;
-		dbg_prn("get %s: len %d, val %s\n",
-			name, len, uboot_cache[i].value);
-		if (strncpy_s(value, value_size, uboot_cache[i].value, len)) {
-			dbg_err_fn(strncpy_s);
-			return PON_ADAPTER_ERROR;
+	dbg_out_ret("%d", PON_ADAPTER_SUCCESS);
+	return PON_ADAPTER_SUCCESS;
+}
+
+enum pon_adapter_errno
+pon_uboot_get_multi(struct pon_img_context *ctx, const char * const *names,
+		    char (*values)[UBOOT_VAL_LEN_MAX + 1], unsigned int count)
+{
+	int lens[UBOOT_GET_MULTI_MAX];
+	enum pon_adapter_errno err;
+
+	dbg_in_args("%p, %p, %p, %u", ctx, names, values, count);
+
+	if (!names || !values || count > UBOOT_GET_MULTI_MAX) {
+		dbg_out_ret("%d", PON_ADAPTER_ERR_INVALID_VAL);
+		return PON_ADAPTER_ERR_INVALID_VAL;
+	}
+
+	err = uboot_cache_copy(ctx, names, values, lens, count);
+
+	dbg_out_ret("%d", err);
+	return err;
+}
+
+/* Take over the values of a successful set_uboot_env call. The cache only
+ * holds the variables of the get_uboot_env policy, any other variable drops
+ * the cached values.
+ */
+static void uboot_cache_apply(struct pon_img_context *ctx)
+{
+	struct pon_uboot_cache *cache = ctx->uboot_cache;
+	struct uboot_get_cache_entry *entry;
+	struct uboot_txn_var *var;
+	bool found, complete = true;
+	int i, j;
+
+	pthread_mutex_lock(&cache->lock);
+	uboot_seq_write_begin(cache);
+	for (j = 0; j < cache->txn_count; j++) {
+		var = &cache->txn[j];
+		found = false;
+		/* skip first entry, it is for "message" */
+		for (i = 1; i < ARRAY_SIZE(uboot_get_policy); i++) {
+			if (strcmp(uboot_get_policy[i].name, var->name) != 0)
+				continue;
+			entry = &cache->entry[i];
+			entry->name = uboot_get_policy[i].name;
+			entry->stale = false;
+			/* the first entry of a name is the one which is read */
+			entry->value_size = found ? 0 : var->value_size;
+			if (!found && strncpy_s(entry->value,
+						sizeof(entry->value),
+						var->value, var->value_size))
+				entry->value_size = 0;
+			found = true;
 		}
-		dbg_out_ret("%d", PON_ADAPTER_SUCCESS);
-		return PON_ADAPTER_SUCCESS;
+		if (!found)
+			complete = false;
 	}
+	if (!complete)
+		ctx->last_ubus_ubootvars = 0;
+	uboot_seq_write_end(cache);
+	pthread_mutex_unlock(&cache->lock);
+}
 
-	dbg_err("U-Boot variable '%s' not found\n", name);
-	return PON_ADAPTER_ERR_RESOURCE_NOT_FOUND;
+/* Drop the variables of the transaction which already have the value in
+ * the environment, they cost a flash write without changing anything.
+ * Another process may have changed the environment since the cache was
+ * filled, so only values read within the transaction are compared. They
+ * are read now if the transaction did not read them. The environment
+ * lock must be held.
+ */
+static void uboot_txn_elide(struct pon_img_context *ctx)
+{
+	struct pon_uboot_cache *cache = ctx->uboot_cache;
+	time_t current_time = time(NULL);
+	struct uboot_get_cache_entry *entry;
+	struct uboot_txn_var *var;
+	unsigned int i, j, n = 0;
+	uint32_t gen;
+	bool fresh;
+
+	pthread_mutex_lock(&cache->lock);
+	fresh = cache->stats.refreshes != cache->txn_refreshes &&
+		uboot_cache_fresh(ctx, NULL, current_time);
+	gen = cache->notify_gen;
+	pthread_mutex_unlock(&cache->lock);
+	if (!fresh && uboot_cache_load(ctx, current_time, gen) !=
+	    PON_ADAPTER_SUCCESS)
+		return;
+
+	pthread_mutex_lock(&cache->lock);
+	for (j = 0; j < cache->txn_count; j++) {
+		var = &cache->txn[j];
+		entry = NULL;
+		/* the first entry with a value is the one which is read */
+		for (i = 1; i < ARRAY_SIZE(uboot_get_policy); i++) {
+			if (cache->entry[i].value_size &&
+			    strcmp(uboot_get_policy[i].name, var->name) == 0) {
+				entry = &cache->entry[i];
+				break;
+			}
+		}
+		if (entry && entry->value_size == var->value_size &&
+		    strcmp(entry->value, var->value) == 0 &&
+		    uboot_cache_fresh(ctx, var->name, current_time)) {
+			dbg_prn("U-Boot variable '%s' is already '%s'\n",
+				var->name, var->value);
+			cache->stats.elided++;
+			continue;
+		}
+		if (n != j)
+			cache->txn[n] = *var;
+		n++;
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	cache->txn_count = n;
 }
 
-static enum pon_adapter_errno _pon_uboot_set(struct pon_img_context *ctx,
-					     struct blob_buf *req)
+/* Send all variables of the transaction with one set_uboot_env call */
+static enum pon_adapter_errno uboot_ubus_store(struct pon_img_context *ctx)
 {
-	int err;
+	struct pon_uboot_cache *cache = ctx->uboot_cache;
+	struct blob_buf req = {0, };
+	struct uboot_txn_var *var;
 	uint32_t retval = 0;
+	int i, err;
 
 	if (ctx->ubus_reboot_only)
 		return PON_ADAPTER_ERROR;
 
+	blob_buf_init(&req, 0);
+	/* we could check the names here, but as they are only set inside
+	 * this library and only with fixed names, we trust that wrong names
+	 * are ignored by the ubus method in procd.
+	 * And for now the names of U-Boot variables are matching the
+	 * supported parameter names in ubus.
+	 */
+	for (i = 0; i < cache->txn_count; i++) {
+		var = &cache->txn[i];
+		if (var->is_bool)
+			blobmsg_add_u8(&req, var->name,
+				       strcmp(var->value, "true") == 0);
+		else
+			blobmsg_add_string(&req, var->name, var->value);
+	}
+
 	err = ctx->pa_config->ubus_call(ctx->hl_handle,
 					ctx->ubus_path,
 					UBUS_METHOD_SET_UBOOTVAR,
-					req->head, retval_get, &retval,
+					req.head, retval_get, &retval,
 					PON_UBUS_TIMEOUT);
+	blob_buf_free(&req);
 	if (err) {
 		dbg_err_fn_ret(ubus_call, err);
 		return PON_ADAPTER_ERROR;
@@ -181,54 +892,318 @@ static enum pon_adapter_errno _pon_uboot_set(struct pon_img_context *ctx,
 			ctx->ubus_path, UBUS_METHOD_SET_UBOOTVAR, retval);
 		return PON_ADAPTER_ERROR;
 	}
-	/* just invalidate the cached values */
-	ctx->last_ubus_ubootvars = 0;
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* Write all variables of the transaction with one environment update,
+ * a boolean is stored as "true" or "false" like by the ubus method
+ */
+static enum pon_adapter_errno uboot_env_store(struct pon_img_context *ctx)
+{
+	struct pon_uboot_cache *cache = ctx->uboot_cache;
+	enum pon_adapter_errno err = PON_ADAPTER_SUCCESS;
+	int i;
+
+	/* another process may have written the environment since it was
+	 * read, it must not change it before the commit
+	 */
+	err = pon_img_env_lock(cache->env);
+	if (err != PON_ADAPTER_SUCCESS)
+		return err;
+	err = pon_img_env_reload(cache->env, NULL);
+
+	for (i = 0; i < cache->txn_count && err == PON_ADAPTER_SUCCESS; i++)
+		err = pon_img_env_set(cache->env, cache->txn[i].name,
+				      cache->txn[i].value);
+	if (err == PON_ADAPTER_SUCCESS)
+		err = pon_img_env_commit(cache->env);
+	else
+		/* drop the variables which were already set */
+		(void)pon_img_env_reload(cache->env, NULL);
+
+	pon_img_env_unlock(cache->env);
+	return err;
+}
+
+static const struct uboot_backend uboot_backend_ubus = {
+	.load = uboot_ubus_load,
+	.store = uboot_ubus_store,
+};
+
+static const struct uboot_backend uboot_backend_env = {
+	.load = uboot_env_load,
+	.store = uboot_env_store,
+};
+
+enum pon_adapter_errno pon_uboot_cache_create(struct pon_img_context *ctx)
+{
+	ctx->uboot_cache = calloc(1, sizeof(*ctx->uboot_cache));
+	if (!ctx->uboot_cache)
+		return PON_ADAPTER_ERR_NO_MEMORY;
+
+	if (pthread_mutex_init(&ctx->uboot_cache->lock, NULL)) {
+		free(ctx->uboot_cache);
+		ctx->uboot_cache = NULL;
+		return PON_ADAPTER_ERROR;
+	}
+	if (pthread_mutex_init(&ctx->uboot_cache->env_lock, NULL)) {
+		pthread_mutex_destroy(&ctx->uboot_cache->lock);
+		free(ctx->uboot_cache);
+		ctx->uboot_cache = NULL;
+		return PON_ADAPTER_ERROR;
+	}
+	if (pthread_mutex_init(&ctx->uboot_cache->txn_lock, NULL)) {
+		pthread_mutex_destroy(&ctx->uboot_cache->env_lock);
+		pthread_mutex_destroy(&ctx->uboot_cache->lock);
+		free(ctx->uboot_cache);
+		ctx->uboot_cache = NULL;
+		return PON_ADAPTER_ERROR;
+	}
+	ctx->uboot_cache->backend = &uboot_backend_ubus;
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+void pon_uboot_cache_destroy(struct pon_img_context *ctx)
+{
+	struct pon_uboot_cache *cache = ctx->uboot_cache;
+
+	if (!cache)
+		return;
+
+	if (IFXOS_THREAD_INIT_VALID(&cache->thread))
+		(void)IFXOS_ThreadShutdown(&cache->thread,
+					   2 * UBOOT_NOTIFY_POLL_TIME);
+	if (cache->ubus)
+		ubus_free(cache->ubus);
+	pon_img_env_close(cache->env);
+
+	pthread_mutex_destroy(&cache->txn_lock);
+	pthread_mutex_destroy(&cache->env_lock);
+	pthread_mutex_destroy(&cache->lock);
+	free(cache);
+	ctx->uboot_cache = NULL;
+}
+
+enum pon_adapter_errno pon_uboot_env_open(struct pon_img_context *ctx,
+					 const char *config)
+{
+	struct pon_uboot_cache *cache = ctx->uboot_cache;
+	enum pon_adapter_errno err;
+
+	dbg_in_args("%p, %s", ctx, config);
+
+	err = pon_img_env_open(&cache->env, config);
+	if (err != PON_ADAPTER_SUCCESS) {
+		dbg_err_fn_ret(pon_img_env_open, err);
+		return err;
+	}
+	cache->backend = &uboot_backend_env;
+	uboot_cache_expire(ctx);
 
 	dbg_out_ret("%d", PON_ADAPTER_SUCCESS);
 	return PON_ADAPTER_SUCCESS;
 }
 
-enum pon_adapter_errno pon_uboot_set_str(struct pon_img_context *ctx,
-					 const char *name, const char *value)
+static enum pon_adapter_errno uboot_txn_send(struct pon_img_context *ctx)
 {
-	struct blob_buf req = {0, };
+	struct pon_uboot_cache *cache = ctx->uboot_cache;
 	enum pon_adapter_errno ret;
 
-	dbg_prn("U-Boot variable set: '%s' to '%s'\n", name, value);
+	pthread_mutex_lock(&cache->env_lock);
 
-	blob_buf_init(&req, 0);
-	/* we could check the "name" here, but as it is only called inside this
-	 * library and only with fixed names, we trust that wrong names are
-	 * ignored by the ubus method in procd.
-	 * And for now the names of U-Boot variables are matching the supported
-	 * parameter names in ubus.
-	 */
-	blobmsg_add_string(&req, name, value);
+	uboot_txn_elide(ctx);
+	if (!cache->txn_count) {
+		pthread_mutex_unlock(&cache->env_lock);
+		return PON_ADAPTER_SUCCESS;
+	}
 
-	ret = _pon_uboot_set(ctx, &req);
-	blob_buf_free(&req);
+	ret = cache->backend->store(ctx);
+	if (ret == PON_ADAPTER_SUCCESS)
+		uboot_cache_apply(ctx);
+	else
+		/* the variables may be partially written */
+		uboot_cache_expire(ctx);
+
+	pthread_mutex_unlock(&cache->env_lock);
+
+	cache->txn_count = 0;
 	return ret;
 }
 
-enum pon_adapter_errno pon_uboot_set_bool(struct pon_img_context *ctx,
-					  const char *name, bool value)
+/* Check if the calling thread has an open transaction */
+static bool uboot_txn_owned(struct pon_uboot_cache *cache)
 {
-	struct blob_buf req = {0, };
+	return cache && cache->txn_depth &&
+	       pthread_equal(cache->txn_owner, pthread_self());
+}
+
+enum pon_adapter_errno pon_uboot_txn_begin(struct pon_img_context *ctx)
+{
+	struct pon_uboot_cache *cache = ctx->uboot_cache;
+
+	dbg_in_args("%p", ctx);
+
+	if (!cache) {
+		dbg_err("no U-Boot variable cache\n");
+		dbg_out_ret("%d", PON_ADAPTER_ERR_INVALID_VAL);
+		return PON_ADAPTER_ERR_INVALID_VAL;
+	}
+
+	if (uboot_txn_owned(cache)) {
+		cache->txn_depth++;
+		dbg_out_ret("%d", PON_ADAPTER_SUCCESS);
+		return PON_ADAPTER_SUCCESS;
+	}
+
+	pthread_mutex_lock(&cache->txn_lock);
+	cache->txn_owner = pthread_self();
+	cache->txn_depth = 1;
+	cache->txn_failed = false;
+	pthread_mutex_lock(&cache->lock);
+	cache->txn_refreshes = cache->stats.refreshes;
+	pthread_mutex_unlock(&cache->lock);
+
+	dbg_out_ret("%d", PON_ADAPTER_SUCCESS);
+	return PON_ADAPTER_SUCCESS;
+}
+
+enum pon_adapter_errno pon_uboot_txn_commit(struct pon_img_context *ctx)
+{
+	struct pon_uboot_cache *cache = ctx->uboot_cache;
 	enum pon_adapter_errno ret;
 
-	dbg_prn("U-Boot variable set: '%s' to '%s'\n",
-		name, value ? "true" : "false");
+	dbg_in_args("%p", ctx);
 
-	blob_buf_init(&req, 0);
-	/* we could check the "name" here, but as it is only called inside this
-	 * library and only with fixed names, we trust that wrong names are
-	 * ignored by the ubus method in procd.
-	 * And for now the names of U-Boot variables are matching the supported
-	 * parameter names in ubus.
-	 */
-	blobmsg_add_u8(&req, name, value);
+	if (!uboot_txn_owned(cache)) {
+		dbg_err("no U-Boot variable transaction\n");
+		dbg_out_ret("%d", PON_ADAPTER_ERR_INVALID_VAL);
+		return PON_ADAPTER_ERR_INVALID_VAL;
+	}
 
-	ret = _pon_uboot_set(ctx, &req);
-	blob_buf_free(&req);
+	/* a nested transaction is sent with the outermost one */
+	if (--cache->txn_depth) {
+		dbg_out_ret("%d", PON_ADAPTER_SUCCESS);
+		return PON_ADAPTER_SUCCESS;
+	}
+
+	if (cache->txn_failed) {
+		dbg_err("U-Boot variable transaction was aborted\n");
+		cache->txn_count = 0;
+		ret = PON_ADAPTER_ERROR;
+	} else {
+		ret = uboot_txn_send(ctx);
+	}
+	pthread_mutex_unlock(&cache->txn_lock);
+
+	dbg_out_ret("%d", ret);
 	return ret;
 }
+
+void pon_uboot_txn_abort(struct pon_img_context *ctx)
+{
+	struct pon_uboot_cache *cache = ctx->uboot_cache;
+
+	dbg_in_args("%p", ctx);
+
+	if (!uboot_txn_owned(cache)) {
+		dbg_out();
+		return;
+	}
+
+	/* the variables of the outer transaction are dropped by its end */
+	if (--cache->txn_depth) {
+		cache->txn_failed = true;
+		dbg_out();
+		return;
+	}
+
+	cache->txn_count = 0;
+	pthread_mutex_unlock(&cache->txn_lock);
+
+	dbg_out();
+}
+
+/* Add a variable to the transaction, a later value of the same variable
+ * replaces the earlier one
+ */
+static enum pon_adapter_errno uboot_txn_add(struct pon_img_context *ctx,
+					    const char *name,
+					    const char *value,
+					    bool is_bool)
+{
+	struct pon_uboot_cache *cache = ctx->uboot_cache;
+	struct uboot_txn_var *var = NULL;
+	size_t len;
+	int i;
+
+	for (i = 0; i < cache->txn_count; i++) {
+		if (strcmp(cache->txn[i].name, name) == 0) {
+			var = &cache->txn[i];
+			break;
+		}
+	}
+	if (!var) {
+		if (cache->txn_count >= ARRAY_SIZE(cache->txn)) {
+			dbg_err("too many U-Boot variables in a transaction\n");
+			return PON_ADAPTER_ERR_OUT_OF_BOUNDS;
+		}
+		var = &cache->txn[cache->txn_count];
+		if (strncpy_s(var->name, sizeof(var->name), name,
+			      strnlen_s(name, UBOOT_NAME_LEN_MAX + 1))) {
+			dbg_err_fn(strncpy_s);
+			return PON_ADAPTER_ERR_INVALID_VAL;
+		}
+		cache->txn_count++;
+	}
+
+	len = strnlen_s(value, UBOOT_VAL_LEN_MAX + 1);
+	if (len > UBOOT_VAL_LEN_MAX)
+		len = UBOOT_VAL_LEN_MAX;
+	if (strncpy_s(var->value, sizeof(var->value), value, len)) {
+		dbg_err_fn(strncpy_s);
+		return PON_ADAPTER_ERROR;
+	}
+	var->value_size = len;
+	var->is_bool = is_bool;
+
+	return PON_ADAPTER_SUCCESS;
+}
+
+/* Outside of a transaction, a variable is written immediately */
+static enum pon_adapter_errno uboot_set(struct pon_img_context *ctx,
+					const char *name, const char *value,
+					bool is_bool)
+{
+	enum pon_adapter_errno ret;
+
+	ret = pon_uboot_txn_begin(ctx);
+	if (ret != PON_ADAPTER_SUCCESS)
+		return ret;
+
+	ret = uboot_txn_add(ctx, name, value, is_bool);
+	if (ret != PON_ADAPTER_SUCCESS) {
+		pon_uboot_txn_abort(ctx);
+		return ret;
+	}
+
+	return pon_uboot_txn_commit(ctx);
+}
+
+enum pon_adapter_errno pon_uboot_set_str(struct pon_img_context *ctx,
+					 const char *name, const char *value)
+{
+	dbg_prn("U-Boot variable set: '%s' to '%s'\n", name, value);
+
+	return uboot_set(ctx, name, value, false);
+}
+
+enum pon_adapter_errno pon_uboot_set_bool(struct pon_img_context *ctx,
+					  const char *name, bool value)
+{
+	dbg_prn("U-Boot variable set: '%s' to '%s'\n",
+		name, value ? "true" : "false");
+
+	return uboot_set(ctx, name, value ? "true" : "false", true);
+}